@@ -0,0 +1,112 @@
+#include "functions.h"
+#include "gpuarray.h"
+#include "multirankSimulation.h"
+#include "multirankQTensorLatticeModel.h"
+#include "landauDeGennesLC.h"
+#include "relaxationalDynamics.h"
+#include "defectTracker.h"
+#include "noiseSource.h"
+#include "profiler.h"
+#include "logSpacedIntegers.h"
+#include <tclap/CmdLine.h>
+#include <mpi.h>
+
+int3 partitionProcessors(int numberOfProcesses)
+    {
+    int3 ans;
+    ans.z = floor(pow(numberOfProcesses,1./3.));
+    int nLeft = floor(numberOfProcesses/ans.z);
+    ans.y = floor(sqrt(nLeft));
+    ans.x = floor(nLeft / ans.y);
+    return ans;
+    }
+
+/*!
+Coarsening of a nematic after a quench from a random state, using overdamped relaxational dynamics (optionally with
+thermal noise). At logarithmically spaced times the energy, the number of defect clusters, and the number of defect
+sites are printed, together with the throughput of the integrator (in site updates per second).
+*/
+using namespace TCLAP;
+int main(int argc, char*argv[])
+{
+    int myRank,worldSize;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+    CmdLine cmd("coarsening dynamics of a quenched nematic", ' ', "V0.9");
+    ValueArg<int> lSwitchArg("l","boxL","number of lattice sites for cubic box on each rank",false,50,"int",cmd);
+    ValueArg<int> iterationsSwitchArg("i","iterations","number of time steps",false,10000,"int",cmd);
+    ValueArg<scalar> dtSwitchArg("e","deltaT","time step",false,0.005,"scalar",cmd);
+    ValueArg<scalar> temperatureSwitchArg("","temperature","temperature of the thermal noise",false,0.0,"scalar",cmd);
+    ValueArg<scalar> thresholdSwitchArg("","defectThreshold","largest Q eigenvalue below which a site is a defect",false,0.3,"scalar",cmd);
+    ValueArg<int> threadsSwitchArg("t","threads","number of CPU threads to use per rank",false,1,"int",cmd);
+    ValueArg<int> randomSeedSwitch("","randomSeed","seed for reproducible random number generation",false,13371,"int",cmd);
+    cmd.parse( argc, argv );
+
+    int boxL = lSwitchArg.getValue();
+    int maximumIterations = iterationsSwitchArg.getValue();
+    scalar dt = dtSwitchArg.getValue();
+    scalar temperature = temperatureSwitchArg.getValue();
+    int nThreads = threadsSwitchArg.getValue();
+
+    int3 rankTopology = partitionProcessors(worldSize);
+    bool xH = (rankTopology.x >1) ? true : false;
+    bool yH = (rankTopology.y >1) ? true : false;
+    bool zH = (rankTopology.z >1) ? true : false;
+
+    scalar a = -1;
+    scalar b = -2.12/0.172;
+    scalar c = 1.73/0.172;
+    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
+    noiseSource noise(true);
+    noise.setReproducibleSeed(randomSeedSwitch.getValue()+myRank);
+    noise.setCounterSeed(randomSeedSwitch.getValue());
+
+    setGPUArrayFirstTouchThreads(nThreads);
+    shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(boxL,boxL,boxL,xH,yH,zH,false,true);
+    shared_ptr<multirankSimulation> sim = make_shared<multirankSimulation>(myRank,rankTopology.x,rankTopology.y,rankTopology.z,false,false);
+    shared_ptr<landauDeGennesLC> landauLCForce = make_shared<landauDeGennesLC>(a,b,c,4.64);
+    sim->setConfiguration(Configuration);
+    landauLCForce->setModel(Configuration);
+    sim->addForce(landauLCForce);
+
+    shared_ptr<relaxationalDynamics> dynamics = make_shared<relaxationalDynamics>(Configuration);
+    sim->addUpdater(dynamics,Configuration);
+    sim->setIntegrationTimestep(dt);
+    sim->setCPUOperation(true);
+    sim->setNThreads(nThreads);
+    dynamics->setNoise(noise,temperature);
+
+    Configuration->setNematicQTensorRandomly(noise,S0);
+    sim->finalizeObjects();
+    defectTracker defects(sim,thresholdSwitchArg.getValue());
+
+    if(myRank == 0)
+        printf("step\tenergy\tclusters\tdefect sites\tsite updates per second\n");
+    profiler pDynamics("dynamics");
+    logSpacedIntegers lsi(0,0.1);
+    int step = 0;
+    while(step < maximumIterations)
+        {
+        lsi.update();
+        int nextStep = min(lsi.nextSave,maximumIterations);
+        pDynamics.start();
+        for (; step < nextStep; ++step)
+            sim->performTimestep();
+        pDynamics.end();
+        scalar energy = sim->computePotentialEnergy();
+        defects.findDefects();
+        if(myRank == 0)
+            {
+            int defectSites = 0;
+            for (int cc = 0; cc < defects.clusters.size(); ++cc)
+                defectSites += defects.clusters[cc].nSites;
+            scalar siteUpdates = (scalar)step*boxL*boxL*boxL*worldSize;
+            printf("%i\t%f\t%lu\t%i\t%g\n",step,energy,defects.clusters.size(),defectSites,siteUpdates/pDynamics.timeTaken);
+            }
+        }
+
+    MPI_Finalize();
+    return 0;
+};
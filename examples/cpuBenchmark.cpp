@@ -0,0 +1,389 @@
+#include "functions.h"
+#include "gpuarray.h"
+#include "multirankSimulation.h"
+#include "multirankQTensorLatticeModel.h"
+#include "landauDeGennesLC.h"
+#include "energyMinimizerFIRE.h"
+#include "energyMinimizerGradientDescent.h"
+#include "energyMinimizerLoLBFGS.h"
+#include "noiseSource.h"
+#include "profiler.h"
+#include "regionTimers.h"
+#include <tclap/CmdLine.h>
+#include <mpi.h>
+#include <sstream>
+
+/*!
+A CPU benchmark of the main pieces of a minimization, over a matrix of lattice sizes (per rank), elastic-constant
+models, colloid volume fractions, and minimizers. For each case the time per call of the force kernel, the halo
+exchange, a global reduction, the lattice update (moveParticles), and a complete minimizer step are measured
+separately (the slowest rank's time is reported), together with the number of lattice sites processed per second.
+With --communicationAvoiding the minimizer steps are timed as a single minimization, in which halos are exchanged
+only every few steps (--haloDepth sets how many). --siteBlocks compares orders of the lattice sites in memory (see
+cubicLattice::setSiteBlockSize), and --hardwareCounters adds the cache misses per site of the force kernel.
+
+The force kernel and the update are memory-bound, so they are also reported as an achieved bandwidth, using the
+compulsory traffic of each kernel (every array it touches read or written once per site), and as a percentage of
+the bandwidth of a STREAM triad measured at the start of the run (with every rank running the triad at the same
+time, so that ranks sharing a memory system see the bandwidth they will get during the simulation). Results are
+written as JSON to the file given by --output (the minimizers report on stdout). Lattices that fit in cache will
+show more than 100% of the STREAM bandwidth.
+*/
+
+int3 partitionProcessors(int numberOfProcesses)
+    {
+    int3 ans;
+    ans.z = floor(pow(numberOfProcesses,1./3.));
+    int nLeft = floor(numberOfProcesses/ans.z);
+    ans.y = floor(sqrt(nLeft));
+    ans.x = floor(nLeft / ans.y);
+    return ans;
+    }
+
+//!parse a comma-separated list
+template<typename T>
+vector<T> parseList(string list)
+    {
+    vector<T> ans;
+    stringstream ss(list);
+    string item;
+    while(getline(ss,item,','))
+        {
+        stringstream itemStream(item);
+        T value;
+        itemStream >> value;
+        ans.push_back(value);
+        }
+    return ans;
+    }
+
+//!the largest value of x over all ranks
+double maxOverRanks(double x)
+    {
+    double ans;
+    MPI_Allreduce(&x,&ans,1,MPI_DOUBLE,MPI_MAX,MPI_COMM_WORLD);
+    return ans;
+    }
+
+//!best-of-n STREAM triad bandwidth (GB/s, counting 24 bytes per element as STREAM does), run concurrently on every rank
+double streamTriad(int arrayMB, int nThreads, int repeats)
+    {
+    size_t n = (size_t)arrayMB*1024*1024/sizeof(double);
+    GPUArray<double> aArray(n,false,true), bArray(n,false,true), cArray(n,false,true);
+    ArrayHandle<double> a(aArray);
+    ArrayHandle<double> b(bArray);
+    ArrayHandle<double> c(cArray);
+    #pragma omp parallel for num_threads(nThreads)
+    for (size_t ii = 0; ii < n; ++ii)
+        {
+        a.data[ii] = 1.0; b.data[ii] = 2.0; c.data[ii] = 0.0;
+        }
+    double best = 1e30;
+    for (int rr = 0; rr < repeats; ++rr)
+        {
+        MPI_Barrier(MPI_COMM_WORLD);
+        profiler p("triad");
+        p.start();
+        #pragma omp parallel for num_threads(nThreads)
+        for (size_t ii = 0; ii < n; ++ii)
+            a.data[ii] = b.data[ii] + 3.0*c.data[ii];
+        p.end();
+        best = min(best,maxOverRanks(p.timeTaken));
+        }
+    return 24.0*n/best*1e-9;
+    }
+
+struct benchmarkCase
+    {
+    int L;
+    int nConstants;
+    scalar colloidFraction;
+    string minimizer;
+    int siteBlock;
+    int forceTile;
+    };
+
+using namespace TCLAP;
+int main(int argc, char*argv[])
+{
+    int myRank,worldSize;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+    CmdLine cmd("CPU benchmark of forces, halo exchange, reductions, updates, and minimizers", ' ', "V0.9");
+    ValueArg<string> sizesSwitchArg("","sizes","comma-separated cubic lattice sizes per rank",false,"32,64","string",cmd);
+    ValueArg<string> modelsSwitchArg("","models","comma-separated numbers of elastic constants (1 = one-constant, 3 = L1,L2,L3)",false,"1,3","string",cmd);
+    ValueArg<string> fractionsSwitchArg("","colloidFractions","comma-separated volume fractions of colloids (one per rank domain)",false,"0,0.2","string",cmd);
+    ValueArg<string> siteBlocksSwitchArg("","siteBlocks","comma-separated edges of the blocks the sites of each rank are stored in (0 = x-fastest order)",false,"0","string",cmd);
+    ValueArg<string> forceTilesSwitchArg("","forceTiles","comma-separated edges of the cubic tiles the multi-constant bulk forces are computed in (0 = whole planes, -1 = untiled)",false,"0","string",cmd);
+    SwitchArg hardwareCountersSwitch("","hardwareCounters","count the cache misses of the force kernel (where Linux perf_event is permitted)",cmd,false);
+    ValueArg<string> minimizersSwitchArg("","minimizers","comma-separated minimizers (fire, gd, lbfgs)",false,"fire,gd,lbfgs","string",cmd);
+    ValueArg<int> iterationsSwitchArg("i","iterations","number of timed calls of each piece",false,20,"int",cmd);
+    ValueArg<int> threadsSwitchArg("t","threads","number of CPU threads to use per rank",false,1,"int",cmd);
+    ValueArg<int> streamSizeSwitchArg("","streamMB","size of each STREAM array, in MB",false,256,"int",cmd);
+    SwitchArg dimensionOrderedHalosSwitch("","dimensionOrderedHalos","exchange halo sites face by face (6 messages) instead of face, edge, and corner pairs",cmd,false);
+    SwitchArg sharedMemoryHalosSwitch("","sharedMemoryHalos","exchange halo faces with ranks on the same node through MPI-3 shared memory",cmd,false);
+    SwitchArg cartesianRanksSwitch("","cartesianRanks","place ranks with a node-aware MPI Cartesian communicator and exchange halos with neighborhood collectives",cmd,false);
+    ValueArg<int> haloDepthSwitchArg("","haloDepth","number of layers of halo sites each rank keeps (more than one implies --dimensionOrderedHalos)",false,1,"int",cmd);
+    SwitchArg communicationAvoidingSwitch("","communicationAvoiding","advance the halo sites too and exchange them only every few iterations (fire and gd only; use with --haloDepth)",cmd,false);
+    ValueArg<string> outputSwitchArg("","output","file to write the JSON results to",false,"benchmark.json","string",cmd);
+    cmd.parse( argc, argv );
+
+    int iterations = max(1,iterationsSwitchArg.getValue());
+    int nThreads = threadsSwitchArg.getValue();
+    vector<int> sizes = parseList<int>(sizesSwitchArg.getValue());
+    vector<int> models = parseList<int>(modelsSwitchArg.getValue());
+    vector<scalar> fractions = parseList<scalar>(fractionsSwitchArg.getValue());
+    vector<string> minimizers = parseList<string>(minimizersSwitchArg.getValue());
+    vector<int> siteBlocks = parseList<int>(siteBlocksSwitchArg.getValue());
+    vector<int> forceTiles = parseList<int>(forceTilesSwitchArg.getValue());
+    //the counters are read directly around the force kernel, without timing regions
+    if(hardwareCountersSwitch.getValue())
+        {
+        regionTimers.enable(true);
+        regionTimers.disable();
+        }
+    setGPUArrayFirstTouchThreads(nThreads);
+
+    double streamBandwidth = streamTriad(streamSizeSwitchArg.getValue(),nThreads,10);
+
+    int3 rankTopology = partitionProcessors(worldSize);
+    bool xH = (rankTopology.x >1) ? true : false;
+    bool yH = (rankTopology.y >1) ? true : false;
+    bool zH = (rankTopology.z >1) ? true : false;
+    scalar a = -1;
+    scalar b = -2.12/0.172;
+    scalar c = 1.73/0.172;
+    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
+    double siteBytes = sizeof(dVec);
+
+    vector<benchmarkCase> cases;
+    for (int ll = 0; ll < sizes.size(); ++ll)
+        for (int mm = 0; mm < models.size(); ++mm)
+            for (int ff = 0; ff < fractions.size(); ++ff)
+                for (int uu = 0; uu < minimizers.size(); ++uu)
+                    for (int bb = 0; bb < siteBlocks.size(); ++bb)
+                        for (int tt = 0; tt < forceTiles.size(); ++tt)
+                            {
+                            benchmarkCase bc = {sizes[ll],models[mm],fractions[ff],minimizers[uu],siteBlocks[bb],forceTiles[tt]};
+                            //L-BFGS needs global sums within every iteration
+                            if(communicationAvoidingSwitch.getValue() && bc.minimizer == "lbfgs")
+                                continue;
+                            //the one-constant forces have no tiles
+                            if(bc.nConstants < 2 && tt > 0)
+                                continue;
+                            cases.push_back(bc);
+                            }
+
+    stringstream json;
+    json.setf(ios_base::scientific);
+    json << setprecision(6);
+    json << "{\n  \"benchmark\": \"openQmin CPU\",\n";
+    json << "  \"ranks\": " << worldSize << ",\n  \"threadsPerRank\": " << nThreads << ",\n";
+    json << "  \"dimensionOrderedHalos\": " << (dimensionOrderedHalosSwitch.getValue() ? "true" : "false") << ",\n";
+    json << "  \"sharedMemoryHalos\": " << (sharedMemoryHalosSwitch.getValue() ? "true" : "false") << ",\n";
+    json << "  \"cartesianRanks\": " << (cartesianRanksSwitch.getValue() ? "true" : "false") << ",\n";
+    json << "  \"haloDepth\": " << haloDepthSwitchArg.getValue() << ",\n";
+    json << "  \"communicationAvoiding\": " << (communicationAvoidingSwitch.getValue() ? "true" : "false") << ",\n";
+    json << "  \"rankTopology\": [" << rankTopology.x << ", " << rankTopology.y << ", " << rankTopology.z << "],\n";
+    json << "  \"streamTriadGBPerSecondPerRank\": " << streamBandwidth << ",\n";
+    json << "  \"results\": [\n";
+
+    for (int cc = 0; cc < cases.size(); ++cc)
+        {
+        benchmarkCase bc = cases[cc];
+        int L = bc.L;
+        bool multiConstant = bc.nConstants > 1;
+        noiseSource noise(true);
+        noise.setReproducibleSeed(13371+myRank);
+        noise.setCounterSeed(13371);
+
+        shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(L,L,L,xH,yH,zH,false,true);
+        if(bc.siteBlock > 0)
+            Configuration->setSiteBlockSize(bc.siteBlock);
+        shared_ptr<multirankSimulation> sim = make_shared<multirankSimulation>(myRank,rankTopology.x,rankTopology.y,rankTopology.z,multiConstant,multiConstant);
+        shared_ptr<landauDeGennesLC> landauLCForce = make_shared<landauDeGennesLC>(a,b,c,4.64);
+        if(cartesianRanksSwitch.getValue())
+            sim->setCartesianTopology(true,cc == 0);
+        sim->setDimensionOrderedHaloExchange(dimensionOrderedHalosSwitch.getValue() || cartesianRanksSwitch.getValue());
+        sim->setSharedMemoryHaloExchange(sharedMemoryHalosSwitch.getValue());
+        if(multiConstant)
+            {
+            landauLCForce->setElasticConstants(4.64,2.32,2.32);
+            landauLCForce->setNumberOfConstants(distortionEnergyType::multiConstant);
+            landauLCForce->setForceTiling(bc.forceTile >= 0,make_int3(max(0,bc.forceTile),max(0,bc.forceTile),max(0,bc.forceTile)));
+            }
+        //multi-constant forces on several ranks read the derivatives of the first halo layer
+        int haloDepth = (multiConstant && worldSize > 1) ? max(2,haloDepthSwitchArg.getValue()) : haloDepthSwitchArg.getValue();
+        if(haloDepth > 1)
+            Configuration->setHaloDepth(haloDepth);
+        sim->setConfiguration(Configuration);
+        landauLCForce->setModel(Configuration);
+        sim->addForce(landauLCForce);
+
+        shared_ptr<updater> minimizer;
+        scalar dt = 0.0005;
+        if(bc.minimizer == "gd")
+            {
+            shared_ptr<energyMinimizerGradientDescent> gd = make_shared<energyMinimizerGradientDescent>(Configuration);
+            gd->setGradientDescentParameters(dt,1e-16);
+            minimizer = gd;
+            }
+        else if(bc.minimizer == "lbfgs")
+            {
+            shared_ptr<energyMinimizerLoLBFGS> lbfgs = make_shared<energyMinimizerLoLBFGS>(Configuration);
+            lbfgs->setLoLBFGSParameters(5,0.01,1.0,1e-16,10);
+            minimizer = lbfgs;
+            }
+        else
+            {
+            shared_ptr<energyMinimizerFIRE> fire = make_shared<energyMinimizerFIRE>(Configuration);
+            fire->setFIREParameters(dt,0.99,100*dt,1.1,0.95,0.9,4,1e-16,0.0);
+            minimizer = fire;
+            }
+        minimizer->setMaximumIterations(1);
+        sim->addUpdater(minimizer,Configuration);
+        if(communicationAvoidingSwitch.getValue())
+            sim->setCommunicationAvoidingUpdates(true);
+        sim->setCPUOperation(true);
+        sim->setNThreads(nThreads);
+        Configuration->setNematicQTensorRandomly(noise,S0);
+
+        //one colloid at the center of every rank's domain
+        if(bc.colloidFraction > 0)
+            {
+            scalar radius = min((scalar)(0.45*L),(scalar)cbrt(3.0*bc.colloidFraction*L*L*L/(4.0*PI)));
+            boundaryObject homeotropicBoundary(boundaryType::homeotropic,0.58,S0);
+            for (int rx = 0; rx < rankTopology.x; ++rx)
+                for (int ry = 0; ry < rankTopology.y; ++ry)
+                    for (int rz = 0; rz < rankTopology.z; ++rz)
+                        {
+                        scalar3 center;
+                        center.x = (rx+0.5)*L; center.y = (ry+0.5)*L; center.z = (rz+0.5)*L;
+                        sim->createSphericalColloid(center,radius,homeotropicBoundary);
+                        }
+            }
+        sim->finalizeObjects();
+        int N = Configuration->getNumberOfParticles();
+        double globalSites = (double)N*worldSize;
+        double activeFraction = sim->NActive/globalSites;
+
+        //force kernel, with up-to-date halos
+        sim->computeForces();
+        profiler pForce("force");
+        long long countersBefore[regionTimerRegistry::nCounters], countersAfter[regionTimerRegistry::nCounters];
+        regionTimers.currentCounters(countersBefore);
+        for (int ii = 0; ii < iterations; ++ii)
+            {
+            pForce.start();
+            landauLCForce->computeForces(Configuration->returnForces(),true,0);
+            landauLCForce->computeForces(Configuration->returnForces(),false,1);
+            pForce.end();
+            }
+        regionTimers.currentCounters(countersAfter);
+        //cache misses per site and call, averaged over ranks
+        double forceCacheMisses = (double)(countersAfter[2]-countersBefore[2])/((double)N*iterations);
+        MPI_Allreduce(MPI_IN_PLACE,&forceCacheMisses,1,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+        forceCacheMisses /= worldSize;
+        //halo exchange
+        profiler pHalo("halo");
+        for (int ii = 0; ii < iterations; ++ii)
+            {
+            MPI_Barrier(MPI_COMM_WORLD);
+            pHalo.start();
+            sim->communicateHaloSitesRoutine();
+            sim->synchronizeAndTransferBuffers();
+            pHalo.end();
+            }
+        //a global reduction of the size used by FIRE
+        profiler pReduction("reduction");
+        vector<scalar> reductionData(3);
+        for (int ii = 0; ii < iterations; ++ii)
+            {
+            reductionData[0] = 1.0; reductionData[1] = 2.0; reductionData[2] = 3.0;
+            pReduction.start();
+            sim->sumUpdaterData(reductionData);
+            pReduction.end();
+            }
+        //lattice update, without the halo exchange that the simulation would add
+        profiler pUpdate("update");
+        GPUArray<dVec> displacement(N,false,true);
+        {
+        ArrayHandle<dVec> d(displacement);
+        for (int ii = 0; ii < N; ++ii)
+            d.data[ii] = make_dVec(0.0);
+        }
+        for (int ii = 0; ii < iterations; ++ii)
+            {
+            pUpdate.start();
+            Configuration->moveParticles(displacement,1.0);
+            pUpdate.end();
+            }
+        //complete minimizer steps (the first one, which sets up the minimizer, is not timed)
+        sim->performTimestep();
+        profiler pStep("minimizer step");
+        int stepsPerTimestep = 1;
+        //communication-avoiding updates exchange halos every few iterations of a minimization, so time them in one
+        if(communicationAvoidingSwitch.getValue())
+            stepsPerTimestep = iterations;
+        for (int ii = 0; ii < iterations; ii += stepsPerTimestep)
+            {
+            minimizer->setMaximumIterations(minimizer->getCurrentIterations()+stepsPerTimestep);
+            MPI_Barrier(MPI_COMM_WORLD);
+            pStep.start();
+            sim->performTimestep();
+            pStep.end();
+            }
+
+        double tForce = maxOverRanks(pForce.timing());
+        double tHalo = maxOverRanks(pHalo.timing());
+        double tReduction = maxOverRanks(pReduction.timing());
+        double tUpdate = maxOverRanks(pUpdate.timing());
+        double tStep = maxOverRanks(pStep.timing())/stepsPerTimestep;
+
+        //compulsory traffic per site: read Q, the site type, and six neighbor indices, write the force (and, with more
+        //than one elastic constant, write the first derivatives, and read them back unless the forces are tiled);
+        //the update reads Q and the displacement and writes Q
+        double forceBytes = 2*siteBytes + sizeof(int) + 6*sizeof(int);
+        if(multiConstant)
+            forceBytes += (bc.forceTile >= 0 ? 1 : 2)*sizeof(cubicLatticeDerivativeVector);
+        double updateBytes = 3*siteBytes;
+        double forceBandwidth = forceBytes*N/tForce*1e-9;
+        double updateBandwidth = updateBytes*N/tUpdate*1e-9;
+
+        json << "    {\"sitesPerRank\": [" << L << ", " << L << ", " << L << "], "
+             << "\"model\": \"" << (multiConstant ? "multiConstant" : "oneConstant") << "\", "
+             << "\"colloidFraction\": " << bc.colloidFraction << ", "
+             << "\"activeSiteFraction\": " << activeFraction << ", "
+             << "\"minimizer\": \"" << bc.minimizer << "\", "
+             << "\"siteBlock\": " << bc.siteBlock << ", \"forceTile\": " << bc.forceTile << ",\n";
+        json << "     \"secondsPerCall\": {\"force\": " << tForce << ", \"halo\": " << tHalo
+             << ", \"reduction\": " << tReduction << ", \"update\": " << tUpdate << ", \"minimizerStep\": " << tStep << "},\n";
+        json << "     \"sitesPerSecond\": {\"force\": " << globalSites/tForce << ", \"update\": " << globalSites/tUpdate
+             << ", \"minimizerStep\": " << globalSites/tStep << "},\n";
+        if(regionTimers.countingHardware())
+            json << "     \"cacheMissesPerSite\": {\"force\": " << forceCacheMisses << "},\n";
+        json << "     \"bytesPerSite\": {\"force\": " << forceBytes << ", \"update\": " << updateBytes << "},\n";
+        json << "     \"bandwidthGBPerSecondPerRank\": {\"force\": " << forceBandwidth << ", \"update\": " << updateBandwidth << "},\n";
+        json << "     \"percentOfStream\": {\"force\": " << 100.0*forceBandwidth/streamBandwidth
+             << ", \"update\": " << 100.0*updateBandwidth/streamBandwidth << "}}";
+        json << (cc+1 < cases.size() ? ",\n" : "\n");
+        if(myRank == 0)
+            {
+            fprintf(stderr,"L=%i %s colloids=%.2f %s block=%i tile=%i: %.3g force and %.3g minimizer site updates per second\n",L,
+                    multiConstant ? "multiConstant" : "oneConstant",bc.colloidFraction,bc.minimizer.c_str(),bc.siteBlock,
+                    bc.forceTile,globalSites/tForce,globalSites/tStep);
+            }
+        }
+    json << "  ]\n}\n";
+
+    if(myRank == 0)
+        {
+        ofstream out(outputSwitchArg.getValue().c_str());
+        out << json.str();
+        }
+
+    MPI_Finalize();
+    return 0;
+};
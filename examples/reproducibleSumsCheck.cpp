@@ -0,0 +1,138 @@
+#include "functions.h"
+#include "gpuarray.h"
+#include "multirankSimulation.h"
+#include "multirankQTensorLatticeModel.h"
+#include "landauDeGennesLC.h"
+#include "energyMinimizerFIRE.h"
+#include "energyMinimizerGradientDescent.h"
+#include "energyMinimizerLoLBFGS.h"
+#include "noiseSource.h"
+#include <tclap/CmdLine.h>
+#include <mpi.h>
+
+/*!
+A check of the reproducible summation mode (simulation::setSummationMode). The same random nematic configuration
+of a periodic box is minimized for a few steps with FIRE, gradient descent, and L-BFGS, and the energy after each
+minimization is printed with all 17 significant digits. With reproducible sums the printed energies should be
+identical, bit for bit, when the program is run on 1, 2, or 4 ranks (e.g. "mpirun -n 2 examples/reproducibleSumsCheck.out")
+and with any number of threads; with --plainSums they will typically differ in the last few digits.
+*/
+
+int3 partitionProcessors(int numberOfProcesses)
+    {
+    int3 ans;
+    ans.z = floor(pow(numberOfProcesses,1./3.));
+    int nLeft = floor(numberOfProcesses/ans.z);
+    ans.y = floor(sqrt(nLeft));
+    ans.x = floor(nLeft / ans.y);
+    return ans;
+    }
+
+//!minimize the same initial state with the given minimizer, and return the final energy
+scalar minimizedEnergy(string minimizer, int myRank, int3 rankTopology, int boxL, int nConstants, int iterations, int nThreads, bool exactSums)
+    {
+    scalar a = -1;
+    scalar b = -2.12/0.172;
+    scalar c = 1.73/0.172;
+    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
+    bool edges = nConstants > 1;
+    bool corners = nConstants > 1;
+    shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(
+                    boxL/rankTopology.x,boxL/rankTopology.y,boxL/rankTopology.z,
+                    rankTopology.x > 1,rankTopology.y > 1,rankTopology.z > 1,false,true);
+    shared_ptr<multirankSimulation> sim = make_shared<multirankSimulation>(myRank,rankTopology.x,rankTopology.y,rankTopology.z,edges,corners);
+    shared_ptr<landauDeGennesLC> landauLCForce = make_shared<landauDeGennesLC>(a,b,c,4.64);
+    if(nConstants > 1)
+        {
+        landauLCForce->setElasticConstants(4.64,2.32,2.32);
+        landauLCForce->setNumberOfConstants(distortionEnergyType::multiConstant);
+        }
+    //multi-constant forces on several ranks read the derivatives of the first halo layer
+    if(nConstants > 1 && rankTopology.x*rankTopology.y*rankTopology.z > 1)
+        Configuration->setHaloDepth(2);
+    sim->setConfiguration(Configuration);
+    landauLCForce->setModel(Configuration);
+    sim->addForce(landauLCForce);
+
+    //the simulation only keeps a weak pointer to its updaters
+    shared_ptr<updater> minimizerUpdater;
+    scalar dt = 0.005;
+    if(minimizer == "fire")
+        {
+        shared_ptr<energyMinimizerFIRE> fire = make_shared<energyMinimizerFIRE>(Configuration);
+        fire->setFIREParameters(0.1*dt,.99,10*dt,1.1,0.95,.9,4,1e-12,0);
+        fire->setMaximumIterations(iterations);
+        minimizerUpdater = fire;
+        }
+    else if(minimizer == "gd")
+        {
+        shared_ptr<energyMinimizerGradientDescent> gd = make_shared<energyMinimizerGradientDescent>(Configuration);
+        gd->setGradientDescentParameters(dt,1e-12);
+        gd->setMaximumIterations(iterations);
+        minimizerUpdater = gd;
+        }
+    else
+        {
+        shared_ptr<energyMinimizerLoLBFGS> lbfgs = make_shared<energyMinimizerLoLBFGS>(Configuration);
+        lbfgs->setLoLBFGSParameters(5,dt,1.0,1e-12,10);
+        lbfgs->setMaximumIterations(iterations);
+        minimizerUpdater = lbfgs;
+        }
+    sim->addUpdater(minimizerUpdater,Configuration);
+    sim->setCPUOperation(true);
+    sim->setNThreads(nThreads);
+
+    //the counter-based generator gives each lattice site the same director for any decomposition of the box
+    noiseSource noise(true);
+    noise.setReproducibleSeed(1);
+    noise.setCounterSeed(7);
+    Configuration->setRandomDirectors(noise,S0,false);
+    sim->finalizeObjects();
+    if(exactSums)
+        sim->setSummationMode(reductionService::reproducibleSummation);
+
+    sim->performTimestep();
+    return sim->computePotentialEnergy();
+    }
+
+using namespace TCLAP;
+int main(int argc, char*argv[])
+    {
+    int myRank,worldSize;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+    CmdLine cmd("energies of short minimizations, for comparison across numbers of ranks and threads", ' ', "V0.5");
+    ValueArg<int> lSwitchArg("l","boxL","number of lattice sites on a side of the (cubic, global) box",false,24,"int",cmd);
+    ValueArg<int> kSwitchArg("k","nConstants","1 for the one-constant approximation, 3 for distinct constants",false,1,"int",cmd);
+    ValueArg<int> iterationsSwitchArg("i","iterations","number of minimization steps",false,40,"int",cmd);
+    ValueArg<int> threadsSwitchArg("t","threads","number of threads to request",false,1,"int",cmd);
+    SwitchArg plainSumsSwitch("","plainSums","use ordinary floating-point sums instead of reproducible ones", cmd, false);
+    cmd.parse( argc, argv );
+
+    int boxL = lSwitchArg.getValue();
+    int3 rankTopology = partitionProcessors(worldSize);
+    if(boxL % rankTopology.x != 0 || boxL % rankTopology.y != 0 || boxL % rankTopology.z != 0)
+        {
+        if(myRank == 0)
+            printf("a box of side %i can not be split evenly over {%i, %i, %i} ranks\n",boxL,rankTopology.x,rankTopology.y,rankTopology.z);
+        MPI_Finalize();
+        return 1;
+        }
+    bool exactSums = !plainSumsSwitch.getValue();
+    if(myRank == 0)
+        printf("lattice divisions: {%i, %i, %i}, %s sums\n",rankTopology.x,rankTopology.y,rankTopology.z,exactSums ? "reproducible" : "plain");
+
+    vector<string> minimizers = {"fire","gd","lbfgs"};
+    for (unsigned int ii = 0; ii < minimizers.size(); ++ii)
+        {
+        scalar E = minimizedEnergy(minimizers[ii],myRank,rankTopology,boxL,kSwitchArg.getValue(),
+                                   iterationsSwitchArg.getValue(),threadsSwitchArg.getValue(),exactSums);
+        if(myRank == 0)
+            printf("%s\t%.17g\n",minimizers[ii].c_str(),E);
+        }
+
+    MPI_Finalize();
+    return 0;
+    };
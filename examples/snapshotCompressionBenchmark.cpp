@@ -0,0 +1,152 @@
+#include "functions.h"
+#include "gpuarray.h"
+#include "multirankSimulation.h"
+#include "qTensorLatticeModel.h"
+#include "landauDeGennesLC.h"
+#include "energyMinimizerFIRE.h"
+#include "noiseSource.h"
+#include "indexer.h"
+#include "qTensorFunctions.h"
+#include "latticeBoundaries.h"
+#include "profiler.h"
+#include "snapshotCompression.h"
+#include <tclap/CmdLine.h>
+#include <mpi.h>
+
+/*!
+Throughput and compression-ratio benchmarks for the compressed snapshot format. A random (isotropic) Q-tensor
+configuration is quenched with a few FIRE steps, which leaves a dense tangle of disclination lines, and a spherical
+colloid with homeotropic anchoring is added so that boundary and surface sites are represented. The same
+configuration is then saved as a text file (saveState) and as compressed snapshots with several error bounds.
+For every format we report the bytes per site, compression ratio relative to the text files, the encode+write and
+read+decode throughput (in MB/s of the 40 bytes of double-precision Q-tensor data per site), the maximum error of any
+component, and the time to decode a single tile-sized region.
+*/
+using namespace TCLAP;
+int main(int argc, char*argv[])
+{
+    int myRank,worldSize;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+
+    CmdLine cmd("benchmark of compressed Q-tensor snapshots", ' ', "V0.9");
+    ValueArg<int> lSwitchArg("l","boxL","number of lattice sites for cubic box",false,80,"int",cmd);
+    ValueArg<int> iterationsSwitchArg("i","iterations","number of FIRE steps used to quench the random configuration",false,200,"int",cmd);
+    ValueArg<int> tileSwitchArg("t","tileSize","linear size of the tiles of the compressed snapshot",false,16,"int",cmd);
+    ValueArg<int> repeatSwitchArg("n","repeats","number of timing repetitions",false,3,"int",cmd);
+    ValueArg<string> saveFileSwitchArg("","saveFile","the base name of the files written during the benchmark",false,"snapshotBenchmark","string",cmd);
+    cmd.parse( argc, argv );
+
+    int boxL = lSwitchArg.getValue();
+    int maximumIterations = iterationsSwitchArg.getValue();
+    int tileSize = tileSwitchArg.getValue();
+    int repeats = max(1,repeatSwitchArg.getValue());
+    string saveFile = saveFileSwitchArg.getValue();
+
+    scalar a = -1;
+    scalar b = -2.12/0.172;
+    scalar c = 1.73/0.172;
+    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
+
+    noiseSource noise(true);
+    noise.setReproducibleSeed(13371+myRank);
+    shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(boxL,boxL,boxL,false,false,false,false,true);
+    shared_ptr<multirankSimulation> sim = make_shared<multirankSimulation>(myRank,1,1,1,false,false);
+    shared_ptr<landauDeGennesLC> landauLCForce = make_shared<landauDeGennesLC>(a,b,c,4.64);
+    sim->setConfiguration(Configuration);
+    landauLCForce->setModel(Configuration);
+    sim->addForce(landauLCForce);
+
+    shared_ptr<energyMinimizerFIRE> Fminimizer = make_shared<energyMinimizerFIRE>(Configuration);
+    Fminimizer->setMaximumIterations(maximumIterations);
+    scalar dt = 0.0005;
+    Fminimizer->setFIREParameters(dt,.99,100*dt,1.1,0.5,0.9,4,1e-12,0.0);
+    sim->addUpdater(Fminimizer,Configuration);
+    sim->setCPUOperation(true);
+
+    Configuration->setNematicQTensorRandomly(noise,S0);
+    boundaryObject homeotropicBoundary(boundaryType::homeotropic,5.8,S0);
+    scalar3 center = make_scalar3(0.5*boxL,0.5*boxL,0.5*boxL);
+    sim->createSphericalColloid(center,0.15*boxL,homeotropicBoundary);
+    sim->finalizeObjects();
+    sim->performTimestep();
+    printf("quenched a random configuration of %i sites for %i FIRE steps\n",boxL*boxL*boxL,maximumIterations);
+
+    int N = Configuration->getNumberOfParticles();
+    scalar dataMB = N*DIMENSION*sizeof(scalar)/1.0e6;
+    vector<dVec> Q(N);
+    vector<int> types(N);
+    {
+    ArrayHandle<dVec> pp(Configuration->returnPositions(),access_location::host,access_mode::read);
+    ArrayHandle<int> tt(Configuration->returnTypes(),access_location::host,access_mode::read);
+    for (int ii = 0; ii < N; ++ii)
+        {
+        Q[ii] = pp.data[ii];
+        types[ii] = tt.data[ii];
+        }
+    }
+
+    //the text format, as a reference point
+    profiler pText("text save");
+    for (int rr = 0; rr < repeats; ++rr)
+        {
+        pText.start();
+        sim->saveState(saveFile);
+        pText.end();
+        }
+    char fn[256];
+    sprintf(fn,"%s_x0y0z0.txt",saveFile.c_str());
+    ifstream textFile(fn,ios::binary | ios::ate);
+    scalar textBytes = textFile.tellg();
+    textFile.close();
+    printf("\nformat\t\tbytes/site\tratio\twrite MB/s\tread MB/s\tmax error\tregion read (s)\n");
+    printf("text\t\t%f\t%f\t%f\t-\t\t-\t\t-\n",textBytes/N,1.0,dataMB/pText.timing());
+
+    vector<scalar> errorBounds = {0.0, 1e-6, 1e-4, 1e-3};
+    sprintf(fn,"%s.oqs",saveFile.c_str());
+    vector<dVec> decodedQ(N);
+    vector<int> decodedTypes(N);
+    vector<dVec> regionQ;
+    vector<int> regionTypes;
+    int3 regionMin = make_int3(boxL/2,boxL/2,boxL/2);
+    int3 regionMax = make_int3(boxL/2+tileSize,boxL/2+tileSize,boxL/2+tileSize);
+    for (int ee = 0; ee < errorBounds.size(); ++ee)
+        {
+        profiler pWrite("compressed save");
+        profiler pRead("compressed load");
+        profiler pRegion("compressed region load");
+        qTensorSnapshot snapshot;
+        for (int rr = 0; rr < repeats; ++rr)
+            {
+            pWrite.start();
+            qTensorSnapshot::save(fn,Q.data(),types.data(),Configuration->latticeSites,make_int3(0,0,0),tileSize,errorBounds[ee]);
+            pWrite.end();
+            pRead.start();
+            snapshot.open(fn);
+            snapshot.readLattice(decodedQ.data(),decodedTypes.data());
+            pRead.end();
+            pRegion.start();
+            snapshot.readRegion(regionMin,regionMax,regionQ,regionTypes);
+            pRegion.end();
+            }
+
+        scalar maxError = 0.0;
+        for (int ii = 0; ii < N; ++ii)
+            {
+            if(decodedTypes[ii] != types[ii])
+                {
+                printf("site types were not recovered correctly!\n");
+                throw std::exception();
+                }
+            for (int dd = 0; dd < DIMENSION; ++dd)
+                maxError = max(maxError,fabs(decodedQ[ii][dd]-Q[ii][dd]));
+            }
+        scalar bytes = snapshot.getFileSize();
+        printf("oqs eb=%.0e\t%f\t%f\t%f\t%f\t%e\t%e\n",errorBounds[ee],bytes/N,textBytes/bytes,
+                dataMB/pWrite.timing(),dataMB/pRead.timing(),maxError,pRegion.timing());
+        }
+
+    MPI_Finalize();
+    return 0;
+};
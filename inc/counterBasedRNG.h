@@ -0,0 +1,129 @@
+#ifndef COUNTERBASEDRNG_H
+#define COUNTERBASEDRNG_H
+
+#include "std_include.h"
+#include <cstdint>
+
+#ifdef __NVCC__
+#define HOSTDEVICE __host__ __device__ inline
+#else
+#define HOSTDEVICE inline __attribute__((always_inline))
+#endif
+
+/*! \file counterBasedRNG.h */
+
+//!Stream identifiers, so that different uses of the counter-based generator never share random numbers
+enum counterRNGStream
+    {
+    directorStream = 0,
+    globalDirectorStream = 1,
+    relaxationalNoiseStream = 2
+    };
+
+//!pack a global lattice position (each coordinate < 2^21) into a 64-bit site key
+HOSTDEVICE uint64_t counterRNGSiteKey(int3 globalPosition)
+    {
+    return ((uint64_t)(uint32_t)globalPosition.x)
+         | (((uint64_t)(uint32_t)globalPosition.y) << 21)
+         | (((uint64_t)(uint32_t)globalPosition.z) << 42);
+    };
+
+//!One Philox4x32 round's 32x32 -> 64 bit multiply
+HOSTDEVICE void philoxMultiply(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+    {
+    uint64_t product = (uint64_t)a*(uint64_t)b;
+    hi = (uint32_t)(product >> 32);
+    lo = (uint32_t)product;
+    };
+
+//!The Philox4x32-10 bijection of Salmon et al. (SC11): encrypt the 128-bit counter ctr with the 64-bit key
+HOSTDEVICE void philox4x32(uint32_t ctr[4], uint32_t key0, uint32_t key1)
+    {
+    for (int round = 0; round < 10; ++round)
+        {
+        uint32_t hi0,lo0,hi1,lo1;
+        philoxMultiply(0xD2511F53u,ctr[0],hi0,lo0);
+        philoxMultiply(0xCD9E8D57u,ctr[2],hi1,lo1);
+        uint32_t c0 = hi1^ctr[1]^key0;
+        uint32_t c2 = hi0^ctr[3]^key1;
+        ctr[0] = c0;
+        ctr[1] = lo1;
+        ctr[2] = c2;
+        ctr[3] = lo0;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+        };
+    };
+
+//!A stateless-in-spirit random number generator: every (seed, stream, site, step) tuple has its own random sequence
+/*!
+A counter-based generator turns a counter into random bits with a keyed bijection (here Philox4x32-10, which passes
+BigCrush), so there is no shared generator state to advance: the random numbers used at a given lattice site and time
+step depend only on the seed, the stream, the global site, and the step. Fields drawn this way are therefore identical
+for any number of threads, any rank decomposition, and either the CPU or the GPU, and any site can be drawn
+independently of every other one. A counterBasedRNG object is a lightweight cursor into one such sequence; the
+128-bit counter is (site low word, site high word, step, block), and the key is (seed, stream).
+*/
+class counterBasedRNG
+    {
+    public:
+        HOSTDEVICE counterBasedRNG(uint32_t seed, uint64_t site, uint32_t step, uint32_t stream)
+            {
+            key[0] = seed;
+            key[1] = stream;
+            counter[0] = (uint32_t)site;
+            counter[1] = (uint32_t)(site >> 32);
+            counter[2] = step;
+            counter[3] = 0;
+            available = 0;
+            haveSpareNormal = false;
+            };
+
+        //!the next 32 random bits of this sequence
+        HOSTDEVICE uint32_t nextInt()
+            {
+            if(available == 0)
+                {
+                for (int ii = 0; ii < 4; ++ii)
+                    buffer[ii] = counter[ii];
+                philox4x32(buffer,key[0],key[1]);
+                counter[3] += 1;
+                available = 4;
+                };
+            available -= 1;
+            return buffer[3-available];
+            };
+
+        //!a double uniformly distributed in [0,1), with 53 random bits
+        HOSTDEVICE scalar uniform()
+            {
+            uint32_t a = nextInt() >> 5;
+            uint32_t b = nextInt() >> 6;
+            return (a*67108864.0+b)*(1.0/9007199254740992.0);
+            };
+
+        //!a standard normal variate (Box-Muller, with the second variate of each pair cached)
+        HOSTDEVICE scalar normal()
+            {
+            if(haveSpareNormal)
+                {
+                haveSpareNormal = false;
+                return spareNormal;
+                };
+            scalar r = sqrt(-2.0*log(1.0-uniform()));
+            scalar phi = 2.0*PI*uniform();
+            spareNormal = r*sin(phi);
+            haveSpareNormal = true;
+            return r*cos(phi);
+            };
+
+    protected:
+        uint32_t key[2];
+        uint32_t counter[4];
+        uint32_t buffer[4];
+        int available;
+        bool haveSpareNormal;
+        scalar spareNormal;
+    };
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef CUDACOMPATIBILITY_H
+#define CUDACOMPATIBILITY_H
+
+/*! \file cudaCompatibility.h */
+/*!
+In a CPU-only build (CPU_ONLY defined; see the CPU_ONLY option of CMakeLists.txt) nothing from the CUDA toolkit is
+available. The headers in this directory (which is only on the include path of CPU-only builds) stand in for the
+toolkit headers of the same names, and all forward to this file: it provides host definitions of the CUDA vector
+types and their make_ functions, the function qualifiers (as no-ops), and the handful of runtime calls that the host
+code makes to query devices. Every query reports that there are no devices, so the GPU branches of the code are never
+selected.
+*/
+
+#include <cstring>
+#include <cstddef>
+
+#define __host__
+#define __device__
+#define __global__
+#define __forceinline__ inline
+#define __align__(n) __attribute__((aligned(n)))
+
+struct int2 {int x, y;};
+struct int3 {int x, y, z;};
+struct __align__(16) int4 {int x, y, z, w;};
+struct uint2 {unsigned int x, y;};
+struct uint3 {unsigned int x, y, z;};
+struct __align__(16) uint4 {unsigned int x, y, z, w;};
+struct __align__(8) float2 {float x, y;};
+struct float3 {float x, y, z;};
+struct __align__(16) float4 {float x, y, z, w;};
+struct __align__(16) double2 {double x, y;};
+struct double3 {double x, y, z;};
+struct __align__(16) double4 {double x, y, z, w;};
+struct dim3
+    {
+    unsigned int x, y, z;
+    dim3(unsigned int _x = 1, unsigned int _y = 1, unsigned int _z = 1) : x(_x), y(_y), z(_z) {};
+    };
+
+inline int2 make_int2(int x, int y) {int2 a; a.x = x; a.y = y; return a;};
+inline int3 make_int3(int x, int y, int z) {int3 a; a.x = x; a.y = y; a.z = z; return a;};
+inline int4 make_int4(int x, int y, int z, int w) {int4 a; a.x = x; a.y = y; a.z = z; a.w = w; return a;};
+inline uint2 make_uint2(unsigned int x, unsigned int y) {uint2 a; a.x = x; a.y = y; return a;};
+inline uint3 make_uint3(unsigned int x, unsigned int y, unsigned int z) {uint3 a; a.x = x; a.y = y; a.z = z; return a;};
+inline float2 make_float2(float x, float y) {float2 a; a.x = x; a.y = y; return a;};
+inline float3 make_float3(float x, float y, float z) {float3 a; a.x = x; a.y = y; a.z = z; return a;};
+inline float4 make_float4(float x, float y, float z, float w) {float4 a; a.x = x; a.y = y; a.z = z; a.w = w; return a;};
+inline double2 make_double2(double x, double y) {double2 a; a.x = x; a.y = y; return a;};
+inline double3 make_double3(double x, double y, double z) {double3 a; a.x = x; a.y = y; a.z = z; return a;};
+inline double4 make_double4(double x, double y, double z, double w) {double4 a; a.x = x; a.y = y; a.z = z; a.w = w; return a;};
+
+//!the subset of the runtime's error codes the host code looks at
+enum cudaError_t
+    {
+    cudaSuccess = 0,
+    cudaErrorInvalidDevice = 101,
+    cudaErrorNoDevice = 100
+    };
+enum cudaMemcpyKind
+    {
+    cudaMemcpyHostToHost = 0,
+    cudaMemcpyHostToDevice = 1,
+    cudaMemcpyDeviceToHost = 2,
+    cudaMemcpyDeviceToDevice = 3
+    };
+#define cudaHostRegisterDefault 0
+
+//!the fields of the device properties that the host code reports
+struct cudaDeviceProp
+    {
+    char name[256];
+    size_t totalGlobalMem;
+    int memoryClockRate;
+    int memoryBusWidth;
+    };
+
+inline const char *cudaGetErrorString(cudaError_t err)
+    {
+    return (err == cudaSuccess) ? "no error" : "CUDA is not available in a CPU-only build";
+    };
+inline cudaError_t cudaGetLastError() {return cudaSuccess;};
+inline cudaError_t cudaGetDeviceCount(int *count) {*count = 0; return cudaErrorNoDevice;};
+inline cudaError_t cudaSetDevice(int device) {return cudaErrorInvalidDevice;};
+inline cudaError_t cudaGetDeviceProperties(cudaDeviceProp *prop, int device)
+    {
+    memset(prop,0,sizeof(cudaDeviceProp));
+    strcpy(prop->name,"none (CPU-only build)");
+    return cudaErrorInvalidDevice;
+    };
+inline cudaError_t cudaDeviceSynchronize() {return cudaSuccess;};
+inline cudaError_t cudaThreadSynchronize() {return cudaSuccess;};
+inline cudaError_t cudaProfilerStart() {return cudaSuccess;};
+inline cudaError_t cudaProfilerStop() {return cudaSuccess;};
+inline cudaError_t cudaHostRegister(void *ptr, size_t size, unsigned int flags) {return cudaSuccess;};
+inline cudaError_t cudaHostUnregister(void *ptr) {return cudaSuccess;};
+
+//!profiling ranges are no-ops without the NVIDIA tools extension
+inline int nvtxRangePushA(const char *message) {return 0;};
+inline int nvtxRangePop() {return 0;};
+
+//!placeholder for the per-thread state of the GPU random number generators, which are never initialized on the CPU
+struct curandState
+    {
+    unsigned int d, v[5];
+    int boxmuller_flag, boxmuller_flag_double;
+    float boxmuller_extra;
+    double boxmuller_extra_double;
+    };
+
+#endif
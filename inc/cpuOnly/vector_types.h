@@ -0,0 +1,2 @@
+//stand-in for the CUDA toolkit header of the same name in CPU-only builds; see cudaCompatibility.h
+#include "cudaCompatibility.h"
@@ -36,6 +36,7 @@ for (int c = 0; c < numberOfCells;++c)
 // for vector types
 #include "std_include.h"
 #include <cuda_runtime.h>
+#include <sys/mman.h>
 
 
 //!A structure for declaring where we want to access data
@@ -73,12 +74,72 @@ struct access_mode
         };
     };
 
+//!Host allocations of at least this many bytes are aligned to, and advised to be backed by, 2MB pages
+#define GPUARRAY_LARGE_PAGE_BYTES 2097152
+
+//!The number of threads used to first touch (i.e., zero) newly allocated host memory
+inline int &gpuArrayFirstTouchThreads()
+    {
+    static int nThreads = 1;
+    return nThreads;
+    }
+
+//!Zero new host memory with n threads, so that on NUMA machines its pages are placed near the threads that will use them
+/*!
+Operating systems place a page on the NUMA node of the thread that first touches it. With n > 1, the large host
+allocations of every GPUArray created or resized afterwards are zeroed in n contiguous pieces by n threads, matching
+the static schedule of the "omp parallel for num_threads(nThreads)" loops of the CPU code paths.
+*/
+inline void setGPUArrayFirstTouchThreads(int n)
+    {
+    gpuArrayFirstTouchThreads() = max(1,n);
+    }
+
+//!Allocate host memory: cache-line aligned, or aligned to (and advised to use) transparent huge pages for large arrays
+inline void *allocateGPUArrayHostMemory(size_t bytes)
+    {
+    size_t alignment = (bytes >= GPUARRAY_LARGE_PAGE_BYTES) ? GPUARRAY_LARGE_PAGE_BYTES : 64;
+    void *ptr = NULL;
+    int retval = posix_memalign(&ptr, alignment, bytes);
+    if (retval != 0)
+        {
+        throw std::runtime_error("Error allocating GPUArray.");
+        }
+#ifdef MADV_HUGEPAGE
+    if (alignment == GPUARRAY_LARGE_PAGE_BYTES)
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+    return ptr;
+    }
+
+//!Zero host memory, splitting large regions over the first-touch threads
+inline void clearGPUArrayHostMemory(void *ptr, size_t bytes)
+    {
+    int nThreads = gpuArrayFirstTouchThreads();
+    if (nThreads <= 1 || bytes < GPUARRAY_LARGE_PAGE_BYTES)
+        {
+        memset(ptr, 0, bytes);
+        return;
+        }
+    char *p = (char *)ptr;
+    #pragma omp parallel for num_threads(nThreads) schedule(static)
+    for (int tt = 0; tt < nThreads; ++tt)
+        {
+        size_t first = (bytes*tt)/nThreads;
+        size_t last = (bytes*(tt+1))/nThreads;
+        memset(p+first, 0, last-first);
+        }
+    }
+
 //!A class for handling data simultaneously on the CPU and GPU
 /*!This class and accessor are based on GPUArray.h, from the HOOMD-Blue simulation package.
 It is, however, simplified. It takes care of cuda memory copying for templated arrays.
 A flag (default to false) when declaring a GPUArray controls whether the memory is HostRegistered
 but only handles synchronous copy operatations (no Asynch, no HostRegister, etc.)
 It is also only for 1D arrays of data. Importantly, the user accesses and handles data through the ArrayHandle class.
+
+Arrays flagged noGPU never allocate device memory. In a CPU-only build (CPU_ONLY defined) no array does: the "device"
+pointer simply aliases the host data, so that every access is a host access and no copies are ever made.
 */
 template<class T> class GPUArray;
 
@@ -117,9 +178,16 @@ template<class T> class GPUArray
         virtual ~GPUArray();
 
         GPUArray(const GPUArray& from);
+        //!Copy assignment; the existing allocation is reused when the sizes already match
         GPUArray& operator=(const GPUArray& rhs);
+        //!Move construction takes over the memory of from, which is left empty
+        GPUArray(GPUArray&& from) noexcept;
+        //!Move assignment frees the current memory and takes over that of rhs, which is left empty
+        GPUArray& operator=(GPUArray&& rhs) noexcept;
         //!Swap two GPUarrays efficiently
         inline void swap(GPUArray& from);
+        //!Copy the first numElements elements of from into this (already large enough) array, without reallocating
+        inline void copyFrom(const GPUArray& from, unsigned int numElements, const access_location::Enum location = access_location::host);
         //!Get the size of the array
         unsigned int getNumElements() const
             {
@@ -212,7 +280,7 @@ template<class T> GPUArray<T>::~GPUArray()
     }
 
 template<class T> GPUArray<T>::GPUArray(const GPUArray& from) : Num_elements(from.Num_elements),
-        Acquired(false), Data_location(data_location::host),
+        Acquired(false), Data_location(data_location::host), RegisterArray(from.RegisterArray), noGPU(from.noGPU),
         d_data(NULL),
         h_data(NULL)
     {
@@ -228,26 +296,33 @@ template<class T> GPUArray<T>::GPUArray(const GPUArray& from) : Num_elements(fro
         }
     }
 
+/*!
+If rhs has the same number of elements (and the same noGPU setting) as this array, its data is simply copied into the
+existing memory; only otherwise is the memory freed and reallocated
+*/
 template<class T> GPUArray<T>& GPUArray<T>::operator=(const GPUArray& rhs)
     {
     if (this != &rhs) // protect against invalid self-assignment
         {
-        // free current memory
-        deallocate();
+        if (Num_elements != rhs.Num_elements || noGPU != rhs.noGPU)
+            {
+            // free current memory
+            deallocate();
 
-        // is the array registered
-        RegisterArray = rhs.RegisterArray;
+            // is the array registered, or host-only
+            RegisterArray = rhs.RegisterArray;
+            noGPU = rhs.noGPU;
 
-        // copy over basic elements
-        Num_elements = rhs.Num_elements;
+            // copy over basic elements
+            Num_elements = rhs.Num_elements;
+
+            // allocate new memory the same size as the data in rhs (every element is overwritten below)
+            allocate();
+            }
 
         // initialize state variables
         Data_location = data_location::host;
 
-        // allocate and clear new memory the same size as the data in rhs
-        allocate();
-        memclear();
-
         // copy over the data to the new GPUArray
         if (Num_elements > 0)
             {
@@ -259,6 +334,26 @@ template<class T> GPUArray<T>& GPUArray<T>::operator=(const GPUArray& rhs)
     return *this;
     }
 
+template<class T> GPUArray<T>::GPUArray(GPUArray&& from) noexcept :
+        Num_elements(0), Acquired(false), Data_location(data_location::host), RegisterArray(false), noGPU(from.noGPU),
+        d_data(NULL),
+        h_data(NULL)
+    {
+    swap(from);
+    }
+
+template<class T> GPUArray<T>& GPUArray<T>::operator=(GPUArray&& rhs) noexcept
+    {
+    if (this != &rhs)
+        {
+        deallocate();
+        Num_elements = 0;
+        Data_location = data_location::host;
+        swap(rhs);
+        }
+    return *this;
+    }
+
 /*!
     a.swap(b) is:
         GPUArray c(a);
@@ -272,26 +367,50 @@ template<class T> void GPUArray<T>::swap(GPUArray& from)
     std::swap(Acquired, from.Acquired);
     std::swap(Data_location, from.Data_location);
     std::swap(RegisterArray,from.RegisterArray);
+    std::swap(noGPU,from.noGPU);
     std::swap(d_data, from.d_data);
     std::swap(h_data, from.h_data);
     }
 
+/*!
+Both arrays are accessed at the given location (so that data that is current on the device is copied there); when
+numElements covers all of this array the old contents are not read
+*/
+template<class T> void GPUArray<T>::copyFrom(const GPUArray& from, unsigned int numElements, const access_location::Enum location)
+    {
+    if (numElements > Num_elements || numElements > from.Num_elements)
+        throw std::runtime_error("Error copying into a GPUArray that is too small.");
+    if (numElements == 0)
+        return;
+    access_mode::Enum mode = (numElements == Num_elements) ? access_mode::overwrite : access_mode::readwrite;
+    ArrayHandle<T> source(from, location, access_mode::read);
+    ArrayHandle<T> target(*this, location, mode);
+#ifndef CPU_ONLY
+    if (location == access_location::device)
+        {
+        cudaMemcpy(target.data, source.data, sizeof(T)*numElements, cudaMemcpyDeviceToDevice);
+        return;
+        }
+#endif
+    memcpy(target.data, source.data, sizeof(T)*numElements);
+    }
+
 template<class T> void GPUArray<T>::allocate()
     {
     // don't allocate anything if there are zero elements
     if (Num_elements == 0)
         return;
     // allocate host memory
-    // at minimum, alignment needs to be 32 bytes for AVX
-    int retval = posix_memalign((void**)&h_data, 32, Num_elements*sizeof(T));
-    if (retval != 0)
-        {
-        throw std::runtime_error("Error allocating GPUArray.");
-        }
+    h_data = (T *)allocateGPUArrayHostMemory(Num_elements*sizeof(T));
 
 //    if(RegisterArray)
 //        cudaHostRegister(h_data,Num_elements*sizeof(T),cudaHostRegisterDefault);
-    cudaMalloc(&d_data, Num_elements*sizeof(T));
+#ifdef CPU_ONLY
+    d_data = h_data;
+#else
+    if (!noGPU)
+        cudaMalloc(&d_data, Num_elements*sizeof(T));
+#endif
     }
 
 template<class T> void GPUArray<T>::deallocate()
@@ -300,7 +419,10 @@ template<class T> void GPUArray<T>::deallocate()
     if (Num_elements == 0)
         return;
     // free memory
-    cudaFree(d_data);
+#ifndef CPU_ONLY
+    if (d_data != NULL)
+        cudaFree(d_data);
+#endif
 //    if(RegisterArray)
 //        cudaHostUnregister(h_data);
 
@@ -318,8 +440,11 @@ template<class T> void GPUArray<T>::memclear(unsigned int first)
         return;
 
     // clear memory
-    memset(h_data+first, 0, sizeof(T)*(Num_elements-first));
-    cudaMemset(d_data+first, 0, (Num_elements-first)*sizeof(T));
+    clearGPUArrayHostMemory(h_data+first, sizeof(T)*(Num_elements-first));
+#ifndef CPU_ONLY
+    if (d_data != NULL)
+        cudaMemset(d_data+first, 0, (Num_elements-first)*sizeof(T));
+#endif
     }
 
 
@@ -329,8 +454,9 @@ template<class T> void GPUArray<T>::memcpyDeviceToHost() const
     if (Num_elements == 0)
         return;
 
-
+#ifndef CPU_ONLY
     cudaMemcpy(h_data, d_data, sizeof(T)*Num_elements, cudaMemcpyDeviceToHost);
+#endif
 
     }
 
@@ -340,7 +466,9 @@ template<class T> void GPUArray<T>::memcpyHostToDevice() const
     if (Num_elements == 0)
         return;
 
+#ifndef CPU_ONLY
     cudaMemcpy(d_data, h_data, sizeof(T)*Num_elements, cudaMemcpyHostToDevice);
+#endif
     }
 
 /*!
@@ -462,18 +590,13 @@ template<class T> T* GPUArray<T>::resizeHostArray(unsigned int num_elements)
     T *h_tmp = NULL;
 
     // allocate host memory
-    // at minimum, alignment needs to be 32 bytes for AVX
-    int retval = posix_memalign((void**)&h_tmp, 32, num_elements*sizeof(T));
-    if (retval != 0)
-        {
-        throw std::runtime_error("Error allocating GPUArray.");
-        }
+    h_tmp = (T *)allocateGPUArrayHostMemory(num_elements*sizeof(T));
 
 //    if(RegisterArray)
 //        cudaHostRegister(h_tmp,Num_elements*sizeof(T),cudaHostRegisterDefault);
 
     // clear memory
-    memset(h_tmp, 0, sizeof(T)*num_elements);
+    clearGPUArrayHostMemory(h_tmp, sizeof(T)*num_elements);
 
     // copy over data
     unsigned int num_copy_elements = Num_elements > num_elements ? num_elements : Num_elements;
@@ -491,6 +614,9 @@ template<class T> T* GPUArray<T>::resizeHostArray(unsigned int num_elements)
 
 template<class T> T* GPUArray<T>::resizeDeviceArray(unsigned int num_elements)
     {
+#ifdef CPU_ONLY
+    d_data = h_data;
+#else
     // allocate resized array
     T *d_tmp;
     cudaMalloc(&d_tmp, num_elements*sizeof(T));
@@ -500,20 +626,27 @@ template<class T> T* GPUArray<T>::resizeDeviceArray(unsigned int num_elements)
 
     // copy over data
     unsigned int num_copy_elements = Num_elements > num_elements ? num_elements : Num_elements;
-    cudaMemcpy(d_tmp, d_data, sizeof(T)*num_copy_elements,cudaMemcpyDeviceToDevice);
+    if (d_data != NULL)
+        cudaMemcpy(d_tmp, d_data, sizeof(T)*num_copy_elements,cudaMemcpyDeviceToDevice);
 
     // free old memory location
-    cudaFree(d_data);
+    if (d_data != NULL)
+        cudaFree(d_data);
 
     d_data = d_tmp;
+#endif
     return d_data;
     }
 
 template<class T> void GPUArray<T>::resize(unsigned int num_elements)
     {
     resizeHostArray(num_elements);
+#ifdef CPU_ONLY
+    resizeDeviceArray(num_elements);
+#else
     if(!noGPU)
         resizeDeviceArray(num_elements);
+#endif
     Num_elements = num_elements;
     }
 
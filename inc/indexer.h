@@ -66,12 +66,16 @@ class Index2D
 /*!
  * A class for converting between a 3d index and a 1-d array, which makes calculation on
  * the GPU a bit easier. This was inspired by the indexer class of Hoomd-blue
+ *
+ * By default x is fastest, then y, then z. With setBlockSize(b) the grid is instead stored as b*b*b blocks, each
+ * contiguous and x-fastest inside, with the blocks themselves in x-fastest order (blocks on the upper edges hold the
+ * remainder when the sizes are not multiples of b); neighbors along y and z are then usually within b*b sites.
  */
 class Index3D
     {
     public:
-        HOSTDEVICE Index3D(unsigned int w=0){setSizes(w);};
-        HOSTDEVICE Index3D(int3 w){setSizes(w);};
+        HOSTDEVICE Index3D(unsigned int w=0){blockSize = 0;setSizes(w);};
+        HOSTDEVICE Index3D(int3 w){blockSize = 0;setSizes(w);};
 
         HOSTDEVICE void setSizes(unsigned int w)
             {
@@ -88,20 +92,59 @@ class Index3D
             intermediateSizes.z = intermediateSizes.y*sizes.y;
             };
 
+        //!store the grid in blocks of b*b*b sites (0 for the plain x-fastest order)
+        HOSTDEVICE void setBlockSize(int b)
+            {
+            blockSize = b > 1 ? b : 0;
+            };
+
         HOSTDEVICE unsigned int operator()(const int x, const int y, const int z) const
             {
+            if(blockSize > 0)
+                return blockedIndex(x,y,z);
             return x*intermediateSizes.x + y*intermediateSizes.y + z*intermediateSizes.z;
             };
 
         HOSTDEVICE unsigned int operator()(const int3 &i) const
             {
+            if(blockSize > 0)
+                return blockedIndex(i.x,i.y,i.z);
             return i.x*intermediateSizes.x + i.y*intermediateSizes.y + i.z*intermediateSizes.z;
             };
 
+        //!the index of (x,y,z) in the blocked order: all earlier layers of blocks, rows of blocks, and blocks, then the offset in the block
+        HOSTDEVICE unsigned int blockedIndex(const int x, const int y, const int z) const
+            {
+            int b = blockSize;
+            int bx = x/b; int by = y/b; int bz = z/b;
+            int ex = (sizes.x-bx*b < b) ? sizes.x-bx*b : b;
+            int ey = (sizes.y-by*b < b) ? sizes.y-by*b : b;
+            int ez = (sizes.z-bz*b < b) ? sizes.z-bz*b : b;
+            return bz*b*sizes.x*sizes.y + by*b*sizes.x*ez + bx*b*ey*ez + (x-bx*b) + ex*((y-by*b) + ey*(z-bz*b));
+            };
+
         //!What iVec would correspond to a given unsigned int IndexDD(iVec)
         HOSTDEVICE int3 inverseIndex(int i)
             {
             int3 ans;
+            if(blockSize > 0)
+                {
+                int b = blockSize;
+                int bz = i/(b*sizes.x*sizes.y);
+                i -= bz*b*sizes.x*sizes.y;
+                int ez = (sizes.z-bz*b < b) ? sizes.z-bz*b : b;
+                int by = i/(b*sizes.x*ez);
+                i -= by*b*sizes.x*ez;
+                int ey = (sizes.y-by*b < b) ? sizes.y-by*b : b;
+                int bx = i/(b*ey*ez);
+                i -= bx*b*ey*ez;
+                int ex = (sizes.x-bx*b < b) ? sizes.x-bx*b : b;
+                ans.x = bx*b + i%ex;
+                i /= ex;
+                ans.y = by*b + i%ey;
+                ans.z = bz*b + i/ey;
+                return ans;
+                };
             int z0 = i;
             ans.x = z0%sizes.x;
             z0= (z0-ans.x)/sizes.x;
@@ -127,6 +170,7 @@ class Index3D
         int3 intermediateSizes; //!<intermediateSizes[a] = Product_{d<=a} sizes. intermediateSizes[0]=1;
         unsigned int numberOfElements; //! The total number of elements that the indexer can index
         unsigned int width;   //!< array width
+        int blockSize; //!< edge of the blocks of the blocked order, or 0 for the plain order
     };
 
 //!Switch between a d-dimensional grid to a flattened, 1D index
@@ -132,6 +132,27 @@ HOSTDEVICE dVec QjkQki(dVec &q)
     return ans;
     };
 
+//!Map between components in an orthonormal basis of Q-tensor space and the components above
+/*!
+The orthonormal basis is the one of qTensorFunctionsGartlandBasis.h, with its two diagonal elements in slots 0 and 3
+and every element scaled by 1/sqrt(2), so that the plain dot product of two vectors of orthonormal components equals
+the dotVec of the corresponding Q-tensors. The map, M, is symmetric: it takes orthonormal components v to Q-tensor
+components M v, and co-forces f (derivatives with respect to the Q-tensor components) to their orthonormal
+components M f. Applying it twice is the metric correction of the forces.
+*/
+HOSTDEVICE dVec orthonormalBasisTransform(const dVec &v)
+    {
+    scalar cMinus = (sqrt3-3.0)/(3.0*sqrt2);
+    scalar cPlus = (sqrt3+3.0)/(3.0*sqrt2);
+    dVec ans;
+    ans[0] = cMinus*v[0] + cPlus*v[3];
+    ans[1] = v[1];
+    ans[2] = v[2];
+    ans[3] = cPlus*v[0] + cMinus*v[3];
+    ans[4] = v[4];
+    return ans;
+    };
+
 //! determinant of a qt matrix
 HOSTDEVICE scalar determinantOfQ(dVec &q)
     {
@@ -0,0 +1,129 @@
+#ifndef REPRODUCIBLESUM_H
+#define REPRODUCIBLESUM_H
+
+#include "std_include.h"
+#include <cstdint>
+
+/*! \file reproducibleSum.h */
+
+//!An exact, order-independent accumulator of floating point numbers
+/*!
+Every double is an integer multiple of 2^-1074, so a sum of doubles can be accumulated exactly as a (very long)
+fixed-point integer. Here that integer is stored as nBins signed 64-bit "digits" of 32 bits each, the lowest digit
+holding the bits of weight 2^-1074...2^-1043. Adding a number splits its 53-bit mantissa over (at most) three
+consecutive digits; the spare 31 bits of every digit absorb the carries of 2^30 additions before the digits have to
+be normalized. Since integer addition is associative, the result does not depend on the order in which numbers (or
+partial sums, e.g. those of different threads or ranks) are added: a sum over a lattice is the same, bit for bit,
+for any decomposition of the lattice. value() rounds the exact sum to a double. The price is a few integer
+operations per addition, and 70 digits of storage per sum.
+*/
+class reproducibleSum
+    {
+    public:
+        static const int nBins = 70;
+        static const int binBits = 32;
+        static const int64_t binBase = ((int64_t)1) << 32;
+
+        reproducibleSum(){reset();};
+
+        //!set the sum to zero
+        void reset()
+            {
+            for (int ii = 0; ii < nBins; ++ii)
+                bins[ii] = 0;
+            additionsSinceNormalization = 0;
+            };
+
+        //!add x to the sum exactly (non-finite values are ignored)
+        void add(double x)
+            {
+            if(x == 0 || !std::isfinite(x))
+                return;
+            int exponent;
+            double fraction = frexp(fabs(x),&exponent);
+            int64_t mantissa = (int64_t)ldexp(fraction,53);
+            //x = mantissa * 2^(exponent-53); positions are counted from 2^-1074
+            int position = exponent - 53 + 1074;
+            if(position < 0)
+                {
+                mantissa >>= -position;
+                position = 0;
+                };
+            int bin = position / binBits;
+            int shift = position % binBits;
+            uint64_t lowBits = ((uint64_t)mantissa << shift) & 0xffffffffu;
+            uint64_t middleBits = ((uint64_t)mantissa >> (binBits - shift)) & 0xffffffffu;
+            uint64_t highBits = shift == 0 ? 0 : ((uint64_t)mantissa >> (2*binBits - shift));
+            int64_t sign = x < 0 ? -1 : 1;
+            bins[bin] += sign*(int64_t)lowBits;
+            bins[bin+1] += sign*(int64_t)middleBits;
+            bins[bin+2] += sign*(int64_t)highBits;
+            additionsSinceNormalization += 1;
+            if(additionsSinceNormalization >= (1 << 30))
+                normalize();
+            };
+
+        //!add another exact sum
+        void add(const reproducibleSum &other)
+            {
+            for (int ii = 0; ii < nBins; ++ii)
+                bins[ii] += other.bins[ii];
+            additionsSinceNormalization += other.additionsSinceNormalization+1;
+            normalize();
+            };
+
+        //!propagate carries, so that every digit but the last is in [0,2^32); this form is unique for every sum
+        void normalize()
+            {
+            for (int ii = 0; ii < nBins-1; ++ii)
+                {
+                int64_t carry = bins[ii] >> binBits;
+                bins[ii] -= carry*binBase;
+                bins[ii+1] += carry;
+                };
+            additionsSinceNormalization = 0;
+            };
+
+        //!the exact sum, rounded to a double
+        double value()
+            {
+            normalize();
+            //work with the magnitude, so that no cancellation happens in floating point
+            bool negative = bins[nBins-1] < 0;
+            int64_t digits[nBins];
+            for (int ii = 0; ii < nBins; ++ii)
+                digits[ii] = negative ? -bins[ii] : bins[ii];
+            if(negative)
+                for (int ii = 0; ii < nBins-1; ++ii)
+                    {
+                    int64_t carry = digits[ii] >> binBits;
+                    digits[ii] -= carry*binBase;
+                    digits[ii+1] += carry;
+                    };
+            double ans = 0.0;
+            for (int ii = nBins-1; ii >= 0; --ii)
+                if(digits[ii] != 0)
+                    ans += ldexp((double)digits[ii],binBits*ii-1074);
+            return negative ? -ans : ans;
+            };
+
+        //!write the (normalized) digits as doubles; sums of up to 2^20 such arrays are exact in double precision
+        void getDigits(double *digits)
+            {
+            normalize();
+            for (int ii = 0; ii < nBins; ++ii)
+                digits[ii] = (double)bins[ii];
+            };
+        //!set the sum from an array of digits written by getDigits (or a sum of such arrays)
+        void setDigits(const double *digits)
+            {
+            for (int ii = 0; ii < nBins; ++ii)
+                bins[ii] = (int64_t)digits[ii];
+            normalize();
+            };
+
+    protected:
+        int64_t bins[nBins];
+        int additionsSinceNormalization;
+    };
+#endif
@@ -1,5 +1,7 @@
 #include "functions.h"
 #include "multirankSimulation.h"
+#include "defectTracker.h"
+#include "coarseGrainedOutput.h"
 #include "multirankQTensorLatticeModel.h"
 #include "landauDeGennesLC.h"
 #include "energyMinimizerFIRE.h"
@@ -12,6 +14,8 @@
 #include "qTensorFunctions.h"
 #include "latticeBoundaries.h"
 #include "profiler.h"
+#include "regionTimers.h"
+#include "memoryPlanner.h"
 #include <tclap/CmdLine.h>
 #include <mpi.h>
 #include "logSpacedIntegers.h"
@@ -56,9 +60,32 @@ int main(int argc, char*argv[])
     //ValueArg<T> variableName("shortflag","longFlag","description",required or not, default value,"value type",CmdLine object to add to
     ValueArg<int> initializationSwitchArg("z","initializationSwitch","an integer controlling program branch",false,0,"int",cmd);
     ValueArg<int> gpuSwitchArg("g","GPU","which gpu to use",false,-1,"int",cmd);
+    ValueArg<int> threadsSwitchArg("t","threads","number of CPU threads to use per rank",false,1,"int",cmd);
 
     SwitchArg reproducibleSwitch("r","reproducible","reproducible random number generation", cmd, true);
     SwitchArg verboseSwitch("v","verbose","output more things to screen ", cmd, false);
+    SwitchArg reproducibleSumsSwitch("","reproducibleSums","sum energies, and the force norms and dot products of the FIRE, gradient descent, and L-BFGS minimizers, exactly, so that they do not depend on the number of ranks or threads (slower; the other updaters keep ordinary sums)", cmd, false);
+    SwitchArg timersSwitch("","timers","time forces, halo exchange, reductions, updates, and I/O, and print a summary over ranks at the end", cmd, false);
+    SwitchArg hardwareCountersSwitch("","hardwareCounters","with --timers, also count cycles, instructions, and cache misses in every region (Linux perf_event)", cmd, false);
+    SwitchArg sparseStorageSwitch("","sparseStorage","keep forces, velocities, and minimizer data only for liquid crystal sites, not for sites inside objects (CPU only)", cmd, false);
+    SwitchArg orthonormalBasisSwitch("","orthonormalBasis","compute forces and minimize in an orthonormal basis of Q-tensor space, so that no metric correction is needed (CPU only)", cmd, false);
+    SwitchArg dimensionOrderedHalosSwitch("","dimensionOrderedHalos","exchange halo sites along x, then y, then z, with one message per face (edge and corner sites are forwarded)", cmd, false);
+    SwitchArg sharedMemoryHalosSwitch("","sharedMemoryHalos","exchange halo faces with ranks on the same node through MPI-3 shared memory (implies --dimensionOrderedHalos)", cmd, false);
+    SwitchArg cartesianRanksSwitch("","cartesianRanks","place ranks with an MPI Cartesian communicator, giving the ranks of each node a compact block of the rank grid, and exchange halos with neighborhood collectives (implies --dimensionOrderedHalos)", cmd, false);
+    ValueArg<int> forceTileSwitchArg("","forceTile","compute the multi-constant bulk forces in cubic tiles of this edge length (0 = whole planes of each rank, -1 = in separate passes over all sites)", false, 0, "int",cmd);
+    SwitchArg autotuneSwitch("","autotune","choose the CPU threads per rank (up to -t) and multi-constant force tiles by timing the forces during the run", cmd, false);
+    ValueArg<string> tuningCacheSwitchArg("","tuningCache","file in which --autotune keeps the best settings for each host and lattice, so that later runs start from them",false,"","string",cmd);
+    ValueArg<int> siteBlockSwitchArg("","siteBlock","store the lattice sites of each rank in blocks of this edge length, for cache locality of the force stencil (0 = x-fastest order)", false, 0, "int",cmd);
+    ValueArg<int> haloDepthSwitchArg("","haloDepth","number of layers of halo sites each rank keeps of its neighbors (more than one implies --dimensionOrderedHalos; CPU only; multi-constant runs on several ranks keep at least two)", false, 1, "int",cmd);
+    SwitchArg communicationAvoidingSwitch("","communicationAvoiding","with --haloDepth k, also advance the halo sites and exchange them only every few FIRE steps, steering with global sums lagged by a step (CPU only, not with --sparseStorage)", cmd, false);
+    SwitchArg loadBalanceSwitch("","loadBalance","give every rank about the same number of liquid crystal (non-object) sites, by choosing unequal slabs of the lattice along each axis", cmd, false);
+    ValueArg<string> timingTraceSwitchArg("","timingTrace","with --timers, write a chrome://tracing file of every timed region call to this base name (plus _rankR.json)",false,"","string",cmd);
+    ValueArg<string> rankTopologySwitchArg("","rankTopology","ranks along x, y, and z (e.g. 4,2,2) instead of the default partition of the ranks; their product must be the number of ranks",false,"","string",cmd);
+    SwitchArg planMemorySwitch("","planMemory","print the predicted memory of every array on each rank, and settings that fit in --memoryPerRank, then exit without allocating the lattice (can be run on one rank with --planRanks)", cmd, false);
+    ValueArg<scalar> memoryPerRankSwitchArg("","memoryPerRank","memory available to each rank in GB (0 = the physical memory of the node divided among its ranks)",false,0,"scalar",cmd);
+    ValueArg<int> planRanksSwitchArg("","planRanks","with --planMemory, the number of ranks to plan for (0 = the ranks of this job)",false,0,"int",cmd);
+    ValueArg<scalar> planObjectFractionSwitchArg("","planObjectFraction","with --planMemory, the fraction of lattice sites inside boundary objects",false,0,"scalar",cmd);
+    ValueArg<string> planUpdaterSwitchArg("","planUpdater","with --planMemory, the updater to plan for (FIRE, gradientDescent, nesterovAG, loLBFGS, adam, relaxationalDynamics)",false,"FIRE","string",cmd);
 
 
     ValueArg<scalar> aSwitchArg("a","phaseConstantA","value of phase constant A",false,0.172,"scalar",cmd);
@@ -91,6 +118,10 @@ int main(int argc, char*argv[])
     ValueArg<int> linearSaveSwitchArg("","linearSpacedSaving","save a file every x minimization steps",false,-1,"int",cmd);
     ValueArg<scalar> logSaveSwitchArg("","logSpacedSaving","save a file every x^j for integer j",false,-1,"scalar",cmd);
     ValueArg<int> saveStrideSwitchArg("","stride","stride of the saved lattice sites",false,1,"int",cmd);
+    ValueArg<scalar> defectThresholdSwitchArg("","defectThreshold","whenever a state is saved, also save the clustered defects (sites whose largest Q eigenvalue is below this threshold)",false,-1,"scalar",cmd);
+    ValueArg<int> coarseGrainedSaveSwitchArg("","coarseGrainedSaving","whenever a state is saved, also save director and order-parameter fields averaged over blocks of this many sites per side",false,-1,"int",cmd);
+    ValueArg<string> slicesSwitchArg("","slices","whenever a state is saved, also save director and order-parameter fields on these lattice planes (e.g. z32,x10), averaged over blocks of coarseGrainedSaving sites within the plane",false,"NONE","string",cmd);
+    ValueArg<scalar> compressedSaveSwitchArg("","compressedSaving","save compressed binary snapshots (.oqs) instead of text files, with this maximum error per Q-tensor component (0 is lossless)",false,-1,"scalar",cmd);
 
     ValueArg<scalar> setHFieldXSwitchArg("","hFieldX", "x component of external H field",false,0,"scalar",cmd);
     ValueArg<scalar> setHFieldYSwitchArg("","hFieldY", "y component of external H field",false,0,"scalar",cmd);
@@ -116,6 +147,10 @@ int main(int argc, char*argv[])
     int saveStride = saveStrideSwitchArg.getValue();
     int linearSave = linearSaveSwitchArg.getValue();
     scalar logSave = logSaveSwitchArg.getValue();
+    scalar compressedSave = compressedSaveSwitchArg.getValue();
+    scalar defectThreshold = defectThresholdSwitchArg.getValue();
+    int coarseGrainedSave = coarseGrainedSaveSwitchArg.getValue();
+    string slices = slicesSwitchArg.getValue();
 
     int randomSeed = randomSeedSwitch.getValue();
     bool reproducible = reproducibleSwitch.getValue();
@@ -124,6 +159,7 @@ int main(int argc, char*argv[])
 
     bool verbose= verboseSwitch.getValue();
     int gpu = gpuSwitchArg.getValue();
+    int nThreads = threadsSwitchArg.getValue();
     int initializationSwitch = initializationSwitchArg.getValue();
     int nDev;
     cudaGetDeviceCount(&nDev);
@@ -161,10 +197,84 @@ int main(int argc, char*argv[])
     else if (gpu >=0)
             GPU = chooseGPU(gpu);
 
-    int3 rankTopology = partitionProcessors(worldSize);
-    if(myRank ==0 && worldSize > 1)
+    bool planMemory = planMemorySwitch.getValue();
+    int plannedRanks = (planMemory && planRanksSwitchArg.getValue() > 0) ? planRanksSwitchArg.getValue() : worldSize;
+    int3 rankTopology = partitionProcessors(plannedRanks);
+    if(rankTopologySwitchArg.getValue() != "")
+        {
+        if(sscanf(rankTopologySwitchArg.getValue().c_str(),"%i,%i,%i",&rankTopology.x,&rankTopology.y,&rankTopology.z) != 3)
+            {
+            if(myRank == 0) printf("--rankTopology needs three comma-separated integers\n");
+            MPI_Finalize();
+            return 1;
+            };
+        if(planMemory && planRanksSwitchArg.getValue() <= 0)
+            plannedRanks = rankTopology.x*rankTopology.y*rankTopology.z;
+        if(rankTopology.x < 1 || rankTopology.y < 1 || rankTopology.z < 1 || rankTopology.x*rankTopology.y*rankTopology.z != plannedRanks)
+            {
+            if(myRank == 0) printf("a rank topology of (%i,%i,%i) does not match %i ranks\n",rankTopology.x,rankTopology.y,rankTopology.z,plannedRanks);
+            MPI_Finalize();
+            return 1;
+            };
+        };
+    //sparse storage keeps nothing for the halo sites that communication-avoiding updates advance
+    if(sparseStorageSwitch.getValue() && communicationAvoidingSwitch.getValue())
+        {
+        if(myRank == 0) printf("--sparseStorage cannot be combined with --communicationAvoiding\n");
+        MPI_Finalize();
+        return 1;
+        };
+    //multi-constant forces next to the halo read the first derivatives of the first halo layer, which needs a second
+    int haloDepth = max(1,haloDepthSwitchArg.getValue());
+    if(nConstants > 1 && plannedRanks > 1 && haloDepth < 2)
+        {
+        if(GPU)
+            {
+            if(myRank == 0) printf("multi-constant runs on several ranks need two layers of halo sites, which are only implemented on the CPU\n");
+            MPI_Finalize();
+            return 1;
+            };
+        haloDepth = 2;
+        if(myRank == 0 && verbose) printf("keeping two layers of halo sites for the multi-constant derivatives\n");
+        };
+    if(myRank ==0 && worldSize > 1 && !planMemory)
             printf("lattice divisions: {%i, %i, %i}\n",rankTopology.x,rankTopology.y,rankTopology.z);
 
+    //predict the memory each rank will allocate, before allocating anything
+    {
+    plannedRun plan;
+    plan.globalLatticeSites = make_int3(rankTopology.x*boxLx,rankTopology.y*boxLy,rankTopology.z*boxLz);
+    plan.rankTopology = rankTopology;
+    plan.nConstants = nConstants;
+    plan.updater = memoryPlanner::updaterFromName(planUpdaterSwitchArg.getValue());
+    plan.objectFraction = planObjectFractionSwitchArg.getValue();
+    plan.sparseStorage = sparseStorageSwitch.getValue();
+    plan.sharedMemoryHalos = sharedMemoryHalosSwitch.getValue();
+    plan.dimensionOrderedHalos = dimensionOrderedHalosSwitch.getValue() || cartesianRanksSwitch.getValue() || plan.sharedMemoryHalos;
+    plan.haloDepth = haloDepth;
+    plan.communicationAvoiding = communicationAvoidingSwitch.getValue() && plan.haloDepth > 1;
+    plan.spatiallyVaryingField = fieldFileSwitchArg.getValue() != "NONE";
+    int ranksOnNode;
+    MPI_Comm_size(shmcomm,&ranksOnNode);
+    //when planning for another job, guess one rank per core of this node
+    if(plannedRanks != worldSize)
+        ranksOnNode = min(plannedRanks,(int)sysconf(_SC_NPROCESSORS_ONLN));
+    double budget = memoryPerRankSwitchArg.getValue() > 0 ? 1e9*memoryPerRankSwitchArg.getValue() : memoryPlanner::nodeMemoryPerRank(ranksOnNode);
+    memoryPlanner planner(plan,budget);
+    if(planMemory)
+        {
+        if(myRank == 0)
+            planner.report(max(4096,plannedRanks));
+        MPI_Finalize();
+        return 0;
+        };
+    if(myRank == 0 && planner.bytesPerRank(plan) > budget)
+        {
+        printf("warning: the run is predicted to need more memory than each rank has\n");
+        planner.report(max(4096,worldSize));
+        };
+    }
+
     scalar a = -1;
     scalar b = -phaseB/phaseA;
     scalar c = phaseC/phaseA;
@@ -173,7 +283,18 @@ int main(int argc, char*argv[])
         noise.setReproducibleSeed(13371+myRank);
     else
         noise.setReproducibleSeed(randomSeed+myRank);
-
+    //counter-based random fields are keyed by global lattice sites, and need the same seed on every rank
+    unsigned int counterSeed = (randomSeed == -1) ? 13371 : randomSeed;
+    if(!reproducible)
+        counterSeed = noise.counterSeed;
+    MPI_Bcast(&counterSeed,1,MPI_UNSIGNED,0,MPI_COMM_WORLD);
+    noise.setCounterSeed(counterSeed);
+
+    //turn the timers on before any threads are created, so that hardware counters include them
+    if(timersSwitch.getValue() || hardwareCountersSwitch.getValue() || timingTraceSwitchArg.getValue() != "")
+        regionTimers.enable(hardwareCountersSwitch.getValue(),timingTraceSwitchArg.getValue());
+    //let the threads that will work on the lattice arrays be the first to touch them
+    setGPUArrayFirstTouchThreads(nThreads);
     if(verbose) printf("setting a rectilinear lattice of size (%i,%i,%i)\n",boxLx,boxLy,boxLz);
     profiler pInit("initialization");
     pInit.start();
@@ -183,10 +304,58 @@ int main(int argc, char*argv[])
     bool edges = ((rankTopology.y >1) && nConstants > 1) ? true : false;
     bool corners = ((rankTopology.z >1) && nConstants > 1) ? true : false;
     bool neverGPU = !GPU;
+    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
+
+    //boundary objects, from the boundary file and from the header below
+    auto addObjects = [&](shared_ptr<multirankSimulation> sim)
+        {
+        if(boundaryFile == "NONE")
+            {
+            if(myRank ==0 && verbose )
+                cout << "not using any custom boundary conditions" << endl;
+            }
+        else
+            {
+            sim->createBoundaryFromFile(boundaryFile,true);
+            }
+
+        /*
+        If you would like to add certain types of pre-defined objects to the simulation, you can insert them here
+        (before the "finalizeObjects()" call below. You can also change the indicated header file and recompile
+        the code, if you prefer. That header file contains (possibly) helpful examples to follow. Object positions
+        are global lattice coordinates; boxLx, boxLy, and boxLz are the sizes of the equal blocks of the ranks
+        */
+#include "addObjectsToOpenQmin.h"
+        };
+
+    //the size of the block of the lattice controlled by this rank
+    int3 localLatticeSites = make_int3(boxLx,boxLy,boxLz);
+    if(loadBalanceSwitch.getValue() && worldSize > 1)
+        {
+        //place the objects on equal blocks first, and use them to choose slabs with equal amounts of liquid crystal
+        shared_ptr<multirankQTensorLatticeModel> probeConfiguration = make_shared<multirankQTensorLatticeModel>(boxLx,boxLy,boxLz,xH,yH,zH,false,true);
+        shared_ptr<multirankSimulation> probe = make_shared<multirankSimulation>(myRank,rankTopology.x,rankTopology.y,rankTopology.z,edges,corners);
+        //the slab widths are chosen for grid positions, so the probe must place the ranks as the simulation will
+        if(cartesianRanksSwitch.getValue())
+            probe->setCartesianTopology(true,false);
+        probe->setConfiguration(probeConfiguration);
+        addObjects(probe);
+        localLatticeSites = probe->loadBalancedLatticeSites(2,verbose);
+        }
 
-    shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(boxLx,boxLy,boxLz,xH,yH,zH,false,neverGPU);
+    shared_ptr<multirankQTensorLatticeModel> Configuration = make_shared<multirankQTensorLatticeModel>(localLatticeSites.x,localLatticeSites.y,localLatticeSites.z,xH,yH,zH,false,neverGPU);
     shared_ptr<multirankSimulation> sim = make_shared<multirankSimulation>(myRank,rankTopology.x,rankTopology.y,rankTopology.z,edges,corners);
     shared_ptr<landauDeGennesLC> landauLCForce = make_shared<landauDeGennesLC>(neverGPU);
+    if(cartesianRanksSwitch.getValue())
+        sim->setCartesianTopology(true,verbose);
+    if(dimensionOrderedHalosSwitch.getValue())
+        sim->setDimensionOrderedHaloExchange(true);
+    if(sharedMemoryHalosSwitch.getValue())
+        sim->setSharedMemoryHaloExchange(true);
+    if(siteBlockSwitchArg.getValue() > 0)
+        Configuration->setSiteBlockSize(siteBlockSwitchArg.getValue());
+    if(haloDepth > 1)
+        Configuration->setHaloDepth(haloDepth);
     sim->setConfiguration(Configuration);
     pInit.end();
 
@@ -202,6 +371,8 @@ int main(int argc, char*argv[])
         {
         landauLCForce->setElasticConstants(L1,L2,L3,L4,L6);
         landauLCForce->setNumberOfConstants(distortionEnergyType::multiConstant);
+        int tile = max(0,forceTileSwitchArg.getValue());
+        landauLCForce->setForceTiling(forceTileSwitchArg.getValue() >= 0,make_int3(tile,tile,tile));
         }
 
     scalar3 fieldH,fieldE; //direction and magnitude
@@ -249,34 +420,71 @@ int main(int argc, char*argv[])
     scalar alphaDec=0.9; int nMin=4;scalar alphaMin = .0;
     Fminimizer->setFIREParameters(dt,alphaStart,deltaTMax,deltaTInc,deltaTDec,alphaDec,nMin,forceCutoff,alphaMin);
     sim->addUpdater(Fminimizer,Configuration);
+    if(communicationAvoidingSwitch.getValue())
+        sim->setCommunicationAvoidingUpdates(true);
 
     sim->setCPUOperation(true);//have cpu and gpu initialized the same...for debugging
     /*
     The following header file includes various common ways you might want to set the inital state of the lattice of Qtensors. 
     It is controlled by the "initializationSwitch" command line option (-z integer); by default (-z 0) the lattice will be set to a different random Q-tensor at every lattice site (with uniform s0)
     */
-    scalar S0 = (-b+sqrt(b*b-24*a*c))/(6*c);
 #include "setInitialConditions.h"
     sim->setCPUOperation(!GPU);
+    sim->setNThreads(nThreads);
+    if(tuningCacheSwitchArg.getValue() != "")
+        tuningCache.open(tuningCacheSwitchArg.getValue());
+    if(autotuneSwitch.getValue() && !GPU)
+        landauLCForce->setCPUAutotuning(true);
+    if(reproducibleSumsSwitch.getValue())
+        sim->setSummationMode(reductionService::reproducibleSummation);
     if(verbose) printf("initialization done\n");
 
-    if(boundaryFile == "NONE")
+    if(sparseStorageSwitch.getValue())
+        Configuration->setSparseStorage(true);
+    if(orthonormalBasisSwitch.getValue())
+        Configuration->setOrthonormalBasis(true);
+    addObjects(sim);
+    sim->finalizeObjects();
+
+    //save either text files or compressed binary snapshots, depending on the command line, and optionally the defects
+    shared_ptr<defectTracker> defects;
+    if(defectThreshold > 0)
+        defects = make_shared<defectTracker>(sim,defectThreshold);
+    shared_ptr<coarseGrainedOutput> coarseGrained;
+    vector<int2> slicePlanes;//(axis, plane) pairs
+    if(coarseGrainedSave > 0 || slices != "NONE")
+        coarseGrained = make_shared<coarseGrainedOutput>(sim,max(coarseGrainedSave,1));
+    if(slices != "NONE")
         {
-        if(myRank ==0 && verbose )
-            cout << "not using any custom boundary conditions" << endl;
+        stringstream sliceList(slices);
+        string slice;
+        while(getline(sliceList,slice,','))
+            {
+            int axis = slice[0]-'x';
+            if(slice.size() < 2 || axis < 0 || axis > 2)
+                {
+                printf("could not parse slice \"%s\"; slices should look like x10,z32\n",slice.c_str());
+                throw std::exception();
+                }
+            slicePlanes.push_back(make_int2(axis,atoi(slice.c_str()+1)));
+            };
         }
-    else
+    auto saveConfiguration = [&](string fileName)
         {
-        sim->createBoundaryFromFile(boundaryFile,true);
-        }
-
-    /*
-    If you would like to add certain types of pre-defined objects to the simulation, you can insert them here
-    (before the "finalizeObjects()" call below. You can also change the indicated header file and recompile
-    the code, if you prefer. That header file contains (possibly) helpful examples to follow
-    */
-#include "addObjectsToOpenQmin.h"
-    sim->finalizeObjects();
+        if(compressedSave >= 0)
+            sim->saveStateCompressed(fileName,16,compressedSave);
+        else
+            sim->saveState(fileName,saveStride);
+        if(defects)
+            defects->saveDefects(fileName);
+        if(coarseGrainedSave > 0)
+            coarseGrained->saveDownsampled(fileName+"_coarse.oqcg");
+        for (int ss = 0; ss < slicePlanes.size(); ++ss)
+            {
+            string sliceName = fileName+"_slice_"+string(1,(char)('x'+slicePlanes[ss].x))+to_string(slicePlanes[ss].y)+".oqcg";
+            coarseGrained->saveSlice(sliceName,slicePlanes[ss].x,slicePlanes[ss].y);
+            };
+        };
 
     profiler pMinimize("minimization");
     pMinimize.start();
@@ -295,7 +503,7 @@ int main(int argc, char*argv[])
             //save the current state, then minimize more
             string newSaveFile = saveFile+saveFileAppend+std::to_string(currentIteration);
             if(saveFile != "NONE")
-                sim->saveState(newSaveFile,saveStride);
+                saveConfiguration(newSaveFile);
             currentIteration += linearSave;
             Fminimizer->setMaximumIterations(currentIteration);
             sim->performTimestep();
@@ -313,7 +521,7 @@ int main(int argc, char*argv[])
             //save the current state, then minimize more
             string newSaveFile = saveFile+saveFileAppend+std::to_string(currentIteration);
             if(saveFile != "NONE")
-                sim->saveState(newSaveFile,saveStride);
+                saveConfiguration(newSaveFile);
             lsi.update();
             currentIteration =lsi.nextSave;
             Fminimizer->setMaximumIterations(currentIteration);
@@ -334,7 +542,7 @@ int main(int argc, char*argv[])
     if(verbose) pMinimize.print();
     if(verbose) sim->p1.print();
     if(saveFile != "NONE")
-        sim->saveState(saveFile,saveStride);
+        saveConfiguration(saveFile);
     scalar totalMinTime = pMinimize.timeTaken;
     scalar communicationTime = sim->p1.timeTaken;
     if(myRank == 0 && verbose)
@@ -353,6 +561,8 @@ int main(int argc, char*argv[])
     tempF <<averageN[0]<<", "<<averageN[1]<<", "<<averageN[2]<<"\n";
     tempF.close();
     */
+    if(regionTimers.enabled)
+        regionTimers.report();
     MPI_Finalize();
     return 0;
     };
@@ -44,14 +44,8 @@ if(initializationSwitch ==0)
 if(initializationSwitch ==1)
     {
     if(verbose) printf("setting random uniform texture with S0 = %f\n",S0);
-    //to pick the same random direction across all ranks, we need to have a rng with the same seed everywhere... this is a bit of a hack, and needs to be nudged to allow this to work non-reproducibly
-    noiseSource multirankNoise(true);
-    if(randomSeed == -1)
-        multirankNoise.setReproducibleSeed(13371);
-    else
-        multirankNoise.setReproducibleSeed(randomSeed);
-
-    Configuration->setRandomDirectors(multirankNoise,S0, true);
+    //the counter-based generators share their seed across ranks, so every rank picks the same random direction
+    Configuration->setRandomDirectors(noise,S0, true);
     };
 
 //choose a specific director and S0 value, and set all Q tensors to it
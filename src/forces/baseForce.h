@@ -33,8 +33,21 @@ class force
         //! virtual function to allow the model to be a derived class
         virtual void setModel(shared_ptr<simpleModel> _model){model=_model;};
 
+        //!the force on a lattice site depends on the sites within this many lattice steps of it
+        virtual int stencilRadius(){return 1;};
+
         //!compute the energy associated with this force
         virtual scalar computeEnergy(bool verbose = false){return 0.;};
+        //!if true, computeEnergy also accumulates this rank's energy exactly, in exactEnergy
+        bool reproducibleEnergy = false;
+        //!the exactly accumulated energy of the last call to computeEnergy (when reproducibleEnergy is true)
+        reproducibleSum exactEnergy;
+
+        //!the force on each listed boundary object from the sites this rank controls (zero unless the force acts on objects)
+        virtual void computeObjectForces(vector<int> &objects, vector<scalar3> &objectForces)
+            {
+            objectForces.assign(objects.size(),make_scalar3(0.,0.,0.));
+            };
 
         //! compute the system-averaged pressure tensor; return identity if the force hasn't defined this yet
         virtual MatrixDxD computePressureTensor(){MatrixDxD temp; return temp;};
@@ -13,6 +13,9 @@ class baseLatticeForce : public force
         //!the call to compute forces, and store them in the referenced variable
         virtual void computeForces(GPUArray<dVec> &forces,bool zeroOutForce = true, int type = 0)
             {
+            //every site is handled in the first (type 0) pass
+            if(type != 0)
+                return;
             if(useGPU)
                 computeForceGPU(forces,zeroOutForce);
             else
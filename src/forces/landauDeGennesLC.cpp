@@ -2,6 +2,7 @@
 #include "landauDeGennesLC.cuh"
 #include "qTensorFunctions.h"
 #include "utilities.cuh"
+#include "regionTimers.h"
 /*! \file landauDeGennesLC.cpp */
 
 landauDeGennesLC::landauDeGennesLC(bool _neverGPU)
@@ -11,7 +12,6 @@ landauDeGennesLC::landauDeGennesLC(bool _neverGPU)
         {
         energyDensity.noGPU =true;
         energyDensityReduction.noGPU=true;
-        objectForceArray.noGPU = true;
         forceCalculationAssist.noGPU=true;
         energyPerParticle.noGPU = true;
         }
@@ -45,6 +45,7 @@ void landauDeGennesLC::baseInitialization()
     useNeighborList=false;
     computeEfieldContribution=false;
     computeHfieldContribution=false;
+    spatiallyVaryingFieldContribution=false;
     forceTuner = make_shared<kernelTuner>(128,256,32,10,200000);
     boundaryForceTuner = make_shared<kernelTuner>(128,256,32,10,200000);
     l24ForceTuner = make_shared<kernelTuner>(128,256,32,10,200000);
@@ -57,6 +58,7 @@ void landauDeGennesLC::setModel(shared_ptr<cubicLattice> _model)
     {
     lattice=_model;
     model = _model;
+    cpuForceTuner = NULL;
     if(numberOfConstants == distortionEnergyType::multiConstant)
         {
         lattice->fillNeighborLists(0);//fill neighbor lists to allow computing mixed partials
@@ -114,9 +116,11 @@ void landauDeGennesLC::setSpatiallyVaryingField(string fname, scalar chi, scalar
     sprintf(fn,"%s_x%iy%iz%i.txt",fname.c_str(),rankParity.x,rankParity.y,rankParity.z);
 
     printf("loading spatially varying field from file name %s...\n",fn);
-    int xOffset = rankParity.x*lattice->latticeSites.x;
-    int yOffset = rankParity.y*lattice->latticeSites.y;
-    int zOffset = rankParity.z*lattice->latticeSites.z;
+    //the global position of the rank's first site (rank blocks need not all have the same size)
+    int3 offset = lattice->globalLatticePosition(0);
+    int xOffset = offset.x;
+    int yOffset = offset.y;
+    int zOffset = offset.z;
     ArrayHandle<scalar3> hh(spatiallyVaryingField);
     ifstream myfile;
     myfile.open(fn);
@@ -144,14 +148,81 @@ void landauDeGennesLC::setSpatiallyVaryingField(string fname, scalar chi, scalar
 
 void landauDeGennesLC::computeForces(GPUArray<dVec> &forces,bool zeroOutForce, int type)
     {
+    scopedRegionTimer timer("landau-de Gennes forces");
+    if(useGPU && lattice->sparseStorage)
+        UNWRITTENCODE("sparse storage of lattice sites is only implemented on the CPU");
+    if(useGPU && lattice->orthonormalBasis)
+        UNWRITTENCODE("the orthonormal basis for forces is only implemented on the CPU");
     if(useGPU)
         computeForceGPU(forces,zeroOutForce);
+    else if(autotuneCPU)
+        {
+        //both passes use the configuration being sampled; the bulk pass, which does most of the work, is timed
+        if(!cpuForceTuner || cpuForceTunerSparseStorage != lattice->sparseStorage)
+            initializeCPUForceTuner();
+        int threads = nThreads;
+        bool tiled = tiledForces;
+        int3 tileSize = forceTileSize;
+        int2 configuration = cpuForceConfigurations[cpuForceTuner->getParameter()];
+        nThreads = configuration.x;
+        setForceTiling(configuration.y >= 0,make_int3(max(0,configuration.y),max(0,configuration.y),max(0,configuration.y)));
+        if(type == 0)
+            cpuForceTuner->begin();
+        computeForceCPU(forces,zeroOutForce,type);
+        if(type == 0)
+            cpuForceTuner->end();
+        nThreads = threads;
+        setForceTiling(tiled,tileSize);
+        }
     else
         computeForceCPU(forces,zeroOutForce,type);
 
-    correctForceFromMetric(forces);
+    //on the CPU the bulk (type 0) and boundary (type 1) passes accumulate into the same forces; correct the sum once
+    //(in the orthonormal basis every contribution was already transformed by the kernel that computed it)
+    if((useGPU || type != 0) && !lattice->orthonormalBasis)
+        correctForceFromMetric(forces);
     }
 
+/*!
+The number of threads is halved from the number set down to one; with more than one elastic constant and dense
+storage, each thread count is tried with whole-plane tiles, the untiled passes, and 32^3 and 16^3 tiles. The key in
+the tuning cache names the elastic constants in use, the storage, the sites of this model, and the number of threads.
+*/
+void landauDeGennesLC::initializeCPUForceTuner()
+    {
+    vector<int> tiles(1,0);
+    bool multiConstant = numberOfConstants == distortionEnergyType::multiConstant;
+    if(multiConstant && !lattice->sparseStorage)
+        {
+        tiles.push_back(-1);
+        tiles.push_back(32);
+        tiles.push_back(16);
+        };
+    cpuForceTunerSparseStorage = lattice->sparseStorage;
+    cpuForceConfigurations.clear();
+    vector<int> configurationIndices;
+    for (int threads = max(1,nThreads); threads >= 1; threads /= 2)
+        for (int tt = 0; tt < tiles.size(); ++tt)
+            {
+            configurationIndices.push_back(cpuForceConfigurations.size());
+            cpuForceConfigurations.push_back(make_int2(threads,tiles[tt]));
+            };
+    cpuForceTuner = make_shared<kernelTuner>(configurationIndices,5,200000);
+
+    stringstream key;
+    key << "landauDeGennesLC CPU forces, constants L1";
+    if(multiConstant)
+        {
+        if(L2 != 0) key << ",L2";
+        if(L3 != 0) key << ",L3";
+        if(L4 != 0) key << ",L4";
+        if(L6 != 0) key << ",L6";
+        };
+    key << (lattice->sparseStorage ? ", sparse" : ", dense") << ", sites " << lattice->latticeSites.x << "x"
+        << lattice->latticeSites.y << "x" << lattice->latticeSites.z << ", up to " << nThreads << " threads";
+    cpuForceTuner->setCacheKey(key.str());
+    };
+
 void landauDeGennesLC::correctForceFromMetric(GPUArray<dVec> &forces)
     {
     int N = lattice->getNumberOfParticles();
@@ -165,7 +236,8 @@ void landauDeGennesLC::correctForceFromMetric(GPUArray<dVec> &forces)
         ArrayHandle<dVec> h_force(forces,access_location::host,access_mode::readwrite);
         scalar QxxOld, QyyOld;
         scalar twoThirds = 2./3.;
-        for (int i = 0; i < N ; ++i)
+        int nDof = lattice->getNumberOfForceSites();
+        for (int i = 0; i < nDof ; ++i)
             {
             QxxOld = h_force.data[i][0];
             QyyOld = h_force.data[i][3];
@@ -233,11 +305,25 @@ void landauDeGennesLC::computeForceCPU(GPUArray<dVec> &forces,bool zeroOutForce,
         case distortionEnergyType::multiConstant :
             {
             bool zeroForce = zeroOutForce;
-            computeFirstDerivatives();
             if(type ==0)
-                computeAllDistortionTermsBulkCPU(forces,zeroForce);
+                {
+                if(tiledForces && !lattice->sparseStorage)
+                    computeAllDistortionTermsBulkTiledCPU(forces,zeroForce);
+                else
+                    {
+                    computeFirstDerivatives();
+                    computeAllDistortionTermsBulkCPU(forces,zeroForce);
+                    bulkPassComputedDerivatives = true;
+                    };
+                }
             if(type ==1)
+                {
+                //the bulk pass just before this one has computed the same derivatives
+                if(!bulkPassComputedDerivatives)
+                    computeFirstDerivatives();
+                bulkPassComputedDerivatives = false;
                 computeAllDistortionTermsBoundaryCPU(forces,zeroForce);
+                }
             break;
             };
         };
@@ -288,164 +374,194 @@ void landauDeGennesLC::computeEnergyGPU(bool verbose)
     int maxBlocks = 64;
     int maxThreads = 256;
     getNumBlocksAndThreads(N, maxBlocks, maxThreads, numBlocks, numThreads);
+    {
     ArrayHandle<scalar> energyPerSite(energyDensity,access_location::device,access_mode::read);
     ArrayHandle<scalar> energyPerSiteReduction(energyDensityReduction,access_location::device,access_mode::readwrite);
     energy = gpuReduction(N,numThreads,numBlocks,maxThreads,maxBlocks,energyPerSite.data,energyPerSiteReduction.data);
     }
+    if(reproducibleEnergy)
+        sumEnergyDensityExactly();
+    }
+
+/*!
+Accumulate the energy density of every site in exactEnergy, so that the total (and its sum over ranks) does not
+depend on the order in which the sites are visited
+*/
+void landauDeGennesLC::sumEnergyDensityExactly()
+    {
+    ArrayHandle<scalar> energyPerSite(energyDensity,access_location::host,access_mode::read);
+    exactEnergy.reset();
+    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+        exactEnergy.add(energyPerSite.data[i]);
+    }
+
+/*!
+The phase, field, anchoring, and distortion energy density at a liquid crystal site (of type <= 0), given its six
+neighbors; each term is also added to energyTerms (phase, distortion, anchoring, E field, H field)
+*/
+scalar landauDeGennesLC::siteEnergyDensity(int site, const int *neighbors, const dVec *Qtensors, const int *latticeTypes,
+                                          const boundaryObject *bounds, const scalar3 *externalField, scalar *energyTerms)
+    {
+    scalar a = 0.5*A;
+    scalar b = B/3.0;
+    scalar c = 0.25*C;
+    scalar energyAtSite = 0.0;
+    dVec qCurrent = Qtensors[site];
+    dVec xDown, xUp, yDown,yUp,zDown,zUp;
+    scalar phaseAtSite = a*TrQ2(qCurrent) + b*TrQ3(qCurrent) + c* TrQ2Squared(qCurrent);
+    energyAtSite += phaseAtSite;
+    energyTerms[0] += phaseAtSite;
+
+    if(computeEfieldContribution)
+        {
+            scalar eFieldAtSite = epsilon0*(-0.5*Efield.x*Efield.x*(epsilon + deltaEpsilon*qCurrent[0]) -
+                      deltaEpsilon*Efield.x*Efield.y*qCurrent[1] - deltaEpsilon*Efield.x*Efield.z*qCurrent[2] -
+                      0.5*Efield.z*Efield.z*(epsilon - deltaEpsilon*qCurrent[0] - deltaEpsilon*qCurrent[3]) -
+                      0.5*Efield.y*Efield.y*(epsilon + deltaEpsilon*qCurrent[3]) - deltaEpsilon*Efield.y*Efield.z*qCurrent[4]);
+            energyTerms[3]+=eFieldAtSite;
+            energyAtSite +=eFieldAtSite;
+        }
+    if(computeHfieldContribution)
+        {
+            scalar hFieldAtSite=mu0*(-0.5*Hfield.x*Hfield.x*(Chi + deltaChi*qCurrent[0]) -
+                      deltaChi*Hfield.x*Hfield.y*qCurrent[1] - deltaChi*Hfield.x*Hfield.z*qCurrent[2] -
+                      0.5*Hfield.z*Hfield.z*(Chi - deltaChi*qCurrent[0] - deltaChi*qCurrent[3]) -
+                      0.5*Hfield.y*Hfield.y*(Chi + deltaChi*qCurrent[3]) - deltaChi*Hfield.y*Hfield.z*qCurrent[4]);
+            energyTerms[4]+=hFieldAtSite;
+            energyAtSite +=hFieldAtSite;
+        }
+    if(spatiallyVaryingFieldContribution)
+        {
+            scalar3 field = externalField[site];
+            scalar hFieldAtSite=mu0*(-0.5*field.x*field.x*(Chi + deltaChi*qCurrent[0]) -
+                      deltaChi*field.x*field.y*qCurrent[1] - deltaChi*field.x*field.z*qCurrent[2] -
+                      0.5*field.z*field.z*(Chi - deltaChi*qCurrent[0] - deltaChi*qCurrent[3]) -
+                      0.5*field.y*field.y*(Chi + deltaChi*qCurrent[3]) - deltaChi*field.y*field.z*qCurrent[4]);
+            energyTerms[4]+=hFieldAtSite;
+            energyAtSite +=hFieldAtSite;
+        }
+    xDown = Qtensors[neighbors[0]];
+    xUp = Qtensors[neighbors[1]];
+    yDown = Qtensors[neighbors[2]];
+    yUp = Qtensors[neighbors[3]];
+    zDown = Qtensors[neighbors[4]];
+    zUp = Qtensors[neighbors[5]];
+
+    dVec firstDerivativeX = 0.5*(xUp - xDown);
+    dVec firstDerivativeY = 0.5*(yUp - yDown);
+    dVec firstDerivativeZ = 0.5*(zUp - zDown);
+    scalar anchoringEnergyAtSite = 0.0;
+    if(latticeTypes[site] <0)
+        {
+        if(latticeTypes[neighbors[0]]>0)
+            {
+            anchoringEnergyAtSite+= computeBoundaryEnergy(qCurrent, xDown, bounds[latticeTypes[neighbors[0]]-1]);
+            firstDerivativeX = xUp - qCurrent;
+            }
+        if(latticeTypes[neighbors[1]]>0)
+            {
+            anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, xUp, bounds[latticeTypes[neighbors[1]]-1]);
+            firstDerivativeX = qCurrent - xDown;
+            }
+        if(latticeTypes[neighbors[2]]>0)
+            {
+            anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, yDown, bounds[latticeTypes[neighbors[2]]-1]);
+            firstDerivativeY = yUp - qCurrent;
+            }
+        if(latticeTypes[neighbors[3]]>0)
+            {
+            anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, yUp, bounds[latticeTypes[neighbors[3]]-1]);
+            firstDerivativeY = qCurrent - yDown;
+            }
+        if(latticeTypes[neighbors[4]]>0)
+            {
+            anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, zDown, bounds[latticeTypes[neighbors[4]]-1]);
+            firstDerivativeZ = zUp - qCurrent;
+            }
+        if(latticeTypes[neighbors[5]]>0)
+            {
+            anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, zUp, bounds[latticeTypes[neighbors[5]]-1]);
+            firstDerivativeZ = qCurrent - zDown;
+            }
+        energyTerms[2] += anchoringEnergyAtSite;
+        energyAtSite +=anchoringEnergyAtSite;
+        }
+    scalar distortionEnergyAtSite=0.0;
+    if(L1 !=0 )
+		{
+		distortionEnergyAtSite+=L1*(firstDerivativeX[0]*firstDerivativeX[3] + firstDerivativeY[0]*firstDerivativeY[3] + firstDerivativeZ[0]*firstDerivativeZ[3] + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeX[3]*firstDerivativeX[3] + firstDerivativeX[4]*firstDerivativeX[4] + firstDerivativeY[0]*firstDerivativeY[0]
+                                + firstDerivativeY[1]*firstDerivativeY[1] + firstDerivativeY[2]*firstDerivativeY[2] + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4] + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[1]*firstDerivativeZ[1] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]);
+		};
+	if(L2 !=0 )
+		{
+		distortionEnergyAtSite+=(L2*(2*firstDerivativeX[2]*firstDerivativeY[4] - 2*firstDerivativeX[2]*firstDerivativeZ[0] - 2*firstDerivativeY[4]*firstDerivativeZ[0] + 2*firstDerivativeY[1]*firstDerivativeZ[2] + 2*firstDerivativeX[0]*(firstDerivativeY[1] + firstDerivativeZ[2]) - 2*firstDerivativeX[2]*firstDerivativeZ[3] - 2*firstDerivativeY[4]*firstDerivativeZ[3] + 2*firstDerivativeZ[0]*firstDerivativeZ[3]
+                                + 2*firstDerivativeY[3]*firstDerivativeZ[4] + 2*firstDerivativeX[1]*(firstDerivativeY[3] + firstDerivativeZ[4]) + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeY[1]*firstDerivativeY[1] + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4]
+                                + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]))/2.;
+		};
+	if(L3 !=0 )
+		{
+		distortionEnergyAtSite+=(L3*(2*firstDerivativeX[1]*firstDerivativeY[0] + 2*firstDerivativeX[3]*firstDerivativeY[1] + 2*firstDerivativeX[4]*firstDerivativeY[2] + 2*firstDerivativeX[2]*firstDerivativeZ[0] + 2*firstDerivativeX[4]*firstDerivativeZ[1] + 2*firstDerivativeY[2]*firstDerivativeZ[1] - 2*firstDerivativeX[0]*firstDerivativeZ[2] - 2*firstDerivativeX[3]*firstDerivativeZ[2]
+                                + 2*firstDerivativeY[4]*firstDerivativeZ[3] + 2*firstDerivativeZ[0]*firstDerivativeZ[3] - 2*firstDerivativeY[0]*firstDerivativeZ[4] - 2*firstDerivativeY[3]*firstDerivativeZ[4] + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeY[1]*firstDerivativeY[1]
+                                + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4] + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]))/2.;
+		};
+	if(L4 !=0 )
+		{
+		distortionEnergyAtSite+=(L4*(-(firstDerivativeY[4]*qCurrent[0]) + firstDerivativeZ[4]*qCurrent[0] + firstDerivativeX[2]*qCurrent[1] - firstDerivativeY[4]*qCurrent[1] - firstDerivativeZ[2]*qCurrent[1] + firstDerivativeZ[4]*qCurrent[1] - firstDerivativeY[4]*qCurrent[2] + firstDerivativeZ[4]*qCurrent[2] + firstDerivativeX[2]*qCurrent[3] - firstDerivativeZ[2]*qCurrent[3]
+                                + firstDerivativeX[1]*(qCurrent[0] - qCurrent[2] + qCurrent[3] - qCurrent[4]) + firstDerivativeX[2]*qCurrent[4] - firstDerivativeZ[2]*qCurrent[4] + firstDerivativeY[1]*(-qCurrent[0] + qCurrent[2] - qCurrent[3] + qCurrent[4])))/2.;
+		};
+	if(L6 !=0 )
+		{
+		distortionEnergyAtSite+=L6*(-(firstDerivativeZ[0]*firstDerivativeZ[3]*qCurrent[0]) + firstDerivativeX[0]*firstDerivativeX[0]*qCurrent[0] + firstDerivativeX[1]*firstDerivativeX[1]*qCurrent[0] + firstDerivativeX[2]*firstDerivativeX[2]*qCurrent[0] + firstDerivativeX[3]*firstDerivativeX[3]*qCurrent[0] + firstDerivativeX[4]*firstDerivativeX[4]*qCurrent[0]
+                                - firstDerivativeZ[0]*firstDerivativeZ[0]*qCurrent[0] - firstDerivativeZ[1]*firstDerivativeZ[1]*qCurrent[0] - firstDerivativeZ[2]*firstDerivativeZ[2]*qCurrent[0] - firstDerivativeZ[3]*firstDerivativeZ[3]*qCurrent[0] - firstDerivativeZ[4]*firstDerivativeZ[4]*qCurrent[0] + firstDerivativeX[3]*firstDerivativeY[0]*qCurrent[1]
+                                + 2*firstDerivativeX[2]*firstDerivativeY[2]*qCurrent[1] + 2*firstDerivativeX[3]*firstDerivativeY[3]*qCurrent[1] + 2*firstDerivativeX[4]*firstDerivativeY[4]*qCurrent[1] + firstDerivativeX[3]*firstDerivativeZ[0]*qCurrent[2] + 2*firstDerivativeX[2]*firstDerivativeZ[2]*qCurrent[2] + 2*firstDerivativeX[3]*firstDerivativeZ[3]*qCurrent[2]
+                                + 2*firstDerivativeX[4]*firstDerivativeZ[4]*qCurrent[2] + 2*firstDerivativeX[1]*(firstDerivativeY[1]*qCurrent[1] + firstDerivativeZ[1]*qCurrent[2]) + firstDerivativeX[0]*(firstDerivativeX[3]*qCurrent[0] + 2*firstDerivativeY[0]*qCurrent[1] + firstDerivativeY[3]*qCurrent[1] + 2*firstDerivativeZ[0]*qCurrent[2] + firstDerivativeZ[3]*qCurrent[2])
+                                + firstDerivativeY[0]*firstDerivativeY[3]*qCurrent[3] - firstDerivativeZ[0]*firstDerivativeZ[3]*qCurrent[3] + firstDerivativeY[0]*firstDerivativeY[0]*qCurrent[3] + firstDerivativeY[1]*firstDerivativeY[1]*qCurrent[3] + firstDerivativeY[2]*firstDerivativeY[2]*qCurrent[3] + firstDerivativeY[3]*firstDerivativeY[3]*qCurrent[3]
+                                + firstDerivativeY[4]*firstDerivativeY[4]*qCurrent[3] - firstDerivativeZ[0]*firstDerivativeZ[0]*qCurrent[3] - firstDerivativeZ[1]*firstDerivativeZ[1]*qCurrent[3] - firstDerivativeZ[2]*firstDerivativeZ[2]*qCurrent[3] - firstDerivativeZ[3]*firstDerivativeZ[3]*qCurrent[3] - firstDerivativeZ[4]*firstDerivativeZ[4]*qCurrent[3]
+                                + 2*firstDerivativeY[0]*firstDerivativeZ[0]*qCurrent[4] + firstDerivativeY[3]*firstDerivativeZ[0]*qCurrent[4] + 2*firstDerivativeY[1]*firstDerivativeZ[1]*qCurrent[4] + 2*firstDerivativeY[2]*firstDerivativeZ[2]*qCurrent[4] + firstDerivativeY[0]*firstDerivativeZ[3]*qCurrent[4] + 2*firstDerivativeY[3]*firstDerivativeZ[3]*qCurrent[4] + 2*firstDerivativeY[4]*firstDerivativeZ[4]*qCurrent[4]);
+		};
+
+    energyTerms[1] +=distortionEnergyAtSite;
+    energyAtSite +=distortionEnergyAtSite;
+    return energyAtSite;
+    };
 
 void landauDeGennesLC::computeEnergyCPU(bool verbose)
     {
-    scalar phaseEnergy = 0.0;
-    scalar distortionEnergy = 0.0;
-    scalar anchoringEnergy = 0.0;
-    scalar eFieldEnergy = 0.0;
-    scalar hFieldEnergy = 0.0;
+    scalar energyTerms[5] = {0.0,0.0,0.0,0.0,0.0};
     energy=0.0;
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
     ArrayHandle<boundaryObject> bounds(lattice->boundaries);
     ArrayHandle<scalar> energyPerSite(energyDensity);
     ArrayHandle<scalar3> externalField(spatiallyVaryingField);
-    scalar a = 0.5*A;
-    scalar b = B/3.0;
-    scalar c = 0.25*C;
     int LCSites = 0;
+    //the current scheme for getting the six nearest neighbors
+    int neighNum;
+    vector<int> neighbors(6);
     for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
         {
         energyPerSite.data[i] = 0.0;
-        //the current scheme for getting the six nearest neighbors
-        int neighNum;
-        vector<int> neighbors(6);
-        int currentIndex;
-        dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
-        currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
-        qCurrent = Qtensors.data[currentIndex];
+        int currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
         if(latticeTypes.data[currentIndex] <=0)
             {
             LCSites +=1;
-            scalar phaseAtSite = a*TrQ2(qCurrent) + b*TrQ3(qCurrent) + c* TrQ2Squared(qCurrent);
-            energyPerSite.data[i] += phaseAtSite;
-            phaseEnergy += phaseAtSite;
-
-            if(computeEfieldContribution)
-                {
-                    scalar eFieldAtSite = epsilon0*(-0.5*Efield.x*Efield.x*(epsilon + deltaEpsilon*qCurrent[0]) -
-                              deltaEpsilon*Efield.x*Efield.y*qCurrent[1] - deltaEpsilon*Efield.x*Efield.z*qCurrent[2] -
-                              0.5*Efield.z*Efield.z*(epsilon - deltaEpsilon*qCurrent[0] - deltaEpsilon*qCurrent[3]) -
-                              0.5*Efield.y*Efield.y*(epsilon + deltaEpsilon*qCurrent[3]) - deltaEpsilon*Efield.y*Efield.z*qCurrent[4]);
-                    eFieldEnergy+=eFieldAtSite;
-                    energyPerSite.data[i] +=eFieldAtSite;
-                }
-            if(computeHfieldContribution)
-                {
-                    scalar hFieldAtSite=mu0*(-0.5*Hfield.x*Hfield.x*(Chi + deltaChi*qCurrent[0]) -
-                              deltaChi*Hfield.x*Hfield.y*qCurrent[1] - deltaChi*Hfield.x*Hfield.z*qCurrent[2] -
-                              0.5*Hfield.z*Hfield.z*(Chi - deltaChi*qCurrent[0] - deltaChi*qCurrent[3]) -
-                              0.5*Hfield.y*Hfield.y*(Chi + deltaChi*qCurrent[3]) - deltaChi*Hfield.y*Hfield.z*qCurrent[4]);
-                    hFieldEnergy+=hFieldAtSite;
-                    energyPerSite.data[i] +=hFieldAtSite;
-                }
-            if(spatiallyVaryingFieldContribution)
-                {
-                    scalar3 field = externalField.data[currentIndex];
-                    scalar hFieldAtSite=mu0*(-0.5*field.x*field.x*(Chi + deltaChi*qCurrent[0]) -
-                              deltaChi*field.x*field.y*qCurrent[1] - deltaChi*field.x*field.z*qCurrent[2] -
-                              0.5*field.z*field.z*(Chi - deltaChi*qCurrent[0] - deltaChi*qCurrent[3]) -
-                              0.5*field.y*field.y*(Chi + deltaChi*qCurrent[3]) - deltaChi*field.y*field.z*qCurrent[4]);
-                    hFieldEnergy+=hFieldAtSite;
-                    energyPerSite.data[i] +=hFieldAtSite;
-                }
-            xDown = Qtensors.data[neighbors[0]];
-            xUp = Qtensors.data[neighbors[1]];
-            yDown = Qtensors.data[neighbors[2]];
-            yUp = Qtensors.data[neighbors[3]];
-            zDown = Qtensors.data[neighbors[4]];
-            zUp = Qtensors.data[neighbors[5]];
-
-            dVec firstDerivativeX = 0.5*(xUp - xDown);
-            dVec firstDerivativeY = 0.5*(yUp - yDown);
-            dVec firstDerivativeZ = 0.5*(zUp - zDown);
-            scalar anchoringEnergyAtSite = 0.0;
-            if(latticeTypes.data[currentIndex] <0)
-                {
-                if(latticeTypes.data[neighbors[0]]>0)
-                    {
-                    anchoringEnergyAtSite+= computeBoundaryEnergy(qCurrent, xDown, bounds.data[latticeTypes.data[neighbors[0]]-1]);
-                    firstDerivativeX = xUp - qCurrent;
-                    }
-                if(latticeTypes.data[neighbors[1]]>0)
-                    {
-                    anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, xUp, bounds.data[latticeTypes.data[neighbors[1]]-1]);
-                    firstDerivativeX = qCurrent - xDown;
-                    }
-                if(latticeTypes.data[neighbors[2]]>0)
-                    {
-                    anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, yDown, bounds.data[latticeTypes.data[neighbors[2]]-1]);
-                    firstDerivativeY = yUp - qCurrent;
-                    }
-                if(latticeTypes.data[neighbors[3]]>0)
-                    {
-                    anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, yUp, bounds.data[latticeTypes.data[neighbors[3]]-1]);
-                    firstDerivativeY = qCurrent - yDown;
-                    }
-                if(latticeTypes.data[neighbors[4]]>0)
-                    {
-                    anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, zDown, bounds.data[latticeTypes.data[neighbors[4]]-1]);
-                    firstDerivativeZ = zUp - qCurrent;
-                    }
-                if(latticeTypes.data[neighbors[5]]>0)
-                    {
-                    anchoringEnergyAtSite += computeBoundaryEnergy(qCurrent, zUp, bounds.data[latticeTypes.data[neighbors[5]]-1]);
-                    firstDerivativeZ = qCurrent - zDown;
-                    }
-                anchoringEnergy += anchoringEnergyAtSite;
-                energyPerSite.data[i] +=anchoringEnergyAtSite;
-                }
-            scalar distortionEnergyAtSite=0.0;
-            if(L1 !=0 )
-        		{
-        		distortionEnergyAtSite+=L1*(firstDerivativeX[0]*firstDerivativeX[3] + firstDerivativeY[0]*firstDerivativeY[3] + firstDerivativeZ[0]*firstDerivativeZ[3] + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeX[3]*firstDerivativeX[3] + firstDerivativeX[4]*firstDerivativeX[4] + firstDerivativeY[0]*firstDerivativeY[0]
-                                        + firstDerivativeY[1]*firstDerivativeY[1] + firstDerivativeY[2]*firstDerivativeY[2] + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4] + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[1]*firstDerivativeZ[1] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]);
-        		};
-        	if(L2 !=0 )
-        		{
-        		distortionEnergyAtSite+=(L2*(2*firstDerivativeX[2]*firstDerivativeY[4] - 2*firstDerivativeX[2]*firstDerivativeZ[0] - 2*firstDerivativeY[4]*firstDerivativeZ[0] + 2*firstDerivativeY[1]*firstDerivativeZ[2] + 2*firstDerivativeX[0]*(firstDerivativeY[1] + firstDerivativeZ[2]) - 2*firstDerivativeX[2]*firstDerivativeZ[3] - 2*firstDerivativeY[4]*firstDerivativeZ[3] + 2*firstDerivativeZ[0]*firstDerivativeZ[3]
-                                        + 2*firstDerivativeY[3]*firstDerivativeZ[4] + 2*firstDerivativeX[1]*(firstDerivativeY[3] + firstDerivativeZ[4]) + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeY[1]*firstDerivativeY[1] + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4]
-                                        + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]))/2.;
-        		};
-        	if(L3 !=0 )
-        		{
-        		distortionEnergyAtSite+=(L3*(2*firstDerivativeX[1]*firstDerivativeY[0] + 2*firstDerivativeX[3]*firstDerivativeY[1] + 2*firstDerivativeX[4]*firstDerivativeY[2] + 2*firstDerivativeX[2]*firstDerivativeZ[0] + 2*firstDerivativeX[4]*firstDerivativeZ[1] + 2*firstDerivativeY[2]*firstDerivativeZ[1] - 2*firstDerivativeX[0]*firstDerivativeZ[2] - 2*firstDerivativeX[3]*firstDerivativeZ[2]
-                                        + 2*firstDerivativeY[4]*firstDerivativeZ[3] + 2*firstDerivativeZ[0]*firstDerivativeZ[3] - 2*firstDerivativeY[0]*firstDerivativeZ[4] - 2*firstDerivativeY[3]*firstDerivativeZ[4] + firstDerivativeX[0]*firstDerivativeX[0] + firstDerivativeX[1]*firstDerivativeX[1] + firstDerivativeX[2]*firstDerivativeX[2] + firstDerivativeY[1]*firstDerivativeY[1]
-                                        + firstDerivativeY[3]*firstDerivativeY[3] + firstDerivativeY[4]*firstDerivativeY[4] + firstDerivativeZ[0]*firstDerivativeZ[0] + firstDerivativeZ[2]*firstDerivativeZ[2] + firstDerivativeZ[3]*firstDerivativeZ[3] + firstDerivativeZ[4]*firstDerivativeZ[4]))/2.;
-        		};
-        	if(L4 !=0 )
-        		{
-        		distortionEnergyAtSite+=(L4*(-(firstDerivativeY[4]*qCurrent[0]) + firstDerivativeZ[4]*qCurrent[0] + firstDerivativeX[2]*qCurrent[1] - firstDerivativeY[4]*qCurrent[1] - firstDerivativeZ[2]*qCurrent[1] + firstDerivativeZ[4]*qCurrent[1] - firstDerivativeY[4]*qCurrent[2] + firstDerivativeZ[4]*qCurrent[2] + firstDerivativeX[2]*qCurrent[3] - firstDerivativeZ[2]*qCurrent[3]
-                                        + firstDerivativeX[1]*(qCurrent[0] - qCurrent[2] + qCurrent[3] - qCurrent[4]) + firstDerivativeX[2]*qCurrent[4] - firstDerivativeZ[2]*qCurrent[4] + firstDerivativeY[1]*(-qCurrent[0] + qCurrent[2] - qCurrent[3] + qCurrent[4])))/2.;
-        		};
-        	if(L6 !=0 )
-        		{
-        		distortionEnergyAtSite+=L6*(-(firstDerivativeZ[0]*firstDerivativeZ[3]*qCurrent[0]) + firstDerivativeX[0]*firstDerivativeX[0]*qCurrent[0] + firstDerivativeX[1]*firstDerivativeX[1]*qCurrent[0] + firstDerivativeX[2]*firstDerivativeX[2]*qCurrent[0] + firstDerivativeX[3]*firstDerivativeX[3]*qCurrent[0] + firstDerivativeX[4]*firstDerivativeX[4]*qCurrent[0]
-                                        - firstDerivativeZ[0]*firstDerivativeZ[0]*qCurrent[0] - firstDerivativeZ[1]*firstDerivativeZ[1]*qCurrent[0] - firstDerivativeZ[2]*firstDerivativeZ[2]*qCurrent[0] - firstDerivativeZ[3]*firstDerivativeZ[3]*qCurrent[0] - firstDerivativeZ[4]*firstDerivativeZ[4]*qCurrent[0] + firstDerivativeX[3]*firstDerivativeY[0]*qCurrent[1]
-                                        + 2*firstDerivativeX[2]*firstDerivativeY[2]*qCurrent[1] + 2*firstDerivativeX[3]*firstDerivativeY[3]*qCurrent[1] + 2*firstDerivativeX[4]*firstDerivativeY[4]*qCurrent[1] + firstDerivativeX[3]*firstDerivativeZ[0]*qCurrent[2] + 2*firstDerivativeX[2]*firstDerivativeZ[2]*qCurrent[2] + 2*firstDerivativeX[3]*firstDerivativeZ[3]*qCurrent[2]
-                                        + 2*firstDerivativeX[4]*firstDerivativeZ[4]*qCurrent[2] + 2*firstDerivativeX[1]*(firstDerivativeY[1]*qCurrent[1] + firstDerivativeZ[1]*qCurrent[2]) + firstDerivativeX[0]*(firstDerivativeX[3]*qCurrent[0] + 2*firstDerivativeY[0]*qCurrent[1] + firstDerivativeY[3]*qCurrent[1] + 2*firstDerivativeZ[0]*qCurrent[2] + firstDerivativeZ[3]*qCurrent[2])
-                                        + firstDerivativeY[0]*firstDerivativeY[3]*qCurrent[3] - firstDerivativeZ[0]*firstDerivativeZ[3]*qCurrent[3] + firstDerivativeY[0]*firstDerivativeY[0]*qCurrent[3] + firstDerivativeY[1]*firstDerivativeY[1]*qCurrent[3] + firstDerivativeY[2]*firstDerivativeY[2]*qCurrent[3] + firstDerivativeY[3]*firstDerivativeY[3]*qCurrent[3]
-                                        + firstDerivativeY[4]*firstDerivativeY[4]*qCurrent[3] - firstDerivativeZ[0]*firstDerivativeZ[0]*qCurrent[3] - firstDerivativeZ[1]*firstDerivativeZ[1]*qCurrent[3] - firstDerivativeZ[2]*firstDerivativeZ[2]*qCurrent[3] - firstDerivativeZ[3]*firstDerivativeZ[3]*qCurrent[3] - firstDerivativeZ[4]*firstDerivativeZ[4]*qCurrent[3]
-                                        + 2*firstDerivativeY[0]*firstDerivativeZ[0]*qCurrent[4] + firstDerivativeY[3]*firstDerivativeZ[0]*qCurrent[4] + 2*firstDerivativeY[1]*firstDerivativeZ[1]*qCurrent[4] + 2*firstDerivativeY[2]*firstDerivativeZ[2]*qCurrent[4] + firstDerivativeY[0]*firstDerivativeZ[3]*qCurrent[4] + 2*firstDerivativeY[3]*firstDerivativeZ[3]*qCurrent[4] + 2*firstDerivativeY[4]*firstDerivativeZ[4]*qCurrent[4]);
-        		};
-
-            distortionEnergy+=distortionEnergyAtSite;
-            energyPerSite.data[i] +=distortionEnergyAtSite;
+            energyPerSite.data[i] = siteEnergyDensity(currentIndex,neighbors.data(),Qtensors.data,latticeTypes.data,
+                                                      bounds.data,externalField.data,energyTerms);
             }
-
         };
+    scalar phaseEnergy = energyTerms[0];
+    scalar distortionEnergy = energyTerms[1];
+    scalar anchoringEnergy = energyTerms[2];
+    scalar eFieldEnergy = energyTerms[3];
+    scalar hFieldEnergy = energyTerms[4];
     energy = (phaseEnergy + distortionEnergy + anchoringEnergy + eFieldEnergy + hFieldEnergy);
     energyComponents[0] = phaseEnergy;
     energyComponents[1] = distortionEnergy;
     energyComponents[2] = anchoringEnergy;
     energyComponents[3] = eFieldEnergy;
     energyComponents[4] = hFieldEnergy;
+    if(reproducibleEnergy)
+        sumEnergyDensityExactly();
 
     if(verbose)
         printf("%f %f %f %f %f\n",phaseEnergy , distortionEnergy , anchoringEnergy , eFieldEnergy , hFieldEnergy);
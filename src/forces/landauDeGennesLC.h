@@ -37,17 +37,45 @@ class landauDeGennesLC : public baseLatticeForce
         void setPhaseConstants(scalar _a=-1, scalar _b =-12.325581395, scalar _c =  10.058139535){A=_a;B=_b;C=_c;};
         void setElasticConstants(scalar _l1=2.32,scalar _l2=0, scalar _l3=0, scalar _l4 = 0, scalar _l6=0){L1=_l1;L2=_l2;L3=_l3; L4=_l4; L6 = _l6;};
         void setNumberOfConstants(distortionEnergyType _type);
+        //!the multi-constant forces use the first derivatives of the neighbors of each site
+        virtual int stencilRadius(){return numberOfConstants == distortionEnergyType::multiConstant ? 2 : 1;};
 
         virtual void computeForceCPU(GPUArray<dVec> &forces,bool zeroOutForce = true, int type = 0);
 
-        //!compute the forces on the objects in the system
+        //!add the force from the stress on its surface to lattice->boundaryForce[objectIdx]
         virtual void computeObjectForces(int objectIdx);
+        //!the force on each listed object from the stress at the surface sites this model controls, evaluated in one pass over them
+        virtual void computeObjectForces(vector<int> &objects, vector<scalar3> &objectForces);
 
         //!Precompute the first derivatives at all of the LC Sites
-        virtual void computeFirstDerivatives();
+        virtual void computeFirstDerivatives(int firstSite = 0);
 
-        //!compute the stress tensors at the given set of sites
+        //!set the lattice sites per tile of the multi-constant bulk forces on the CPU (0 in a dimension keeps the default of forceTile); tiled = false restores the untiled passes
+        void setForceTiling(bool tiled, int3 tileSize = make_int3(0,0,0))
+            {
+            tiledForces = tiled;
+            forceTileSize = tileSize;
+            };
+        //!the tile used by the tiled bulk forces on a lattice of the given size
+        int3 forceTile(int3 latticeSites);
+        //!choose the threads (up to the number set) and force tiles of the CPU forces by timing them, starting from the tuning cache if it has this lattice
+        void setCPUAutotuning(bool _autotune = true)
+            {
+            autotuneCPU = _autotune;
+            cpuForceTuner = NULL;
+            };
+        //!a new number of threads changes the configurations the CPU autotuner chooses from
+        virtual void setNThreads(int n)
+            {
+            nThreads = n;
+            cpuForceTuner = NULL;
+            };
+
+        //!compute the stress tensors at the given set of sites, from the Q-tensors of those sites and their neighbors only
         virtual void computeStressTensors(GPUArray<int> &sites,GPUArray<Matrix3x3> &stress);
+        //!the stress tensor at a liquid crystal site with the given six neighbors
+        Matrix3x3 siteStressTensor(int site, const int *neighbors, const dVec *Qtensors, const int *latticeTypes,
+                                   const boundaryObject *bounds, const scalar3 *externalField);
 
         virtual void computeBoundaryForcesCPU(GPUArray<dVec> &forces,bool zeroOutForce);
         virtual void computeBoundaryForcesGPU(GPUArray<dVec> &forces,bool zeroOutForce);
@@ -63,7 +91,12 @@ class landauDeGennesLC : public baseLatticeForce
         virtual void computeSpatiallyVaryingFieldGPU(GPUArray<dVec> &forces,bool zeroOutForce,
                                     GPUArray<scalar3> field, scalar anisotropicSusceptibility,scalar vacuumPermeability);
         virtual void computeEnergyCPU(bool verbose = false);
+        //!the energy density at one liquid crystal site with the given six neighbors, adding each of its terms to energyTerms
+        scalar siteEnergyDensity(int site, const int *neighbors, const dVec *Qtensors, const int *latticeTypes,
+                                 const boundaryObject *bounds, const scalar3 *externalField, scalar *energyTerms);
         virtual void computeEnergyGPU(bool verbose = false);
+        //!accumulate the per-site energies of the last energy computation in exactEnergy
+        void sumEnergyDensityExactly();
 
         //!A vector storing the components of energy (phase,distortion,anchoring)
         vector<scalar> energyComponents;
@@ -106,27 +139,25 @@ class landauDeGennesLC : public baseLatticeForce
         GPUArray<scalar> energyDensity;
         //!A helper array for energy reductions
         GPUArray<scalar> energyDensityReduction;
-        //!the force from stresses at the surface of an object
-        GPUArray<scalar3> objectForceArray;
 
         virtual scalar getClassSize()
             {
-            scalar thisClassSize = sizeof(scalar)*(energyComponents.size() + energyDensity.getNumElements() + 3*objectForceArray.getNumElements()+20) + 3*sizeof(bool) + 4*sizeof(kernelTuner)+ sizeof(cubicLatticeDerivativeVector)*forceCalculationAssist.getNumElements();
+            scalar thisClassSize = sizeof(scalar)*(energyComponents.size() + energyDensity.getNumElements()+20) + 3*sizeof(bool) + 4*sizeof(kernelTuner)+ sizeof(cubicLatticeDerivativeVector)*forceCalculationAssist.getNumElements();
             return 0.000000001*thisClassSize + baseLatticeForce::getClassSize();
             }
 
     protected:
-        //!constants, etc.
+        //!constants, etc.; the elastic constants a constructor does not set are zero
         scalar A;
         scalar B;
         scalar C;
-        scalar L1;
-        scalar L2;
-        scalar L3;
-        scalar L4;
-        scalar L6;
+        scalar L1 = 0;
+        scalar L2 = 0;
+        scalar L3 = 0;
+        scalar L4 = 0;
+        scalar L6 = 0;
 
-        scalar q0;
+        scalar q0 = 0;
 
         scalar3 Efield;
         scalar deltaEpsilon;
@@ -156,6 +187,16 @@ class landauDeGennesLC : public baseLatticeForce
 
         //!performance for the first derivative calculation
         shared_ptr<kernelTuner> forceAssistTuner;
+        //!are the CPU threads and force tiles autotuned?
+        bool autotuneCPU = false;
+        //!performance of the CPU forces, over indices into cpuForceConfigurations
+        shared_ptr<kernelTuner> cpuForceTuner;
+        //!the (threads, tile edge as in --forceTile) configurations the CPU autotuner chooses from
+        vector<int2> cpuForceConfigurations;
+        //!the storage of the lattice when the configurations were listed
+        bool cpuForceTunerSparseStorage = false;
+        //!list the configurations for the current lattice and threads, and look them up in the tuning cache
+        void initializeCPUForceTuner();
         //!performance for the boundary force kernel
         shared_ptr<kernelTuner> boundaryForceTuner;
         //!performance for the l24 force kernel
@@ -168,8 +209,16 @@ class landauDeGennesLC : public baseLatticeForce
         //!Compute L1 distortion terms at boundaries *and* the phase force
         virtual void computeL1BoundaryCPU(GPUArray<dVec> &forces,bool zeroOutForce);
 
-        //!Compute all distortion terms in the bulk *and* the phase force
-        virtual void computeAllDistortionTermsBulkCPU(GPUArray<dVec> &forces,bool zeroOutForce);
+        //!Compute all distortion terms in the bulk *and* the phase force (at the degrees of freedom from firstSite on)
+        virtual void computeAllDistortionTermsBulkCPU(GPUArray<dVec> &forces,bool zeroOutForce, int firstSite = 0);
+        //!Compute the first derivatives and the bulk forces tile by tile, while the data of each tile is in cache
+        virtual void computeAllDistortionTermsBulkTiledCPU(GPUArray<dVec> &forces,bool zeroOutForce);
+        //!should the multi-constant bulk forces on the CPU be computed tile by tile, when the storage is dense?
+        bool tiledForces = true;
+        //!the requested lattice sites per tile (0 in a dimension is chosen automatically)
+        int3 forceTileSize = make_int3(0,0,0);
+        //!did the last bulk force pass leave the first derivatives of every site current?
+        bool bulkPassComputedDerivatives = false;
         //!Compute all distortion terms at boundaries *and* the phase force
         virtual void computeAllDistortionTermsBoundaryCPU(GPUArray<dVec> &forces,bool zeroOutForce);
     };
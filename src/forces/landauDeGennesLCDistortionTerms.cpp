@@ -17,43 +17,51 @@ void landauDeGennesLC::computeL1BulkCPU(GPUArray<dVec> &forces,bool zeroOutForce
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
     ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+    bool sparse = lattice->sparseStorage;
+    bool orthonormal = lattice->orthonormalBasis;
+    //the sites this model controls, and any halo sites it advances along with them (a prefix of each sorted list)
+    int nDof = lattice->getNumberOfForceSites();
+    lattice->updateSiteTypeLists();
+    ArrayHandle<int> bulkSites(lattice->bulkSiteIndices,access_location::host,access_mode::read);
+    int nBulk = lattice->forceSitesInList(lattice->bulkSiteIndices);
+    if(zeroOutForce)
+        for (int i = 0; i < nDof; ++i)
+            h_f.data[i] = make_dVec(0.0);
 
     scalar a = 0.5*A;
     scalar b = B/3.0;
     scalar c = 0.25*C;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    #pragma omp parallel for num_threads(nThreads)
+    for (int ii = 0; ii < nBulk; ++ii)
         {
+        int i = bulkSites.data[ii];
         dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
         //currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
-        int currentIndex = i;
+        //forces and neighbor lists are indexed by degree of freedom, Q-tensors and types by site
+        int currentIndex = sparse ? activeSites.data[i] : i;
         dVec force(0.0);
-        if(latticeTypes.data[currentIndex] == 0)
-            {
-            qCurrent = Qtensors.data[currentIndex];
-            //compute the phase terms depending only on the current site
-            force -= a*derivativeTrQ2(qCurrent);
-            force -= b*derivativeTrQ3(qCurrent);
-            force -= c*derivativeTrQ2Squared(qCurrent);
+        qCurrent = Qtensors.data[currentIndex];
+        //compute the phase terms depending only on the current site
+        force -= a*derivativeTrQ2(qCurrent);
+        force -= b*derivativeTrQ3(qCurrent);
+        force -= c*derivativeTrQ2Squared(qCurrent);
 
-            int ixd, ixu,iyd,iyu,izd,izu;
-            ixd =latticeNeighbors.data[lattice->neighborIndex(0,currentIndex)];
-            ixu =latticeNeighbors.data[lattice->neighborIndex(1,currentIndex)];
-            iyd =latticeNeighbors.data[lattice->neighborIndex(2,currentIndex)];
-            iyu =latticeNeighbors.data[lattice->neighborIndex(3,currentIndex)];
-            izd =latticeNeighbors.data[lattice->neighborIndex(4,currentIndex)];
-            izu =latticeNeighbors.data[lattice->neighborIndex(5,currentIndex)];
-            xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
-            yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
-            zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
-            dVec spatialTerm(0.0);
-            //use the neighbors to compute the distortion
-            lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,spatialTerm);
-            force -= spatialTerm;
-            };
-        if(zeroOutForce)
-            h_f.data[currentIndex] = force;
-        else
-            h_f.data[currentIndex] += force;
+        int ixd, ixu,iyd,iyu,izd,izu;
+        ixd =latticeNeighbors.data[lattice->neighborIndex(0,i)];
+        ixu =latticeNeighbors.data[lattice->neighborIndex(1,i)];
+        iyd =latticeNeighbors.data[lattice->neighborIndex(2,i)];
+        iyu =latticeNeighbors.data[lattice->neighborIndex(3,i)];
+        izd =latticeNeighbors.data[lattice->neighborIndex(4,i)];
+        izu =latticeNeighbors.data[lattice->neighborIndex(5,i)];
+        xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
+        yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
+        zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
+        dVec spatialTerm(0.0);
+        //use the neighbors to compute the distortion
+        lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,spatialTerm);
+        force -= spatialTerm;
+        h_f.data[i] += orthonormal ? orthonormalBasisTransform(force) : force;
         };
     }
 void landauDeGennesLC::computeL1BoundaryCPU(GPUArray<dVec> &forces,bool zeroOutForce)
@@ -62,96 +70,311 @@ void landauDeGennesLC::computeL1BoundaryCPU(GPUArray<dVec> &forces,bool zeroOutF
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
     ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+    bool sparse = lattice->sparseStorage;
+    bool orthonormal = lattice->orthonormalBasis;
+    int nDof = lattice->getNumberOfForceSites();
+    lattice->updateSiteTypeLists();
+    ArrayHandle<int> surfaceSites(lattice->surfaceSiteIndices,access_location::host,access_mode::read);
+    int nSurface = lattice->forceSitesInList(lattice->surfaceSiteIndices);
+    if(zeroOutForce)
+        for (int i = 0; i < nDof; ++i)
+            h_f.data[i] = make_dVec(0.0);
 
     scalar a = 0.5*A;
     scalar b = B/3.0;
     scalar c = 0.25*C;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    #pragma omp parallel for num_threads(nThreads)
+    for (int ii = 0; ii < nSurface; ++ii)
         {
+        int i = surfaceSites.data[ii];
         dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
         //currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
-        int currentIndex = i;
+        int currentIndex = sparse ? activeSites.data[i] : i;
         dVec force(0.0);
         int siteType = latticeTypes.data[currentIndex];
-        if(siteType < 0)
+        qCurrent = Qtensors.data[currentIndex];
+        //compute the phase terms depending only on the current site
+        force -= a*derivativeTrQ2(qCurrent);
+        force -= b*derivativeTrQ3(qCurrent);
+        force -= c*derivativeTrQ2Squared(qCurrent);
+
+        int ixd, ixu,iyd,iyu,izd,izu;
+        ixd =latticeNeighbors.data[lattice->neighborIndex(0,i)];
+        ixu =latticeNeighbors.data[lattice->neighborIndex(1,i)];
+        iyd =latticeNeighbors.data[lattice->neighborIndex(2,i)];
+        iyu =latticeNeighbors.data[lattice->neighborIndex(3,i)];
+        izd =latticeNeighbors.data[lattice->neighborIndex(4,i)];
+        izu =latticeNeighbors.data[lattice->neighborIndex(5,i)];
+        xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
+        yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
+        zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
+        dVec spatialTerm(0.0);
+        if(siteType == -2)
+                lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,spatialTerm);
+        else
+                lcForce::boundaryL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                        latticeTypes.data[ixd],latticeTypes.data[ixu],latticeTypes.data[iyd],
+                        latticeTypes.data[iyu],latticeTypes.data[izd],latticeTypes.data[izu],
+                        spatialTerm);
+        force -= spatialTerm;
+        h_f.data[i] += orthonormal ? orthonormalBasisTransform(force) : force;
+        };
+    }
+
+void landauDeGennesLC::computeAllDistortionTermsBulkCPU(GPUArray<dVec> &forces,bool zeroOutForce, int firstSite)
+    {
+    ArrayHandle<dVec> h_f(forces);
+    ArrayHandle<dVec> Qtensors(lattice->returnPositions());
+    ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist,access_location::host,access_mode::read);
+    ArrayHandle<int> latticeTypes(lattice->returnTypes());
+    ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+    bool sparse = lattice->sparseStorage;
+    bool orthonormal = lattice->orthonormalBasis;
+    int nDof = lattice->getNumberOfForceSites();
+    lattice->updateSiteTypeLists();
+    ArrayHandle<int> bulkSites(lattice->bulkSiteIndices,access_location::host,access_mode::read);
+    int nBulk = lattice->forceSitesInList(lattice->bulkSiteIndices);
+    //the lists are sorted, so the degrees of freedom from firstSite on are the end of the list
+    int firstEntry = std::lower_bound(bulkSites.data,bulkSites.data+nBulk,firstSite) - bulkSites.data;
+    if(zeroOutForce)
+        for (int i = firstSite; i < nDof; ++i)
+            h_f.data[i] = make_dVec(0.0);
+
+    scalar a = 0.5*A;
+    scalar b = B/3.0;
+    scalar c = 0.25*C;
+    #pragma omp parallel for num_threads(nThreads)
+    for (int ii = firstEntry; ii < nBulk; ++ii)
+        {
+        int i = bulkSites.data[ii];
+        dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
+        cubicLatticeDerivativeVector xDownDerivative, xUpDerivative,yDownDerivative,yUpDerivative,zDownDerivative,zUpDerivative;
+        int currentIndex = sparse ? activeSites.data[i] : i;
+        dVec force(0.0);
+        qCurrent = Qtensors.data[currentIndex];
+        //compute the phase terms depending only on the current site
+        force -= a*derivativeTrQ2(qCurrent);
+        force -= b*derivativeTrQ3(qCurrent);
+        force -= c*derivativeTrQ2Squared(qCurrent);
+
+        int ixd, ixu,iyd,iyu,izd,izu;
+        ixd =latticeNeighbors.data[lattice->neighborIndex(0,i)];
+        ixu =latticeNeighbors.data[lattice->neighborIndex(1,i)];
+        iyd =latticeNeighbors.data[lattice->neighborIndex(2,i)];
+        iyu =latticeNeighbors.data[lattice->neighborIndex(3,i)];
+        izd =latticeNeighbors.data[lattice->neighborIndex(4,i)];
+        izu =latticeNeighbors.data[lattice->neighborIndex(5,i)];
+        xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
+        yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
+        zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
+        xDownDerivative = h_derivatives.data[ixd];
+        xUpDerivative = h_derivatives.data[ixu];
+        yDownDerivative = h_derivatives.data[iyd];
+        yUpDerivative = h_derivatives.data[iyu];
+        zDownDerivative = h_derivatives.data[izd];
+        zUpDerivative = h_derivatives.data[izu];
+        dVec spatialTerm;
+        lcForce::bulkDistortionForce(L1,L2,L3,L4,L6,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                spatialTerm);
+        force -= spatialTerm;
+        h_f.data[i] += orthonormal ? orthonormalBasisTransform(force) : force;
+        };
+    }
+
+
+//!the first derivatives at a site of a densely stored lattice, from its neighbor list
+static inline void siteFirstDerivatives(cubicLatticeDerivativeVector &derivative, int i, const dVec *Qtensors,
+                                        const int *types, const int *neighbors, const Index2D &neighborIndex)
+    {
+    int ixd = neighbors[neighborIndex(0,i)]; int ixu = neighbors[neighborIndex(1,i)];
+    int iyd = neighbors[neighborIndex(2,i)]; int iyu = neighbors[neighborIndex(3,i)];
+    int izd = neighbors[neighborIndex(4,i)]; int izu = neighbors[neighborIndex(5,i)];
+    lcForce::firstDerivatives(derivative,types[i],Qtensors[i],
+            Qtensors[ixd],Qtensors[ixu],Qtensors[iyd],Qtensors[iyu],Qtensors[izd],Qtensors[izu],
+            types[ixd],types[ixu],types[iyd],types[iyu],types[izd],types[izu]);
+    };
+
+/*!
+Unless set, tiles span whole planes of sites, and the planes are shared evenly among the threads. Within a tile the
+derivatives run one plane ahead of the forces, so what the forces read is in the last three planes touched. Smaller
+tiles keep those planes in a smaller cache, at the cost of computing the derivatives at the faces of each tile twice.
+*/
+int3 landauDeGennesLC::forceTile(int3 latticeSites)
+    {
+    int3 tile = latticeSites;
+    tile.z = max(1,(latticeSites.z+nThreads-1)/nThreads);
+    if(forceTileSize.x > 0) tile.x = forceTileSize.x;
+    if(forceTileSize.y > 0) tile.y = forceTileSize.y;
+    if(forceTileSize.z > 0) tile.z = forceTileSize.z;
+    tile.x = min(tile.x,latticeSites.x);
+    tile.y = min(tile.y,latticeSites.y);
+    tile.z = min(tile.z,latticeSites.z);
+    return tile;
+    };
+
+/*!
+The separate passes stream the Q-tensors of every site past the derivatives and then, with the derivatives
+themselves, past the forces. Here each tile of sites this model controls (see forceTile) computes the derivatives of
+its sites and the forces on its bulk sites together, plane by plane, so that the forces read Q-tensors and
+derivatives that were just written. The derivatives at a neighbor in another tile are computed again rather than read, since another thread
+may be writing them; the results are the same as those of the separate passes. Tiles are shared among the threads.
+Forces on any halo sites (see multirankQTensorLatticeModel::getNumberOfForceSites) use the untiled passes afterwards.
+*/
+void landauDeGennesLC::computeAllDistortionTermsBulkTiledCPU(GPUArray<dVec> &forces,bool zeroOutForce)
+    {
+    int N = lattice->getNumberOfParticles();
+    int nDerivatives = max(N,lattice->getNumberOfForceSites(1));
+    if(forceCalculationAssist.getNumElements() < nDerivatives)
+        forceCalculationAssist.resize(nDerivatives);
+    int nDof = lattice->getNumberOfForceSites();
+    {//scope for array handles
+    ArrayHandle<dVec> h_f(forces);
+    ArrayHandle<dVec> Qtensors(lattice->returnPositions(),access_location::host,access_mode::read);
+    ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist,access_location::host,access_mode::readwrite);
+    ArrayHandle<int> latticeTypes(lattice->returnTypes(),access_location::host,access_mode::read);
+    ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    bool orthonormal = lattice->orthonormalBasis;
+    Index3D latticeIndex = lattice->latticeIndex;
+    Index2D neighborIndex = lattice->neighborIndex;
+    int3 sites = lattice->latticeSites;
+    int3 tile = forceTile(sites);
+    int3 tiles = make_int3((sites.x+tile.x-1)/tile.x,(sites.y+tile.y-1)/tile.y,(sites.z+tile.z-1)/tile.z);
+    int nTiles = tiles.x*tiles.y*tiles.z;
+    if(zeroOutForce)
+        for (int i = N; i < nDof; ++i)
+            h_f.data[i] = make_dVec(0.0);
+
+    scalar a = 0.5*A;
+    scalar b = B/3.0;
+    scalar c = 0.25*C;
+    #pragma omp parallel for num_threads(nThreads) schedule(dynamic)
+    for (int tt = 0; tt < nTiles; ++tt)
+        {
+        int3 tileStart = make_int3(tile.x*(tt%tiles.x),tile.y*((tt/tiles.x)%tiles.y),tile.z*(tt/(tiles.x*tiles.y)));
+        int3 tileEnd = make_int3(min(sites.x,tileStart.x+tile.x),min(sites.y,tileStart.y+tile.y),min(sites.z,tileStart.z+tile.z));
+        //the derivatives of each plane of the tile are computed just before the forces on the plane below it need them
+        for (int z = tileStart.z-1; z < tileEnd.z; ++z)
             {
-            qCurrent = Qtensors.data[currentIndex];
-            //compute the phase terms depending only on the current site
-            force -= a*derivativeTrQ2(qCurrent);
-            force -= b*derivativeTrQ3(qCurrent);
-            force -= c*derivativeTrQ2Squared(qCurrent);
+            if(z+1 < tileEnd.z)
+                for (int y = tileStart.y; y < tileEnd.y; ++y)
+                    for (int x = tileStart.x; x < tileEnd.x; ++x)
+                        {
+                        int i = latticeIndex(x,y,z+1);
+                        if(zeroOutForce)
+                            h_f.data[i] = make_dVec(0.0);
+                        if(latticeTypes.data[i] <= 0)
+                            siteFirstDerivatives(h_derivatives.data[i],i,Qtensors.data,latticeTypes.data,latticeNeighbors.data,neighborIndex);
+                        };
+            if(z < tileStart.z)
+                continue;
+            for (int y = tileStart.y; y < tileEnd.y; ++y)
+                for (int x = tileStart.x; x < tileEnd.x; ++x)
+                    {
+                    int i = latticeIndex(x,y,z);
+                    if(latticeTypes.data[i] != 0)
+                        continue;
+                    dVec qCurrent = Qtensors.data[i];
+                    dVec force(0.0);
+                    force -= a*derivativeTrQ2(qCurrent);
+                    force -= b*derivativeTrQ3(qCurrent);
+                    force -= c*derivativeTrQ2Squared(qCurrent);
 
-            int ixd, ixu,iyd,iyu,izd,izu;
-            ixd =latticeNeighbors.data[lattice->neighborIndex(0,currentIndex)];
-            ixu =latticeNeighbors.data[lattice->neighborIndex(1,currentIndex)];
-            iyd =latticeNeighbors.data[lattice->neighborIndex(2,currentIndex)];
-            iyu =latticeNeighbors.data[lattice->neighborIndex(3,currentIndex)];
-            izd =latticeNeighbors.data[lattice->neighborIndex(4,currentIndex)];
-            izu =latticeNeighbors.data[lattice->neighborIndex(5,currentIndex)];
-            xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
-            yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
-            zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
-            dVec spatialTerm(0.0);
-            if(siteType == -2)
-                    lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,spatialTerm);
-            else
-                    lcForce::boundaryL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                            latticeTypes.data[ixd],latticeTypes.data[ixu],latticeTypes.data[iyd],
-                            latticeTypes.data[iyu],latticeTypes.data[izd],latticeTypes.data[izu],
+                    int neighbors[6];
+                    for (int nn = 0; nn < 6; ++nn)
+                        neighbors[nn] = latticeNeighbors.data[neighborIndex(nn,i)];
+                    //the neighbors of a bulk site are never objects, so all of them have derivatives
+                    bool inTile[6] = {x > tileStart.x, x+1 < tileEnd.x, y > tileStart.y, y+1 < tileEnd.y, z > tileStart.z, z+1 < tileEnd.z};
+                    cubicLatticeDerivativeVector neighborDerivatives[6];
+                    for (int nn = 0; nn < 6; ++nn)
+                        {
+                        if(inTile[nn])
+                            neighborDerivatives[nn] = h_derivatives.data[neighbors[nn]];
+                        else
+                            siteFirstDerivatives(neighborDerivatives[nn],neighbors[nn],Qtensors.data,latticeTypes.data,latticeNeighbors.data,neighborIndex);
+                        };
+                    dVec spatialTerm;
+                    lcForce::bulkDistortionForce(L1,L2,L3,L4,L6,qCurrent,
+                            Qtensors.data[neighbors[0]],Qtensors.data[neighbors[1]],Qtensors.data[neighbors[2]],
+                            Qtensors.data[neighbors[3]],Qtensors.data[neighbors[4]],Qtensors.data[neighbors[5]],
+                            neighborDerivatives[0],neighborDerivatives[1],neighborDerivatives[2],
+                            neighborDerivatives[3],neighborDerivatives[4],neighborDerivatives[5],
                             spatialTerm);
-            force -= spatialTerm;
+                    force -= spatialTerm;
+                    h_f.data[i] += orthonormal ? orthonormalBasisTransform(force) : force;
+                    };
             };
-        if(zeroOutForce)
-            h_f.data[currentIndex] = force;
-        else
-            h_f.data[currentIndex] += force;
         };
+    }//end scope for array handles
+    if(nDerivatives > N)
+        {
+        computeFirstDerivatives(N);
+        if(nDof > N)
+            computeAllDistortionTermsBulkCPU(forces,false,N);
+        };
+    bulkPassComputedDerivatives = true;
     }
 
-void landauDeGennesLC::computeAllDistortionTermsBulkCPU(GPUArray<dVec> &forces,bool zeroOutForce)
+void landauDeGennesLC::computeAllDistortionTermsBoundaryCPU(GPUArray<dVec> &forces,bool zeroOutForce)
     {
     ArrayHandle<dVec> h_f(forces);
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist,access_location::host,access_mode::read);
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
     ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+    bool sparse = lattice->sparseStorage;
+    bool orthonormal = lattice->orthonormalBasis;
+    int nDof = lattice->getNumberOfForceSites();
+    lattice->updateSiteTypeLists();
+    ArrayHandle<int> surfaceSites(lattice->surfaceSiteIndices,access_location::host,access_mode::read);
+    int nSurface = lattice->forceSitesInList(lattice->surfaceSiteIndices);
+    if(zeroOutForce)
+        for (int i = 0; i < nDof; ++i)
+            h_f.data[i] = make_dVec(0.0);
 
     scalar a = 0.5*A;
     scalar b = B/3.0;
     scalar c = 0.25*C;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    #pragma omp parallel for num_threads(nThreads)
+    for (int ii = 0; ii < nSurface; ++ii)
         {
+        int i = surfaceSites.data[ii];
         dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
         cubicLatticeDerivativeVector xDownDerivative, xUpDerivative,yDownDerivative,yUpDerivative,zDownDerivative,zUpDerivative;
-        int currentIndex = i;
+        int currentIndex = sparse ? activeSites.data[i] : i;
         dVec force(0.0);
-        if(latticeTypes.data[currentIndex] == 0)
-            {
-            qCurrent = Qtensors.data[currentIndex];
-            //compute the phase terms depending only on the current site
-            force -= a*derivativeTrQ2(qCurrent);
-            force -= b*derivativeTrQ3(qCurrent);
-            force -= c*derivativeTrQ2Squared(qCurrent);
+        int siteType = latticeTypes.data[currentIndex];
+        qCurrent = Qtensors.data[currentIndex];
+        //compute the phase terms depending only on the current site
+        force -= a*derivativeTrQ2(qCurrent);
+        force -= b*derivativeTrQ3(qCurrent);
+        force -= c*derivativeTrQ2Squared(qCurrent);
+        
+        int ixd, ixu,iyd,iyu,izd,izu;
+        ixd =latticeNeighbors.data[lattice->neighborIndex(0,i)];
+        ixu =latticeNeighbors.data[lattice->neighborIndex(1,i)];
+        iyd =latticeNeighbors.data[lattice->neighborIndex(2,i)];
+        iyu =latticeNeighbors.data[lattice->neighborIndex(3,i)];
+        izd =latticeNeighbors.data[lattice->neighborIndex(4,i)];
+        izu =latticeNeighbors.data[lattice->neighborIndex(5,i)];
+        xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
+        yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
+        zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
+        xDownDerivative = h_derivatives.data[ixd];
+        xUpDerivative = h_derivatives.data[ixu];
+        yDownDerivative = h_derivatives.data[iyd];
+        yUpDerivative = h_derivatives.data[iyu];
+        zDownDerivative = h_derivatives.data[izd];
+        zUpDerivative = h_derivatives.data[izu];
 
-            int ixd, ixu,iyd,iyu,izd,izu;
-            ixd =latticeNeighbors.data[lattice->neighborIndex(0,currentIndex)];
-            ixu =latticeNeighbors.data[lattice->neighborIndex(1,currentIndex)];
-            iyd =latticeNeighbors.data[lattice->neighborIndex(2,currentIndex)];
-            iyu =latticeNeighbors.data[lattice->neighborIndex(3,currentIndex)];
-            izd =latticeNeighbors.data[lattice->neighborIndex(4,currentIndex)];
-            izu =latticeNeighbors.data[lattice->neighborIndex(5,currentIndex)];
-            xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
-            yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
-            zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
-            xDownDerivative = h_derivatives.data[ixd];
-            xUpDerivative = h_derivatives.data[ixu];
-            yDownDerivative = h_derivatives.data[iyd];
-            yUpDerivative = h_derivatives.data[iyu];
-            zDownDerivative = h_derivatives.data[izd];
-            zUpDerivative = h_derivatives.data[izu];
-            dVec spatialTerm(0.0);
-            dVec individualTerms(0.0);
+        dVec spatialTerm(0.0);
+        dVec individualTerms(0.0);
 
+        if(siteType == -2)
+            {
             if(L1 != 0)
                 {
                 lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,individualTerms);
@@ -185,144 +408,50 @@ void landauDeGennesLC::computeAllDistortionTermsBulkCPU(GPUArray<dVec> &forces,b
                     individualTerms);
                 spatialTerm += individualTerms;
                 }
-            force -= spatialTerm;
-            };
-        if(zeroOutForce)
-            h_f.data[currentIndex] = force;
+            }
         else
-            h_f.data[currentIndex] += force;
-        };
-    }
-
-void landauDeGennesLC::computeAllDistortionTermsBoundaryCPU(GPUArray<dVec> &forces,bool zeroOutForce)
-    {
-    ArrayHandle<dVec> h_f(forces);
-    ArrayHandle<dVec> Qtensors(lattice->returnPositions());
-    ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist,access_location::host,access_mode::read);
-    ArrayHandle<int> latticeTypes(lattice->returnTypes());
-    ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
-
-    scalar a = 0.5*A;
-    scalar b = B/3.0;
-    scalar c = 0.25*C;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
-        {
-        dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
-        cubicLatticeDerivativeVector xDownDerivative, xUpDerivative,yDownDerivative,yUpDerivative,zDownDerivative,zUpDerivative;
-        int currentIndex = i;
-        dVec force(0.0);
-        int siteType = latticeTypes.data[currentIndex];
-        if(siteType < 0)
             {
-            qCurrent = Qtensors.data[currentIndex];
-            //compute the phase terms depending only on the current site
-            force -= a*derivativeTrQ2(qCurrent);
-            force -= b*derivativeTrQ3(qCurrent);
-            force -= c*derivativeTrQ2Squared(qCurrent);
-            
-            int ixd, ixu,iyd,iyu,izd,izu;
-            ixd =latticeNeighbors.data[lattice->neighborIndex(0,currentIndex)];
-            ixu =latticeNeighbors.data[lattice->neighborIndex(1,currentIndex)];
-            iyd =latticeNeighbors.data[lattice->neighborIndex(2,currentIndex)];
-            iyu =latticeNeighbors.data[lattice->neighborIndex(3,currentIndex)];
-            izd =latticeNeighbors.data[lattice->neighborIndex(4,currentIndex)];
-            izu =latticeNeighbors.data[lattice->neighborIndex(5,currentIndex)];
-            xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
-            yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
-            zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
-            xDownDerivative = h_derivatives.data[ixd];
-            xUpDerivative = h_derivatives.data[ixu];
-            yDownDerivative = h_derivatives.data[iyd];
-            yUpDerivative = h_derivatives.data[iyu];
-            zDownDerivative = h_derivatives.data[izd];
-            zUpDerivative = h_derivatives.data[izu];
-
-            dVec spatialTerm(0.0);
-            dVec individualTerms(0.0);
-
-            if(siteType == -2)
+            int boundaryCase = lcForce::getBoundaryCase(latticeTypes.data[ixd],latticeTypes.data[ixu],
+                                               latticeTypes.data[iyd],latticeTypes.data[iyu],
+                                               latticeTypes.data[izd],latticeTypes.data[izu]);
+            if(L1 != 0)
                 {
-                if(L1 != 0)
-                    {
-                    lcForce::bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L2 != 0)
-                    {
-                    lcForce::bulkL2Force(L2,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L3 != 0)
-                    {
-                    lcForce::bulkL3Force(L3,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L4 != 0)
-                    {
-                    lcForce::bulkL4Force(L4,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L6 != 0)
-                    {
-                    lcForce::bulkL6Force(L6,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
+                lcForce::boundaryL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                            latticeTypes.data[ixd],latticeTypes.data[ixu],latticeTypes.data[iyd],
+                            latticeTypes.data[iyu],latticeTypes.data[izd],latticeTypes.data[izu],
+                            individualTerms);
+                spatialTerm += individualTerms;
                 }
-            else
+            if(L2 != 0)
                 {
-                int boundaryCase = lcForce::getBoundaryCase(latticeTypes.data[ixd],latticeTypes.data[ixu],
-                                                   latticeTypes.data[iyd],latticeTypes.data[iyu],
-                                                   latticeTypes.data[izd],latticeTypes.data[izu]);
-                if(L1 != 0)
-                    {
-                    lcForce::boundaryL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                                latticeTypes.data[ixd],latticeTypes.data[ixu],latticeTypes.data[iyd],
-                                latticeTypes.data[iyu],latticeTypes.data[izd],latticeTypes.data[izu],
-                                individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L2 != 0)
-                    {
-                    lcForce::boundaryL2Force(L2,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L3 != 0)
-                    {
-                    lcForce::boundaryL3Force(L3,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L4 != 0)
-                    {
-                    lcForce::boundaryL4Force(L4,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                if(L6 != 0)
-                    {
-                    lcForce::boundaryL6Force(L6,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
-                        xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
-                        individualTerms);
-                    spatialTerm += individualTerms;
-                    }
-                };
-            force -= spatialTerm;
+                lcForce::boundaryL2Force(L2,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                    xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                    individualTerms);
+                spatialTerm += individualTerms;
+                }
+            if(L3 != 0)
+                {
+                lcForce::boundaryL3Force(L3,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                    xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                    individualTerms);
+                spatialTerm += individualTerms;
+                }
+            if(L4 != 0)
+                {
+                lcForce::boundaryL4Force(L4,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                    xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                    individualTerms);
+                spatialTerm += individualTerms;
+                }
+            if(L6 != 0)
+                {
+                lcForce::boundaryL6Force(L6,boundaryCase,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                    xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                    individualTerms);
+                spatialTerm += individualTerms;
+                }
             };
-        if(zeroOutForce)
-            h_f.data[currentIndex] = force;
-        else
-            h_f.data[currentIndex] += force;
+        force -= spatialTerm;
+        h_f.data[i] += orthonormal ? orthonormalBasisTransform(force) : force;
         };
     }
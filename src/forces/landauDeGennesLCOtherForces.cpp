@@ -2,6 +2,7 @@
 #include "landauDeGennesLC.cuh"
 #include "qTensorFunctions.h"
 #include "utilities.cuh"
+#include "lcForces.h"
 /*! \file landauDeGennesLCOtherForces.cpp */
 
 /*
@@ -10,11 +11,17 @@ terms (utility functions, objects, external fields).
 Keeps files and compilation more managable.
  */
 
-void landauDeGennesLC::computeFirstDerivatives()
+/*!
+The forces on a site use the derivatives at its neighbors, so when forces are computed on some halo sites the
+derivatives are computed one layer further out. On the CPU, only the degrees of freedom from firstSite on are
+computed (the tiled bulk forces compute those of the sites this model controls themselves)
+*/
+void landauDeGennesLC::computeFirstDerivatives(int firstSite)
     {
     int N = lattice->getNumberOfParticles();
-    if(forceCalculationAssist.getNumElements() < N)
-        forceCalculationAssist.resize(N);
+    int nDerivatives = lattice->sparseStorage ? lattice->getNumberOfSitesWithinHaloLayers(1) : max(N,lattice->getNumberOfForceSites(1));
+    if(forceCalculationAssist.getNumElements() < nDerivatives)
+        forceCalculationAssist.resize(nDerivatives);
     if(useGPU)
         {
         ArrayHandle<cubicLatticeDerivativeVector> d_derivatives(forceCalculationAssist,access_location::device,access_mode::readwrite);
@@ -37,211 +44,179 @@ void landauDeGennesLC::computeFirstDerivatives()
         ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist);
         ArrayHandle<dVec> Qtensors(lattice->returnPositions(),access_location::host,access_mode::read);
         ArrayHandle<int>  h_latticeTypes(lattice->returnTypes(),access_location::host,access_mode::read);
-        for (int i = 0; i < N; ++i)
+        ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+        //the neighbor lists cover every degree of freedom (and halo site) derivatives are needed at
+        ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+        Index2D neighborIndex = lattice->neighborIndex;
+        int nDof = lattice->getNumberOfForceSites(1);
+        for (int i = firstSite; i < nDof; ++i)
             {
-            int neighNum;
-            vector<int> neighbors(6);
-            int idx;
-            dVec qCurrent, xDown, xUp, yDown,yUp,zDown,zUp;
-            idx = lattice->getNeighbors(i,neighbors,neighNum);
+            int idx = lattice->sparseStorage ? activeSites.data[i] : i;
             if(h_latticeTypes.data[idx] <= 0)
                 {
-                qCurrent = Qtensors.data[idx];
-                int ixd = neighbors[0]; int ixu = neighbors[1];
-                int iyd = neighbors[2]; int iyu = neighbors[3];
-                int izd = neighbors[4]; int izu = neighbors[5];
-                xDown = Qtensors.data[ixd]; xUp = Qtensors.data[ixu];
-                yDown = Qtensors.data[iyd]; yUp = Qtensors.data[iyu];
-                zDown = Qtensors.data[izd]; zUp = Qtensors.data[izu];
-
-                if(h_latticeTypes.data[idx] == 0) // if it's in the bulk, things are easy
-                    {
-                    for (int qq = 0; qq < DIMENSION; ++qq)
-                        {
-                        h_derivatives.data[idx][qq] = 0.5*(xUp[qq]-xDown[qq]);
-                        };
-                    for (int qq = 0; qq < DIMENSION; ++qq)
-                        {
-                        h_derivatives.data[idx][DIMENSION+qq] = 0.5*(yUp[qq]-yDown[qq]);
-                        };
-                    for (int qq = 0; qq < DIMENSION; ++qq)
-                        {
-                        h_derivatives.data[idx][2*DIMENSION+qq] = 0.5*(zUp[qq]-zDown[qq]);
-                        };
-                    }
-                else // boundary terms are slightly more work
-                    {
-                    if(h_latticeTypes.data[ixd] <=0 && h_latticeTypes.data[ixu] <= 0) //x bulk
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][qq] = 0.5*(xUp[qq]-xDown[qq]);
-                            };
-                        }
-                    else if (h_latticeTypes.data[ixu] > 0) //right is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][qq] = (qCurrent[qq]-xDown[qq]);
-                            };
-                        }
-                    else//left is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][qq] = (xUp[qq]-qCurrent[qq]);
-                            };
-                        };
-                    if(h_latticeTypes.data[iyd] <=0 && h_latticeTypes.data[iyu] <= 0) //y bulk
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][DIMENSION+qq] = 0.5*(yUp[qq]-yDown[qq]);
-                            };
-                        }
-                    else if (h_latticeTypes.data[iyu] > 0) //up is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][DIMENSION+qq] = (qCurrent[qq]-yDown[qq]);
-                            };
-                        }
-                    else//down is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][DIMENSION+qq] = (yUp[qq]-qCurrent[qq]);
-                            };
-                        };
-                    if(h_latticeTypes.data[izd] <=0 && h_latticeTypes.data[izu] <= 0) //z bulk
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][2*DIMENSION+qq] = 0.5*(zUp[qq]-zDown[qq]);
-                            };
-                        }
-                    else if (h_latticeTypes.data[izu] > 0) //up is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][2*DIMENSION+qq] = (qCurrent[qq]-zDown[qq]);
-                            };
-                        }
-                    else//down is boundary
-                        {
-                        for (int qq = 0; qq < DIMENSION; ++qq)
-                            {
-                            h_derivatives.data[idx][2*DIMENSION+qq] = (zUp[qq]-qCurrent[qq]);
-                            };
-                        };
-                    }
+                int ixd = latticeNeighbors.data[neighborIndex(0,i)]; int ixu = latticeNeighbors.data[neighborIndex(1,i)];
+                int iyd = latticeNeighbors.data[neighborIndex(2,i)]; int iyu = latticeNeighbors.data[neighborIndex(3,i)];
+                int izd = latticeNeighbors.data[neighborIndex(4,i)]; int izu = latticeNeighbors.data[neighborIndex(5,i)];
+                lcForce::firstDerivatives(h_derivatives.data[idx],h_latticeTypes.data[idx],Qtensors.data[idx],
+                        Qtensors.data[ixd],Qtensors.data[ixu],Qtensors.data[iyd],Qtensors.data[iyu],Qtensors.data[izd],Qtensors.data[izu],
+                        h_latticeTypes.data[ixd],h_latticeTypes.data[ixu],h_latticeTypes.data[iyd],h_latticeTypes.data[iyu],
+                        h_latticeTypes.data[izd],h_latticeTypes.data[izu]);
                 };
             };//end cpu loop over N
+        //in sparse storage halo sites have no neighbor lists, but forces on the sites next to them read their derivatives
+        if(lattice->sparseStorage)
+            {
+            vector<int> neighbors(6);
+            int neighNum;
+            for (int idx = N; idx < nDerivatives; ++idx)
+                {
+                if(h_latticeTypes.data[idx] > 0)
+                    continue;
+                lattice->getNeighbors(idx,neighbors,neighNum);
+                lcForce::firstDerivatives(h_derivatives.data[idx],h_latticeTypes.data[idx],Qtensors.data[idx],
+                        Qtensors.data[neighbors[0]],Qtensors.data[neighbors[1]],Qtensors.data[neighbors[2]],
+                        Qtensors.data[neighbors[3]],Qtensors.data[neighbors[4]],Qtensors.data[neighbors[5]],
+                        h_latticeTypes.data[neighbors[0]],h_latticeTypes.data[neighbors[1]],h_latticeTypes.data[neighbors[2]],
+                        h_latticeTypes.data[neighbors[3]],h_latticeTypes.data[neighbors[4]],h_latticeTypes.data[neighbors[5]]);
+                };
+            };
         }//end if -- else for using GPU
     };
 
 void landauDeGennesLC::computeObjectForces(int objectIdx)
     {
-    GPUArray<Matrix3x3> stressTensors;
-    computeStressTensors(lattice->surfaceSites[objectIdx],stressTensors);
+    vector<int> objects(1,objectIdx);
+    vector<scalar3> objectForces;
+    computeObjectForces(objects,objectForces);
+    lattice->boundaryForce[objectIdx] = lattice->boundaryForce[objectIdx] + objectForces[0];
+    }
 
-    if(!useGPU)
+/*!
+Every surface site this model controls (halo sites are left to the rank that owns them) adds the stress tensor there,
+times its outward faces, to each listed object it borders. Only the Q-tensors of those sites and of their six
+neighbors are read, so the cost grows with the surface area of the objects rather than the lattice, and all of the
+objects are done in a single pass. The halo sites must be current; summing objectForces over ranks gives the total.
+The stress is that of the one-constant distortion energy.
+*/
+void landauDeGennesLC::computeObjectForces(vector<int> &objects, vector<scalar3> &objectForces)
+    {
+    objectForces.assign(objects.size(),make_scalar3(0.,0.,0.));
+    //the position of each object in the list, or -1
+    vector<int> objectSlot(lattice->boundaries.getNumElements(),-1);
+    for (int oo = 0; oo < objects.size(); ++oo)
+        objectSlot[objects[oo]] = oo;
+    if(numberOfConstants != distortionEnergyType::oneConstant)
+        return;
+
+    lattice->updateSiteTypeLists();
+    int N = lattice->getNumberOfParticles();
+    ArrayHandle<dVec> Qtensors(lattice->returnPositions(),access_location::host,access_mode::read);
+    ArrayHandle<int> latticeTypes(lattice->returnTypes(),access_location::host,access_mode::read);
+    ArrayHandle<boundaryObject> bounds(lattice->boundaries,access_location::host,access_mode::read);
+    ArrayHandle<scalar3> externalField(spatiallyVaryingField,access_location::host,access_mode::read);
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
+    ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
+    ArrayHandle<int> surfaceSites(lattice->surfaceSiteIndices,access_location::host,access_mode::read);
+    Index2D neighborIndex = lattice->neighborIndex;
+    int neighbors[6];
+    int borderedObjects[6];
+    for (int ii = 0; ii < lattice->surfaceSiteIndices.getNumElements(); ++ii)
         {
-        ArrayHandle<int> sites(lattice->surfaceSites[objectIdx],access_location::host,access_mode::read);
-        ArrayHandle<int>  latticeTypes(lattice->returnTypes(),access_location::host,access_mode::read);
-        ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::host,access_mode::read);
-        ArrayHandle<Matrix3x3> stress(stressTensors,access_location::host,access_mode::read);
-        for(int ii = 0; ii < lattice->surfaceSites[objectIdx].getNumElements();++ii)
+        int dof = surfaceSites.data[ii];
+        int site = lattice->sparseStorage ? activeSites.data[dof] : dof;
+        if(site >= N)
+            continue;
+        //the requested objects this site borders, each counted once
+        int nBordered = 0;
+        for (int nn = 0; nn < 6; ++nn)
             {
-            int currentIndex = sites.data[ii];
-            int ixd =latticeNeighbors.data[lattice->neighborIndex(0,currentIndex)];
-            int ixu =latticeNeighbors.data[lattice->neighborIndex(1,currentIndex)];
-            int iyd =latticeNeighbors.data[lattice->neighborIndex(2,currentIndex)];
-            int iyu =latticeNeighbors.data[lattice->neighborIndex(3,currentIndex)];
-            int izd =latticeNeighbors.data[lattice->neighborIndex(4,currentIndex)];
-            int izu =latticeNeighbors.data[lattice->neighborIndex(5,currentIndex)];
-            scalar3 surfaceArea = make_scalar3(0,0,0);
-            if(latticeTypes.data[ixd] >0)
-                surfaceArea.x = -1.0;
-            if(latticeTypes.data[ixu] >0)
-                surfaceArea.x = 1.0;
-            if(latticeTypes.data[iyd] >0)
-                surfaceArea.y = -1.0;
-            if(latticeTypes.data[iyu] >0)
-                surfaceArea.y = 1.0;
-            if(latticeTypes.data[izd] >0)
-                surfaceArea.z = -1.0;
-            if(latticeTypes.data[izu] >0)
-                surfaceArea.z = 1.0;
-            lattice->boundaryForce[objectIdx] = lattice->boundaryForce[objectIdx]+ surfaceArea*stress.data[ii];
-            }
-        }
-    else
-        {
-        int nSites = lattice->surfaceSites[objectIdx].getNumElements();
-        if(objectForceArray.getNumElements() < nSites)
-            objectForceArray.resize(nSites);
-        {
-        ArrayHandle<int> sites(lattice->surfaceSites[objectIdx],access_location::device,access_mode::read);
-        ArrayHandle<int>  latticeTypes(lattice->returnTypes(),access_location::device,access_mode::read);
-        ArrayHandle<int> latticeNeighbors(lattice->neighboringSites,access_location::device,access_mode::read);
-        ArrayHandle<Matrix3x3> stress(stressTensors,access_location::device,access_mode::read);
-        ArrayHandle<scalar3> objectForces(objectForceArray,access_location::device,access_mode::overwrite);
-        gpu_qTensor_computeObjectForceFromStresses(sites.data,
-                                           latticeTypes.data,
-                                           latticeNeighbors.data,
-                                           stress.data,
-                                           objectForces.data,
-                                           lattice->neighborIndex,
-                                           nSites,512);//temp maxBlockSize
-        }//scope for device call
-        ArrayHandle<scalar3> objectForces(objectForceArray,access_location::host,access_mode::read);
-        for (int ii = 0; ii < nSites; ++ii)
-            lattice->boundaryForce[objectIdx] = lattice->boundaryForce[objectIdx] + objectForces.data[ii];
-        }
-    printf("%f\t%f\t%f\n",lattice->boundaryForce[objectIdx].x,lattice->boundaryForce[objectIdx].y,lattice->boundaryForce[objectIdx].z);
+            neighbors[nn] = latticeNeighbors.data[neighborIndex(nn,dof)];
+            int neighborType = latticeTypes.data[neighbors[nn]];
+            if(neighborType <= 0 || objectSlot[neighborType-1] < 0)
+                continue;
+            bool counted = false;
+            for (int bb = 0; bb < nBordered; ++bb)
+                counted = counted || borderedObjects[bb] == objectSlot[neighborType-1];
+            if(!counted)
+                borderedObjects[nBordered++] = objectSlot[neighborType-1];
+            };
+        if(nBordered == 0)
+            continue;
+        scalar3 surfaceArea = make_scalar3(0,0,0);
+        if(latticeTypes.data[neighbors[0]] >0)
+            surfaceArea.x = -1.0;
+        if(latticeTypes.data[neighbors[1]] >0)
+            surfaceArea.x = 1.0;
+        if(latticeTypes.data[neighbors[2]] >0)
+            surfaceArea.y = -1.0;
+        if(latticeTypes.data[neighbors[3]] >0)
+            surfaceArea.y = 1.0;
+        if(latticeTypes.data[neighbors[4]] >0)
+            surfaceArea.z = -1.0;
+        if(latticeTypes.data[neighbors[5]] >0)
+            surfaceArea.z = 1.0;
+        scalar3 siteForce = surfaceArea*siteStressTensor(site,neighbors,Qtensors.data,latticeTypes.data,bounds.data,externalField.data);
+        for (int bb = 0; bb < nBordered; ++bb)
+            objectForces[borderedObjects[bb]] = objectForces[borderedObjects[bb]] + siteForce;
+        };
     }
 
 /*!
 expression from "Hierarchical self-assembly of nematic colloidal superstructures"
 PHYSICAL REVIEW E 77, 061706 (2008)
 */
+Matrix3x3 landauDeGennesLC::siteStressTensor(int site, const int *neighbors, const dVec *Qtensors, const int *latticeTypes,
+                                             const boundaryObject *bounds, const scalar3 *externalField)
+    {
+    cubicLatticeDerivativeVector firstDerivative;
+    lcForce::firstDerivatives(firstDerivative,latticeTypes[site],Qtensors[site],
+            Qtensors[neighbors[0]],Qtensors[neighbors[1]],Qtensors[neighbors[2]],Qtensors[neighbors[3]],Qtensors[neighbors[4]],Qtensors[neighbors[5]],
+            latticeTypes[neighbors[0]],latticeTypes[neighbors[1]],latticeTypes[neighbors[2]],latticeTypes[neighbors[3]],
+            latticeTypes[neighbors[4]],latticeTypes[neighbors[5]]);
+    scalar energyTerms[5] = {0.0,0.0,0.0,0.0,0.0};
+    scalar energyAtSite = siteEnergyDensity(site,neighbors,Qtensors,latticeTypes,bounds,externalField,energyTerms);
+    Matrix3x3 stress;
+    stress.set(
+                        -2*L1*(firstDerivative[0]*firstDerivative[0] + 2*(firstDerivative[1]*firstDerivative[1]) + 2*(firstDerivative[2]*firstDerivative[2]) + firstDerivative[3]*firstDerivative[3] + 2*(firstDerivative[4]*firstDerivative[4]) + firstDerivative[0]*firstDerivative[3]),
+                        L1*(-(firstDerivative[5]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[8]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[6]*firstDerivative[1] + firstDerivative[7]*firstDerivative[2] + firstDerivative[9]*firstDerivative[4])),
+                        L1*(-(firstDerivative[10]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[13]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[11]*firstDerivative[1] + firstDerivative[12]*firstDerivative[2] + firstDerivative[14]*firstDerivative[4])),
+                        L1*(-(firstDerivative[5]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[8]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[6]*firstDerivative[1] + firstDerivative[7]*firstDerivative[2] + firstDerivative[9]*firstDerivative[4])),
+                        -2*L1*(firstDerivative[5]*firstDerivative[5] + 2*(firstDerivative[6]*firstDerivative[6]) + 2*(firstDerivative[7]*firstDerivative[7]) + firstDerivative[8]*firstDerivative[8] + 2*(firstDerivative[9]*firstDerivative[9]) + firstDerivative[5]*firstDerivative[8]),
+                        L1*(-(firstDerivative[10]*(2*firstDerivative[5] + firstDerivative[8])) - firstDerivative[13]*(firstDerivative[5] + 2*firstDerivative[8]) - 4*(firstDerivative[11]*firstDerivative[6] + firstDerivative[12]*firstDerivative[7] + firstDerivative[14]*firstDerivative[9])),
+                        L1*(-(firstDerivative[10]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[13]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[11]*firstDerivative[1] + firstDerivative[12]*firstDerivative[2] + firstDerivative[14]*firstDerivative[4])),
+                        L1*(-(firstDerivative[10]*(2*firstDerivative[5] + firstDerivative[8])) - firstDerivative[13]*(firstDerivative[5] + 2*firstDerivative[8]) - 4*(firstDerivative[11]*firstDerivative[6] + firstDerivative[12]*firstDerivative[7] + firstDerivative[14]*firstDerivative[9])),
+                        -2*L1*(firstDerivative[10]*firstDerivative[10] + 2*(firstDerivative[11]*firstDerivative[11]) + 2*(firstDerivative[12]*firstDerivative[12]) + firstDerivative[13]*firstDerivative[13] + 2*(firstDerivative[14]*firstDerivative[14]) + firstDerivative[10]*firstDerivative[13])
+                        );
+    stress.x11 += energyAtSite;
+    stress.x22 += energyAtSite;
+    stress.x33 += energyAtSite;
+    return stress;
+    };
+
+/*!
+Only the listed sites and their neighbors are read (rather than computing the derivatives and energy density of the
+whole lattice), so this is cheap for the surface of an object. Only the one-constant stress is known.
+*/
 void landauDeGennesLC::computeStressTensors(GPUArray<int> &sites,GPUArray<Matrix3x3> &stresses)
     {
-    computeFirstDerivatives();
     int n = sites.getNumElements();
     if(stresses.getNumElements() < n)
         stresses.resize(n);
-    if(numberOfConstants == distortionEnergyType::oneConstant)
+    if(numberOfConstants != distortionEnergyType::oneConstant)
+        return;
+    ArrayHandle<int> targetSites(sites,access_location::host,access_mode::read);
+    ArrayHandle<Matrix3x3> stress(stresses,access_location::host,access_mode::overwrite);
+    ArrayHandle<dVec> Qtensors(lattice->returnPositions(),access_location::host,access_mode::read);
+    ArrayHandle<int> latticeTypes(lattice->returnTypes(),access_location::host,access_mode::read);
+    ArrayHandle<boundaryObject> bounds(lattice->boundaries,access_location::host,access_mode::read);
+    ArrayHandle<scalar3> externalField(spatiallyVaryingField,access_location::host,access_mode::read);
+    int neighNum;
+    vector<int> neighbors(6);
+    for (int ii = 0; ii < n; ++ii)
         {
-        if(true)//        if(!useGPU)
-            {
-            computeEnergyCPU(false);
-            ArrayHandle<int> targetSites(sites,access_location::host,access_mode::read);
-            ArrayHandle<Matrix3x3> stress(stresses,access_location::host,access_mode::overwrite);
-            ArrayHandle<cubicLatticeDerivativeVector> h_derivatives(forceCalculationAssist,access_location::host,access_mode::read);
-            ArrayHandle<scalar> energyPerSite(energyDensity,access_location::host,access_mode::read);
-            for (int ii = 0; ii < n; ++ii)
-                {
-                int s=targetSites.data[ii];
-                cubicLatticeDerivativeVector firstDerivative = h_derivatives.data[s];
-                stress.data[ii].set(
-                                    -2*L1*(firstDerivative[0]*firstDerivative[0] + 2*(firstDerivative[1]*firstDerivative[1]) + 2*(firstDerivative[2]*firstDerivative[2]) + firstDerivative[3]*firstDerivative[3] + 2*(firstDerivative[4]*firstDerivative[4]) + firstDerivative[0]*firstDerivative[3]),
-                                    L1*(-(firstDerivative[5]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[8]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[6]*firstDerivative[1] + firstDerivative[7]*firstDerivative[2] + firstDerivative[9]*firstDerivative[4])),
-                                    L1*(-(firstDerivative[10]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[13]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[11]*firstDerivative[1] + firstDerivative[12]*firstDerivative[2] + firstDerivative[14]*firstDerivative[4])),
-                                    L1*(-(firstDerivative[5]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[8]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[6]*firstDerivative[1] + firstDerivative[7]*firstDerivative[2] + firstDerivative[9]*firstDerivative[4])),
-                                    -2*L1*(firstDerivative[5]*firstDerivative[5] + 2*(firstDerivative[6]*firstDerivative[6]) + 2*(firstDerivative[7]*firstDerivative[7]) + firstDerivative[8]*firstDerivative[8] + 2*(firstDerivative[9]*firstDerivative[9]) + firstDerivative[5]*firstDerivative[8]),
-                                    L1*(-(firstDerivative[10]*(2*firstDerivative[5] + firstDerivative[8])) - firstDerivative[13]*(firstDerivative[5] + 2*firstDerivative[8]) - 4*(firstDerivative[11]*firstDerivative[6] + firstDerivative[12]*firstDerivative[7] + firstDerivative[14]*firstDerivative[9])),
-                                    L1*(-(firstDerivative[10]*(2*firstDerivative[0] + firstDerivative[3])) - firstDerivative[13]*(firstDerivative[0] + 2*firstDerivative[3]) - 4*(firstDerivative[11]*firstDerivative[1] + firstDerivative[12]*firstDerivative[2] + firstDerivative[14]*firstDerivative[4])),
-                                    L1*(-(firstDerivative[10]*(2*firstDerivative[5] + firstDerivative[8])) - firstDerivative[13]*(firstDerivative[5] + 2*firstDerivative[8]) - 4*(firstDerivative[11]*firstDerivative[6] + firstDerivative[12]*firstDerivative[7] + firstDerivative[14]*firstDerivative[9])),
-                                    -2*L1*(firstDerivative[10]*firstDerivative[10] + 2*(firstDerivative[11]*firstDerivative[11]) + 2*(firstDerivative[12]*firstDerivative[12]) + firstDerivative[13]*firstDerivative[13] + 2*(firstDerivative[14]*firstDerivative[14]) + firstDerivative[10]*firstDerivative[13])
-                                    );
-                stress.data[ii].x11 += energyPerSite.data[s];
-                stress.data[ii].x22 += energyPerSite.data[s];
-                stress.data[ii].x33 += energyPerSite.data[s];
-                }
-            }//if not GPU
-        }//if oneConstant
+        int s = lattice->getNeighbors(targetSites.data[ii],neighbors,neighNum);
+        stress.data[ii] = siteStressTensor(s,neighbors.data(),Qtensors.data,latticeTypes.data,bounds.data,externalField.data);
+        };
     };
 
 void landauDeGennesLC::computeEorHFieldForcesGPU(GPUArray<dVec> &forces,bool zeroOutForce,
@@ -277,11 +252,18 @@ void landauDeGennesLC::computeSpatiallyVaryingFieldCPU(GPUArray<dVec> &forces,bo
     {
     ArrayHandle<dVec> h_f(forces);
     ArrayHandle<scalar3> h_field(externalField,access_location::host,access_mode::read);
+    int nDof = lattice->getNumberOfForceSites();
+    if(!lattice->sparseStorage && nDof > externalField.getNumElements())
+        {
+        printf("a spatially varying field is only loaded for the sites each rank controls, so it cannot act on halo sites\n");
+        throw std::exception();
+        };
     if(zeroOutForce)
-        for(int pp = 0; pp < lattice->getNumberOfParticles(); ++pp)
+        for(int pp = 0; pp < nDof; ++pp)
             h_f.data[pp] = make_dVec(0.0);
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
     //the current scheme for getting the six nearest neighbors
     int neighNum;
     vector<int> neighbors(6);
@@ -289,9 +271,9 @@ void landauDeGennesLC::computeSpatiallyVaryingFieldCPU(GPUArray<dVec> &forces,bo
     scalar fieldProduct = anisotropicSusceptibility*vacuumPermeability;
     dVec fieldForce(0.);
     scalar3 field;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    for (int i = 0; i < nDof; ++i)
         {
-        currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
+        currentIndex = lattice->getNeighbors(lattice->sparseStorage ? activeSites.data[i] : i,neighbors,neighNum);
         if(latticeTypes.data[currentIndex] > 0)//skip boundary sites
             continue;
         field = h_field.data[currentIndex];
@@ -300,7 +282,9 @@ void landauDeGennesLC::computeSpatiallyVaryingFieldCPU(GPUArray<dVec> &forces,bo
         fieldForce[2] = -fieldProduct*field.x*field.z;
         fieldForce[3] = -0.5*fieldProduct*(field.y*field.y-field.z*field.z);
         fieldForce[4] = -fieldProduct*field.y*field.z;
-        h_f.data[currentIndex] -= fieldForce;
+        if(lattice->orthonormalBasis)
+            fieldForce = orthonormalBasisTransform(fieldForce);
+        h_f.data[i] -= fieldForce;
         };
     };
 
@@ -308,11 +292,13 @@ void landauDeGennesLC::computeEorHFieldForcesCPU(GPUArray<dVec> &forces,bool zer
                     scalar3 field, scalar anisotropicSusceptibility,scalar vacuumPermeability)
     {
     ArrayHandle<dVec> h_f(forces);
+    int nDof = lattice->getNumberOfForceSites();
     if(zeroOutForce)
-        for(int pp = 0; pp < lattice->getNumberOfParticles(); ++pp)
+        for(int pp = 0; pp < nDof; ++pp)
             h_f.data[pp] = make_dVec(0.0);
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
     //the current scheme for getting the six nearest neighbors
     int neighNum;
     vector<int> neighbors(6);
@@ -324,12 +310,14 @@ void landauDeGennesLC::computeEorHFieldForcesCPU(GPUArray<dVec> &forces,bool zer
     fieldForce[2] = -fieldProduct*field.x*field.z;
     fieldForce[3] = -0.5*fieldProduct*(field.y*field.y-field.z*field.z);
     fieldForce[4] = -fieldProduct*field.y*field.z;
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    if(lattice->orthonormalBasis)
+        fieldForce = orthonormalBasisTransform(fieldForce);
+    for (int i = 0; i < nDof; ++i)
         {
-        currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
+        currentIndex = lattice->getNeighbors(lattice->sparseStorage ? activeSites.data[i] : i,neighbors,neighNum);
         if(latticeTypes.data[currentIndex] > 0)//skip boundary sites
             continue;
-        h_f.data[currentIndex] -= fieldForce;
+        h_f.data[i] -= fieldForce;
         };
     };
 
@@ -356,67 +344,74 @@ void landauDeGennesLC::computeBoundaryForcesGPU(GPUArray<dVec> &forces,bool zero
 void landauDeGennesLC::computeBoundaryForcesCPU(GPUArray<dVec> &forces,bool zeroOutForce)
     {
     ArrayHandle<dVec> h_f(forces);
+    int nDof = lattice->getNumberOfForceSites();
     if(zeroOutForce)
-        for(int pp = 0; pp < lattice->getNumberOfParticles(); ++pp)
+        for(int pp = 0; pp < nDof; ++pp)
             h_f.data[pp] = make_dVec(0.0);
     ArrayHandle<dVec> Qtensors(lattice->returnPositions());
     ArrayHandle<int> latticeTypes(lattice->returnTypes());
+    ArrayHandle<int> activeSites(lattice->activeSites,access_location::host,access_mode::read);
     ArrayHandle<boundaryObject> bounds(lattice->boundaries);
-    for (int i = 0; i < lattice->getNumberOfParticles(); ++i)
+    //only surface sites can neighbor an object
+    lattice->updateSiteTypeLists();
+    ArrayHandle<int> surfaceSites(lattice->surfaceSiteIndices,access_location::host,access_mode::read);
+    int nSurface = lattice->forceSitesInList(lattice->surfaceSiteIndices);
+    for (int ii = 0; ii < nSurface; ++ii)
         {
+        int i = surfaceSites.data[ii];
         //the current scheme for getting the six nearest neighbors
         int neighNum;
         vector<int> neighbors(6);
         int currentIndex;
         dVec qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,tempForce;
-        currentIndex = lattice->getNeighbors(i,neighbors,neighNum);
-        if(latticeTypes.data[currentIndex] < 0)
-            {
-            qCurrent = Qtensors.data[currentIndex];
-            xDown = Qtensors.data[neighbors[0]];
-            xUp = Qtensors.data[neighbors[1]];
-            yDown = Qtensors.data[neighbors[2]];
-            yUp = Qtensors.data[neighbors[3]];
-            zDown = Qtensors.data[neighbors[4]];
-            zUp = Qtensors.data[neighbors[5]];
+        dVec anchoringForce(0.0);
+        currentIndex = lattice->getNeighbors(lattice->sparseStorage ? activeSites.data[i] : i,neighbors,neighNum);
+        qCurrent = Qtensors.data[currentIndex];
+        xDown = Qtensors.data[neighbors[0]];
+        xUp = Qtensors.data[neighbors[1]];
+        yDown = Qtensors.data[neighbors[2]];
+        yUp = Qtensors.data[neighbors[3]];
+        zDown = Qtensors.data[neighbors[4]];
+        zUp = Qtensors.data[neighbors[5]];
 
-            if(latticeTypes.data[neighbors[0]] > 0)
-                {
-                computeBoundaryForce(qCurrent, xDown, bounds.data[latticeTypes.data[neighbors[0]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                }
-            if(latticeTypes.data[neighbors[1]] > 0)
-                {
-                computeBoundaryForce(qCurrent, xUp, bounds.data[latticeTypes.data[neighbors[1]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                };
-            if(latticeTypes.data[neighbors[2]] > 0)
-                {
-                computeBoundaryForce(qCurrent, yDown, bounds.data[latticeTypes.data[neighbors[2]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                }
-            if(latticeTypes.data[neighbors[3]] > 0)
-                {
-                computeBoundaryForce(qCurrent, yUp, bounds.data[latticeTypes.data[neighbors[3]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                }
-            if(latticeTypes.data[neighbors[4]] > 0)
-                {
-                computeBoundaryForce(qCurrent, zDown, bounds.data[latticeTypes.data[neighbors[4]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                }
-            if(latticeTypes.data[neighbors[5]] > 0)
-                {
-                computeBoundaryForce(qCurrent, zUp, bounds.data[latticeTypes.data[neighbors[5]]-1],tempForce);
-                h_f.data[currentIndex] += tempForce;
-                }
+        if(latticeTypes.data[neighbors[0]] > 0)
+            {
+            computeBoundaryForce(qCurrent, xDown, bounds.data[latticeTypes.data[neighbors[0]]-1],tempForce);
+            anchoringForce += tempForce;
+            }
+        if(latticeTypes.data[neighbors[1]] > 0)
+            {
+            computeBoundaryForce(qCurrent, xUp, bounds.data[latticeTypes.data[neighbors[1]]-1],tempForce);
+            anchoringForce += tempForce;
+            };
+        if(latticeTypes.data[neighbors[2]] > 0)
+            {
+            computeBoundaryForce(qCurrent, yDown, bounds.data[latticeTypes.data[neighbors[2]]-1],tempForce);
+            anchoringForce += tempForce;
+            }
+        if(latticeTypes.data[neighbors[3]] > 0)
+            {
+            computeBoundaryForce(qCurrent, yUp, bounds.data[latticeTypes.data[neighbors[3]]-1],tempForce);
+            anchoringForce += tempForce;
+            }
+        if(latticeTypes.data[neighbors[4]] > 0)
+            {
+            computeBoundaryForce(qCurrent, zDown, bounds.data[latticeTypes.data[neighbors[4]]-1],tempForce);
+            anchoringForce += tempForce;
+            }
+        if(latticeTypes.data[neighbors[5]] > 0)
+            {
+            computeBoundaryForce(qCurrent, zUp, bounds.data[latticeTypes.data[neighbors[5]]-1],tempForce);
+            anchoringForce += tempForce;
             }
+        h_f.data[i] += lattice->orthonormalBasis ? orthonormalBasisTransform(anchoringForce) : anchoringForce;
         }
     };
 
 void landauDeGennesLC::setNumberOfConstants(distortionEnergyType _type)
     {
     numberOfConstants = _type;
+    cpuForceTuner = NULL;
     //if(numberOfConstants == distortionEnergyType::multiConstant)
 //        printf("\n\n ***WARNING*** \nSome users have reported that the expressions used in multi-constant expressions for the distortion free energy forces may have an error in them. We are currently investigating\n***WARNING***\n\n");
 //      DMS, Feb 22, 2021: I believe I have resolved the error in the lcForces.h file that gave rise to the problems with the multi-constant expressions
@@ -1036,6 +1036,91 @@ namespace lcForce
         spatialTerm = (0.5*L6)*spatialTerm;
         };
 
+    /*!
+    The first derivatives at a site whose type is not positive (as laid out in forceCalculationAssist): centered
+    differences, except that along a direction with an object neighbor they are one-sided, away from the object
+    */
+    HOSTDEVICE void firstDerivatives(cubicLatticeDerivativeVector &derivative, int siteType, const dVec &qCurrent,
+            const dVec &xDown, const dVec &xUp, const dVec &yDown, const dVec &yUp, const dVec &zDown, const dVec &zUp,
+            int xDownType, int xUpType, int yDownType, int yUpType, int zDownType, int zUpType)
+        {
+        if(siteType == 0 || (xDownType <= 0 && xUpType <= 0))
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[qq] = 0.5*(xUp[qq]-xDown[qq]);
+        else if(xUpType > 0)
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[qq] = (qCurrent[qq]-xDown[qq]);
+        else
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[qq] = (xUp[qq]-qCurrent[qq]);
+
+        if(siteType == 0 || (yDownType <= 0 && yUpType <= 0))
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[DIMENSION+qq] = 0.5*(yUp[qq]-yDown[qq]);
+        else if(yUpType > 0)
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[DIMENSION+qq] = (qCurrent[qq]-yDown[qq]);
+        else
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[DIMENSION+qq] = (yUp[qq]-qCurrent[qq]);
+
+        if(siteType == 0 || (zDownType <= 0 && zUpType <= 0))
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[2*DIMENSION+qq] = 0.5*(zUp[qq]-zDown[qq]);
+        else if(zUpType > 0)
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[2*DIMENSION+qq] = (qCurrent[qq]-zDown[qq]);
+        else
+            for (int qq = 0; qq < DIMENSION; ++qq)
+                derivative[2*DIMENSION+qq] = (zUp[qq]-qCurrent[qq]);
+        };
+
+    //!the L1 through L6 distortion terms at a bulk site (the negative of the force, as above)
+    HOSTDEVICE void bulkDistortionForce(const scalar L1, const scalar L2, const scalar L3, const scalar L4, const scalar L6,
+            const dVec &qCurrent,
+            const dVec &xDown, const dVec &xUp, const dVec &yDown, const dVec &yUp, const dVec &zDown, const dVec &zUp,
+            const cubicLatticeDerivativeVector &xDownDerivative, const cubicLatticeDerivativeVector &xUpDerivative,
+            const cubicLatticeDerivativeVector &yDownDerivative, const cubicLatticeDerivativeVector &yUpDerivative,
+            const cubicLatticeDerivativeVector &zDownDerivative, const cubicLatticeDerivativeVector &zUpDerivative,
+            dVec &spatialTerm)
+        {
+        dVec individualTerms(0.0);
+        spatialTerm = make_dVec(0.0);
+        if(L1 != 0)
+            {
+            bulkL1Force(L1,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,individualTerms);
+            spatialTerm += individualTerms;
+            }
+        if(L2 != 0)
+            {
+            bulkL2Force(L2,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                individualTerms);
+            spatialTerm += individualTerms;
+            }
+        if(L3 != 0)
+            {
+            bulkL3Force(L3,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                individualTerms);
+            spatialTerm += individualTerms;
+            }
+        if(L4 != 0)
+            {
+            bulkL4Force(L4,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                individualTerms);
+            spatialTerm += individualTerms;
+            }
+        if(L6 != 0)
+            {
+            bulkL6Force(L6,qCurrent,xDown,xUp,yDown,yUp,zDown,zUp,
+                xDownDerivative, xUpDerivative,yDownDerivative, yUpDerivative,zDownDerivative, zUpDerivative,
+                individualTerms);
+            spatialTerm += individualTerms;
+            }
+        };
+
     }//end namespace
 #undef HOSTDEVICE
 #endif
@@ -38,6 +38,9 @@ void cubicLattice::initializeNSites()
     if(neverGPU)
         {
         neighboringSites.noGPU = true;
+        activeSites.noGPU = true;
+        bulkSiteIndices.noGPU = true;
+        surfaceSiteIndices.noGPU = true;
         boundaries.noGPU = true;
         boundaryMoveAssist1.noGPU = true;
         boundaryMoveAssist2.noGPU = true;
@@ -146,16 +149,21 @@ void cubicLattice::fillNeighborLists(int stencilType)
     vector<int> neighs;
     int nNeighs;
     int temp = getNeighbors(0, neighs,nNeighs,stencilType);
+    neighborListStencil = stencilType;
 
-    neighborIndex = Index2D(nNeighs,N);
-    neighboringSites.resize(nNeighs*N);
+    //in sparse storage only the active sites get a list, indexed by their degree of freedom
+    int nSites = getNumberOfNeighborListSites();
+    neighborIndex = Index2D(nNeighs,nSites);
+    neighboringSites.resize(nNeighs*nSites);
 
     //if(!useGPU)
         {
         ArrayHandle<int> neighbors(neighboringSites);
-        for (int ii = 0; ii < N; ++ii)
+        ArrayHandle<int> sites(activeSites,access_location::host,access_mode::read);
+        for (int ii = 0; ii < nSites; ++ii)
             {
-            temp = getNeighbors(ii, neighs,nNeighs,stencilType);
+            int site = sparseStorage ? sites.data[ii] : ii;
+            temp = getNeighbors(site, neighs,nNeighs,stencilType);
             for (int jj = 0; jj < nNeighs; ++jj)
                 {
                 neighbors.data[neighborIndex(jj,ii)] = neighs[jj];
@@ -167,6 +175,171 @@ void cubicLattice::fillNeighborLists(int stencilType)
     //    }
     };
 
+/*!
+Blocked storage keeps the six neighbors of most sites within blockSize^2 entries of each other, instead of a whole plane
+of the lattice for the z neighbors, so the force stencil reuses cache lines across a block. Every index of a site goes
+through latticeIndex, so the order is invisible outside of the model apart from the layout of the per-site arrays;
+halo sites (in multi-rank models) stay after the first N. Forces must be recomputed. Call it before boundary objects
+or spatially varying fields are set up (they store site indices), and before sparse storage is switched on.
+*/
+void cubicLattice::setSiteBlockSize(int blockSize)
+    {
+    if(boundaries.getNumElements() > 0 || sparseStorage)
+        {
+        printf("the site order must be chosen before boundary objects are created and before sparse storage is used\n");
+        throw std::exception();
+        };
+    Index3D newIndex = latticeIndex;
+    newIndex.setBlockSize(blockSize);
+    vector<int> newSite(N);
+    for (int ii = 0; ii < N; ++ii)
+        newSite[ii] = newIndex(latticeIndex.inverseIndex(ii));
+    latticeIndex = newIndex;
+    renumberSites(newSite);
+    forcesComputed = false;
+    siteTypesChanged();
+    if(neighboringSites.getNumElements() > 0)
+        fillNeighborLists(neighborListStencil);
+    };
+
+//!permute the first N entries of a per-site array
+template<typename T>
+static void renumberArray(GPUArray<T> &data, vector<int> &newSite)
+    {
+    if(data.getNumElements() < newSite.size())
+        return;
+    ArrayHandle<T> h(data);
+    vector<T> old(h.data,h.data+newSite.size());
+    for (int ii = 0; ii < newSite.size(); ++ii)
+        h.data[newSite[ii]] = old[ii];
+    };
+
+void cubicLattice::renumberSites(vector<int> &newSite)
+    {
+    renumberArray(positions,newSite);
+    renumberArray(types,newSite);
+    renumberArray(velocities,newSite);
+    };
+
+/*!
+In sparse storage, sites that belong to boundary objects (type > 0) are not degrees of freedom: they keep their
+Q-tensor and type (so that surface sites can read their anchoring data), but no force, velocity, or neighbor list,
+and the force computers and updaters loop over the active sites only. Only the CPU branch supports it.
+*/
+void cubicLattice::setSparseStorage(bool _sparse)
+    {
+    if(_sparse && useGPU)
+        {
+        printf("sparse storage of lattice sites is only implemented on the CPU\n");
+        throw std::exception();
+        };
+    if(_sparse == sparseStorage)
+        return;
+    //expand to dense storage first, then compact again if requested
+    if(sparseStorage)
+        {
+        sparseStorage = false;
+        compactActiveSites();
+        };
+    sparseStorage = _sparse;
+    if(sparseStorage)
+        compactActiveSites();
+    };
+
+/*!
+Build the list of sites (among the N controlled by this model) with type <= 0, and resize the per-degree-of-freedom
+arrays to match. Velocities of sites that are active before and after are kept; those of newly active sites are zero.
+Forces must be recomputed. When sparse storage is off this restores full-length arrays.
+*/
+void cubicLattice::compactActiveSites()
+    {
+    int nDense = positions.getNumElements();
+    //the current velocities, indexed by site
+    vector<dVec> siteVelocities(nDense,make_dVec(0.0));
+    {
+    ArrayHandle<dVec> h_v(velocities,access_location::host,access_mode::read);
+    ArrayHandle<int> oldSites(activeSites,access_location::host,access_mode::read);
+    int nOld = velocities.getNumElements();
+    bool wasCompact = activeSites.getNumElements() > 0;
+    for (int dof = 0; dof < nOld; ++dof)
+        siteVelocities[wasCompact ? oldSites.data[dof] : dof] = h_v.data[dof];
+    }
+
+    int nDof = nDense;
+    if(sparseStorage)
+        {
+        vector<int> active;
+        active.reserve(N);
+        ArrayHandle<int> t(types,access_location::host,access_mode::read);
+        for (int ii = 0; ii < N; ++ii)
+            if(t.data[ii] <= 0)
+                active.push_back(ii);
+        //fillGPUArrayWithVector never shrinks an array
+        activeSites.resize(active.size());
+        fillGPUArrayWithVector(active,activeSites);
+        nDof = active.size();
+        }
+    else
+        activeSites.resize(0);
+
+    forces.resize(nDof);
+    velocities.resize(storeVelocities ? nDof : 0);
+    {
+    ArrayHandle<dVec> h_f(forces,access_location::host,access_mode::overwrite);
+    ArrayHandle<dVec> h_v(velocities,access_location::host,access_mode::overwrite);
+    ArrayHandle<int> sites(activeSites,access_location::host,access_mode::read);
+    for (int dof = 0; dof < nDof; ++dof)
+        {
+        h_f.data[dof] = make_dVec(0.0);
+        if(storeVelocities)
+            h_v.data[dof] = siteVelocities[sparseStorage ? sites.data[dof] : dof];
+        };
+    }
+    forcesComputed = false;
+    siteTypeListsCurrent = false;
+    if(neighboringSites.getNumElements() > 0)
+        fillNeighborLists(neighborListStencil);
+    };
+
+/*!
+The CPU force kernels loop over these lists instead of testing the type of every site (twice per force evaluation).
+Entries are degrees of freedom, i.e. positions in the force and neighbor lists; sites that belong to objects are in
+neither list. Models whose forces can be computed on some halo sites list those as well.
+*/
+void cubicLattice::sortSitesByType()
+    {
+    vector<int> bulk, surface;
+    int nDof = getNumberOfNeighborListSites();
+    bulk.reserve(nDof);
+    ArrayHandle<int> t(types,access_location::host,access_mode::read);
+    ArrayHandle<int> sites(activeSites,access_location::host,access_mode::read);
+    for (int dof = 0; dof < nDof; ++dof)
+        {
+        int siteType = t.data[sparseStorage ? sites.data[dof] : dof];
+        if(siteType == 0)
+            bulk.push_back(dof);
+        else if(siteType < 0)
+            surface.push_back(dof);
+        };
+    //fillGPUArrayWithVector never shrinks an array
+    bulkSiteIndices.resize(bulk.size());
+    surfaceSiteIndices.resize(surface.size());
+    fillGPUArrayWithVector(bulk,bulkSiteIndices);
+    fillGPUArrayWithVector(surface,surfaceSiteIndices);
+    siteTypeListsCurrent = true;
+    };
+
+/*!
+The lists are sorted, and the halo sites of a model follow the sites it controls in order of their distance from them,
+so the sites whose forces are computed are a prefix of each list
+*/
+int cubicLattice::forceSitesInList(GPUArray<int> &sortedSites)
+    {
+    int nSites = sortedSites.getNumElements();
+    ArrayHandle<int> sites(sortedSites,access_location::host,access_mode::read);
+    return std::lower_bound(sites.data,sites.data+nSites,getNumberOfForceSites()) - sites.data;
+    };
+
 /*!
 returns, in the vector "neighbors" a list of lattice neighbors of the target site.
 If stencilType ==0 (the default), the result will be
@@ -296,6 +469,7 @@ void cubicLattice::createBoundaryObject(vector<int> &latticeSites, boundaryType
                 }
         };
     removeDuplicateVectorElements(surfaceSite);
+    siteTypesChanged();
 
     //add object and surface sites to the vectors
     GPUArray<int> newBoundarySites;
@@ -346,19 +520,36 @@ void cubicLattice::displaceBoundaryObject(int objectIndex, int motionDirection,
         ArrayHandle<pair<int,dVec> > bma1(boundaryMoveAssist1,access_location::host,access_mode::overwrite);
         ArrayHandle<pair<int,dVec> > bma2(boundaryMoveAssist2,access_location::host,access_mode::overwrite);
         ArrayHandle<int> neighbors(neighboringSites,access_location::host,access_mode::read);
+        //sparse storage has no neighbor lists for object sites, so look those neighbors up directly
+        vector<int> siteNeighbors;
+        int nNeighbors;
 
         //first, copy the Q-tensors for parallel transport, and set all surface sites to type 0 (will be overwritten in second step)
         for(int bb = 0; bb < boundarySites[objectIndex].getNumElements();++bb)
             {
             int site = bSites.data[bb];
-            int motionSite = neighbors.data[neighborIndex(motionDirection,site)];
+            int motionSite;
+            if(sparseStorage)
+                {
+                getNeighbors(site,siteNeighbors,nNeighbors);
+                motionSite = siteNeighbors[motionDirection];
+                }
+            else
+                motionSite = neighbors.data[neighborIndex(motionDirection,site)];
             bma1.data[bb].first = motionSite;
             bma1.data[bb].second = pos.data[site];
             }
         for (int ss = 0; ss < surfaceSites[objectIndex].getNumElements();++ss)
             {
             int site = sSites.data[ss];
-            int motionSite = neighbors.data[neighborIndex(motionDirection,site)];
+            int motionSite;
+            if(sparseStorage)
+                {
+                getNeighbors(site,siteNeighbors,nNeighbors);
+                motionSite = siteNeighbors[motionDirection];
+                }
+            else
+                motionSite = neighbors.data[neighborIndex(motionDirection,site)];
             bma2.data[ss].first = motionSite;
             bma2.data[ss].second = pos.data[site];
             t.data[site] = 0;
@@ -402,4 +593,9 @@ void cubicLattice::displaceBoundaryObject(int objectIndex, int motionDirection,
                                  surfaceSites[objectIndex].getNumElements());
         };
     }//end loop over steps.... this should be (easily) optimized away at some point.
+    //the sites the object left are now active, and the ones it entered are not
+    if(sparseStorage)
+        compactActiveSites();
+    else
+        siteTypesChanged();
     };
@@ -34,6 +34,8 @@ class cubicLattice : public simpleModel
         void sliceIndices(bool _s=true){sliceSites = _s;};
         //!given a triple, determine what
         int latticeSiteToLinearIndex(const int3 &target);
+        //!the position of (local) site idx in the global lattice; models that are part of a larger lattice override this
+        virtual int3 globalLatticePosition(int idx){return latticeIndex.inverseIndex(idx);};
         //!indexer for lattice sites
         Index3D latticeIndex;
         int3 latticeSites;
@@ -45,6 +47,46 @@ class cubicLattice : public simpleModel
         //!store the neighbors of each lattice site. The i'th neighbor of site j is given by neighboringSites[neighborIndex(i,j)]
         virtual void fillNeighborLists(int stencilType = 0);
 
+        //!store the sites in blocks of blockSize^3 (see Index3D) for locality of the neighbors along y and z; 0 restores the x-fastest order
+        void setSiteBlockSize(int blockSize);
+
+        //!keep forces, velocities, and neighbor lists only for sites that are not part of a boundary object
+        virtual void setSparseStorage(bool _sparse = true);
+        //!rebuild the list of active sites (and the arrays that depend on it) after the types of sites have changed
+        void compactActiveSites();
+        //!in sparse storage the degrees of freedom are the active sites only
+        virtual int getNumberOfDegreesOfFreedom(){return sparseStorage ? activeSites.getNumElements() : N;};
+        //!in sparse storage the active sites, and otherwise an empty array
+        virtual GPUArray<int> & returnDegreeOfFreedomParticles(){return activeSites;};
+        //!the number of degrees of freedom with neighbor lists, which are also those sorted into the bulk and surface lists
+        virtual int getNumberOfNeighborListSites(){return getNumberOfDegreesOfFreedom();};
+        //!the number of sites (halo sites included, indexed by site) within layers layers of halo sites whose neighbors are all stored
+        virtual int getNumberOfSitesWithinHaloLayers(int layers){return N;};
+        //!the number of leading entries of a bulk or surface list that are among the first getNumberOfForceSites() degrees of freedom
+        int forceSitesInList(GPUArray<int> &sortedSites);
+        //!are only the active sites stored?
+        bool sparseStorage = false;
+        //!in sparse storage, the lattice site of every degree of freedom (in increasing order)
+        /*!
+        Degree of freedom k is site activeSites[k]: forces[k], velocities[k], and the neighbor list entries
+        neighboringSites[neighborIndex(j,k)] all refer to it, while positions and types remain indexed by site (the
+        Q-tensors of object sites are the anchoring data read by their surface neighbors)
+        */
+        GPUArray<int> activeSites;
+
+        //!rebuild the bulk and surface lists if the types of sites have changed since they were last sorted
+        void updateSiteTypeLists()
+            {
+            if(!siteTypeListsCurrent)
+                sortSitesByType();
+            };
+        //!must be called by anything that changes the types of sites this model controls
+        void siteTypesChanged(){siteTypeListsCurrent = false;};
+        //!the degrees of freedom (with neighbor lists) of the bulk (type 0) sites, in increasing order
+        GPUArray<int> bulkSiteIndices;
+        //!the degrees of freedom of the surface and rank-border (type < 0) sites, in increasing order
+        GPUArray<int> surfaceSiteIndices;
+
         //!return the mean spin
         virtual dVec averagePosition()
             {
@@ -95,7 +137,7 @@ class cubicLattice : public simpleModel
             for (int bb = 0; bb < boundarySites.size(); ++bb)
                 bsSites += boundarySites[bb].getNumElements() + surfaceSites[bb].getNumElements();
             return 0.000000001*(2*sizeof(bool) +
-            (1+neighboringSites.getNumElements()+bsSites+boundaryState.size()+boundaryMoveAssist1.getNumElements()+boundaryMoveAssist2.getNumElements())*sizeof(int) +
+            (1+neighboringSites.getNumElements()+activeSites.getNumElements()+bulkSiteIndices.getNumElements()+surfaceSiteIndices.getNumElements()+bsSites+boundaryState.size()+boundaryMoveAssist1.getNumElements()+boundaryMoveAssist2.getNumElements())*sizeof(int) +
             sizeof(kernelTuner) + sizeof(boundaryObject) +
             2*sizeof(scalar)*DIMENSION*(boundaryMoveAssist2.getNumElements()+boundaryMoveAssist1.getNumElements()) +
             sizeof(Index2D) + sizeof(Index3D)) +
@@ -110,6 +152,15 @@ class cubicLattice : public simpleModel
         //!lattice sites per edge
         int L;
 
+        //!the stencil of the most recently filled neighbor lists
+        int neighborListStencil = 0;
+        //!sort the degrees of freedom into the bulk and surface lists
+        void sortSitesByType();
+        //!move the data of each site i < N to index newSite[i], after the lattice indexer has changed
+        virtual void renumberSites(vector<int> &newSite);
+        //!are the bulk and surface lists consistent with the types?
+        bool siteTypeListsCurrent = false;
+
         //!normalize vector length when moving spins?
         bool normalizeSpins;
 
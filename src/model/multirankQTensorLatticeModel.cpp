@@ -11,6 +11,7 @@ multirankQTensorLatticeModel::multirankQTensorLatticeModel(int lx, int ly, int l
     latticeSites.x = Lx;
     latticeSites.y = Ly;
     latticeSites.z = Lz;
+    latticeMinPosition = make_int3(0,0,0);
     if(neverGPU)
         {
         intTransferBufferSend.noGPU = true;
@@ -18,6 +19,8 @@ multirankQTensorLatticeModel::multirankQTensorLatticeModel(int lx, int ly, int l
         doubleTransferBufferSend.noGPU = true;
         doubleTransferBufferReceive.noGPU = true;
         }
+    dimensionOrderedBufferSend.noGPU = true;
+    dimensionOrderedBufferReceive.noGPU = true;
     determineBufferLayout();
 
     if(xHalo)
@@ -29,12 +32,15 @@ multirankQTensorLatticeModel::multirankQTensorLatticeModel(int lx, int ly, int l
 
     totalSites = N;
     if(xHalo || yHalo || zHalo)
-        totalSites = N+transferStartStopIndexes[25].y;
+        totalSites = N+transferStartStopIndexes[25].y+1;
+    haloLayerEnd.assign(1,N);
+    haloLayerEnd.push_back(totalSites);
+    haloOffset = make_int3(0,0,0);
     //printf("total sites: %i\n",totalSites);
     positions.resize(totalSites);
     types.resize(totalSites);
     forces.resize(totalSites);
-    velocities.resize(totalSites);
+    velocities.resize(storeVelocities ? totalSites : 0);
 
     //by default, set sites that interface with the other ranks to a negative type
     int tTest = 0;
@@ -50,33 +56,16 @@ multirankQTensorLatticeModel::multirankQTensorLatticeModel(int lx, int ly, int l
             h_t.data[ii]=-2;
         if(h_t.data[ii] == -2) tTest +=1;
         }
+    siteTypesChanged();
     }
 
+/*!
+The directors are drawn from counter-based generators keyed by the global lattice position, so the random field is the
+same for any rank decomposition and any number of threads
+*/
 void multirankQTensorLatticeModel::setRandomDirectors(noiseSource &noise, scalar s0, bool globallyAligned)
     {
-    scalar globalTheta = acos(2.0*noise.getRealUniform()-1);
-    scalar globalPhi = 2.0*PI*noise.getRealUniform();
-    ArrayHandle<dVec> pos(positions);
-    ArrayHandle<int> t(types,access_location::host,access_mode::read);
-    for (int ii = 0; ii < N; ++ii)
-        {
-        scalar theta = acos(2.0*noise.getRealUniform()-1);
-        scalar phi = 2.0*PI*noise.getRealUniform();
-        if(globallyAligned)
-            {
-            theta = globalTheta;
-            phi = globalPhi;
-            }
-        if(t.data[ii] <=0)
-            {
-            scalar3 n;
-            n.x = cos(phi)*sin(theta);
-            n.y = sin(phi)*sin(theta);
-            n.z = cos(theta);
-            qTensorFromDirector(n, s0, pos.data[ii]);
-            };
-        }
-
+    setCounterBasedRandomDirectors(noise,s0,globallyAligned);
     };
 
 void multirankQTensorLatticeModel::setUniformDirectors(scalar3 targetDirector, scalar s0)
@@ -114,6 +103,130 @@ void multirankQTensorLatticeModel::setDirectorFromFunction(std::function<scalar4
         }
     };
 
+/*!
+The halo sites keep their indices; the tables of the deep halo and of the dimension-ordered exchange refer to sites of
+the block by index, so their entries are renumbered as well
+*/
+void multirankQTensorLatticeModel::renumberSites(vector<int> &newSite)
+    {
+    cubicLattice::renumberSites(newSite);
+    vector<int> *tables[3] = {&extendedSiteIndex,&dimensionOrderedSendSites,&dimensionOrderedReceiveSites};
+    for (int tt = 0; tt < 3; ++tt)
+        for (int ii = 0; ii < tables[tt]->size(); ++ii)
+            {
+            int site = (*tables[tt])[ii];
+            if(site >= 0 && site < N)
+                (*tables[tt])[ii] = newSite[site];
+            };
+    };
+
+//!how far a coordinate is outside [0, L-1]
+static int distanceOutside(int p, int L)
+    {
+    if(p < 0)
+        return -p;
+    return p >= L ? p-L+1 : 0;
+    };
+
+/*!
+Halo sites of all layers are stored after the N sites this model controls, in order of their layer (the larger of
+their distances from the block along the three dimensions, so that edge and corner sites of layer m are as far out as
+face sites of layer m). The sites within any number of layers of the block are then a prefix of the data arrays, and a
+simulation can compute forces on, and advance, the inner layers of a deep halo along with its own sites to exchange
+halos less often (see multirankSimulation::setCommunicationAvoidingUpdates). A depth of one restores the layout of
+determineBufferLayout. Deep halos are exchanged with the dimension-ordered exchange, on the CPU, and every block must be
+at least as thick as the halo along the dimensions with halos.
+*/
+void multirankQTensorLatticeModel::setSparseStorage(bool _sparse)
+    {
+    if(_sparse && communicationAvoiding)
+        {
+        printf("sparse storage cannot be combined with communication-avoiding updates\n");
+        throw std::exception();
+        };
+    cubicLattice::setSparseStorage(_sparse);
+    };
+
+void multirankQTensorLatticeModel::setHaloDepth(int depth)
+    {
+    if(depth < 1)
+        {
+        printf("the halo depth must be at least one site\n");
+        throw std::exception();
+        };
+    if(depth > 1 && useGPU)
+        {
+        printf("halos deeper than one site are only implemented on the CPU\n");
+        throw std::exception();
+        };
+    bool halos[3] = {xHalo,yHalo,zHalo};
+    int sizes[3] = {latticeSites.x,latticeSites.y,latticeSites.z};
+    for (int dd = 0; dd < 3; ++dd)
+        if(halos[dd] && sizes[dd] < depth)
+            {
+            printf("a block of %i sites along axis %i cannot hold halos %i sites deep\n",sizes[dd],dd,depth);
+            throw std::exception();
+            };
+    haloDepth = depth;
+    haloLayerEnd.assign(1,N);
+    extendedSiteIndex.clear();
+    haloSitePositions.clear();
+    if(haloDepth == 1)
+        {
+        haloOffset = make_int3(0,0,0);
+        totalSites = N;
+        if(xHalo || yHalo || zHalo)
+            totalSites = N+transferStartStopIndexes[25].y+1;
+        }
+    else
+        {
+        haloOffset = make_int3(xHalo ? depth : 0, yHalo ? depth : 0, zHalo ? depth : 0);
+        extendedIndex = Index3D(make_int3(latticeSites.x+2*haloOffset.x,latticeSites.y+2*haloOffset.y,latticeSites.z+2*haloOffset.z));
+        extendedSiteIndex.assign(extendedIndex.getNumElements(),-1);
+        for (int layer = 0; layer <= haloDepth; ++layer)
+            {
+            for (int ee = 0; ee < extendedIndex.getNumElements(); ++ee)
+                {
+                int3 pos = extendedIndex.inverseIndex(ee);
+                pos.x -= haloOffset.x; pos.y -= haloOffset.y; pos.z -= haloOffset.z;
+                int siteLayer = max(distanceOutside(pos.x,latticeSites.x),
+                                    max(distanceOutside(pos.y,latticeSites.y),distanceOutside(pos.z,latticeSites.z)));
+                if(siteLayer != layer)
+                    continue;
+                if(layer == 0)
+                    extendedSiteIndex[ee] = latticeIndex(pos);
+                else
+                    {
+                    extendedSiteIndex[ee] = N + haloSitePositions.size();
+                    haloSitePositions.push_back(pos);
+                    };
+                };
+            if(layer > 0)
+                haloLayerEnd.push_back(N+haloSitePositions.size());
+            };
+        totalSites = haloLayerEnd[haloDepth];
+        };
+    if(haloDepth == 1)
+        haloLayerEnd.push_back(totalSites);
+    positions.resize(totalSites);
+    types.resize(totalSites);
+    forces.resize(totalSites);
+    velocities.resize(storeVelocities ? totalSites : 0);
+    //halo sites are filled by the next exchange
+    {
+    ArrayHandle<int> h_t(types);
+    ArrayHandle<dVec> h_p(positions);
+    for (int ii = N; ii < totalSites; ++ii)
+        {
+        h_t.data[ii] = 0;
+        h_p.data[ii] = make_dVec(0.0);
+        };
+    }
+    siteTypesChanged();
+    if(neighboringSites.getNumElements() > 0)
+        fillNeighborLists(neighborListStencil);
+    };
+
 int3 multirankQTensorLatticeModel::indexToPosition(int idx)
     {
 
@@ -122,6 +235,8 @@ int3 multirankQTensorLatticeModel::indexToPosition(int idx)
 
     if(idx >=totalSites)
         throw std::runtime_error("invalid index requested");
+    if(haloDepth > 1)
+        return haloSitePositions[idx-N];
     int ii = idx - N;
     int directionType = 0;
     int3 ans;
@@ -298,6 +413,14 @@ int multirankQTensorLatticeModel::positionToIndex(int3 &pos)
 
     if(pos.x < latticeSites.x && pos.y < latticeSites.y && pos.z < latticeSites.z && pos.x >=0 && pos.y >= 0 && pos.z >= 0)
         return latticeIndex(pos);
+    if(haloDepth > 1)
+        {
+        int3 extended = make_int3(pos.x+haloOffset.x,pos.y+haloOffset.y,pos.z+haloOffset.z);
+        if(ordered(0,extended.x,extendedIndex.sizes.x-1) && ordered(0,extended.y,extendedIndex.sizes.y-1) && ordered(0,extended.z,extendedIndex.sizes.z-1))
+            return extendedSiteIndex[extendedIndex(extended)];
+        printf("(%i %i %i)\n",pos.x,pos.y,pos.z);
+        throw std::runtime_error("invalid site requested");
+        };
     int base = N;
     //0: x = -1 face
     base = N + transferStartStopIndexes[0].x;
@@ -440,7 +563,7 @@ void multirankQTensorLatticeModel::prepareSendingBuffer(int directionType)
         ArrayHandle<dVec> hp(positions,access_location::device,access_mode::read);
         ArrayHandle<int> iBuf(intTransferBufferSend,access_location::device,access_mode::readwrite);
         ArrayHandle<scalar> dBuf(doubleTransferBufferSend,access_location::device,access_mode::readwrite);
-        int maxIndex = transferStartStopIndexes[transferStartStopIndexes.size()-1].y;
+        int maxIndex = transferStartStopIndexes[transferStartStopIndexes.size()-1].y+1;
         gpu_prepareSendingBuffer(ht.data,hp.data,iBuf.data,dBuf.data,latticeSites,latticeIndex,maxIndex);
         }
     }
@@ -476,7 +599,7 @@ void multirankQTensorLatticeModel::readReceivingBuffer(int directionType)
         ArrayHandle<dVec> hp(positions,access_location::device,access_mode::readwrite);
         ArrayHandle<int> iBuf(intTransferBufferReceive,access_location::device,access_mode::read);
         ArrayHandle<scalar> dBuf(doubleTransferBufferReceive,access_location::device,access_mode::read);
-        int maxIndex = transferStartStopIndexes[transferStartStopIndexes.size()-1].y;
+        int maxIndex = transferStartStopIndexes[transferStartStopIndexes.size()-1].y+1;
         gpu_copyReceivingBuffer(ht.data,hp.data,iBuf.data,dBuf.data,N,maxIndex);
         }
     }
@@ -486,6 +609,9 @@ During halo site communication, each rank will first completely fill the send bu
 Finally, the entire receive buffer will be transfered into the expanded data arrays.
 To facilitate this, a specific layout of the transfer buffers will be adopted for easy package/send/receive patterns:
 the x = 0 face will be the first (Ly*Lz) elemetents, followed by the other faces, the edges, and finally the 8 corners.
+The layout only depends on this rank's block, so ranks may control blocks of different sizes provided that the blocks
+form a rectilinear grid (see multirankSimulation::setConfiguration): a face or edge is then exactly as long as the
+one the neighbor on the other side sends or receives.
  */
 void multirankQTensorLatticeModel::determineBufferLayout()
     {
@@ -576,12 +702,131 @@ void multirankQTensorLatticeModel::determineBufferLayout()
     //printf("number of entries: %i\n",transferStartStopIndexes.size());
     //for (int ii = 0; ii < transferStartStopIndexes.size(); ++ii)
     //    printf("%i, %i\n", transferStartStopIndexes[ii].x,transferStartStopIndexes[ii].y);
-    intTransferBufferSend.resize(startStop.y);
-    intTransferBufferReceive.resize(startStop.y);
-    doubleTransferBufferSend.resize(DIMENSION*startStop.y);
-    doubleTransferBufferReceive.resize(DIMENSION*startStop.y);
+    //start and stop indexes are inclusive, so the buffers hold startStop.y+1 sites
+    intTransferBufferSend.resize(startStop.y+1);
+    intTransferBufferReceive.resize(startStop.y+1);
+    doubleTransferBufferSend.resize(DIMENSION*(startStop.y+1));
+    doubleTransferBufferReceive.resize(DIMENSION*(startStop.y+1));
     }
 
+/*!
+The dimension-ordered exchange sends whole faces, first along x, then along y, then along z. When forwardHalos is
+true, the y faces also cover the x halo sites (received in the first stage) and the z faces cover both the x and y
+halo sites, so edge and corner sites reach diagonal neighbors in two or three hops while each rank sends a single
+message across each face. The sites of a face are listed in the same order on both sides, so the buffer a rank sends
+across its x- face is read directly into the x+ halo of its neighbor. Faces along dimensions without halo sites are
+left empty. With deep halos each face is haloDepth planes thick, and halo sites are always forwarded.
+*/
+void multirankQTensorLatticeModel::determineDimensionOrderedLayout(bool forwardHalos)
+    {
+    dimensionOrderedSendSites.clear();
+    dimensionOrderedReceiveSites.clear();
+    dimensionOrderedStartStop.clear();
+    bool halos[3] = {xHalo,yHalo,zHalo};
+    int sizes[3] = {latticeSites.x,latticeSites.y,latticeSites.z};
+    int2 startStop;
+    for (int face = 0; face < 6; ++face)
+        {
+        int dimension = face/2;
+        startStop.x = dimensionOrderedSendSites.size();
+        startStop.y = startStop.x-1;
+        if(!halos[dimension])
+            {
+            dimensionOrderedStartStop.push_back(startStop);
+            continue;
+            };
+        //the other two dimensions, with the faster-varying one first
+        int fast = (dimension == 0) ? 1 : 0;
+        int slow = (dimension == 2) ? 1 : 2;
+        int minimum[3], maximum[3];
+        for (int dd = 0; dd < 3; ++dd)
+            {
+            bool forwarded = (forwardHalos || haloDepth > 1) && dd < dimension && halos[dd];
+            minimum[dd] = forwarded ? -haloDepth : 0;
+            maximum[dd] = forwarded ? sizes[dd]-1+haloDepth : sizes[dd]-1;
+            };
+        int coordinates[3];
+        int3 pos;
+        for (int plane = 0; plane < haloDepth; ++plane)
+            {
+            int sendPlane = (face%2 == 0) ? plane : sizes[dimension]-haloDepth+plane;
+            int receivePlane = (face%2 == 0) ? plane-haloDepth : sizes[dimension]+plane;
+            for (int bb = minimum[slow]; bb <= maximum[slow]; ++bb)
+                for (int aa = minimum[fast]; aa <= maximum[fast]; ++aa)
+                    {
+                    coordinates[fast] = aa;
+                    coordinates[slow] = bb;
+                    coordinates[dimension] = sendPlane;
+                    pos = make_int3(coordinates[0],coordinates[1],coordinates[2]);
+                    dimensionOrderedSendSites.push_back(positionToIndex(pos));
+                    coordinates[dimension] = receivePlane;
+                    pos = make_int3(coordinates[0],coordinates[1],coordinates[2]);
+                    dimensionOrderedReceiveSites.push_back(positionToIndex(pos));
+                    };
+            };
+        startStop.y = dimensionOrderedSendSites.size()-1;
+        dimensionOrderedStartStop.push_back(startStop);
+        };
+    dimensionOrderedBufferSend.resize(haloSiteScalars()*dimensionOrderedSendSites.size());
+    dimensionOrderedBufferReceive.resize(haloSiteScalars()*dimensionOrderedReceiveSites.size());
+    };
+
+/*!
+Types are sent alongside the Q-tensor components as scalars (they are small integers, so the conversion is exact), so
+that a face needs a single message. With haloVelocities the velocities follow the type of each site.
+*/
+void multirankQTensorLatticeModel::packDimensionOrderedBuffer(int face)
+    {
+    ArrayHandle<scalar> buf(dimensionOrderedBufferSend,access_location::host,access_mode::readwrite);
+    packDimensionOrderedBuffer(face,&buf.data[haloSiteScalars()*dimensionOrderedStartStop[face].x]);
+    };
+
+void multirankQTensorLatticeModel::packDimensionOrderedBuffer(int face, scalar *buffer)
+    {
+    ArrayHandle<int> ht(types,access_location::host,access_mode::read);
+    ArrayHandle<dVec> hp(positions,access_location::host,access_mode::read);
+    ArrayHandle<dVec> hv(velocities,access_location::host,access_mode::read);
+    int2 startStop = dimensionOrderedStartStop[face];
+    int stride = haloSiteScalars();
+    for (int ii = startStop.x; ii <= startStop.y; ++ii)
+        {
+        int currentSite = dimensionOrderedSendSites[ii];
+        scalar *element = &buffer[stride*(ii-startStop.x)];
+        for (int dd = 0; dd < DIMENSION; ++dd)
+            element[dd] = hp.data[currentSite][dd];
+        element[DIMENSION] = ht.data[currentSite];
+        if(haloVelocities)
+            for (int dd = 0; dd < DIMENSION; ++dd)
+                element[DIMENSION+1+dd] = hv.data[currentSite][dd];
+        };
+    };
+
+void multirankQTensorLatticeModel::unpackDimensionOrderedBuffer(int face)
+    {
+    ArrayHandle<scalar> buf(dimensionOrderedBufferReceive,access_location::host,access_mode::read);
+    unpackDimensionOrderedBuffer(face,&buf.data[haloSiteScalars()*dimensionOrderedStartStop[face].x]);
+    };
+
+void multirankQTensorLatticeModel::unpackDimensionOrderedBuffer(int face, const scalar *buffer)
+    {
+    ArrayHandle<int> ht(types,access_location::host,access_mode::readwrite);
+    ArrayHandle<dVec> hp(positions,access_location::host,access_mode::readwrite);
+    ArrayHandle<dVec> hv(velocities,access_location::host,access_mode::readwrite);
+    int2 startStop = dimensionOrderedStartStop[face];
+    int stride = haloSiteScalars();
+    for (int ii = startStop.x; ii <= startStop.y; ++ii)
+        {
+        int currentSite = dimensionOrderedReceiveSites[ii];
+        const scalar *element = &buffer[stride*(ii-startStop.x)];
+        for (int dd = 0; dd < DIMENSION; ++dd)
+            hp.data[currentSite][dd] = element[dd];
+        ht.data[currentSite] = (int) element[DIMENSION];
+        if(haloVelocities)
+            for (int dd = 0; dd < DIMENSION; ++dd)
+                hv.data[currentSite][dd] = element[DIMENSION+1+dd];
+        };
+    };
+
 int multirankQTensorLatticeModel::getNeighbors(int target, vector<int> &neighbors, int &neighs, int stencilType)
     {
     if(stencilType==0)
@@ -590,7 +835,7 @@ int multirankQTensorLatticeModel::getNeighbors(int target, vector<int> &neighbor
         if(neighbors.size()!=neighs) neighbors.resize(neighs);
         if(!sliceSites)
             {
-            int3 pos = latticeIndex.inverseIndex(target);
+            int3 pos = indexToPosition(target);
             neighbors[0] = positionToIndex(pos.x-1,pos.y,pos.z);
             neighbors[1] = positionToIndex(pos.x+1,pos.y,pos.z);
             neighbors[2] = positionToIndex(pos.x,pos.y-1,pos.z);
@@ -604,7 +849,7 @@ int multirankQTensorLatticeModel::getNeighbors(int target, vector<int> &neighbor
         {
         neighs = 18;
         if(neighbors.size()!=neighs) neighbors.resize(neighs);
-        int3 pos = latticeIndex.inverseIndex(target);
+        int3 pos = indexToPosition(target);
         neighbors[0] = positionToIndex(pos.x-1,pos.y,pos.z);
         neighbors[1] = positionToIndex(pos.x+1,pos.y,pos.z);
         neighbors[2] = positionToIndex(pos.x,pos.y-1,pos.z);
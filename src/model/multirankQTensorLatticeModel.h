@@ -32,6 +32,49 @@ class multirankQTensorLatticeModel : public qTensorLatticeModel
         //! list of start/stop elements in the transfer arrays for the halo sites
         vector<int2> transferStartStopIndexes;
 
+        //!store this many layers of halo sites along each dimension with halos (CPU only; call before the model is given to a simulation)
+        void setHaloDepth(int depth);
+        //!the number of layers of halo sites
+        int haloDepth = 1;
+        //!haloLayerEnd[m] is one past the index of the last site within m layers of those this model controls (N for m = 0)
+        vector<int> haloLayerEnd;
+        //!forces are computed, and updaters move, the halo sites of this many layers as well as those this model controls
+        int forceHaloLayers = 0;
+        //!the sites within forceHaloLayers (plus extraHaloLayers) layers of those this model controls, but never more than have neighbor lists
+        virtual int getNumberOfForceSites(int extraHaloLayers = 0)
+            {
+            if(sparseStorage)
+                return cubicLattice::getNumberOfForceSites(extraHaloLayers);
+            return haloLayerEnd[min(forceHaloLayers+extraHaloLayers,haloDepth-1)];
+            };
+        //!halo sites of every layer but the outermost have neighbor lists
+        virtual int getNumberOfNeighborListSites()
+            {
+            if(sparseStorage)
+                return cubicLattice::getNumberOfNeighborListSites();
+            return haloLayerEnd[haloDepth-1];
+            };
+        //!the outermost layer of halo sites is never counted, since its neighbors are not stored
+        virtual int getNumberOfSitesWithinHaloLayers(int layers){return haloLayerEnd[min(layers,haloDepth-1)];};
+        //!does a simulation also advance the halo sites of this model (see multirankSimulation::setCommunicationAvoidingUpdates)?
+        bool communicationAvoiding = false;
+        //!do halo exchanges carry the velocities of sites as well as their positions and types?
+        bool haloVelocities = false;
+        //!sparse storage keeps no forces or velocities for halo sites, so it is refused with communication-avoiding updates
+        virtual void setSparseStorage(bool _sparse = true);
+        //!the number of scalars per site in the buffers of the dimension-ordered exchange
+        int haloSiteScalars(){return haloVelocities ? 2*DIMENSION+1 : DIMENSION+1;};
+        //!freed velocities are no longer exchanged (a simulation exchanges them again when it is given the model)
+        virtual void freeGPUArrays(bool freeVelocities, bool freeRadii, bool freeMasses)
+            {
+            qTensorLatticeModel::freeGPUArrays(freeVelocities,freeRadii,freeMasses);
+            if(!storeVelocities)
+                haloVelocities = false;
+            };
+
+
+        //!the local position of site idx, shifted by latticeMinPosition
+        virtual int3 globalLatticePosition(int idx){return latticeIndex.inverseIndex(idx)+latticeMinPosition;};
 
         //! randomly set Q tensors to correspond to a field of directors of some S0. If globallyAligned = false, each lattice site is set separately, if globallyAligned = true all will point in the same (random) direction.
         void setRandomDirectors(noiseSource &noise, scalar s0, bool globallyAligned = false);
@@ -55,11 +98,24 @@ class multirankQTensorLatticeModel : public qTensorLatticeModel
         GPUArray<int> intTransferBufferReceive;
         GPUArray<scalar> doubleTransferBufferReceive;
 
+        //!sites sent across each face (x-, x+, y-, y+, z-, z+) by the dimension-ordered halo exchange, face by face
+        vector<int> dimensionOrderedSendSites;
+        //!halo sites filled from each face by the dimension-ordered halo exchange, in the order the neighbor sends them
+        vector<int> dimensionOrderedReceiveSites;
+        //!inclusive start/stop elements of each face in the dimension-ordered site lists and buffers
+        vector<int2> dimensionOrderedStartStop;
+        //!positions and types (and velocities if haloVelocities; haloSiteScalars() per site) of the dimension-ordered exchange
+        GPUArray<scalar> dimensionOrderedBufferSend;
+        GPUArray<scalar> dimensionOrderedBufferReceive;
+
         virtual scalar getClassSize()
             {
-            scalar thisClassSize = 0.000000001*(sizeof(scalar)*(doubleTransferBufferSend.getNumElements()+doubleTransferBufferReceive.getNumElements()) + 
+            scalar thisClassSize = 0.000000001*(sizeof(scalar)*(doubleTransferBufferSend.getNumElements()+doubleTransferBufferReceive.getNumElements()
+                                                                +dimensionOrderedBufferSend.getNumElements()+dimensionOrderedBufferReceive.getNumElements()) +
             3*sizeof(bool)
-            +(3+ intTransferBufferSend.getNumElements()+intTransferBufferReceive.getNumElements() + 2*transferStartStopIndexes.size())*sizeof(int));
+            +(3+ intTransferBufferSend.getNumElements()+intTransferBufferReceive.getNumElements() + 2*transferStartStopIndexes.size()
+              +dimensionOrderedSendSites.size()+dimensionOrderedReceiveSites.size()+2*dimensionOrderedStartStop.size()
+              +extendedSiteIndex.size()+3*haloSitePositions.size()+haloLayerEnd.size())*sizeof(int));
             return thisClassSize + qTensorLatticeModel::getClassSize();
             }
         void determineBufferLayout();
@@ -80,8 +136,30 @@ class multirankQTensorLatticeModel : public qTensorLatticeModel
         //!Fill the appropriate part of data from the receiving  buffer...if GPU, fill it all in one function call
         void readReceivingBuffer(int directionType = -1);
 
+        //!list the sites of a face-by-face halo exchange; if forwardHalos (always, for deep halos), each face includes the halo sites of the dimensions exchanged before it
+        void determineDimensionOrderedLayout(bool forwardHalos);
+        //!copy the positions and types of the sites sent across a face (0 to 5) into the send buffer
+        void packDimensionOrderedBuffer(int face);
+        //!copy the positions and types of the sites sent across a face into buffer, which holds only that face
+        void packDimensionOrderedBuffer(int face, scalar *buffer);
+        //!copy the positions and types received across a face (0 to 5) into the halo sites
+        void unpackDimensionOrderedBuffer(int face);
+        //!copy the positions and types of the halo sites of a face from buffer, which holds only that face (e.g., in the memory of another rank)
+        void unpackDimensionOrderedBuffer(int face, const scalar *buffer);
+
         //!this implementation knows that extra neighbors are after N in the data arrays
         virtual int getNeighbors(int target, vector<int> &neighbors, int &neighs, int stencilType = 0);
+
+    protected:
+        //!for halos deeper than one site, the index of every site of the block extended by haloDepth along each dimension with halos...
+        Index3D extendedIndex;
+        vector<int> extendedSiteIndex;
+        //!...and the position of every halo site
+        vector<int3> haloSitePositions;
+        //!the offset of the extended block along each dimension
+        int3 haloOffset;
+        //!also renumber the sites this model controls in the halo tables
+        virtual void renumberSites(vector<int> &newSite);
     };
 typedef shared_ptr<multirankQTensorLatticeModel> MConfigPtr;
 typedef weak_ptr<multirankQTensorLatticeModel> WeakMConfigPtr;
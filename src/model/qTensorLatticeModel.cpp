@@ -127,38 +127,21 @@ void qTensorLatticeModel::computeDefectMeasures(int defectType)
             gpu_get_qtensor_DefectMeasures(pos.data,defects.data,t.data,defectType,N);
         }
     }
+/*!
+On the CPU the directors come from setCounterBasedRandomDirectors; the GPU branch uses the (per-site) curand states
+of the noiseSource
+*/
 void qTensorLatticeModel::setNematicQTensorRandomly(noiseSource &noise,scalar S0, bool globallyAligned)
     {
     //cout << "setting randomly aligned nematic Q tensors of strength " << S0 << endl;
-    scalar amplitude =  3./2.*S0;
-    scalar globalTheta = acos(2.0*noise.getRealUniform()-1);
-    scalar globalPhi = 2.0*PI*noise.getRealUniform();
-
     if(!useGPU)
         {
-        ArrayHandle<dVec> pos(positions);
-        ArrayHandle<int> t(types,access_location::host,access_mode::read);
-        for(int pp = 0; pp < N; ++pp)
-            {
-            scalar theta = acos(2.0*noise.getRealUniform()-1);
-            scalar phi = 2.0*PI*noise.getRealUniform();
-            if(globallyAligned)
-                {
-                theta = globalTheta;
-                phi = globalPhi;
-                }
-            if(t.data[pp] <=0)
-                {
-                scalar3 n;
-                n.x = cos(phi)*sin(theta);
-                n.y = sin(phi)*sin(theta);
-                n.z = cos(theta);
-                qTensorFromDirector(n, S0, pos.data[pp]);
-                };
-            };
+        setCounterBasedRandomDirectors(noise,S0,globallyAligned);
         }
     else
         {
+        scalar globalTheta = acos(2.0*noise.getRealUniform()-1);
+        scalar globalPhi = 2.0*PI*noise.getRealUniform();
         ArrayHandle<int> t(types,access_location::device,access_mode::read);
         ArrayHandle<dVec> pos(positions,access_location::device,access_mode::readwrite);
         int blockSize = 128;
@@ -170,15 +153,88 @@ void qTensorLatticeModel::setNematicQTensorRandomly(noiseSource &noise,scalar S0
         }
     };
 
+/*!
+Each site's director is drawn from a counter-based generator keyed by its global lattice position (the globally aligned
+director uses a separate stream at the origin), so the sites are independent of each other and can be filled by
+nThreads threads, and the resulting field does not depend on the thread count or on how the lattice is split over ranks
+*/
+void qTensorLatticeModel::setCounterBasedRandomDirectors(noiseSource &noise,scalar S0, bool globallyAligned)
+    {
+    counterBasedRNG globalRNG = noise.counterRNG(0,0,globalDirectorStream);
+    scalar globalTheta = acos(2.0*globalRNG.uniform()-1);
+    scalar globalPhi = 2.0*PI*globalRNG.uniform();
+
+    ArrayHandle<dVec> pos(positions);
+    ArrayHandle<int> t(types,access_location::host,access_mode::read);
+    #pragma omp parallel for num_threads(nThreads)
+    for(int pp = 0; pp < N; ++pp)
+        {
+        if(t.data[pp] > 0)
+            continue;
+        scalar theta = globalTheta;
+        scalar phi = globalPhi;
+        if(!globallyAligned)
+            {
+            counterBasedRNG rng = noise.counterRNG(counterRNGSiteKey(globalLatticePosition(pp)),0,directorStream);
+            theta = acos(2.0*rng.uniform()-1);
+            phi = 2.0*PI*rng.uniform();
+            }
+        scalar3 n;
+        n.x = cos(phi)*sin(theta);
+        n.y = sin(phi)*sin(theta);
+        n.z = cos(theta);
+        qTensorFromDirector(n, S0, pos.data[pp]);
+        };
+    };
+
+/*!
+Velocities are zeroed (they are not converted between bases), and forces must be recomputed
+*/
+void qTensorLatticeModel::setOrthonormalBasis(bool _orthonormal)
+    {
+    if(_orthonormal && useGPU)
+        {
+        printf("the orthonormal basis for forces is only implemented on the CPU\n");
+        throw std::exception();
+        };
+    orthonormalBasis = _orthonormal;
+    ArrayHandle<dVec> h_v(velocities,access_location::host,access_mode::overwrite);
+    for (int ii = 0; ii < velocities.getNumElements(); ++ii)
+        h_v.data[ii] = make_dVec(0.0);
+    forcesComputed = false;
+    };
+
 void qTensorLatticeModel::moveParticles(GPUArray<dVec> &displacements,scalar scale)
     {
     if(!useGPU)
         {//cpu branch
         ArrayHandle<dVec> h_disp(displacements, access_location::host,access_mode::read);
         ArrayHandle<dVec> h_pos(positions);
-        if(scale == 1.)
+        if(orthonormalBasis)
+            {
+            //map displacements in the orthonormal basis to changes of the Q-tensor components
+            ArrayHandle<int> sites(activeSites,access_location::host,access_mode::read);
+            bool sparse = sparseStorage;
+            int nDof = getNumberOfForceSites();
+            #pragma omp parallel for num_threads(nThreads)
+            for(int dof = 0; dof < nDof; ++dof)
+                h_pos.data[sparse ? sites.data[dof] : dof] += scale*orthonormalBasisTransform(h_disp.data[dof]);
+            }
+        else if(sparseStorage)
+            {
+            //displacements are per degree of freedom, i.e., per active site
+            ArrayHandle<int> sites(activeSites,access_location::host,access_mode::read);
+            int nDof = activeSites.getNumElements();
+            #pragma omp parallel for num_threads(nThreads)
+            for(int dof = 0; dof < nDof; ++dof)
+                h_pos.data[sites.data[dof]] += scale*h_disp.data[dof];
+            }
+        else if(scale == 1.)
             {
-            for(int pp = 0; pp < N; ++pp)
+            //models with halo sites may advance some of them along with the sites they control
+            int nSites = getNumberOfForceSites();
+            #pragma omp parallel for num_threads(nThreads)
+            for(int pp = 0; pp < nSites; ++pp)
                 {
                 h_pos.data[pp] += h_disp.data[pp];
                 //approximately restrict Q-tensor values
@@ -197,7 +253,9 @@ void qTensorLatticeModel::moveParticles(GPUArray<dVec> &displacements,scalar sca
             }
         else
             {
-            for(int pp = 0; pp < N; ++pp)
+            int nSites = getNumberOfForceSites();
+            #pragma omp parallel for num_threads(nThreads)
+            for(int pp = 0; pp < nSites; ++pp)
                 {
                 h_pos.data[pp] += scale*h_disp.data[pp];
                 //approximately restrict Q-tensor values
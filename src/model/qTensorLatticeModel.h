@@ -23,6 +23,12 @@ whatever object boundaries[type[i]-1] refers to.
 The qTensorLatticeModel implements a "create boundary" method which takes an array of lattice sites, appends a new
 boundaryObject to boundaries (so that boundaries[j] now exists), and then sets the type of the lattice sites so that
 type[i] = j+1
+
+The basis above is not orthonormal, so by default forces are co-forces that the force computers correct with the
+metric, and FIRE weights its dot products. After setOrthonormalBasis(), forces, velocities, and the displacements
+passed to moveParticles are instead components in the orthonormal basis of orthonormalBasisTransform (the Q-tensors
+themselves, and therefore every file format, are unchanged): force computers transform each contribution as they
+compute it, every dot product is a plain one, and moveParticles maps displacements back to Q-tensor components.
  */
 class qTensorLatticeModel : public cubicLattice
     {
@@ -33,9 +39,13 @@ class qTensorLatticeModel : public cubicLattice
 
         //!(possibly) need to rewrite how the Q tensors update with respect to a displacement call
         virtual void moveParticles(GPUArray<dVec> &displacements, scalar scale = 1.);
+        //!express forces, velocities, and displacements in an orthonormal basis of Q-tensor space (CPU only)
+        void setOrthonormalBasis(bool _orthonormal = true);
 
         //!initialize each d.o.f., also passing in the value of the nematicity
         void setNematicQTensorRandomly(noiseSource &noise, scalar s0,bool globallyAligned = false);
+        //!as above, on the CPU, with directors that depend only on the noise's counter seed and the global position of each site
+        void setCounterBasedRandomDirectors(noiseSource &noise, scalar s0,bool globallyAligned = false);
 
         //!get field-averaged eigenvalues
         void getAverageEigenvalues(bool verbose = true);
@@ -27,11 +27,12 @@ void simpleModel::initializeSimpleModel(int n)
         velocities.noGPU = true;
         forces.noGPU = true;
         types.noGPU = true;
+        degreeOfFreedomParticles.noGPU = true;
         defectMeasures.noGPU=true;
         }
     selfForceCompute = false;
     positions.resize(n);
-    velocities.resize(n);
+    velocities.resize(storeVelocities ? n : 0);
     forces.resize(n);
     types.resize(n);
     //masses.resize(n);
@@ -42,7 +43,8 @@ void simpleModel::initializeSimpleModel(int n)
     vector<int> units(N,0);
     fillGPUArrayWithVector(units,types);
     fillGPUArrayWithVector(zeroes,positions);
-    fillGPUArrayWithVector(zeroes,velocities);
+    if(storeVelocities)
+        fillGPUArrayWithVector(zeroes,velocities);
     fillGPUArrayWithVector(zeroes,forces);
     //fillGPUArrayWithVector(ones,masses);
     //fillGPUArrayWithVector(halves,radii);
@@ -51,9 +53,12 @@ void simpleModel::initializeSimpleModel(int n)
 scalar simpleModel::computeKineticEnergy(bool verbose)
     {
     //ArrayHandle<scalar> h_m(masses,access_location::host,access_mode::read);
+    if(!storeVelocities)
+        return 0.0;
     ArrayHandle<dVec> h_v(velocities);
     scalar en = 0.0;
-    for (int ii = 0; ii < N; ++ii)
+    int nDof = getNumberOfDegreesOfFreedom();
+    for (int ii = 0; ii < nDof; ++ii)
         {
         //en += 0.5*h_m.data[ii]*dot(h_v.data[ii],h_v.data[ii]);
         en += 0.5*dot(h_v.data[ii],h_v.data[ii]);
@@ -64,9 +69,12 @@ scalar simpleModel::computeKineticEnergy(bool verbose)
 scalar simpleModel::computeInstantaneousTemperature(bool fixedMomentum)
     {
     //ArrayHandle<scalar> h_m(masses,access_location::host,access_mode::read);
+    if(!storeVelocities)
+        return 0.0;
     ArrayHandle<dVec> h_v(velocities);
     scalar en = 0.0;
-    for (int ii = 0; ii < N; ++ii)
+    int nDof = getNumberOfDegreesOfFreedom();
+    for (int ii = 0; ii < nDof; ++ii)
         {
         //en += 1.0*h_m.data[ii]*dot(h_v.data[ii],h_v.data[ii]);
         en += 1.0*dot(h_v.data[ii],h_v.data[ii]);
@@ -114,11 +122,17 @@ void simpleModel::setParticlePositionsRandomly(noiseSource &noise)
 
 scalar simpleModel::setVelocitiesMaxwellBoltzmann(scalar T,noiseSource &noise)
     {
+    if(!storeVelocities)
+        {
+        printf("velocities have been freed (freeGPUArrays) and cannot be set\n");
+        throw std::exception();
+        };
     //ArrayHandle<scalar> h_m(masses,access_location::host,access_mode::read);
     ArrayHandle<dVec> h_v(velocities);
     scalar KE = 0.0;
     dVec P(0.0);
-    for (int ii = 0; ii < N; ++ii)
+    int nDof = getNumberOfDegreesOfFreedom();
+    for (int ii = 0; ii < nDof; ++ii)
         {
         for (int dd = 0; dd <DIMENSION; ++dd)
             h_v.data[ii].x[dd] = noise.getRealNormal(0.0,sqrt(T));
@@ -130,11 +144,11 @@ scalar simpleModel::setVelocitiesMaxwellBoltzmann(scalar T,noiseSource &noise)
         }
     //remove excess momentum, calculate the ke
     KE = 0.0;
-    for (int ii = 0; ii < N; ++ii)
+    for (int ii = 0; ii < nDof; ++ii)
         {
         //h_v.data[ii] += (-1.0/(N*h_m.data[ii]))*P;
         //KE += 0.5*h_m.data[ii]*dot(h_v.data[ii],h_v.data[ii]);
-        h_v.data[ii] += (-1.0/(N))*P;
+        h_v.data[ii] += (-1.0/(nDof))*P;
         KE += 0.5*dot(h_v.data[ii],h_v.data[ii]);
         };
     return KE;
@@ -175,7 +189,8 @@ void simpleModel::computeForces(bool zeroOutForces)
             {//cpu branch
             ArrayHandle<dVec> h_f(forces);
             dVec dArrayZero(0.0);
-            for(int pp = 0; pp <N;++pp)
+            int nDof = getNumberOfDegreesOfFreedom();
+            for(int pp = 0; pp <nDof;++pp)
                 h_f.data[pp] = dArrayZero;
             }
         else
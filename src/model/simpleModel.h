@@ -41,6 +41,12 @@ class simpleModel
         virtual void setGPU(bool _useGPU=true){useGPU = _useGPU;};
         //!get the number of degrees of freedom, defaulting to the number of cells
         virtual int getNumberOfParticles(){return N;};
+        //!get the number of degrees of freedom that forces and updaters act on (every particle, unless the model stores fewer)
+        virtual int getNumberOfDegreesOfFreedom(){return N;};
+        //!the particle whose state is each degree of freedom; empty if degree of freedom i is particle i
+        virtual GPUArray<int> & returnDegreeOfFreedomParticles(){return degreeOfFreedomParticles;};
+        //!the number of degrees of freedom whose forces are computed and that updaters move; models with halo sites may include some of them (extraHaloLayers asks for that many more layers)
+        virtual int getNumberOfForceSites(int extraHaloLayers = 0){return getNumberOfDegreesOfFreedom();};
         //!move the degrees of freedom
         virtual void moveParticles(GPUArray<dVec> &displacements,scalar scale = 1.);
         //!do everything unusual to compute additional forces... by default, sets forces to zero
@@ -83,6 +89,8 @@ class simpleModel
         BoxPtr Box;
         //!Are the forces current? set to false after every call to moveParticles. set to true after the SIMULATION calls computeForces
         bool forcesComputed;
+        //!Are forces, velocities, and displacements components in an orthonormal basis (see qTensorLatticeModel)?
+        bool orthonormalBasis = false;
 
         //!allow for setting multiple threads
         virtual void setNThreads(int n){nThreads = n;};
@@ -90,21 +98,17 @@ class simpleModel
         virtual void displaceBoundaryObject(int objectIndex, int motionDirection, int magnitude){};
 
         //!some situations do not require us to maintain various data structures
+        /*!
+        Only velocities are currently stored; minimizers other than FIRE (and dynamics other than velocity Verlet) never
+        read them, so freeing them saves DIMENSION scalars per degree of freedom
+        */
         virtual void freeGPUArrays(bool freeVelocities, bool freeRadii, bool freeMasses)
                         {
-                        //if(freeVelocities)
-                        //    velocities.resize(1);
-                        //else
-                        //    velocities.resize(N);
-                        //if(freeRadii)
-                        //    radii.resize(1);
-                        //else
-                        //    radii.resize(N);
-                        //if(freeMasses)
-                        //    masses.resize(1);
-                        //else
-                        //    masses.resize(N);
+                        storeVelocities = !freeVelocities;
+                        velocities.resize(storeVelocities ? forces.getNumElements() : 0);
                         };
+        //!are velocities kept for every degree of freedom? (see freeGPUArrays)
+        bool storeVelocities = true;
 
         //!scalars that can represent different defect measures
         GPUArray<scalar> defectMeasures;
@@ -128,6 +132,8 @@ class simpleModel
         GPUArray<dVec> forces;
         //!particle types
         GPUArray<int> types;
+        //!every degree of freedom is its own particle, so this stays empty
+        GPUArray<int> degreeOfFreedomParticles;
         //!particle radii
         //GPUArray<scalar> radii;
         //!particle masses
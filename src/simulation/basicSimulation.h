@@ -6,6 +6,7 @@
 #include "gpuarray.h"
 #include "periodicBoundaryConditions.h"
 #include "simpleModel.h"
+#include "reproducibleSum.h"
 
 class basicSimulation
     {
@@ -45,6 +46,14 @@ class basicSimulation
 
         //! manipulate data from updaters
         virtual void sumUpdaterData(vector<scalar> &data){};
+        //! sum exact partial sums from updaters
+        virtual void sumUpdaterData(vector<reproducibleSum> &data){};
+        //!begin summing data from updaters without waiting for the result
+        virtual void startSumUpdaterData(vector<scalar> &data){};
+        //!wait for the sums begun by startSumUpdaterData, and write them into data (which must have the same size)
+        virtual void finishSumUpdaterData(vector<scalar> &data){};
+        //!if true, updaters and force computers accumulate global sums exactly, so that they do not depend on the decomposition
+        bool reproducibleSums = false;
 
         //!for debugging...
         virtual scalar computeKineticEnergy(bool verbose =false){return 0.0;};
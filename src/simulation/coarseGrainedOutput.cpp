@@ -0,0 +1,160 @@
+#include "coarseGrainedOutput.h"
+#include "symmetric3x3Eigensolver.h"
+/*! \file coarseGrainedOutput.cpp */
+
+static const char coarseGrainedMagic[8] = {'O','Q','M','C','G','\0','\0','\0'};
+static const int32_t coarseGrainedVersion = 1;
+
+/*!
+The output object must be created after the configuration has been passed to the simulation, so that every rank
+knows where its part of the lattice sits in the global lattice
+*/
+coarseGrainedOutput::coarseGrainedOutput(shared_ptr<multirankSimulation> _sim, int _blockSize)
+    {
+    simulation = _sim;
+    blockSize = max(1,_blockSize);
+    auto Conf = _sim->mConfiguration.lock();
+    int localMax[3] = {_sim->latticeMinPosition.x + Conf->latticeSites.x,
+                       _sim->latticeMinPosition.y + Conf->latticeSites.y,
+                       _sim->latticeMinPosition.z + Conf->latticeSites.z};
+    int globalMax[3];
+    MPI_Allreduce(localMax,globalMax,3,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    globalLatticeSites = make_int3(globalMax[0],globalMax[1],globalMax[2]);
+    };
+
+void coarseGrainedOutput::saveDownsampled(string fname)
+    {
+    saveRegion(fname,make_int3(0,0,0),globalLatticeSites,make_int3(blockSize,blockSize,blockSize));
+    };
+
+void coarseGrainedOutput::saveSlice(string fname, int axis, int plane)
+    {
+    int3 regionMin = make_int3(0,0,0);
+    int3 regionMax = globalLatticeSites;
+    int3 blockSizes = make_int3(blockSize,blockSize,blockSize);
+    if(axis == 0)
+        {
+        regionMin.x = plane; regionMax.x = plane+1; blockSizes.x = 1;
+        }
+    else if(axis == 1)
+        {
+        regionMin.y = plane; regionMax.y = plane+1; blockSizes.y = 1;
+        }
+    else
+        {
+        regionMin.z = plane; regionMax.z = plane+1; blockSizes.z = 1;
+        }
+    saveRegion(fname,regionMin,regionMax,blockSizes);
+    };
+
+void coarseGrainedOutput::saveRegion(string fname, int3 regionMin, int3 regionMax, int3 blockSizes)
+    {
+    auto sim = simulation.lock();
+    auto Conf = sim->mConfiguration.lock();
+    int myRank, nRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    MPI_Comm_size(MPI_COMM_WORLD,&nRanks);
+    int3 L = Conf->latticeSites;
+    int3 offset = sim->latticeMinPosition;
+    int3 nBlocks = make_int3((regionMax.x-regionMin.x+blockSizes.x-1)/blockSizes.x,
+                             (regionMax.y-regionMin.y+blockSizes.y-1)/blockSizes.y,
+                             (regionMax.z-regionMin.z+blockSizes.z-1)/blockSizes.z);
+    Index3D blockIndex(nBlocks);
+
+    //reduce the part of the region on this rank to partial block sums
+    partialSums.clear();
+    int3 lo = make_int3(max(regionMin.x,offset.x),max(regionMin.y,offset.y),max(regionMin.z,offset.z));
+    int3 hi = make_int3(min(regionMax.x,offset.x+L.x),min(regionMax.y,offset.y+L.y),min(regionMax.z,offset.z+L.z));
+    if(lo < hi)
+        {
+        int3 blockLo = make_int3((lo.x-regionMin.x)/blockSizes.x,(lo.y-regionMin.y)/blockSizes.y,(lo.z-regionMin.z)/blockSizes.z);
+        int3 blockHi = make_int3((hi.x-1-regionMin.x)/blockSizes.x+1,(hi.y-1-regionMin.y)/blockSizes.y+1,(hi.z-1-regionMin.z)/blockSizes.z+1);
+        Index3D localBlockIndex(blockHi-blockLo);
+        vector<scalar> sums(6*localBlockIndex.getNumElements(),0.0);
+        ArrayHandle<dVec> Q(Conf->returnPositions(),access_location::host,access_mode::read);
+        ArrayHandle<int> t(Conf->returnTypes(),access_location::host,access_mode::read);
+        for (int z = lo.z; z < hi.z; ++z)
+            for (int y = lo.y; y < hi.y; ++y)
+                for (int x = lo.x; x < hi.x; ++x)
+                    {
+                    int idx = Conf->latticeIndex(x-offset.x,y-offset.y,z-offset.z);
+                    if(t.data[idx] > 0)
+                        continue;
+                    int b = localBlockIndex((x-regionMin.x)/blockSizes.x-blockLo.x,
+                                            (y-regionMin.y)/blockSizes.y-blockLo.y,
+                                            (z-regionMin.z)/blockSizes.z-blockLo.z);
+                    sums[6*b] += 1.0;
+                    for (int dd = 0; dd < DIMENSION; ++dd)
+                        sums[6*b+1+dd] += Q.data[idx][dd];
+                    };
+        for (int b = 0; b < localBlockIndex.getNumElements(); ++b)
+            {
+            if(sums[6*b] == 0)
+                continue;
+            int3 block = localBlockIndex.inverseIndex(b) + blockLo;
+            partialSums.push_back(blockIndex(block));
+            for (int ii = 0; ii < 6; ++ii)
+                partialSums.push_back(sums[6*b+ii]);
+            };
+        };
+
+    //gather the partial sums to rank 0
+    int nPartial = partialSums.size();
+    vector<int> partialCounts(nRanks), partialDisplacements(nRanks,0);
+    MPI_Gather(&nPartial,1,MPI_INT,partialCounts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+    vector<scalar> allPartialSums;
+    if(myRank == 0)
+        {
+        for (int rr = 1; rr < nRanks; ++rr)
+            partialDisplacements[rr] = partialDisplacements[rr-1]+partialCounts[rr-1];
+        allPartialSums.resize(partialDisplacements[nRanks-1]+partialCounts[nRanks-1]);
+        };
+    MPI_Gatherv(partialSums.data(),nPartial,MPI_SCALAR,allPartialSums.data(),partialCounts.data(),partialDisplacements.data(),MPI_SCALAR,0,MPI_COMM_WORLD);
+    if(myRank != 0)
+        return;
+
+    int totalBlocks = blockIndex.getNumElements();
+    vector<scalar> blockSums(6*totalBlocks,0.0);
+    for (int pp = 0; pp < allPartialSums.size(); pp += 7)
+        {
+        int b = (int) allPartialSums[pp];
+        for (int ii = 0; ii < 6; ++ii)
+            blockSums[6*b+ii] += allPartialSums[pp+1+ii];
+        };
+
+    vector<float> fields(5*totalBlocks,0.0f);
+    NISymmetricEigensolver3x3 eigenSolver;
+    std::array<scalar, 3> evals;
+    std::array<std::array<scalar, 3>, 3> evecs;
+    for (int b = 0; b < totalBlocks; ++b)
+        {
+        scalar n = blockSums[6*b];
+        if(n == 0)
+            continue;
+        int3 block = blockIndex.inverseIndex(b);
+        int3 blockLo = make_int3(regionMin.x+block.x*blockSizes.x,regionMin.y+block.y*blockSizes.y,regionMin.z+block.z*blockSizes.z);
+        int3 blockHi = make_int3(min(blockLo.x+blockSizes.x,regionMax.x),min(blockLo.y+blockSizes.y,regionMax.y),min(blockLo.z+blockSizes.z,regionMax.z));
+        scalar blockVolume = (blockHi.x-blockLo.x)*(blockHi.y-blockLo.y)*(blockHi.z-blockLo.z);
+        scalar qxx = blockSums[6*b+1]/n;
+        scalar qyy = blockSums[6*b+4]/n;
+        eigenSolver(qxx,blockSums[6*b+2]/n,blockSums[6*b+3]/n,qyy,blockSums[6*b+5]/n,-qxx-qyy,evals,evecs);
+        fields[5*b] = 1.5*evals[2];
+        fields[5*b+1] = evecs[2][0];
+        fields[5*b+2] = evecs[2][1];
+        fields[5*b+3] = evecs[2][2];
+        fields[5*b+4] = n/blockVolume;
+        };
+
+    int32_t header[10] = {coarseGrainedVersion,nBlocks.x,nBlocks.y,nBlocks.z,
+                          blockSizes.x,blockSizes.y,blockSizes.z,regionMin.x,regionMin.y,regionMin.z};
+    ofstream myfile(fname.c_str(),ios::binary);
+    if(myfile.fail())
+        {
+        printf("\nERROR trying to write coarse-grained output %s\n",fname.c_str());
+        throw std::exception();
+        }
+    myfile.write(coarseGrainedMagic,sizeof(coarseGrainedMagic));
+    myfile.write((const char *)header,sizeof(header));
+    myfile.write((const char *)fields.data(),fields.size()*sizeof(float));
+    myfile.close();
+    };
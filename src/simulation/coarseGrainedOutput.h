@@ -0,0 +1,49 @@
+#ifndef coarseGrainedOutput_H
+#define coarseGrainedOutput_H
+
+#include "multirankSimulation.h"
+#include <cstdint>
+
+/*! \file coarseGrainedOutput.h */
+
+//!Write block-averaged director and order-parameter fields of a multirank simulation, for in-situ rendering
+/*!
+Rather than saving every site, the Q-tensors of the liquid-crystal sites of a region are averaged over blocks of
+(bx,by,bz) sites, and only the eigendecomposition of each averaged Q (the director, the order parameter, and the
+fraction of the block that is liquid crystal) is written. Averaging Q before decomposing it keeps the director
+well-defined in the presence of its n -> -n symmetry. The region is either the whole lattice (saveDownsampled) or a
+single lattice plane (saveSlice, for which the blocks are one site thick normal to the plane).
+
+Every rank reduces its own sites to partial block sums; the partial sums are gathered to rank 0 (blocks can straddle
+rank boundaries), which decomposes each block and writes a single binary file:
+an 8-byte magic string ("OQMCG"), an int32 format version, the int32 number of blocks in each direction, the int32
+block size in each direction, and the int32 global lattice position of the first site of the first block, followed by
+five float32 values per block (x fastest, then y, then z): S, nx, ny, nz, liquid-crystal fraction. S = 3/2 times the
+largest eigenvalue of the averaged Q, and (nx,ny,nz) is the corresponding eigenvector.
+*/
+class coarseGrainedOutput
+    {
+    public:
+        //!The output will be averaged over blocks of blockSize^3 sites
+        coarseGrainedOutput(shared_ptr<multirankSimulation> _sim, int _blockSize = 4);
+
+        //!save the block-averaged fields of the whole lattice to fname (a collective call)
+        void saveDownsampled(string fname);
+        //!save the fields on the global lattice plane {x,y,z}[axis] = plane, block-averaged in the plane, to fname (a collective call)
+        void saveSlice(string fname, int axis, int plane);
+
+        //!the linear size of the averaging blocks
+        int blockSize;
+
+    protected:
+        //!average over blocks of blockSizes sites within the global region [regionMin,regionMax), and have rank 0 write the result
+        void saveRegion(string fname, int3 regionMin, int3 regionMax, int3 blockSizes);
+
+        //!the simulation to sample
+        weak_ptr<multirankSimulation> simulation;
+        //!the size of the global lattice
+        int3 globalLatticeSites;
+        //!partial block sums of this rank: (block index, number of sites, sum of Q) for every block with liquid-crystal sites
+        vector<scalar> partialSums;
+    };
+#endif
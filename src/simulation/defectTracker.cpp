@@ -0,0 +1,317 @@
+#include "defectTracker.h"
+#include "symmetric3x3Eigensolver.h"
+/*! \file defectTracker.cpp */
+
+/*!
+The tracker must be created after the configuration has been passed to the simulation, so that every rank knows
+where its part of the lattice sits in the global lattice
+*/
+defectTracker::defectTracker(shared_ptr<multirankSimulation> _sim, scalar _threshold, int _defectType)
+    {
+    simulation = _sim;
+    threshold = _threshold;
+    defectType = _defectType;
+    auto Conf = _sim->mConfiguration.lock();
+    int localMax[3] = {_sim->latticeMinPosition.x + Conf->latticeSites.x,
+                       _sim->latticeMinPosition.y + Conf->latticeSites.y,
+                       _sim->latticeMinPosition.z + Conf->latticeSites.z};
+    int globalMax[3];
+    MPI_Allreduce(localMax,globalMax,3,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    globalLatticeSites = make_int3(globalMax[0],globalMax[1],globalMax[2]);
+    };
+
+void defectTracker::findDefects()
+    {
+    auto sim = simulation.lock();
+    auto Conf = sim->mConfiguration.lock();
+    int myRank, nRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    MPI_Comm_size(MPI_COMM_WORLD,&nRanks);
+    int N = Conf->getNumberOfParticles();
+    int3 L = Conf->latticeSites;
+    int3 offset = sim->latticeMinPosition;
+    int3 G = globalLatticeSites;
+
+    Conf->computeDefectMeasures(defectType);
+    ArrayHandle<int> t(Conf->returnTypes(),access_location::host,access_mode::read);
+    ArrayHandle<scalar> defects(Conf->returnDefectMeasures(),access_location::host,access_mode::read);
+
+    //label defect sites, and join each to its (-x,-y,-z) neighbors on this rank. Roots are always the smallest index of a set
+    parent.resize(N);
+    for (int ii = 0; ii < N; ++ii)
+        parent[ii] = (t.data[ii] <= 0 && defects.data[ii] < threshold) ? ii : -1;
+    for (int z = 0; z < L.z; ++z)
+        for (int y = 0; y < L.y; ++y)
+            for (int x = 0; x < L.x; ++x)
+                {
+                int ii = Conf->latticeIndex(x,y,z);
+                if(parent[ii] < 0)
+                    continue;
+                if(x > 0 && parent[Conf->latticeIndex(x-1,y,z)] >= 0)
+                    unite(ii,Conf->latticeIndex(x-1,y,z));
+                if(y > 0 && parent[Conf->latticeIndex(x,y-1,z)] >= 0)
+                    unite(ii,Conf->latticeIndex(x,y-1,z));
+                if(z > 0 && parent[Conf->latticeIndex(x,y,z-1)] >= 0)
+                    unite(ii,Conf->latticeIndex(x,y,z-1));
+                };
+    siteCluster.assign(N,-1);
+    int nLocal = 0;
+    for (int ii = 0; ii < N; ++ii)
+        {
+        if(parent[ii] < 0)
+            continue;
+        int root = findRoot(ii);
+        siteCluster[ii] = (root == ii) ? nLocal++ : siteCluster[root];
+        };
+
+    //give every local cluster a globally unique label
+    int labelOffset = 0;
+    int totalLabels = 0;
+    MPI_Exscan(&nLocal,&labelOffset,1,MPI_INT,MPI_SUM,MPI_COMM_WORLD);
+    if(myRank == 0)
+        labelOffset = 0;
+    MPI_Allreduce(&nLocal,&totalLabels,1,MPI_INT,MPI_SUM,MPI_COMM_WORLD);
+
+    //only defect sites on the faces of a rank's domain can connect clusters on different ranks (or across the periodic boundaries)
+    vector<int> faceSites;
+    for (int ii = 0; ii < N; ++ii)
+        {
+        if(siteCluster[ii] < 0)
+            continue;
+        int3 pos = Conf->latticeIndex.inverseIndex(ii);
+        if(pos.x == 0 || pos.y == 0 || pos.z == 0 || pos.x == L.x-1 || pos.y == L.y-1 || pos.z == L.z-1)
+            {
+            faceSites.push_back(pos.x+offset.x);
+            faceSites.push_back(pos.y+offset.y);
+            faceSites.push_back(pos.z+offset.z);
+            faceSites.push_back(siteCluster[ii]+labelOffset);
+            };
+        };
+    int nFaceInts = faceSites.size();
+    vector<int> faceCounts(nRanks), faceDisplacements(nRanks,0);
+    MPI_Gather(&nFaceInts,1,MPI_INT,faceCounts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+    vector<int> allFaceSites;
+    if(myRank == 0)
+        {
+        for (int rr = 1; rr < nRanks; ++rr)
+            faceDisplacements[rr] = faceDisplacements[rr-1]+faceCounts[rr-1];
+        allFaceSites.resize(faceDisplacements[nRanks-1]+faceCounts[nRanks-1]);
+        };
+    MPI_Gatherv(faceSites.data(),nFaceInts,MPI_INT,allFaceSites.data(),faceCounts.data(),faceDisplacements.data(),MPI_INT,0,MPI_COMM_WORLD);
+
+    vector<int> labelToCluster(totalLabels);
+    int nClusters = 0;
+    if(myRank == 0)
+        {
+        parent.resize(totalLabels);
+        for (int ll = 0; ll < totalLabels; ++ll)
+            parent[ll] = ll;
+        unordered_map<long long, int> faceLabels;
+        for (int ff = 0; ff < allFaceSites.size(); ff += 4)
+            {
+            long long key = ((long long)allFaceSites[ff+2]*G.y + allFaceSites[ff+1])*G.x + allFaceSites[ff];
+            faceLabels[key] = allFaceSites[ff+3];
+            };
+        for (int ff = 0; ff < allFaceSites.size(); ff += 4)
+            {
+            int x = allFaceSites[ff]; int y = allFaceSites[ff+1]; int z = allFaceSites[ff+2];
+            long long neighborKeys[3] = {((long long)z*G.y + y)*G.x + (x+1)%G.x,
+                                         ((long long)z*G.y + (y+1)%G.y)*G.x + x,
+                                         ((long long)((z+1)%G.z)*G.y + y)*G.x + x};
+            for (int nn = 0; nn < 3; ++nn)
+                {
+                auto neighbor = faceLabels.find(neighborKeys[nn]);
+                if(neighbor != faceLabels.end())
+                    unite(allFaceSites[ff+3],neighbor->second);
+                };
+            };
+        for (int ll = 0; ll < totalLabels; ++ll)
+            {
+            int root = findRoot(ll);
+            labelToCluster[ll] = (root == ll) ? nClusters++ : labelToCluster[root];
+            };
+        };
+    MPI_Bcast(&nClusters,1,MPI_INT,0,MPI_COMM_WORLD);
+    MPI_Bcast(labelToCluster.data(),totalLabels,MPI_INT,0,MPI_COMM_WORLD);
+
+    //first moments: site counts, periodic (circular-mean) centroids, and contacts with objects
+    vector<scalar> moments(8*nClusters,0.0), globalMoments(8*nClusters,0.0);
+    for (int ii = 0; ii < N; ++ii)
+        {
+        if(siteCluster[ii] < 0)
+            continue;
+        int c = labelToCluster[siteCluster[ii]+labelOffset];
+        siteCluster[ii] = c;
+        int3 pos = Conf->latticeIndex.inverseIndex(ii);
+        scalar gPos[3] = {(scalar)(pos.x+offset.x),(scalar)(pos.y+offset.y),(scalar)(pos.z+offset.z)};
+        scalar gSize[3] = {(scalar)G.x,(scalar)G.y,(scalar)G.z};
+        moments[8*c] += 1.0;
+        for (int aa = 0; aa < 3; ++aa)
+            {
+            moments[8*c+1+2*aa] += cos(2.0*PI*gPos[aa]/gSize[aa]);
+            moments[8*c+2+2*aa] += sin(2.0*PI*gPos[aa]/gSize[aa]);
+            };
+        int3 neighbors[6] = {make_int3(pos.x-1,pos.y,pos.z),make_int3(pos.x+1,pos.y,pos.z),
+                             make_int3(pos.x,pos.y-1,pos.z),make_int3(pos.x,pos.y+1,pos.z),
+                             make_int3(pos.x,pos.y,pos.z-1),make_int3(pos.x,pos.y,pos.z+1)};
+        for (int nn = 0; nn < 6; ++nn)
+            if(t.data[Conf->positionToIndex(neighbors[nn])] > 0)
+                {
+                moments[8*c+7] += 1.0;
+                break;
+                };
+        };
+    MPI_Allreduce(moments.data(),globalMoments.data(),8*nClusters,MPI_SCALAR,MPI_SUM,MPI_COMM_WORLD);
+    vector<scalar3> centroids(nClusters);
+    for (int c = 0; c < nClusters; ++c)
+        {
+        scalar angleX = atan2(globalMoments[8*c+2],globalMoments[8*c+1]);
+        scalar angleY = atan2(globalMoments[8*c+4],globalMoments[8*c+3]);
+        scalar angleZ = atan2(globalMoments[8*c+6],globalMoments[8*c+5]);
+        centroids[c].x = fmod(angleX/(2.0*PI)*G.x + G.x,(scalar)G.x);
+        centroids[c].y = fmod(angleY/(2.0*PI)*G.y + G.y,(scalar)G.y);
+        centroids[c].z = fmod(angleZ/(2.0*PI)*G.z + G.z,(scalar)G.z);
+        };
+
+    //second moments: the gyration tensor about the centroid, using minimum-image separations
+    vector<scalar> gyration(6*nClusters,0.0), globalGyration(6*nClusters,0.0);
+    for (int ii = 0; ii < N; ++ii)
+        {
+        int c = siteCluster[ii];
+        if(c < 0)
+            continue;
+        int3 pos = Conf->latticeIndex.inverseIndex(ii);
+        scalar dx = minimumImage(pos.x+offset.x-centroids[c].x,G.x);
+        scalar dy = minimumImage(pos.y+offset.y-centroids[c].y,G.y);
+        scalar dz = minimumImage(pos.z+offset.z-centroids[c].z,G.z);
+        gyration[6*c] += dx*dx;
+        gyration[6*c+1] += dx*dy;
+        gyration[6*c+2] += dx*dz;
+        gyration[6*c+3] += dy*dy;
+        gyration[6*c+4] += dy*dz;
+        gyration[6*c+5] += dz*dz;
+        };
+    MPI_Reduce(gyration.data(),globalGyration.data(),6*nClusters,MPI_SCALAR,MPI_SUM,0,MPI_COMM_WORLD);
+
+    clusters.clear();
+    if(myRank != 0)
+        return;
+    NISymmetricEigensolver3x3 eigenSolver;
+    std::array<scalar, 3> evals;
+    std::array<std::array<scalar, 3>, 3> evecs;
+    clusters.resize(nClusters);
+    for (int c = 0; c < nClusters; ++c)
+        {
+        scalar n = globalMoments[8*c];
+        clusters[c].nSites = (int) n;
+        clusters[c].centroid = centroids[c];
+        clusters[c].sitesTouchingObjects = (int) globalMoments[8*c+7];
+        eigenSolver(globalGyration[6*c]/n,globalGyration[6*c+1]/n,globalGyration[6*c+2]/n,
+                    globalGyration[6*c+3]/n,globalGyration[6*c+4]/n,globalGyration[6*c+5]/n,evals,evecs);
+        clusters[c].gyrationEigenvalues = make_scalar3(evals[0],evals[1],evals[2]);
+        };
+    matchToPreviousClusters();
+    };
+
+/*!
+Greedily pair current and previous clusters in order of increasing centroid separation (up to matchingDistance).
+Paired clusters inherit the previous trackId; all others (newly created, or the smaller pieces of clusters that
+split) get fresh trackIds.
+*/
+void defectTracker::matchToPreviousClusters()
+    {
+    vector<pair<scalar,int2> > candidatePairs;
+    for (int c = 0; c < clusters.size(); ++c)
+        for (int p = 0; p < previousClusters.size(); ++p)
+            {
+            scalar dx = minimumImage(clusters[c].centroid.x-previousClusters[p].centroid.x,globalLatticeSites.x);
+            scalar dy = minimumImage(clusters[c].centroid.y-previousClusters[p].centroid.y,globalLatticeSites.y);
+            scalar dz = minimumImage(clusters[c].centroid.z-previousClusters[p].centroid.z,globalLatticeSites.z);
+            scalar distance = sqrt(dx*dx+dy*dy+dz*dz);
+            if(distance <= matchingDistance)
+                candidatePairs.push_back(make_pair(distance,make_int2(c,p)));
+            };
+    sort(candidatePairs.begin(),candidatePairs.end(),
+         [](const pair<scalar,int2> &a, const pair<scalar,int2> &b){return a.first < b.first;});
+    vector<bool> currentMatched(clusters.size(),false);
+    vector<bool> previousMatched(previousClusters.size(),false);
+    for (int cc = 0; cc < candidatePairs.size(); ++cc)
+        {
+        int c = candidatePairs[cc].second.x;
+        int p = candidatePairs[cc].second.y;
+        if(currentMatched[c] || previousMatched[p])
+            continue;
+        clusters[c].trackId = previousClusters[p].trackId;
+        currentMatched[c] = true;
+        previousMatched[p] = true;
+        };
+    for (int c = 0; c < clusters.size(); ++c)
+        if(!currentMatched[c])
+            clusters[c].trackId = nextTrackId++;
+    previousClusters = clusters;
+    };
+
+/*!
+Rank 0 writes fname_defects.txt, with a line per cluster of the form
+trackId nSites cx cy cz g1 g2 g3 nTouching
+where (cx,cy,cz) is the centroid in global lattice coordinates, g1 <= g2 <= g3 are the eigenvalues of the gyration
+tensor, and nTouching is the number of sites next to a boundary object. If saveSites is true, every defect site is
+also gathered to rank 0 and written to fname_defectSites.txt as lines of "x y z trackId".
+*/
+void defectTracker::saveDefects(string fname, bool saveSites)
+    {
+    findDefects();
+    int myRank, nRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    MPI_Comm_size(MPI_COMM_WORLD,&nRanks);
+    char fn[256];
+    if(myRank == 0)
+        {
+        sprintf(fn,"%s_defects.txt",fname.c_str());
+        ofstream myfile;
+        myfile.open(fn);
+        myfile << "#trackId\tnSites\tcx\tcy\tcz\tg1\tg2\tg3\tnTouching\n";
+        for (int c = 0; c < clusters.size(); ++c)
+            myfile << clusters[c].trackId << "\t" << clusters[c].nSites << "\t"
+                   << clusters[c].centroid.x << "\t" << clusters[c].centroid.y << "\t" << clusters[c].centroid.z << "\t"
+                   << clusters[c].gyrationEigenvalues.x << "\t" << clusters[c].gyrationEigenvalues.y << "\t"
+                   << clusters[c].gyrationEigenvalues.z << "\t" << clusters[c].sitesTouchingObjects << "\n";
+        myfile.close();
+        };
+    if(!saveSites)
+        return;
+
+    auto sim = simulation.lock();
+    auto Conf = sim->mConfiguration.lock();
+    vector<int> sites;
+    for (int ii = 0; ii < siteCluster.size(); ++ii)
+        {
+        if(siteCluster[ii] < 0)
+            continue;
+        int3 pos = Conf->latticeIndex.inverseIndex(ii);
+        sites.push_back(pos.x+sim->latticeMinPosition.x);
+        sites.push_back(pos.y+sim->latticeMinPosition.y);
+        sites.push_back(pos.z+sim->latticeMinPosition.z);
+        sites.push_back(siteCluster[ii]);
+        };
+    int nSiteInts = sites.size();
+    vector<int> siteCounts(nRanks), siteDisplacements(nRanks,0);
+    MPI_Gather(&nSiteInts,1,MPI_INT,siteCounts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+    vector<int> allSites;
+    if(myRank == 0)
+        {
+        for (int rr = 1; rr < nRanks; ++rr)
+            siteDisplacements[rr] = siteDisplacements[rr-1]+siteCounts[rr-1];
+        allSites.resize(siteDisplacements[nRanks-1]+siteCounts[nRanks-1]);
+        };
+    MPI_Gatherv(sites.data(),nSiteInts,MPI_INT,allSites.data(),siteCounts.data(),siteDisplacements.data(),MPI_INT,0,MPI_COMM_WORLD);
+    if(myRank != 0)
+        return;
+    sprintf(fn,"%s_defectSites.txt",fname.c_str());
+    ofstream myfile;
+    myfile.open(fn);
+    for (int ss = 0; ss < allSites.size(); ss += 4)
+        myfile << allSites[ss] << "\t" << allSites[ss+1] << "\t" << allSites[ss+2] << "\t"
+               << clusters[allSites[ss+3]].trackId << "\n";
+    myfile.close();
+    };
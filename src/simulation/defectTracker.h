@@ -0,0 +1,96 @@
+#ifndef defectTracker_H
+#define defectTracker_H
+
+#include "multirankSimulation.h"
+#include <unordered_map>
+
+/*! \file defectTracker.h */
+
+//!The geometry of a connected cluster of defect sites
+struct defectCluster
+    {
+    //!an identifier that persists across snapshots while the cluster can be matched to its predecessor
+    int trackId;
+    //!the number of lattice sites in the cluster
+    int nSites;
+    //!the (periodic) centroid of the cluster, in global lattice coordinates
+    scalar3 centroid;
+    //!eigenvalues of the gyration tensor, in ascending order; line-like clusters have one dominant eigenvalue
+    scalar3 gyrationEigenvalues;
+    //!number of sites of the cluster that sit next to a boundary object
+    int sitesTouchingObjects;
+    };
+
+//!Identify, cluster, and track defects in a multirank simulation
+/*!
+Sites that are not part of an object, and whose value of computeDefectMeasures(defectType) is below a threshold,
+are labeled as defect sites. Face-adjacent defect sites are joined into clusters (disclination lines, rings, or
+points) with a union-find over each rank's lattice; clusters that continue across rank boundaries (or across the
+periodic boundaries of the simulation box) are merged on rank 0 using only the defect sites on the faces of each
+rank's domain. Each cluster is then reduced to a handful of numbers (size, periodic centroid, gyration tensor), and
+clusters are matched to the nearest cluster of the previous call to findDefects, so that defect motion can be
+followed over the course of a minimization. The cluster list is only populated on rank 0.
+*/
+class defectTracker
+    {
+    public:
+        //!Track defects defined by computeDefectMeasures(_defectType) < _threshold
+        defectTracker(shared_ptr<multirankSimulation> _sim, scalar _threshold, int _defectType = 0);
+
+        //!Find and cluster the defects of the current configuration (a collective call)
+        void findDefects();
+        //!Find defects, and have rank 0 write one line per cluster to fname_defects.txt (optionally also every defect site to fname_defectSites.txt)
+        void saveDefects(string fname, bool saveSites = false);
+
+        //!the clusters found by the last call to findDefects (on rank 0)
+        vector<defectCluster> clusters;
+        //!the largest distance a cluster can move between calls and keep its trackId
+        scalar matchingDistance = 5.0;
+        //!the defect-measure threshold
+        scalar threshold;
+        //!which defect measure to use
+        int defectType;
+
+    protected:
+        //!the simulation whose defects are tracked
+        weak_ptr<multirankSimulation> simulation;
+        //!the size of the global lattice
+        int3 globalLatticeSites;
+        //!for every local site, the index of the defect cluster it belongs to (or -1)
+        vector<int> siteCluster;
+        //!union-find parent array, used both for local sites and for global cluster labels
+        vector<int> parent;
+        //!clusters of the previous call, used for matching
+        vector<defectCluster> previousClusters;
+        //!the next unused trackId
+        int nextTrackId = 0;
+
+        //!find with path halving
+        int findRoot(int i)
+            {
+            while(parent[i] != i)
+                {
+                parent[i] = parent[parent[i]];
+                i = parent[i];
+                }
+            return i;
+            };
+        //!join the sets containing i and j
+        void unite(int i, int j)
+            {
+            int ri = findRoot(i);
+            int rj = findRoot(j);
+            if(ri < rj)
+                parent[rj] = ri;
+            else if (rj < ri)
+                parent[ri] = rj;
+            };
+        //!the minimum-image separation of two coordinates along an axis of length L
+        scalar minimumImage(scalar d, int L)
+            {
+            return d - L*round(d/L);
+            };
+        //!assign trackIds by matching to the clusters of the previous call
+        void matchToPreviousClusters();
+    };
+#endif
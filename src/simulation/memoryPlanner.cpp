@@ -0,0 +1,346 @@
+#include "memoryPlanner.h"
+/*! \file memoryPlanner.cpp */
+
+int3 memoryPlanner::blockSize(const plannedRun &plan)
+    {
+    int3 t = plan.rankTopology;
+    int3 g = plan.globalLatticeSites;
+    return make_int3((g.x+t.x-1)/t.x,(g.y+t.y-1)/t.y,(g.z+t.z-1)/t.z);
+    };
+
+/*!
+A halo of depth one is laid out by multirankQTensorLatticeModel::determineBufferLayout, which always reserves the 26
+face, edge, and corner regions; deeper halos only extend the block along the dimensions that are split among ranks
+*/
+double memoryPlanner::sitesWithinLayers(const plannedRun &plan, int layer)
+    {
+    int3 b = blockSize(plan);
+    double N = (double)b.x*b.y*b.z;
+    bool anyHalo = plan.rankTopology.x > 1 || plan.rankTopology.y > 1 || plan.rankTopology.z > 1;
+    if(layer == 0 || !anyHalo)
+        return N;
+    if(max(minimumHaloDepth(plan),plan.haloDepth) == 1)
+        return (double)(b.x+2)*(b.y+2)*(b.z+2);
+    int hx = plan.rankTopology.x > 1 ? 2*layer : 0;
+    int hy = plan.rankTopology.y > 1 ? 2*layer : 0;
+    int hz = plan.rankTopology.z > 1 ? 2*layer : 0;
+    return (double)(b.x+hx)*(b.y+hy)*(b.z+hz);
+    };
+
+/*!
+The arrays of the model are first allocated for the block alone and then resized to include the halo, which briefly
+holds an old and a new copy of one of them; the first derivatives are only allocated when forces are first computed,
+after every other array
+*/
+void memoryPlanner::predict(const plannedRun &plan, vector<string> &names, vector<double> &bytes, double &peakBytes)
+    {
+    names.clear();
+    bytes.clear();
+    auto add = [&](string name, double b)
+        {
+        names.push_back(name);
+        bytes.push_back(b);
+        };
+    int3 b = blockSize(plan);
+    int topology[3] = {plan.rankTopology.x,plan.rankTopology.y,plan.rankTopology.z};
+    int sizes[3] = {b.x,b.y,b.z};
+    double N = (double)b.x*b.y*b.z;
+    int depth = max(minimumHaloDepth(plan),plan.haloDepth);
+    double totalSites = sitesWithinLayers(plan,depth);
+    double dVecBytes = DIMENSION*sizeof(scalar);
+    double nDof = plan.sparseStorage ? ceil((1.0-plan.objectFraction)*N) : N;
+    double neighborListSites = plan.sparseStorage ? nDof : sitesWithinLayers(plan,depth-1);
+    double dofArraySites = plan.sparseStorage ? nDof : totalSites;
+
+    //the model
+    add("Q-tensors",totalSites*dVecBytes);
+    add("types",totalSites*sizeof(int));
+    add("forces",dofArraySites*dVecBytes);
+    add("velocities",plan.storeVelocities ? dofArraySites*dVecBytes : 0.0);
+    add("defect measures",N*sizeof(scalar));
+    add("neighbor lists",6*neighborListSites*sizeof(int));
+    add("bulk and surface site lists",neighborListSites*sizeof(int));
+    add("active sites",plan.sparseStorage ? nDof*sizeof(int) : 0.0);
+    add("object site lists",plan.objectFraction*N*sizeof(int));
+    double regionSites = (double)(b.x+2)*(b.y+2)*(b.z+2)-N;
+    add("halo transfer buffers",2*regionSites*(sizeof(int)+dVecBytes));
+    double deepIndex = 0.0;
+    if(depth > 1)
+        deepIndex = totalSites*sizeof(int) + (totalSites-N)*sizeof(int3);
+    add("deep halo indexes",deepIndex);
+    double faceBytes = 0.0;
+    if(plan.dimensionOrderedHalos || plan.sharedMemoryHalos || depth > 1)
+        {
+        bool forward = depth > 1 || (plan.nConstants > 1 && (topology[1] > 1 || topology[2] > 1));
+        double faceSites = 0.0;
+        for (int dd = 0; dd < 3; ++dd)
+            {
+            if(topology[dd] < 2)
+                continue;
+            double planeSites = depth;
+            for (int ee = 0; ee < 3; ++ee)
+                if(ee != dd)
+                    planeSites *= (forward && ee < dd && topology[ee] > 1) ? sizes[ee]+2*depth : sizes[ee];
+            faceSites += 2*planeSites;
+            };
+        int stride = (plan.communicationAvoiding && plan.storeVelocities) ? 2*DIMENSION+1 : DIMENSION+1;
+        faceBytes = (plan.sharedMemoryHalos ? 3 : 2)*faceSites*stride*sizeof(scalar);
+        };
+    add("dimension-ordered face buffers",faceBytes);
+
+    //the force
+    add("energy densities",2*N*sizeof(scalar));
+    double derivativeSites = 0.0;
+    if(plan.nConstants > 1)
+        {
+        if(plan.communicationAvoiding && !plan.sparseStorage)
+            derivativeSites = sitesWithinLayers(plan,depth-1);
+        else
+            derivativeSites = sitesWithinLayers(plan,min(1,depth-1));
+        };
+    add("first derivatives",derivativeSites*sizeof(cubicLatticeDerivativeVector));
+    add("spatially varying field",plan.spatiallyVaryingField ? N*sizeof(scalar3) : 0.0);
+
+    //the updater
+    double updaterBytes = 0.0;
+    switch(plan.updater)
+        {
+        case plannedUpdater::FIRE:
+            //communication-avoiding steps also advance the halo sites that forces are computed on
+            updaterBytes = (plan.communicationAvoiding ? max(nDof,sitesWithinLayers(plan,max(0,depth-2))) : nDof)*dVecBytes
+                            + 2*nDof*sizeof(scalar);
+            break;
+        case plannedUpdater::gradientDescent:
+            updaterBytes = nDof*(dVecBytes+2*sizeof(scalar));
+            break;
+        case plannedUpdater::nesterovAG:
+            updaterBytes = (plan.sparseStorage ? nDof : totalSites)*dVecBytes + 2*nDof*sizeof(scalar);
+            break;
+        case plannedUpdater::loLBFGS:
+            updaterBytes = nDof*((1+2*plan.lbfgsHistory)*dVecBytes+2*sizeof(scalar));
+            break;
+        case plannedUpdater::adam:
+            updaterBytes = 5*nDof*dVecBytes;
+            break;
+        case plannedUpdater::relaxationalDynamics:
+            updaterBytes = nDof*dVecBytes;
+            break;
+        };
+    add("updater work arrays",updaterBytes);
+
+    double total = 0.0;
+    for (unsigned int ii = 0; ii < bytes.size(); ++ii)
+        total += bytes[ii];
+    peakBytes = max(total,total-derivativeSites*sizeof(cubicLatticeDerivativeVector)+totalSites*dVecBytes);
+    };
+
+int memoryPlanner::minimumHaloDepth(const plannedRun &plan)
+    {
+    //multi-constant forces on several ranks read the first derivatives of the first halo layer, which needs a second
+    int3 t = plan.rankTopology;
+    return (plan.nConstants > 1 && t.x*t.y*t.z > 1) ? 2 : 1;
+    };
+
+double memoryPlanner::bytesPerRank(const plannedRun &plan)
+    {
+    vector<string> names;
+    vector<double> bytes;
+    double peak;
+    predict(plan,names,bytes,peak);
+    return peak;
+    };
+
+/*!
+openQmin gives every rank a block of the same size, so only topologies that divide the lattice are considered, and
+blocks must be at least as thick as the halo along every split dimension
+*/
+int3 memoryPlanner::leanestTopology(const plannedRun &plan, int ranks)
+    {
+    int3 best = make_int3(0,0,0);
+    double bestBytes = 0.0;
+    plannedRun trial = plan;
+    int3 g = plan.globalLatticeSites;
+    for (int tx = 1; tx <= ranks; ++tx)
+        {
+        if(ranks % tx != 0 || g.x % tx != 0)
+            continue;
+        for (int ty = 1; ty <= ranks/tx; ++ty)
+            {
+            if((ranks/tx) % ty != 0 || g.y % ty != 0)
+                continue;
+            int tz = ranks/(tx*ty);
+            if(g.z % tz != 0)
+                continue;
+            trial.rankTopology = make_int3(tx,ty,tz);
+            int depth = max(minimumHaloDepth(trial),plan.haloDepth);
+            if((tx > 1 && g.x/tx < depth) || (ty > 1 && g.y/ty < depth) || (tz > 1 && g.z/tz < depth))
+                continue;
+            double trialBytes = bytesPerRank(trial);
+            if(best.x == 0 || trialBytes < bestBytes)
+                {
+                best = trial.rankTopology;
+                bestBytes = trialBytes;
+                };
+            };
+        };
+    return best;
+    };
+
+/*!
+Every change keeps the minimized state the same: a different topology of the same ranks, freeing velocities that
+the updater never reads, storing only the liquid crystal sites, and dropping the buffers of the faster halo exchanges
+(deep halos and communication-avoiding updates last, since they can save the most time)
+*/
+bool memoryPlanner::fitSettings(plannedRun &plan)
+    {
+    int ranks = plan.rankTopology.x*plan.rankTopology.y*plan.rankTopology.z;
+    int3 topology = leanestTopology(plan,ranks);
+    if(topology.x > 0)
+        plan.rankTopology = topology;
+    if(bytesPerRank(plan) <= budgetBytes)
+        return true;
+    if(plan.storeVelocities && plan.updater != plannedUpdater::FIRE)
+        {
+        plan.storeVelocities = false;
+        if(bytesPerRank(plan) <= budgetBytes)
+            return true;
+        };
+    if(!plan.sparseStorage && plan.objectFraction > 0 && !plan.communicationAvoiding)
+        {
+        plan.sparseStorage = true;
+        if(bytesPerRank(plan) <= budgetBytes)
+            return true;
+        };
+    if(plan.sharedMemoryHalos)
+        {
+        plan.sharedMemoryHalos = false;
+        if(bytesPerRank(plan) <= budgetBytes)
+            return true;
+        };
+    if(plan.dimensionOrderedHalos && max(minimumHaloDepth(plan),plan.haloDepth) == 1)
+        {
+        plan.dimensionOrderedHalos = false;
+        if(bytesPerRank(plan) <= budgetBytes)
+            return true;
+        };
+    if(plan.haloDepth > minimumHaloDepth(plan))
+        {
+        plan.haloDepth = minimumHaloDepth(plan);
+        plan.communicationAvoiding = false;
+        plan.dimensionOrderedHalos = false;
+        if(!plan.sparseStorage && plan.objectFraction > 0)
+            plan.sparseStorage = true;
+        topology = leanestTopology(plan,ranks);
+        if(topology.x > 0)
+            plan.rankTopology = topology;
+        };
+    return bytesPerRank(plan) <= budgetBytes;
+    };
+
+int memoryPlanner::minimumRanks(plannedRun &plan, int maxRanks)
+    {
+    for (int ranks = 1; ranks <= maxRanks; ++ranks)
+        {
+        plannedRun trial = plan;
+        int3 topology = leanestTopology(trial,ranks);
+        if(topology.x == 0)
+            continue;
+        trial.rankTopology = topology;
+        if(fitSettings(trial))
+            {
+            plan = trial;
+            return ranks;
+            };
+        };
+    return 0;
+    };
+
+string memoryPlanner::commandLineOptions(const plannedRun &plan)
+    {
+    int3 t = plan.rankTopology;
+    int3 g = plan.globalLatticeSites;
+    ostringstream options;
+    options << "-np " << t.x*t.y*t.z << " --rankTopology " << t.x << "," << t.y << "," << t.z
+            << " --Lx " << g.x/t.x << " --Ly " << g.y/t.y << " --Lz " << g.z/t.z;
+    if(plan.sparseStorage)
+        options << " --sparseStorage";
+    if(plan.sharedMemoryHalos)
+        options << " --sharedMemoryHalos";
+    else if(plan.dimensionOrderedHalos)
+        options << " --dimensionOrderedHalos";
+    if(plan.haloDepth > 1)
+        options << " --haloDepth " << plan.haloDepth;
+    if(plan.communicationAvoiding)
+        options << " --communicationAvoiding";
+    return options.str();
+    };
+
+plannedUpdater memoryPlanner::updaterFromName(const string &name)
+    {
+    if(name == "FIRE")
+        return plannedUpdater::FIRE;
+    if(name == "gradientDescent")
+        return plannedUpdater::gradientDescent;
+    if(name == "nesterovAG")
+        return plannedUpdater::nesterovAG;
+    if(name == "loLBFGS")
+        return plannedUpdater::loLBFGS;
+    if(name == "adam")
+        return plannedUpdater::adam;
+    if(name == "relaxationalDynamics")
+        return plannedUpdater::relaxationalDynamics;
+    printf("unknown updater %s (FIRE, gradientDescent, nesterovAG, loLBFGS, adam, relaxationalDynamics)\n",name.c_str());
+    throw std::exception();
+    };
+
+double memoryPlanner::nodeMemoryPerRank(int ranksOnNode)
+    {
+    double physicalBytes = (double)sysconf(_SC_PHYS_PAGES)*(double)sysconf(_SC_PAGE_SIZE);
+    return physicalBytes/max(1,ranksOnNode);
+    };
+
+void memoryPlanner::report(int maxRanks)
+    {
+    vector<string> names;
+    vector<double> bytes;
+    double peak;
+    predict(run,names,bytes,peak);
+    int3 b = blockSize(run);
+    int3 t = run.rankTopology;
+    printf("memory plan for a (%i,%i,%i) lattice on (%i,%i,%i) ranks, blocks of (%i,%i,%i) sites:\n",
+            run.globalLatticeSites.x,run.globalLatticeSites.y,run.globalLatticeSites.z,t.x,t.y,t.z,b.x,b.y,b.z);
+    double total = 0.0;
+    for (unsigned int ii = 0; ii < names.size(); ++ii)
+        {
+        total += bytes[ii];
+        if(bytes[ii] > 0)
+            printf("  %-32s %12.2f MB\n",names[ii].c_str(),bytes[ii]/1000000.);
+        };
+    printf("  %-32s %12.2f MB\n","total",total/1000000.);
+    printf("  %-32s %12.2f MB per rank (budget %.2f MB)\n","peak while resizing",peak/1000000.,budgetBytes/1000000.);
+    if(peak <= budgetBytes)
+        {
+        printf("the run fits\n");
+        return;
+        };
+    plannedRun fitted = run;
+    if(fitSettings(fitted))
+        {
+        printf("the run does not fit; with the same ranks it needs %.2f MB per rank with:\n  %s\n",
+                bytesPerRank(fitted)/1000000.,commandLineOptions(fitted).c_str());
+        if(!fitted.storeVelocities)
+            printf("  and the velocities of the model freed (freeGPUArrays(true,false,false)) before adding the updater\n");
+        return;
+        };
+    plannedRun scaled = run;
+    int ranks = minimumRanks(scaled,maxRanks);
+    if(ranks == 0)
+        {
+        printf("the run does not fit on up to %i ranks that divide the lattice evenly\n",maxRanks);
+        return;
+        };
+    printf("the run does not fit on %i ranks; the fewest that fit are %i, needing %.2f MB per rank with:\n  %s\n",
+            t.x*t.y*t.z,ranks,bytesPerRank(scaled)/1000000.,commandLineOptions(scaled).c_str());
+    if(!scaled.storeVelocities)
+        printf("  and the velocities of the model freed (freeGPUArrays(true,false,false)) before adding the updater\n");
+    };
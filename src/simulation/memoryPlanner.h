@@ -0,0 +1,81 @@
+#ifndef memoryPlanner_H
+#define memoryPlanner_H
+
+#include "std_include.h"
+
+/*! \file memoryPlanner.h */
+
+//!the minimizers (and dynamics) whose work arrays the memory planner knows
+enum class plannedUpdater {FIRE,gradientDescent,nesterovAG,loLBFGS,adam,relaxationalDynamics};
+
+//!everything about a multirank Q-tensor run that decides how much memory each rank allocates
+struct plannedRun
+    {
+    //!the size of the whole lattice
+    int3 globalLatticeSites = make_int3(50,50,50);
+    //!ranks along x, y, and z
+    int3 rankTopology = make_int3(1,1,1);
+    //!number of elastic constants (more than one needs the first derivatives at every site)
+    int nConstants = 1;
+    plannedUpdater updater = plannedUpdater::FIRE;
+    //!the number of (s,y) pairs kept by L-BFGS
+    int lbfgsHistory = 5;
+    //!the fraction of lattice sites inside boundary objects
+    scalar objectFraction = 0.0;
+    bool sparseStorage = false;
+    bool dimensionOrderedHalos = false;
+    bool sharedMemoryHalos = false;
+    int haloDepth = 1;
+    bool communicationAvoiding = false;
+    //!velocities are only read by FIRE and velocity Verlet (see simpleModel::freeGPUArrays)
+    bool storeVelocities = true;
+    bool spatiallyVaryingField = false;
+    };
+
+//!Predict the memory of every array on each rank of a run before anything is allocated, and find settings that fit
+/*!
+The prediction follows the allocations of multirankQTensorLatticeModel, cubicLattice, landauDeGennesLC, and the
+updaters, for a block of the global lattice divided evenly by the rank topology (or the largest block, rounded up, if
+it does not divide evenly). The peak includes the copy made while the per-site arrays are resized to hold the halo
+sites. Small and per-object bookkeeping is ignored, and so is the memory of MPI itself, so the budget should leave
+some headroom. The sizes are those of host memory; GPU builds mirror most of these arrays on the device.
+*/
+class memoryPlanner
+    {
+    public:
+        memoryPlanner(plannedRun _run, double _budgetBytes){run = _run; budgetBytes = _budgetBytes;};
+
+        //!the name and predicted bytes per rank of every array of a run, and the most held at any one time
+        void predict(const plannedRun &plan, vector<string> &names, vector<double> &bytes, double &peakBytes);
+        //!the predicted peak bytes per rank of a run
+        double bytesPerRank(const plannedRun &plan);
+        //!the topology of ranks ranks that divides the lattice evenly with the least memory per rank ((0,0,0) if none does)
+        int3 leanestTopology(const plannedRun &plan, int ranks);
+        //!change the options of plan that do not change its results, least intrusive first, until it fits; returns whether it does
+        bool fitSettings(plannedRun &plan);
+        //!the fewest ranks, up to maxRanks, with which plan fits after fitSettings (0 if none), and those settings
+        int minimumRanks(plannedRun &plan, int maxRanks);
+        //!print the arrays of run and, if it does not fit in the budget, settings that do (with at most maxRanks ranks)
+        void report(int maxRanks);
+
+        //!the openQmin options that select the settings of a plan
+        static string commandLineOptions(const plannedRun &plan);
+        //!the updater with the given name (FIRE, gradientDescent, nesterovAG, loLBFGS, adam, relaxationalDynamics)
+        static plannedUpdater updaterFromName(const string &name);
+        //!the physical memory of this node divided among ranksOnNode ranks
+        static double nodeMemoryPerRank(int ranksOnNode);
+
+        //!the run to plan
+        plannedRun run;
+        //!the memory available to each rank
+        double budgetBytes;
+
+    protected:
+        //!the lattice sites of the (largest) block of a run
+        int3 blockSize(const plannedRun &plan);
+        //!the fewest layers of halo sites a run can keep
+        int minimumHaloDepth(const plannedRun &plan);
+        //!the sites within layer layers of halo sites of a block (layer 0 is the block itself)
+        double sitesWithinLayers(const plannedRun &plan, int layer);
+    };
+#endif
@@ -1,29 +1,88 @@
 #include "multirankSimulation.h"
+#include "snapshotCompression.h"
+#include "regionTimers.h"
 /*! \file multirankSimulation.cpp */
 
+/*!
+Every element of data is summed over all ranks with a single collective of the reduction service (together with any
+values that other components have registered with it since its last reduction)
+*/
 void multirankSimulation::sumUpdaterData(vector<scalar> &data)
     {
     if(nRanks >1)
         {
-        int elements = data.size();
-        int rElements = elements * nRanks;
-        if (dataBuffer.size() < rElements)
-            dataBuffer.resize(rElements);
+        scopedRegionTimer timer("reduction");
         p1.start();
-        MPI_Allgather(&data[0],elements,MPI_SCALAR,&dataBuffer[0],elements,MPI_SCALAR,MPI_COMM_WORLD);
+        reductions.sumInPlace(data);
         p1.end();
-        for (int ii = 0; ii < elements; ++ii) data[ii] = 0.0;
+        };
+    };
 
-        for (int ii = 0; ii < elements; ++ii)
-            for (int rr = 0; rr < nRanks; ++rr)
-                {
-                data[ii] += dataBuffer[rr*elements+ii];
-                }
+void multirankSimulation::sumUpdaterData(vector<reproducibleSum> &data)
+    {
+    if(nRanks >1)
+        {
+        scopedRegionTimer timer("reduction");
+        p1.start();
+        reductions.sumInPlace(data);
+        p1.end();
+        };
+    };
+
+/*!
+The sums travel on a reduction service of their own, so that other global sums (of the energy, say) can be taken while
+they are in flight
+*/
+void multirankSimulation::startSumUpdaterData(vector<scalar> &data)
+    {
+    if(nRanks >1)
+        {
+        for (int ii = 0; ii < data.size(); ++ii)
+            {
+            int slot = laggedReductions.add(data[ii]);
+            if(ii == 0)
+                laggedFirstSlot = slot;
+            };
+        laggedReductions.start();
+        };
+    };
+
+void multirankSimulation::finishSumUpdaterData(vector<scalar> &data)
+    {
+    if(nRanks >1)
+        {
+        scopedRegionTimer timer("reduction");
+        p1.start();
+        laggedReductions.finish();
+        p1.end();
+        for (int ii = 0; ii < data.size(); ++ii)
+            data[ii] = laggedReductions.result(laggedFirstSlot+ii);
+        };
+    };
+
+void multirankSimulation::setSummationMode(reductionService::summationMode mode)
+    {
+    reductions.setSummationMode(mode);
+    laggedReductions.setSummationMode(mode);
+    reproducibleSums = (mode == reductionService::reproducibleSummation);
+    for (int f = 0; f < forceComputers.size(); ++f)
+        {
+        auto frc = forceComputers[f].lock();
+        frc->reproducibleEnergy = reproducibleSums;
         };
     };
 
 void multirankSimulation::communicateHaloSitesRoutine()
     {
+    scopedRegionTimer timer("halo exchange");
+    //every halo layer is current once the exchange has completed
+    currentHaloLayers = mConfiguration.lock()->haloDepth;
+    if(dimensionOrderedHalos)
+        {
+        if(nRanks > 1)
+            communicateDimensionOrderedHalos();
+        return;
+        };
     if(nRanks >1)
     {
     //first, prepare the send buffers
@@ -85,8 +144,10 @@ void multirankSimulation::communicateHaloSitesRoutine()
 
 void multirankSimulation::synchronizeAndTransferBuffers()
     {
-    if(nRanks > 1)
+    //the dimension-ordered exchange completes each of its stages before returning
+    if(nRanks > 1 && !dimensionOrderedHalos)
         {
+        scopedRegionTimer timer("halo wait");
         for(int ii = 0; ii < mpiRequests.size();++ii)
             MPI_Wait(&mpiRequests[ii],&mpiStatuses[ii]);
         //read readReceivingBuffer
@@ -111,9 +172,16 @@ to the rankTopology and boolean settings
 */
 void multirankSimulation::moveParticles(GPUArray<dVec> &displacements,scalar scale)
     {
+    scopedRegionTimer timer("move");
         {
     auto Conf = mConfiguration.lock();
     Conf->moveParticles(displacements,scale);
+    if(communicationAvoiding)
+        {
+        //the halo sites that had forces have moved with the rest, and stay current until a force computation needs more
+        currentHaloLayers = Conf->forceHaloLayers;
+        return;
+        };
         }
     transfersUpToDate = false;
     p1.start();
@@ -130,12 +198,168 @@ void multirankSimulation::setRankTopology(int x, int y, int z)
     parityTest = Index3D(rankTopology);
     rankParity = parityTest.inverseIndex(myRank);
     nRanks = x*y*z;
+    //by default, ranks are placed on the grid in the order of MPI_COMM_WORLD
+    gridRanks.resize(nRanks);
+    rankGridIndex.resize(nRanks);
+    for (int rr = 0; rr < nRanks; ++rr)
+        {
+        gridRanks[rr] = rr;
+        rankGridIndex[rr] = rr;
+        };
     }
 
+/*!
+Choose the block of the rank grid that each node controls: its extent along every axis divides the grid, it holds
+ranksPerNode ranks, and among such blocks it has the fewest faces shared with ranks on other nodes. Returns false if no
+block tiles the grid.
+*/
+static bool chooseNodeBlock(int3 grid, int ranksPerNode, int3 &block)
+    {
+    bool found = false;
+    int fewestFaces = 0;
+    for (int bx = 1; bx <= grid.x; ++bx)
+        for (int by = 1; by <= grid.y; ++by)
+            {
+            if(grid.x % bx != 0 || grid.y % by != 0 || ranksPerNode % (bx*by) != 0)
+                continue;
+            int bz = ranksPerNode/(bx*by);
+            if(bz > grid.z || grid.z % bz != 0)
+                continue;
+            //a block spanning a whole axis has no faces shared with other nodes along it
+            int faces = (bx < grid.x ? 2*by*bz : 0) + (by < grid.y ? 2*bx*bz : 0) + (bz < grid.z ? 2*bx*by : 0);
+            if(!found || faces < fewestFaces)
+                {
+                found = true;
+                fewestFaces = faces;
+                block = make_int3(bx,by,bz);
+                };
+            };
+    return found;
+    };
+
+//!the number of faces across which a rank at gridPosition has a neighbor on another node, given the world rank at every grid position
+static int countFacesBetweenNodes(int3 gridPosition, Index3D &grid, vector<int> &gridRanks, vector<int> &nodeOfRank)
+    {
+    int ans = 0;
+    int me = nodeOfRank[gridRanks[grid(gridPosition)]];
+    int sizes[3] = {grid.sizes.x,grid.sizes.y,grid.sizes.z};
+    for (int dd = 0; dd < 3; ++dd)
+        {
+        if(sizes[dd] < 2)
+            continue;
+        for (int shift = -1; shift <= 1; shift += 2)
+            {
+            int p[3] = {gridPosition.x,gridPosition.y,gridPosition.z};
+            p[dd] = (p[dd]+shift+sizes[dd])%sizes[dd];
+            if(nodeOfRank[gridRanks[grid(p[0],p[1],p[2])]] != me)
+                ans += 1;
+            };
+        };
+    return ans;
+    };
+
+/*!
+Build an MPI Cartesian communicator for the rank grid, and place the ranks on it. With nodeAware, the ranks of each node
+(found with MPI_COMM_TYPE_SHARED) get a compact block of neighboring sub-domains, chosen to minimize the faces shared
+with other nodes; this needs the same number of ranks on every node and a block that tiles the grid. Otherwise (or
+if no such block exists) MPI_Cart_create is allowed to reorder the ranks. Halos are then exchanged in dimension order,
+with a neighborhood collective on the Cartesian communicator for each stage. Must be called by every rank, before
+setConfiguration (the block controlled by a rank depends on its place in the grid).
+*/
+void multirankSimulation::setCartesianTopology(bool nodeAware, bool verbose)
+    {
+    if(!mConfiguration.expired())
+        {
+        printf("the placement of ranks must be chosen before the configuration is set\n");
+        throw std::exception();
+        };
+    freeCartesianCommunicator();
+    int dims[3] = {rankTopology.x,rankTopology.y,rankTopology.z};
+    int periods[3] = {1,1,1};
+    int coordinates[3];
+
+    //number the nodes by their lowest world rank
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(MPI_COMM_WORLD,MPI_COMM_TYPE_SHARED,myRank,MPI_INFO_NULL,&nodeComm);
+    int localRank, ranksPerNode;
+    MPI_Comm_rank(nodeComm,&localRank);
+    MPI_Comm_size(nodeComm,&ranksPerNode);
+    int nodeLeader = myRank;
+    MPI_Bcast(&nodeLeader,1,MPI_INT,0,nodeComm);
+    MPI_Comm_free(&nodeComm);
+    vector<int> nodeOfRank(nRanks);
+    MPI_Allgather(&nodeLeader,1,MPI_INT,nodeOfRank.data(),1,MPI_INT,MPI_COMM_WORLD);
+    int sizeRange[2] = {ranksPerNode,-ranksPerNode};
+    MPI_Allreduce(MPI_IN_PLACE,sizeRange,2,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    bool uniformNodes = (sizeRange[0] == -sizeRange[1]);
+
+    vector<int> worldOrder(gridRanks);
+    int3 block;
+    bool placeByNode = nodeAware && uniformNodes && ranksPerNode < nRanks && chooseNodeBlock(rankTopology,ranksPerNode,block);
+    if(placeByNode)
+        {
+        int nodeIndex = 0;
+        for (int rr = 0; rr < nRanks; ++rr)
+            if(nodeOfRank[rr] == rr && rr < nodeLeader)
+                nodeIndex += 1;
+        Index3D blocks(make_int3(dims[0]/block.x,dims[1]/block.y,dims[2]/block.z));
+        Index3D withinBlock(block);
+        int3 blockPosition = blocks.inverseIndex(nodeIndex);
+        int3 positionInBlock = withinBlock.inverseIndex(localRank);
+        coordinates[0] = blockPosition.x*block.x + positionInBlock.x;
+        coordinates[1] = blockPosition.y*block.y + positionInBlock.y;
+        coordinates[2] = blockPosition.z*block.z + positionInBlock.z;
+        //Cartesian communicators number ranks in row-major order
+        int key = coordinates[2] + dims[2]*(coordinates[1] + dims[1]*coordinates[0]);
+        MPI_Comm ordered;
+        MPI_Comm_split(MPI_COMM_WORLD,0,key,&ordered);
+        MPI_Cart_create(ordered,3,dims,periods,0,&cartesianCommunicator);
+        MPI_Comm_free(&ordered);
+        }
+    else
+        MPI_Cart_create(MPI_COMM_WORLD,3,dims,periods,1,&cartesianCommunicator);
+    cartesianTopology = true;
+    int cartesianRank;
+    MPI_Comm_rank(cartesianCommunicator,&cartesianRank);
+    MPI_Cart_coords(cartesianCommunicator,cartesianRank,3,coordinates);
+    rankParity = make_int3(coordinates[0],coordinates[1],coordinates[2]);
+    int myGridIndex = parityTest(rankParity);
+    MPI_Allgather(&myGridIndex,1,MPI_INT,rankGridIndex.data(),1,MPI_INT,MPI_COMM_WORLD);
+    for (int rr = 0; rr < nRanks; ++rr)
+        gridRanks[rankGridIndex[rr]] = rr;
+    determineCommunicationPattern(edges,corners);
+    setDimensionOrderedHaloExchange(true);
+
+    if(verbose)
+        {
+        int faces[2];
+        faces[0] = countFacesBetweenNodes(parityTest.inverseIndex(myRank),parityTest,worldOrder,nodeOfRank);
+        faces[1] = countFacesBetweenNodes(rankParity,parityTest,gridRanks,nodeOfRank);
+        MPI_Allreduce(MPI_IN_PLACE,faces,2,MPI_INT,MPI_SUM,MPI_COMM_WORLD);
+        if(myRank == 0)
+            printf("Cartesian rank placement (%s): %i of the halo faces of all ranks are shared with another node, compared to %i in MPI_COMM_WORLD order\n",
+                   placeByNode ? "blocks of the grid per node" : "MPI reordering",faces[1],faces[0]);
+        };
+    };
+
+void multirankSimulation::freeCartesianCommunicator()
+    {
+    if(!cartesianTopology)
+        return;
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if(!finalized)
+        MPI_Comm_free(&cartesianCommunicator);
+    cartesianTopology = false;
+    };
+
 void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corners)
     {
     edges = _edges;
     corners = _corners;
+    communicationDirections.clear();
+    communicationDirectionParity.clear();
+    communicationTargets.clear();
 
     bool sendReceiveParity;
     int3 nodeTarget;
@@ -149,7 +373,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
 
         nodeTarget = rankParity; nodeTarget.x -= 1;
         if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -157,7 +381,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         sendReceive.x = 1; sendReceive.y = 0;
         nodeTarget = rankParity; nodeTarget.x += 1;
         if(nodeTarget.x == parityTest.sizes.x) nodeTarget.x = 0;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -169,7 +393,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         sendReceiveParity = (rankParity.y%2==0) ? true : false;
         nodeTarget = rankParity; nodeTarget.y -= 1;
         if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -177,7 +401,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         sendReceive.x = 3; sendReceive.y = 2;
         nodeTarget = rankParity; nodeTarget.y += 1;
         if(nodeTarget.y == parityTest.sizes.y) nodeTarget.y = 0;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -189,7 +413,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             sendReceiveParity = (rankParity.z%2==0) ? true : false;
             nodeTarget = rankParity; nodeTarget.z -= 1;
             if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -197,7 +421,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             sendReceive.x = 5; sendReceive.y = 4;
             nodeTarget = rankParity; nodeTarget.z += 1;
             if(nodeTarget.z == parityTest.sizes.z) nodeTarget.z = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -211,7 +435,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.y -= 1; nodeTarget.x -= 1;
             if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
             if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -220,7 +444,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.y += 1; nodeTarget.x += 1;
             if(nodeTarget.x == parityTest.sizes.x) nodeTarget.x = 0;
             if(nodeTarget.y == parityTest.sizes.y) nodeTarget.y = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -229,7 +453,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.y += 1; nodeTarget.x -= 1;
             if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
             if(nodeTarget.y == parityTest.sizes.y) nodeTarget.y = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -238,7 +462,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.y -= 1; nodeTarget.x += 1;
             if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
             if(nodeTarget.x == parityTest.sizes.x) nodeTarget.x = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -250,7 +474,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z -= 1; nodeTarget.x -= 1;
             if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
             if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -259,7 +483,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z += 1; nodeTarget.x += 1;
             if(nodeTarget.x == parityTest.sizes.x) nodeTarget.x = 0;
             if(nodeTarget.z == parityTest.sizes.z) nodeTarget.z = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -268,7 +492,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z += 1; nodeTarget.x -= 1;
             if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
             if(nodeTarget.z == parityTest.sizes.z) nodeTarget.z = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -277,7 +501,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z -= 1; nodeTarget.x += 1;
             if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
             if(nodeTarget.x == parityTest.sizes.x) nodeTarget.x = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -289,7 +513,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z -= 1; nodeTarget.y -= 1;
             if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
             if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -298,7 +522,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z += 1; nodeTarget.y += 1;
             if(nodeTarget.y == parityTest.sizes.y) nodeTarget.y = 0;
             if(nodeTarget.z == parityTest.sizes.z) nodeTarget.z = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -307,7 +531,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z += 1; nodeTarget.y -= 1;
             if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
             if(nodeTarget.z == parityTest.sizes.z) nodeTarget.z = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -316,7 +540,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
             nodeTarget = rankParity; nodeTarget.z -= 1; nodeTarget.y += 1;
             if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
             if(nodeTarget.y == parityTest.sizes.y) nodeTarget.y = 0;
-            targetRank = parityTest(nodeTarget);
+            targetRank = gridRanks[parityTest(nodeTarget)];
             communicationDirections.push_back(sendReceive);
             communicationDirectionParity.push_back(sendReceiveParity);
             communicationTargets.push_back(targetRank);
@@ -331,7 +555,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
         if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
         if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -341,7 +565,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x  == parityTest.sizes.x) nodeTarget.x = 0;
         if(nodeTarget.y  == parityTest.sizes.y) nodeTarget.y = 0;
         if(nodeTarget.z  == parityTest.sizes.z) nodeTarget.z = 0;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -351,7 +575,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
         if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
         if(nodeTarget.z  == parityTest.sizes.z) nodeTarget.z = 0;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -361,7 +585,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x  == parityTest.sizes.x) nodeTarget.x = 0;
         if(nodeTarget.y  == parityTest.sizes.y) nodeTarget.y = 0;
         if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -371,7 +595,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
         if(nodeTarget.y  == parityTest.sizes.y) nodeTarget.y = 0;
         if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -380,8 +604,8 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         nodeTarget = rankParity; nodeTarget.x += 1; nodeTarget.y -= 1;nodeTarget.z += 1;
         if(nodeTarget.x  == parityTest.sizes.x) nodeTarget.x = 0;
         if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
-        if(nodeTarget.z  == parityTest.sizes.z) nodeTarget.y = 0;
-        targetRank = parityTest(nodeTarget);
+        if(nodeTarget.z  == parityTest.sizes.z) nodeTarget.z = 0;
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -391,7 +615,7 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x < 0) nodeTarget.x = parityTest.sizes.x-1;
         if(nodeTarget.y  == parityTest.sizes.y) nodeTarget.y = 0;
         if(nodeTarget.z  == parityTest.sizes.z) nodeTarget.z = 0;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
@@ -401,13 +625,24 @@ void multirankSimulation::determineCommunicationPattern( bool _edges, bool _corn
         if(nodeTarget.x  == parityTest.sizes.x) nodeTarget.x = 0;
         if(nodeTarget.y < 0) nodeTarget.y = parityTest.sizes.y-1;
         if(nodeTarget.z < 0) nodeTarget.z = parityTest.sizes.z-1;
-        targetRank = parityTest(nodeTarget);
+        targetRank = gridRanks[parityTest(nodeTarget)];
         communicationDirections.push_back(sendReceive);
         communicationDirectionParity.push_back(sendReceiveParity);
         communicationTargets.push_back(targetRank);
         };
     mpiRequests.resize(4*communicationDirections.size());
     mpiStatuses.resize(4*communicationDirections.size());
+
+    faceNeighbors.resize(6);
+    for (int face = 0; face < 6; ++face)
+        {
+        int shift = (face%2 == 0) ? -1 : 1;
+        nodeTarget = rankParity;
+        if(face/2 == 0) nodeTarget.x = (nodeTarget.x+shift+parityTest.sizes.x)%parityTest.sizes.x;
+        if(face/2 == 1) nodeTarget.y = (nodeTarget.y+shift+parityTest.sizes.y)%parityTest.sizes.y;
+        if(face/2 == 2) nodeTarget.z = (nodeTarget.z+shift+parityTest.sizes.z)%parityTest.sizes.z;
+        faceNeighbors[face] = gridRanks[parityTest(nodeTarget)];
+        };
     }
 
 /*!
@@ -418,6 +653,12 @@ void multirankSimulation::addUpdater(UpdaterPtr _upd, MConfigPtr _config)
     {
     _upd->setModel(_config);
     _upd->setSimulation(getPointer());
+    if(communicationAvoiding && !_upd->supportsCommunicationAvoidance())
+        {
+        printf("communication-avoiding updates are only implemented for gradient descent and FIRE minimization\n");
+        throw std::exception();
+        };
+    _upd->communicationAvoiding = communicationAvoiding;
     updaters.push_back(_upd);
     };
 
@@ -428,30 +669,237 @@ model...
 void multirankSimulation::addForce(ForcePtr _force, MConfigPtr _config)
     {
     _force->setModel(_config);
+    _force->reproducibleEnergy = reproducibleSums;
     forceComputers.push_back(_force);
     };
 /*!
-Set a pointer to the configuration
+Set a pointer to the configuration. The blocks of different ranks need not have the same size, as long as they form
+a rectilinear grid: all ranks in the same slab along x control the same number of x planes, and so on. Neighboring
+ranks then share the extent of every face and edge they exchange, so the halo buffers of each rank (whose layout
+only depends on its own block) match those of its neighbors.
 */
 void multirankSimulation::setConfiguration(MConfigPtr _config)
     {
     mConfiguration = _config;
     Box = _config->Box;
+    //deep halos are only exchanged face by face
+    if(_config->haloDepth > 1)
+        dimensionOrderedHalos = true;
+    if(communicationAvoiding && _config->sparseStorage)
+        {
+        printf("communication-avoiding updates cannot be used with sparse storage\n");
+        throw std::exception();
+        };
+    _config->communicationAvoiding = communicationAvoiding;
+    //velocities are only exchanged if the model keeps them (see simpleModel::freeGPUArrays)
+    _config->haloVelocities = communicationAvoiding && _config->storeVelocities;
+    if(dimensionOrderedHalos)
+        _config->determineDimensionOrderedLayout(edges || corners);
+    allocateSharedHaloWindow();
     communicateHaloSitesRoutine();
 
     auto Conf = mConfiguration.lock();
-    latticeMinPosition.x = rankParity.x*Conf->latticeSites.x;
-    latticeMinPosition.y = rankParity.y*Conf->latticeSites.y;
-    latticeMinPosition.z = rankParity.z*Conf->latticeSites.z;
+    vector<int> allSites(3*nRanks);
+    int localSites[3] = {Conf->latticeSites.x,Conf->latticeSites.y,Conf->latticeSites.z};
+    if(nRanks > 1)
+        MPI_Allgather(localSites,3,MPI_INT,allSites.data(),3,MPI_INT,MPI_COMM_WORLD);
+    else
+        for (int dd = 0; dd < 3; ++dd)
+            allSites[dd] = localSites[dd];
+    int slabs[3] = {rankTopology.x,rankTopology.y,rankTopology.z};
+    for (int dd = 0; dd < 3; ++dd)
+        slabWidths[dd].assign(slabs[dd],0);
+    for (int rr = 0; rr < nRanks; ++rr)
+        {
+        int3 parity = parityTest.inverseIndex(rankGridIndex[rr]);
+        int p[3] = {parity.x,parity.y,parity.z};
+        for (int dd = 0; dd < 3; ++dd)
+            {
+            if(slabWidths[dd][p[dd]] == 0)
+                slabWidths[dd][p[dd]] = allSites[3*rr+dd];
+            else if(slabWidths[dd][p[dd]] != allSites[3*rr+dd])
+                {
+                printf("rank %i controls %i planes along axis %i, but another rank in the same slab controls %i; rank blocks must form a rectilinear grid\n",
+                       rr,allSites[3*rr+dd],dd,slabWidths[dd][p[dd]]);
+                throw std::exception();
+                };
+            };
+        };
+    int minimum[3] = {0,0,0};
+    int total[3] = {0,0,0};
+    int myParity[3] = {rankParity.x,rankParity.y,rankParity.z};
+    for (int dd = 0; dd < 3; ++dd)
+        for (int ss = 0; ss < slabs[dd]; ++ss)
+            {
+            if(ss < myParity[dd])
+                minimum[dd] += slabWidths[dd][ss];
+            total[dd] += slabWidths[dd][ss];
+            };
+    latticeMinPosition = make_int3(minimum[0],minimum[1],minimum[2]);
+    globalLatticeSize = make_int3(total[0],total[1],total[2]);
     Conf->latticeMinPosition = latticeMinPosition;
     };
 
+/*!
+Split the planes [first,last) into nSlabs slabs of about the same weight by recursive bisection, appending their widths
+to widths. prefixSum[i] is the total weight of the planes before plane i. Every slab gets at least minimumWidth planes.
+*/
+static void bisectSlabs(const vector<double> &prefixSum, int first, int last, int nSlabs, int minimumWidth, vector<int> &widths)
+    {
+    if(nSlabs == 1)
+        {
+        widths.push_back(last-first);
+        return;
+        };
+    int nLeft = nSlabs/2;
+    int lowest = first + nLeft*minimumWidth;
+    int highest = last - (nSlabs-nLeft)*minimumWidth;
+    double total = prefixSum[last]-prefixSum[first];
+    //with no weight at all, fall back to equal numbers of planes
+    int cut = first + ((last-first)*nLeft)/nSlabs;
+    if(total > 0)
+        {
+        double target = prefixSum[first] + total*nLeft/nSlabs;
+        double bestDifference = fabs(prefixSum[lowest]-target);
+        cut = lowest;
+        for (int cc = lowest+1; cc <= highest; ++cc)
+            if(fabs(prefixSum[cc]-target) < bestDifference)
+                {
+                bestDifference = fabs(prefixSum[cc]-target);
+                cut = cc;
+                };
+        };
+    cut = max(lowest,min(highest,cut));
+    bisectSlabs(prefixSum,first,cut,nLeft,minimumWidth,widths);
+    bisectSlabs(prefixSum,cut,last,nSlabs-nLeft,minimumWidth,widths);
+    };
+
+/*!
+Sites that are part of boundary objects (type > 0) are skipped by the force and minimizer loops, so with equal blocks a
+rank that holds a dense packing of colloids does much less work than one that holds only liquid crystal. Called after
+the objects have been created, this counts the active (type <= 0) sites in every lattice plane along each axis and
+bisects the planes of each axis into the slabs of the current rank topology, so that every slab has about the same
+number of active sites. The same global lattice is then used with blocks of different sizes: each rank constructs its
+configuration with the returned lattice size (and the objects are created again), and setConfiguration works out the
+new block offsets. Because the slabs of different axes are chosen independently, the balance of individual ranks is
+only as good as the active sites are separable along the axes; with verbose output rank 0 prints the largest number
+of active sites on any rank relative to the mean, before and after.
+*/
+int3 multirankSimulation::loadBalancedLatticeSites(int minimumWidth, bool verbose)
+    {
+    auto Conf = mConfiguration.lock();
+    int G[3] = {globalLatticeSize.x,globalLatticeSize.y,globalLatticeSize.z};
+    int slabs[3] = {rankTopology.x,rankTopology.y,rankTopology.z};
+    for (int dd = 0; dd < 3; ++dd)
+        if(G[dd] < slabs[dd]*minimumWidth)
+            {
+            printf("cannot split %i lattice planes into %i slabs of at least %i planes\n",G[dd],slabs[dd],minimumWidth);
+            throw std::exception();
+            };
+    vector<double> planeCounts(G[0]+G[1]+G[2],0.0);
+    int N = Conf->getNumberOfParticles();
+    double localActive = 0;
+    {
+    ArrayHandle<int> types(Conf->returnTypes(),access_location::host,access_mode::read);
+    for (int ii = 0; ii < N; ++ii)
+        {
+        if(types.data[ii] > 0)
+            continue;
+        int3 pos = Conf->indexToPosition(ii) + latticeMinPosition;
+        planeCounts[pos.x] += 1;
+        planeCounts[G[0]+pos.y] += 1;
+        planeCounts[G[0]+G[1]+pos.z] += 1;
+        localActive += 1;
+        };
+    }
+    if(nRanks > 1)
+        MPI_Allreduce(MPI_IN_PLACE,planeCounts.data(),planeCounts.size(),MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+
+    vector<int> widths[3];
+    int offset = 0;
+    for (int dd = 0; dd < 3; ++dd)
+        {
+        vector<double> prefixSum(G[dd]+1,0.0);
+        for (int ii = 0; ii < G[dd]; ++ii)
+            prefixSum[ii+1] = prefixSum[ii] + planeCounts[offset+ii];
+        offset += G[dd];
+        bisectSlabs(prefixSum,0,G[dd],slabs[dd],minimumWidth,widths[dd]);
+        };
+
+    if(verbose)
+        {
+        //the active sites every rank would have with the new slabs
+        vector<int> slabOfPlane[3];
+        for (int dd = 0; dd < 3; ++dd)
+            for (int ss = 0; ss < slabs[dd]; ++ss)
+                slabOfPlane[dd].insert(slabOfPlane[dd].end(),widths[dd][ss],ss);
+        vector<double> newCounts(nRanks,0.0);
+        {
+        ArrayHandle<int> types(Conf->returnTypes(),access_location::host,access_mode::read);
+        for (int ii = 0; ii < N; ++ii)
+            {
+            if(types.data[ii] > 0)
+                continue;
+            int3 pos = Conf->indexToPosition(ii) + latticeMinPosition;
+            newCounts[gridRanks[parityTest(slabOfPlane[0][pos.x],slabOfPlane[1][pos.y],slabOfPlane[2][pos.z])]] += 1;
+            };
+        }
+        vector<double> oldCounts(nRanks,0.0);
+        oldCounts[myRank] = localActive;
+        if(nRanks > 1)
+            {
+            MPI_Allreduce(MPI_IN_PLACE,newCounts.data(),nRanks,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE,oldCounts.data(),nRanks,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+            };
+        double mean = 0, oldMax = 0, newMax = 0;
+        for (int rr = 0; rr < nRanks; ++rr)
+            {
+            mean += oldCounts[rr]/nRanks;
+            oldMax = max(oldMax,oldCounts[rr]);
+            newMax = max(newMax,newCounts[rr]);
+            };
+        if(myRank == 0)
+            {
+            printf("load balancing: largest number of active sites per rank relative to the mean: %f with equal blocks, %f with slabs of widths\n",
+                   mean > 0 ? oldMax/mean : 1.0, mean > 0 ? newMax/mean : 1.0);
+            for (int dd = 0; dd < 3; ++dd)
+                {
+                printf("\t%c:",'x'+dd);
+                for (int ss = 0; ss < slabs[dd]; ++ss)
+                    printf(" %i",widths[dd][ss]);
+                printf("\n");
+                };
+            };
+        };
+    return make_int3(widths[0][rankParity.x],widths[1][rankParity.y],widths[2][rankParity.z]);
+    };
+
 /*!
 Calls all force computers, and evaluate the self force calculation if the model demands it
 */
 void multirankSimulation::computeForces()
     {
+    scopedRegionTimer timer("forces");
     auto Conf = mConfiguration.lock();
+    int radius = 0;
+    for (unsigned int f = 0; f < forceComputers.size(); ++f)
+        radius = max(radius,forceComputers[f].lock()->stencilRadius());
+    //forces on the sites next to the halo read values computed on the halo sites next to them
+    if((Conf->xHalo || Conf->yHalo || Conf->zHalo) && radius > Conf->haloDepth)
+        {
+        printf("forces that reach %i sites need halos at least %i sites deep (setHaloDepth, or --haloDepth)\n",radius,radius);
+        throw std::exception();
+        };
+    if(communicationAvoiding)
+        {
+        if(useGPU || Conf->sparseStorage)
+            {
+            printf("communication-avoiding updates are only implemented on the CPU, without sparse storage\n");
+            throw std::exception();
+            };
+        refreshHaloSites(radius);
+        Conf->forceHaloLayers = max(0,currentHaloLayers-radius);
+        };
     if(Conf->selfForceCompute)
         Conf->computeForces(true);
     for (unsigned int f = 0; f < forceComputers.size(); ++f)
@@ -474,17 +922,33 @@ void multirankSimulation::computeForces()
 
 scalar multirankSimulation::computePotentialEnergy(bool verbose)
     {
-    scalar PE = 0.0;
-    vector<scalar> ePerRank(1);
+    scopedRegionTimer timer("energy");
+    //the energy of the sites of each rank depends on its first halo layer
+    refreshHaloSites(1);
+    //register the energy of every force computer, and sum them all over ranks at once
+    int firstSlot = -1;
     for (int f = 0; f < forceComputers.size(); ++f)
         {
         auto frc = forceComputers[f].lock();
-        if(NActive != 0)
-            ePerRank[0] = frc->computeEnergy(verbose) /(1.0*NActive);
+        scalar energy = frc->computeEnergy(verbose);
+        int slot;
+        if(reproducibleSums && frc->reproducibleEnergy)
+            slot = reductions.add(frc->exactEnergy);
         else
-            ePerRank[0] = frc->computeEnergy(verbose);
-        sumUpdaterData(ePerRank);
-        PE += ePerRank[0];
+            slot = reductions.add(energy);
+        if(f == 0)
+            firstSlot = slot;
+        };
+    p1.start();
+    reductions.reduce();
+    p1.end();
+    scalar PE = 0.0;
+    for (int f = 0; f < forceComputers.size(); ++f)
+        {
+        scalar energy = reductions.result(firstSlot+f);
+        if(NActive != 0)
+            energy /= (1.0*NActive);
+        PE += energy;
         };
     return PE;
     };
@@ -531,6 +995,22 @@ void multirankSimulation::setCPUOperation(bool setcpu)
         };
     };
 
+void multirankSimulation::setNThreads(int n)
+    {
+    auto Conf = mConfiguration.lock();
+    Conf->setNThreads(n);
+    for (int u = 0; u < updaters.size(); ++u)
+        {
+        auto upd = updaters[u].lock();
+        upd->setNThreads(n);
+        };
+    for (int f = 0; f < forceComputers.size(); ++f)
+        {
+        auto frc = forceComputers[f].lock();
+        frc->setNThreads(n);
+        };
+    };
+
 /*!
 \pre the updaters already know if the GPU will be used
 \post the updaters are set to be reproducible if the boolean is true, otherwise the RNG is initialized
@@ -546,6 +1026,7 @@ void multirankSimulation::setReproducible(bool reproducible)
 
 void multirankSimulation::performTimestep()
     {
+    scopedRegionTimer timer("timestep");
     integerTimestep += 1;
     Time += integrationTimestep;
 
@@ -556,6 +1037,63 @@ void multirankSimulation::performTimestep()
         upd->Update(integerTimestep);
         transfersUpToDate = false;
         };
+    //leave every halo layer current, and forces on the sites of each rank only, between timesteps
+    if(communicationAvoiding)
+        {
+        auto Conf = mConfiguration.lock();
+        refreshHaloSites(Conf->haloDepth);
+        Conf->forceHaloLayers = 0;
+        };
+    };
+
+void multirankSimulation::refreshHaloSites(int layers)
+    {
+    if(currentHaloLayers >= layers)
+        return;
+    p1.start();
+    communicateHaloSitesRoutine();
+    p1.end();
+    };
+
+/*!
+After a halo exchange the sites within k = haloDepth layers of each rank's block are current. A force whose stencil
+reaches r sites can then be computed on the inner k-r halo layers as well as on the block, and after updaters that act
+site by site have moved all of those sites, k-r layers remain current: the next force computation covers k-2r layers,
+and so on, until fewer than r are left and the halos are exchanged again. With one-constant forces (r = 1) this
+exchanges halos once every k force evaluations instead of once per step. Halo exchanges then carry velocities (which
+FIRE needs on the halo sites it advances), and updaters lag their global sums by a step so that they do not wait for
+the other ranks either. Only gradient descent and FIRE, on the CPU and without sparse storage, are supported.
+*/
+void multirankSimulation::setCommunicationAvoidingUpdates(bool _communicationAvoiding)
+    {
+    //sparse storage has no velocities (or forces) for halo sites to advance
+    if(_communicationAvoiding && !mConfiguration.expired() && mConfiguration.lock()->sparseStorage)
+        {
+        printf("communication-avoiding updates cannot be used with sparse storage\n");
+        throw std::exception();
+        };
+    for (int u = 0; u < updaters.size(); ++u)
+        {
+        auto upd = updaters[u].lock();
+        if(_communicationAvoiding && !upd->supportsCommunicationAvoidance())
+            {
+            printf("communication-avoiding updates are only implemented for gradient descent and FIRE minimization\n");
+            throw std::exception();
+            };
+        upd->communicationAvoiding = _communicationAvoiding;
+        };
+    communicationAvoiding = _communicationAvoiding;
+    if(!mConfiguration.expired())
+        {
+        auto Conf = mConfiguration.lock();
+        Conf->communicationAvoiding = communicationAvoiding;
+        Conf->haloVelocities = communicationAvoiding && Conf->storeVelocities;
+        Conf->forceHaloLayers = 0;
+        if(dimensionOrderedHalos)
+            Conf->determineDimensionOrderedLayout(edges || corners);
+        allocateSharedHaloWindow();
+        communicateHaloSitesRoutine();
+        };
     };
 
 /*!
@@ -572,15 +1110,16 @@ Note that the load state function DOES NOT load any information about boundary o
 */
 void multirankSimulation::loadState(string fname)
     {
+    scopedRegionTimer timer("load state");
     auto Conf = mConfiguration.lock();
     char fn[256];
     sprintf(fn,"%s_x%iy%iz%i.txt",fname.c_str(),rankParity.x,rankParity.y,rankParity.z);
 
     printf("loading state...\n");
 
-    int xOffset = rankParity.x*Conf->latticeSites.x;
-    int yOffset = rankParity.y*Conf->latticeSites.y;
-    int zOffset = rankParity.z*Conf->latticeSites.z;
+    int xOffset = latticeMinPosition.x;
+    int yOffset = latticeMinPosition.y;
+    int zOffset = latticeMinPosition.z;
 
     ArrayHandle<dVec> pp(Conf->returnPositions());
     ArrayHandle<int> tt(Conf->returnTypes());
@@ -629,6 +1168,7 @@ see the documentation of computeDefectMeasures for more information.
 */
 void multirankSimulation::saveState(string fname, int latticeSkip, int defectType)
     {
+    scopedRegionTimer timer("save state");
     int stride = latticeSkip;
     if(stride < 1) stride = 1;
     auto Conf = mConfiguration.lock();
@@ -648,9 +1188,11 @@ void multirankSimulation::saveState(string fname, int latticeSkip, int defectTyp
     ArrayHandle<scalar> defects(Conf->returnDefectMeasures(),access_location::host,access_mode::read);
     ofstream myfile;
     myfile.open(fn);
+    //sites are written x fastest, then y, then z, whatever order the model stores them in
+    Index3D fileOrder(Conf->latticeSites);
     for (int ii = 0; ii < Conf->getNumberOfParticles(); ++ii)
         {
-        int3 pos = Conf->indexToPosition(ii);
+        int3 pos = fileOrder.inverseIndex(ii);
         if(pos.x % stride == 0 && pos.y % stride == 0 && pos.z % stride ==0)
             {
             int idx = Conf->positionToIndex(pos);
@@ -663,3 +1205,73 @@ void multirankSimulation::saveState(string fname, int latticeSkip, int defectTyp
 
     myfile.close();
     };
+
+/*!
+Saves a compressed binary snapshot for each rank, named StringJoin[fname,"_x(ToString[X])y(ToString[Y])z(ToString[Z]).oqs"].
+Compared to the text files written by saveState (roughly 100 bytes per site), the lossless mode typically needs a
+third of the space or less, and a small errorBound (e.g. 1e-4, well below the scale of thermal or discretization
+errors) reduces this by a further large factor. The lattice is stored in tileSize^3 tiles that can be decoded
+independently; see qTensorSnapshot for the file format and for reading sub-regions of a snapshot.
+
+Only the Q-tensor and the type of each site are stored; defect measures can be recomputed after loading.
+*/
+void multirankSimulation::saveStateCompressed(string fname, int tileSize, scalar errorBound)
+    {
+    scopedRegionTimer timer("save compressed state");
+    auto Conf = mConfiguration.lock();
+    char fn[256];
+    sprintf(fn,"%s_x%iy%iz%i.oqs",fname.c_str(),rankParity.x,rankParity.y,rankParity.z);
+
+    ArrayHandle<dVec> pp(Conf->returnPositions(),access_location::host,access_mode::read);
+    ArrayHandle<int> tt(Conf->returnTypes(),access_location::host,access_mode::read);
+    //the first N entries of the model's arrays are the rank-local lattice, indexed by latticeIndex
+    if(Conf->latticeIndex.blockSize == 0)
+        {
+        qTensorSnapshot::save(fn,pp.data,tt.data,Conf->latticeSites,latticeMinPosition,tileSize,errorBound);
+        return;
+        };
+    //snapshots are stored x fastest, so sites stored in blocks are gathered into that order first
+    Index3D fileOrder(Conf->latticeSites);
+    int nSites = fileOrder.getNumElements();
+    vector<dVec> Q(nSites);
+    vector<int> types(nSites);
+    for (int ii = 0; ii < nSites; ++ii)
+        {
+        int site = Conf->latticeIndex(fileOrder.inverseIndex(ii));
+        Q[ii] = pp.data[site];
+        types[ii] = tt.data[site];
+        };
+    qTensorSnapshot::save(fn,Q.data(),types.data(),Conf->latticeSites,latticeMinPosition,tileSize,errorBound);
+    };
+
+/*!
+Loads a snapshot written by saveStateCompressed. As with loadState, the file names must carry the _x%iy%iz%i ending of
+the rank that wrote them, and the rank-local lattice dimensions must match those of the current configuration.
+*/
+void multirankSimulation::loadStateCompressed(string fname)
+    {
+    scopedRegionTimer timer("load compressed state");
+    auto Conf = mConfiguration.lock();
+    char fn[256];
+    sprintf(fn,"%s_x%iy%iz%i.oqs",fname.c_str(),rankParity.x,rankParity.y,rankParity.z);
+
+    printf("loading compressed state...\n");
+    qTensorSnapshot snapshot(fn);
+    if(snapshot.latticeSites.x != Conf->latticeSites.x || snapshot.latticeSites.y != Conf->latticeSites.y
+       || snapshot.latticeSites.z != Conf->latticeSites.z)
+        {
+        printf("\nERROR: the snapshot %s has local lattice (%i,%i,%i), but this rank controls (%i,%i,%i)\n",fn,
+               snapshot.latticeSites.x,snapshot.latticeSites.y,snapshot.latticeSites.z,
+               Conf->latticeSites.x,Conf->latticeSites.y,Conf->latticeSites.z);
+        throw std::exception();
+        }
+    vector<dVec> Q(snapshot.getNumberOfSites());
+    vector<int> types(snapshot.getNumberOfSites());
+    snapshot.readLattice(Q.data(),types.data());
+
+    ArrayHandle<dVec> pp(Conf->returnPositions());
+    Index3D fileOrder(Conf->latticeSites);
+    for (int ii = 0; ii < Q.size(); ++ii)
+        pp.data[Conf->latticeIndex(fileOrder.inverseIndex(ii))] = Q[ii];
+    transfersUpToDate = false;
+    };
@@ -8,6 +8,7 @@
 #include "baseForce.h"
 #include "multirankQTensorLatticeModel.h"
 #include "latticeBoundaries.h"
+#include "reductionService.h"
 #include <mpi.h>
 
 /*! \file multirankSimulation.h */
@@ -21,6 +22,7 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
             setRankTopology(xDiv,yDiv,zDiv);
             determineCommunicationPattern(_edges,_corners);
             }
+        ~multirankSimulation(){freeSharedHaloWindow();freeCartesianCommunicator();};
         //!move particles, and also communicate halo sites
         virtual void moveParticles(GPUArray<dVec> &displacements,scalar scale = 1.0);
 
@@ -40,6 +42,11 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         //!make a spherocylinder, defined by the start and end of the cylindrical section and the radius
         void createSpherocylinder(scalar3 cylinderStart, scalar3 cylinderEnd, scalar radius, boundaryObject &bObj);
 
+        //!add the force from the stress on its surface to the boundaryForce of every object, summed over forces and ranks
+        void computeObjectForces();
+        //!add the force from the stress on its surface to the boundaryForce of each listed object
+        void computeObjectForces(vector<int> &objects);
+
         //!import a boundary object from a (carefully prepared) text file
         virtual void createBoundaryFromFile(string fname, bool verbose = false);
 
@@ -54,6 +61,21 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         //! synchronize mpi and make transfer buffers
         virtual void synchronizeAndTransferBuffers();
 
+        //!exchange halo sites face by face (x, then y, then z), forwarding edge and corner sites: one message per face instead of one pair per face, edge, and corner
+        void setDimensionOrderedHaloExchange(bool _dimensionOrdered = true);
+        //!exchange dimension-ordered halos with ranks on the same node through an MPI-3 shared-memory window (other neighbors still get messages)
+        void setSharedMemoryHaloExchange(bool _sharedMemory = true);
+        //!place ranks with a Cartesian communicator (neighboring blocks on the same node if nodeAware) and exchange halos with neighborhood collectives; call before setConfiguration
+        void setCartesianTopology(bool nodeAware = true, bool verbose = false);
+        //!with deep halos (multirankQTensorLatticeModel::setHaloDepth), let updaters advance the inner halo layers too and exchange halos only when forces need more layers than remain current
+        void setCommunicationAvoidingUpdates(bool _communicationAvoiding = true);
+        bool communicationAvoiding = false;
+        //!exchange halo sites unless at least this many of their layers are current
+        void refreshHaloSites(int layers);
+        //!the Cartesian communicator of the rank grid (valid if cartesianTopology)
+        MPI_Comm cartesianCommunicator;
+        bool cartesianTopology = false;
+
         profiler p1 = profiler("total communication time");
         profiler p4 = profiler("MPI recv");
         profiler p3 = profiler("MPI send");
@@ -78,7 +100,7 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         //!Add an updater with a reference to a configuration
         void addUpdater(UpdaterPtr _upd, MConfigPtr _config);
         //!Add a force computer configuration
-        virtual void addForce(ForcePtr _force){forceComputers.push_back(_force);};
+        virtual void addForce(ForcePtr _force){_force->reproducibleEnergy = reproducibleSums;forceComputers.push_back(_force);};
         //!Add a force computer configuration
         virtual void addForce(ForcePtr _force, MConfigPtr _config);
 
@@ -96,8 +118,18 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         //!Call every updater to advance one time step
         void performTimestep();
 
-        //! manipulate data from updaters
+        //! sum data from updaters over all ranks
         virtual void sumUpdaterData(vector<scalar> &data);
+        //! sum exact partial sums from updaters over all ranks
+        virtual void sumUpdaterData(vector<reproducibleSum> &data);
+        //!begin summing data from updaters over all ranks (with a collective of its own), without waiting
+        virtual void startSumUpdaterData(vector<scalar> &data);
+        //!wait for the sums begun by startSumUpdaterData
+        virtual void finishSumUpdaterData(vector<scalar> &data);
+        //!combines the global sums needed by updaters and force computers into single collectives
+        reductionService reductions;
+        //!choose how per-rank contributions to global sums are combined; reproducibleSummation also makes the energy, FIRE, and gradient descent sums exact
+        void setSummationMode(reductionService::summationMode mode);
 
         //!compute the potential energy associated with all of the forces
         virtual scalar computePotentialEnergy(bool verbose = false);
@@ -115,6 +147,8 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         void setCPUOperation(bool setcpu);
         //!Enforce reproducible dynamics
         void setReproducible(bool reproducible);
+        //!set the number of CPU threads used by the configuration, updaters, and force computers
+        void setNThreads(int n);
 
         //!save a file for each rank recording the expanded lattice; lattice skip controls the sparsity of saved sites
         void saveState(string fname, int latticeSkip = 1, int defectType = 0);
@@ -122,8 +156,21 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         //!load the Q-tensor values for each lattice site from a specified file. DOES NOT load any logic about the nature of various sites (boundary, etc)
         void loadState(string fname);
 
+        //!save a tiled, compressed binary snapshot of the Q-tensors and site types on each rank; errorBound > 0 allows lossy quantization
+        void saveStateCompressed(string fname, int tileSize = 16, scalar errorBound = 0.0);
+
+        //!load the Q-tensor values for each lattice site from a snapshot written by saveStateCompressed. Like loadState, site types are not loaded
+        void loadStateCompressed(string fname);
+
         //!in multi-rank simulations, this stores the lowest (x,y,z) coordinate controlled by the current rank
         int3 latticeMinPosition;
+        //!the size of the lattice controlled by all ranks together
+        int3 globalLatticeSize;
+        //!the number of lattice planes controlled by each slab of ranks along x, y, and z (set by setConfiguration)
+        vector<int> slabWidths[3];
+
+        //!choose slab boundaries along each axis so that every slab has about the same number of active sites; returns the block this rank should control
+        int3 loadBalancedLatticeSites(int minimumWidth = 2, bool verbose = false);
 
         virtual void reportSelf(){cout << "in the multirank simulation class" << endl;};
 
@@ -139,6 +186,35 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
         vector<bool> communicationDirectionParity;
         vector<int> communicationTargets;
 
+        //!the ranks across the x-, x+, y-, y+, z-, and z+ faces
+        vector<int> faceNeighbors;
+        //!is the halo exchanged face by face?
+        bool dimensionOrderedHalos = false;
+        //!the three stages of the dimension-ordered halo exchange
+        void communicateDimensionOrderedHalos();
+
+        //A section dedicated to shared-memory halos, implemented in multirankSimulationHalos.cpp
+        //!are the faces shared with ranks on the same node exchanged through shared memory?
+        bool sharedMemoryHalos = false;
+        //!the ranks on this node
+        MPI_Comm nodeCommunicator;
+        //!the node's shared window: each rank's part holds flags and its dimension-ordered face buffers
+        MPI_Win haloWindow;
+        bool haloWindowAllocated = false;
+        //!this rank's part of the shared window
+        char *haloWindowBase = NULL;
+        //!the part of the shared window of the rank across each face, or NULL if that rank is on another node
+        vector<char *> faceNeighborWindows;
+        //!the number of shared-memory halo exchanges so far
+        int haloEpoch = 0;
+        void allocateSharedHaloWindow();
+        void freeSharedHaloWindow();
+
+
+        //!the world rank at each position of the rank grid (indexed by parityTest), and the grid position of each world rank
+        vector<int> gridRanks;
+        vector<int> rankGridIndex;
+        void freeCartesianCommunicator();
 
         //!the number of ranks per {x,y,z} axis
         int3 rankTopology;
@@ -150,10 +226,14 @@ class multirankSimulation : public basicSimulation, public enable_shared_from_th
 
         //!have the halo sites been communicated?
         bool transfersUpToDate;
+        //!the number of halo layers whose sites are current (all of them after an exchange)
+        int currentHaloLayers = 0;
+        //!carries the sums that updaters lag by a step, so that other sums can be taken while they are in flight
+        reductionService laggedReductions;
+        int laggedFirstSlot = 0;
 
         MPI_Status mpiStatus;
         vector<MPI_Status> mpiStatuses;
         vector<MPI_Request> mpiRequests;
-        vector<scalar> dataBuffer;
     };
 #endif
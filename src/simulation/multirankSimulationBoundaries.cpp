@@ -125,11 +125,6 @@ void multirankSimulation::createWall(int xyz, int plane, boundaryObject &bObj)
             UNWRITTENCODE("non-defined boundary type is attempting to create a boundary");
         };
 
-        int3 globalLatticeSize;//the maximum size of the combined simulation
-        globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-        globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-        globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
-
         vector<int3> boundSites;
         vector<dVec> qTensors;
         int currentSite;
@@ -216,11 +211,7 @@ void multirankSimulation::createSphericalCavity(scalar3 center, scalar radius, b
     {
     dVec Qtensor(0.);
     scalar S0 = bObj.P2;
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     auto Conf = mConfiguration.lock();
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
     vector<int3> boundSites;
     vector<dVec> qTensors;
     scalar radiusSquared = radius*radius;
@@ -274,11 +265,7 @@ void multirankSimulation::createCylindricalObject(scalar3 cylinderStart, scalar3
     {
     dVec Qtensor(0.);
     scalar S0 = bObj.P2;
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     auto Conf = mConfiguration.lock();
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
     vector<int3> boundSites;
     vector<dVec> qTensors;
     scalar radiusSquared = radius*radius;
@@ -333,11 +320,7 @@ void multirankSimulation::createSpherocylinder(scalar3 cylinderStart, scalar3 cy
     {
     dVec Qtensor(0.);
     scalar S0 = bObj.P2;
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     auto Conf = mConfiguration.lock();
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
     vector<int3> boundSites;
     vector<dVec> qTensors;
     scalar radiusSquared = radius*radius;
@@ -395,14 +378,10 @@ void multirankSimulation::setDipolarField(scalar3 center, scalar ThetaD, scalar
     auto Conf = mConfiguration.lock();
     ArrayHandle<dVec> pos(Conf->returnPositions());
     ArrayHandle<int> types(Conf->returnTypes());
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     int3 latticeMax;//...and (max)
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
-    latticeMax.x = (1+rankParity.x)*Conf->latticeSites.x;
-    latticeMax.y = (1+rankParity.y)*Conf->latticeSites.y;
-    latticeMax.z = (1+rankParity.z)*Conf->latticeSites.z;
+    latticeMax.x = latticeMinPosition.x+Conf->latticeSites.x;
+    latticeMax.y = latticeMinPosition.y+Conf->latticeSites.y;
+    latticeMax.z = latticeMinPosition.z+Conf->latticeSites.z;
 
     scalar k = 0.32;
     scalar rd = 1.22;
@@ -470,14 +449,10 @@ void multirankSimulation::setDipolarField(scalar3 center, scalar3 direction, sca
     auto Conf = mConfiguration.lock();
     ArrayHandle<dVec> pos(Conf->returnPositions());
     ArrayHandle<int> types(Conf->returnTypes());
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     int3 latticeMax;//...and (max)
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
-    latticeMax.x = (1+rankParity.x)*Conf->latticeSites.x;
-    latticeMax.y = (1+rankParity.y)*Conf->latticeSites.y;
-    latticeMax.z = (1+rankParity.z)*Conf->latticeSites.z;
+    latticeMax.x = latticeMinPosition.x+Conf->latticeSites.x;
+    latticeMax.y = latticeMinPosition.y+Conf->latticeSites.y;
+    latticeMax.z = latticeMinPosition.z+Conf->latticeSites.z;
 
     scalar3 i = direction*(1.0/norm(direction));
     scalar P = 2.08;
@@ -511,14 +486,10 @@ void multirankSimulation::createMultirankBoundaryObject(vector<int3> &latticeSit
     {
     auto Conf = mConfiguration.lock();
     ArrayHandle<dVec> pos(Conf->returnPositions());
-    int3 globalLatticeSize;//the maximum size of the combined simulation
     int3 latticeMax;//...and (max)
-    globalLatticeSize.x = rankTopology.x*Conf->latticeSites.x;
-    globalLatticeSize.y = rankTopology.y*Conf->latticeSites.y;
-    globalLatticeSize.z = rankTopology.z*Conf->latticeSites.z;
-    latticeMax.x = (1+rankParity.x)*Conf->latticeSites.x;
-    latticeMax.y = (1+rankParity.y)*Conf->latticeSites.y;
-    latticeMax.z = (1+rankParity.z)*Conf->latticeSites.z;
+    latticeMax.x = latticeMinPosition.x+Conf->latticeSites.x;
+    latticeMax.y = latticeMinPosition.y+Conf->latticeSites.y;
+    latticeMax.z = latticeMinPosition.z+Conf->latticeSites.z;
     vector<int> latticeSitesToEmploy;
     latticeSitesToEmploy.reserve(latticeSites.size());
     for (int ii = 0; ii < latticeSites.size(); ++ii)
@@ -537,6 +508,45 @@ void multirankSimulation::createMultirankBoundaryObject(vector<int3> &latticeSit
     Conf->createBoundaryObject(latticeSitesToEmploy,_type,Param1,Param2);
     };
 
+void multirankSimulation::computeObjectForces()
+    {
+    auto Conf = mConfiguration.lock();
+    vector<int> objects(Conf->boundaries.getNumElements());
+    for (int oo = 0; oo < objects.size(); ++oo)
+        objects[oo] = oo;
+    computeObjectForces(objects);
+    };
+
+/*!
+Each force computer evaluates the stress at the surface sites of this rank only, for all of the objects at once, and
+the per-object forces of every rank are then summed with a single collective. Must be called by every rank.
+*/
+void multirankSimulation::computeObjectForces(vector<int> &objects)
+    {
+    auto Conf = mConfiguration.lock();
+    //the stress at a surface site depends on its six neighbors
+    refreshHaloSites(1);
+    vector<scalar> forceSums(3*objects.size(),0.0);
+    vector<scalar3> objectForces;
+    for (int f = 0; f < forceComputers.size(); ++f)
+        {
+        auto frc = forceComputers[f].lock();
+        frc->computeObjectForces(objects,objectForces);
+        for (int oo = 0; oo < objects.size(); ++oo)
+            {
+            forceSums[3*oo] += objectForces[oo].x;
+            forceSums[3*oo+1] += objectForces[oo].y;
+            forceSums[3*oo+2] += objectForces[oo].z;
+            };
+        };
+    sumUpdaterData(forceSums);
+    for (int oo = 0; oo < objects.size(); ++oo)
+        {
+        scalar3 objectForce = make_scalar3(forceSums[3*oo],forceSums[3*oo+1],forceSums[3*oo+2]);
+        Conf->boundaryForce[objects[oo]] = Conf->boundaryForce[objects[oo]] + objectForce;
+        };
+    };
+
 void multirankSimulation::finalizeObjects()
     {
     /* this section of code now handled in the base "createBoundaryObject() function
@@ -568,10 +578,17 @@ void multirankSimulation::finalizeObjects()
     */
     communicateHaloSitesRoutine();
 
+    //with sparse storage, drop the sites the objects now cover from the degrees of freedom
+    auto Conf = mConfiguration.lock();
+    if(Conf->sparseStorage)
+        Conf->compactActiveSites();
+
     //let updaters know number of non-object sites
     for (int u = 0; u < updaters.size(); ++u)
         {
         auto upd = updaters[u].lock();
+        if(upd->getNdof() != Conf->getNumberOfDegreesOfFreedom())
+            upd->initializeFromModel();
         NActive=upd->getNTotal();
         };
 
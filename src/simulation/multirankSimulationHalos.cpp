@@ -0,0 +1,238 @@
+#include "multirankSimulation.h"
+#include "regionTimers.h"
+#include <thread>
+/*! \file multirankSimulationHalos.cpp */
+
+//!the flags and face layout at the start of each rank's part of the shared halo window
+struct sharedHaloHeader
+    {
+    //!the exchange whose data is in the buffer of each face
+    volatile int published[6];
+    //!the exchange up to which the halo of each face has been read from the buffer of the neighbor
+    volatile int consumed[6];
+    //!the start/stop sites of each face in the buffer
+    int2 faceStartStop[6];
+    };
+//!the face buffers start on their own cache line
+static const int sharedHaloHeaderBytes = 64*((sizeof(sharedHaloHeader)+63)/64);
+
+static sharedHaloHeader *haloHeader(char *windowPart)
+    {
+    return (sharedHaloHeader *) windowPart;
+    };
+
+static scalar *haloData(char *windowPart)
+    {
+    return (scalar *) (windowPart + sharedHaloHeaderBytes);
+    };
+
+//!wait for a flag written by another rank on the node to reach value, yielding the core to other processes after a short spin
+static void waitForSharedFlag(volatile int *flag, int value, MPI_Win &window)
+    {
+    int spins = 0;
+    while(*flag < value)
+        {
+        MPI_Win_sync(window);
+        spins += 1;
+        if(spins > 64)
+            std::this_thread::yield();
+        };
+    MPI_Win_sync(window);
+    };
+
+/*!
+Each stage exchanges the two faces along one dimension and unpacks them before the next stage packs its faces, so that
+the y and z faces can carry the halo sites received along x (and y). With edges or corners enabled this delivers the
+same halo data as the pattern of determineCommunicationPattern with at most six messages, rather than up to 26 pairs
+of int and scalar messages.
+
+With shared-memory halos, each face is packed into this rank's part of the node's shared window instead. A neighbor
+on the same node copies the face straight into its halo sites once the "published" flag of the face shows the
+current exchange, and then sets its own "consumed" flag, which the owner checks before packing that face again in the
+next exchange. Neighbors on other nodes are sent the face from the window as a message.
+
+With a Cartesian communicator (setCartesianTopology), the messages of each stage are a single neighborhood collective,
+in which faces that go through shared memory have no data, unless only two ranks share that dimension.
+*/
+void multirankSimulation::communicateDimensionOrderedHalos()
+    {
+    auto Conf = mConfiguration.lock();
+    int ranksPerDimension[3] = {rankTopology.x,rankTopology.y,rankTopology.z};
+    MPI_Request requests[4];
+    MPI_Status statuses[4];
+    if(sharedMemoryHalos)
+        haloEpoch += 1;
+    sharedHaloHeader *myHeader = sharedMemoryHalos ? haloHeader(haloWindowBase) : NULL;
+    int stride = Conf->haloSiteScalars();
+    for (int dimension = 0; dimension < 3; ++dimension)
+        {
+        if(ranksPerDimension[dimension] < 2)
+            continue;
+        bool onNode[2];
+        int nRequests = 0;
+        //neighborhood collectives list the neighbors of a Cartesian communicator in the same order as the faces
+        int counts[6] = {0,0,0,0,0,0};
+        int displacements[6] = {0,0,0,0,0,0};
+        //with two ranks along a dimension both neighbors are the same rank, and MPI versions before 4.0 do not agree on
+        //which receive block each of its two messages lands in, so those faces keep the tagged point-to-point messages
+        bool neighborCollective = cartesianTopology && ranksPerDimension[dimension] > 2;
+        {
+        ArrayHandle<scalar> bufS(Conf->dimensionOrderedBufferSend,access_location::host,access_mode::readwrite);
+        ArrayHandle<scalar> bufR(Conf->dimensionOrderedBufferReceive,access_location::host,access_mode::readwrite);
+        scalar *sendBuffer = sharedMemoryHalos ? haloData(haloWindowBase) : bufS.data;
+        for (int side = 0; side < 2; ++side)
+            {
+            int face = 2*dimension+side;
+            //the face of the neighbor that borders this one
+            int opposite = 2*dimension+1-side;
+            int2 startStop = Conf->dimensionOrderedStartStop[face];
+            int offset = stride*startStop.x;
+            int messageSize = stride*(startStop.y-startStop.x+1);
+            onNode[side] = sharedMemoryHalos && faceNeighborWindows[face] != NULL;
+            if(onNode[side])
+                {
+                scopedRegionTimer waitTimer("halo wait");
+                waitForSharedFlag(&haloHeader(faceNeighborWindows[face])->consumed[opposite],haloEpoch-1,haloWindow);
+                }
+            Conf->packDimensionOrderedBuffer(face,&sendBuffer[offset]);
+            if(onNode[side])
+                {
+                MPI_Win_sync(haloWindow);
+                myHeader->published[face] = haloEpoch;
+                MPI_Win_sync(haloWindow);
+                }
+            else if(neighborCollective)
+                {
+                counts[face] = messageSize;
+                displacements[face] = offset;
+                }
+            else
+                {
+                //what a rank sends across its "-" face arrives on the "+" face of its neighbor, so tag messages by the sending face
+                MPI_Irecv(&bufR.data[offset],messageSize,MPI_SCALAR,faceNeighbors[face],opposite,MPI_COMM_WORLD,&requests[nRequests]);
+                MPI_Isend(&sendBuffer[offset],messageSize,MPI_SCALAR,faceNeighbors[face],face,MPI_COMM_WORLD,&requests[nRequests+1]);
+                nRequests += 2;
+                };
+            };
+        if(neighborCollective)
+            {
+            MPI_Ineighbor_alltoallv(sendBuffer,counts,displacements,MPI_SCALAR,bufR.data,counts,displacements,MPI_SCALAR,cartesianCommunicator,&requests[0]);
+            nRequests = 1;
+            };
+        for (int side = 0; side < 2; ++side)
+            {
+            if(!onNode[side])
+                continue;
+            int face = 2*dimension+side;
+            int opposite = 2*dimension+1-side;
+            sharedHaloHeader *neighborHeader = haloHeader(faceNeighborWindows[face]);
+            {
+            scopedRegionTimer waitTimer("halo wait");
+            waitForSharedFlag(&neighborHeader->published[opposite],haloEpoch,haloWindow);
+            }
+            Conf->unpackDimensionOrderedBuffer(face,&haloData(faceNeighborWindows[face])[stride*neighborHeader->faceStartStop[opposite].x]);
+            MPI_Win_sync(haloWindow);
+            myHeader->consumed[face] = haloEpoch;
+            MPI_Win_sync(haloWindow);
+            };
+        scopedRegionTimer waitTimer("halo wait");
+        MPI_Waitall(nRequests,requests,statuses);
+        }
+        for (int side = 0; side < 2; ++side)
+            if(!onNode[side])
+                Conf->unpackDimensionOrderedBuffer(2*dimension+side);
+        };
+    transfersUpToDate = true;
+    };
+
+void multirankSimulation::setDimensionOrderedHaloExchange(bool _dimensionOrdered)
+    {
+    dimensionOrderedHalos = _dimensionOrdered;
+    if(!dimensionOrderedHalos)
+        sharedMemoryHalos = false;
+    if(!mConfiguration.expired())
+        {
+        auto Conf = mConfiguration.lock();
+        if(dimensionOrderedHalos)
+            Conf->determineDimensionOrderedLayout(edges || corners);
+        allocateSharedHaloWindow();
+        };
+    };
+
+/*!
+Shared-memory halos use the dimension-ordered exchange, which is switched on as well. Must be called by every rank
+(the window is allocated collectively by the ranks of each node).
+*/
+void multirankSimulation::setSharedMemoryHaloExchange(bool _sharedMemory)
+    {
+    sharedMemoryHalos = _sharedMemory;
+    setDimensionOrderedHaloExchange(dimensionOrderedHalos || sharedMemoryHalos);
+    };
+
+/*!
+Every rank of a node contributes the header and face buffers of its dimension-ordered layout to one MPI-3 shared
+window, and records where in its address space the part of each face neighbor on the same node is. Called whenever
+the configuration or the exchange mode changes; frees any previous window first.
+*/
+void multirankSimulation::allocateSharedHaloWindow()
+    {
+    freeSharedHaloWindow();
+    if(!sharedMemoryHalos)
+        return;
+    auto Conf = mConfiguration.lock();
+    MPI_Comm_split_type(MPI_COMM_WORLD,MPI_COMM_TYPE_SHARED,myRank,MPI_INFO_NULL,&nodeCommunicator);
+    MPI_Info info;
+    MPI_Info_create(&info);
+    //let each rank's part live in memory local to it
+    MPI_Info_set(info,"alloc_shared_noncontig","true");
+    MPI_Aint bytes = sharedHaloHeaderBytes + sizeof(scalar)*Conf->dimensionOrderedBufferSend.getNumElements();
+    MPI_Win_allocate_shared(bytes,1,info,nodeCommunicator,&haloWindowBase,&haloWindow);
+    MPI_Info_free(&info);
+    haloWindowAllocated = true;
+
+    sharedHaloHeader *myHeader = haloHeader(haloWindowBase);
+    for (int face = 0; face < 6; ++face)
+        {
+        myHeader->published[face] = 0;
+        myHeader->consumed[face] = 0;
+        myHeader->faceStartStop[face] = Conf->dimensionOrderedStartStop[face];
+        };
+    haloEpoch = 0;
+    MPI_Win_lock_all(MPI_MODE_NOCHECK,haloWindow);
+    MPI_Win_sync(haloWindow);
+    MPI_Barrier(nodeCommunicator);
+    MPI_Win_sync(haloWindow);
+
+    MPI_Group worldGroup, nodeGroup;
+    MPI_Comm_group(MPI_COMM_WORLD,&worldGroup);
+    MPI_Comm_group(nodeCommunicator,&nodeGroup);
+    faceNeighborWindows.assign(6,(char *)NULL);
+    for (int face = 0; face < 6; ++face)
+        {
+        int nodeRank;
+        MPI_Group_translate_ranks(worldGroup,1,&faceNeighbors[face],nodeGroup,&nodeRank);
+        if(nodeRank == MPI_UNDEFINED || faceNeighbors[face] == myRank)
+            continue;
+        MPI_Aint neighborBytes;
+        int displacementUnit;
+        MPI_Win_shared_query(haloWindow,nodeRank,&neighborBytes,&displacementUnit,&faceNeighborWindows[face]);
+        };
+    MPI_Group_free(&worldGroup);
+    MPI_Group_free(&nodeGroup);
+    };
+
+void multirankSimulation::freeSharedHaloWindow()
+    {
+    if(!haloWindowAllocated)
+        return;
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if(!finalized)
+        {
+        MPI_Win_unlock_all(haloWindow);
+        MPI_Win_free(&haloWindow);
+        MPI_Comm_free(&nodeCommunicator);
+        };
+    haloWindowAllocated = false;
+    faceNeighborWindows.clear();
+    };
@@ -0,0 +1,205 @@
+#include "reductionService.h"
+/*! \file reductionService.cpp */
+
+/*!
+The MPI reduction operation of compensatedSummation: inout[i] = in[i] + inout[i] for (sum, error) pairs, using
+Knuth's two-sum so that the rounding error of adding the two leading parts is kept in the error part
+*/
+static void addCompensatedPairs(void *in, void *inout, int *length, MPI_Datatype *type)
+    {
+    double *a = (double *) in;
+    double *b = (double *) inout;
+    for (int ii = 0; ii < *length; ++ii)
+        {
+        double s = a[2*ii] + b[2*ii];
+        double bVirtual = s - a[2*ii];
+        double error = (a[2*ii] - (s - bVirtual)) + (b[2*ii] - bVirtual);
+        error += a[2*ii+1] + b[2*ii+1];
+        //renormalize so that the error part stays small compared to the sum
+        double t = s + error;
+        b[2*ii+1] = error - (t - s);
+        b[2*ii] = t;
+        };
+    };
+
+reductionService::reductionService(MPI_Comm _communicator)
+    {
+    communicator = _communicator;
+    };
+
+reductionService::~reductionService()
+    {
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if(compensatedOperationCreated && !finalized)
+        {
+        MPI_Op_free(&compensatedOperation);
+        MPI_Type_free(&pairType);
+        };
+    };
+
+void reductionService::createCompensatedOperation()
+    {
+    MPI_Type_contiguous(2,MPI_DOUBLE,&pairType);
+    MPI_Type_commit(&pairType);
+    MPI_Op_create(&addCompensatedPairs,1,&compensatedOperation);
+    compensatedOperationCreated = true;
+    };
+
+int reductionService::newSlot(int size, bool exact)
+    {
+    if(inFlight)
+        {
+        printf("values cannot be registered while a reduction is in progress\n");
+        throw std::exception();
+        };
+    if(batchDone)
+        {
+        slots = 0;
+        values = 0;
+        batchIsExact = false;
+        batchDone = false;
+        };
+    //vectors only grow, so that repeated reductions of the same size do not allocate
+    if(localValues.size() < values+size)
+        {
+        localValues.resize(values+size);
+        globalValues.resize(values+size);
+        };
+    if(slotOffsets.size() < slots+1)
+        {
+        slotOffsets.resize(slots+1);
+        slotIsExact.resize(slots+1);
+        };
+    slotOffsets[slots] = values;
+    slotIsExact[slots] = exact;
+    batchIsExact = batchIsExact || exact;
+    values += size;
+    slots += 1;
+    return slots-1;
+    };
+
+int reductionService::add(scalar value)
+    {
+    if(mode == reproducibleSummation)
+        {
+        reproducibleSum partial;
+        partial.add(value);
+        return add(partial);
+        };
+    compensatedSum partial;
+    partial.sum = value;
+    return add(partial);
+    };
+
+int reductionService::add(const compensatedSum &partial)
+    {
+    if(mode == reproducibleSummation)
+        {
+        reproducibleSum exactPartial;
+        exactPartial.add(partial.sum);
+        exactPartial.add(partial.compensation);
+        return add(exactPartial);
+        };
+    int slot = newSlot(2,false);
+    localValues[slotOffsets[slot]] = partial.sum;
+    localValues[slotOffsets[slot]+1] = partial.compensation;
+    return slot;
+    };
+
+int reductionService::add(reproducibleSum &partial)
+    {
+    int slot = newSlot(reproducibleSum::nBins,true);
+    partial.getDigits(&localValues[slotOffsets[slot]]);
+    return slot;
+    };
+
+void reductionService::start()
+    {
+    if(inFlight)
+        return;
+    MPI_Comm_size(communicator,&nRanks);
+    if(nRanks > 1 && slots > 0)
+        {
+        if(mode == compensatedSummation && !batchIsExact)
+            {
+            if(!compensatedOperationCreated)
+                createCompensatedOperation();
+            MPI_Iallreduce(localValues.data(),globalValues.data(),slots,pairType,compensatedOperation,communicator,&request);
+            }
+        else
+            MPI_Iallreduce(localValues.data(),globalValues.data(),values,MPI_DOUBLE,MPI_SUM,communicator,&request);
+        inFlight = true;
+        }
+    else
+        {
+        for (int ii = 0; ii < values; ++ii)
+            globalValues[ii] = localValues[ii];
+        };
+    batchDone = true;
+    };
+
+void reductionService::finish()
+    {
+    if(inFlight)
+        {
+        MPI_Wait(&request,MPI_STATUS_IGNORE);
+        inFlight = false;
+        };
+    };
+
+scalar reductionService::result(int slot)
+    {
+    if(slot < 0 || slot >= slots)
+        {
+        printf("requested the result of unregistered reduction slot %i\n",slot);
+        throw std::exception();
+        };
+    finish();
+    if(slotIsExact[slot])
+        {
+        reproducibleSum ans;
+        ans.setDigits(&globalValues[slotOffsets[slot]]);
+        return ans.value();
+        };
+    return globalValues[slotOffsets[slot]] + globalValues[slotOffsets[slot]+1];
+    };
+
+void reductionService::exactResult(int slot, reproducibleSum &ans)
+    {
+    if(slot < 0 || slot >= slots || !slotIsExact[slot])
+        {
+        printf("reduction slot %i does not hold an exact sum\n",slot);
+        throw std::exception();
+        };
+    finish();
+    ans.setDigits(&globalValues[slotOffsets[slot]]);
+    };
+
+void reductionService::sumInPlace(vector<scalar> &data)
+    {
+    int firstSlot = -1;
+    for (int ii = 0; ii < data.size(); ++ii)
+        {
+        int slot = add(data[ii]);
+        if(ii == 0)
+            firstSlot = slot;
+        };
+    reduce();
+    for (int ii = 0; ii < data.size(); ++ii)
+        data[ii] = result(firstSlot+ii);
+    };
+
+void reductionService::sumInPlace(vector<reproducibleSum> &data)
+    {
+    int firstSlot = -1;
+    for (int ii = 0; ii < data.size(); ++ii)
+        {
+        int slot = add(data[ii]);
+        if(ii == 0)
+            firstSlot = slot;
+        };
+    reduce();
+    for (int ii = 0; ii < data.size(); ++ii)
+        exactResult(firstSlot+ii,data[ii]);
+    };
@@ -0,0 +1,121 @@
+#ifndef reductionService_H
+#define reductionService_H
+
+#include "std_include.h"
+#include "reproducibleSum.h"
+#include <mpi.h>
+
+/*! \file reductionService.h */
+
+//!A running sum that carries its own rounding error (Neumaier's variant of Kahan summation)
+struct compensatedSum
+    {
+    scalar sum = 0.0;
+    scalar compensation = 0.0;
+    //!add x to the sum, keeping track of the low-order bits that are lost
+    void add(scalar x)
+        {
+        scalar t = sum + x;
+        if(fabs(sum) >= fabs(x))
+            compensation += (sum - t) + x;
+        else
+            compensation += (x - t) + sum;
+        sum = t;
+        };
+    //!the compensated value of the sum
+    scalar value() const {return sum + compensation;};
+    };
+
+//!Sum scalars over all ranks, with one collective per batch of registered values
+/*!
+Updaters and force computers add() the local (per-rank) parts of the global quantities they need, each add
+returning a slot. A single call to reduce() (or to start() and, after some independent work, finish()) sums every
+slot registered since the previous reduction over all ranks with one MPI_Allreduce (MPI_Iallreduce), and result(slot)
+returns the global value. The cost is one latency-bound collective per batch, rather than one MPI_Allgather
+(whose message size grows with the number of ranks) per quantity.
+
+In compensatedSummation mode every slot travels as a (sum, error) pair and ranks are combined with an error-free
+transformation, so that the global sum is accurate to about twice the working precision whatever the number of ranks;
+the local parts can be accumulated with compensatedSum and added with their error term.
+
+In reproducibleSummation mode every slot travels as the digits of a reproducibleSum, which are summed exactly, so
+the global sum is independent of the number of ranks and of the reduction order. Callers that accumulate their
+local parts in a reproducibleSum (rather than in a scalar, whose value depends on which sites a rank owns) get
+global sums that are bitwise identical for any decomposition of the lattice. A batch that contains reproducibleSum
+slots is always combined with a plain MPI_SUM, which is exact for the digits.
+*/
+class reductionService
+    {
+    public:
+        enum summationMode
+            {
+            plainSummation = 0,
+            compensatedSummation = 1,
+            reproducibleSummation = 2
+            };
+
+        reductionService(MPI_Comm _communicator = MPI_COMM_WORLD);
+        ~reductionService();
+
+        //!choose how the per-rank values are combined
+        void setSummationMode(summationMode _mode){mode = _mode;};
+        summationMode getSummationMode(){return mode;};
+
+        //!register a local value to be summed by the next reduction; returns the slot of the result
+        int add(scalar value);
+        //!register a locally compensated partial sum
+        int add(const compensatedSum &partial);
+        //!register an exact partial sum
+        int add(reproducibleSum &partial);
+
+        //!begin summing every value registered since the last reduction (non-blocking when there are several ranks)
+        void start();
+        //!wait for the reduction begun by start() to complete
+        void finish();
+        //!start and finish
+        void reduce(){start();finish();};
+        //!the global sum of a slot after the reduction has finished
+        scalar result(int slot);
+
+        //!the global sum of a reproducibleSum slot, as an exact sum
+        void exactResult(int slot, reproducibleSum &ans);
+
+        //!sum each element of data over all ranks, in place, with a single collective
+        void sumInPlace(vector<scalar> &data);
+        //!sum each exact partial sum over all ranks, in place, with a single collective
+        void sumInPlace(vector<reproducibleSum> &data);
+
+    protected:
+        //!create the MPI datatype and operation used for compensated sums
+        void createCompensatedOperation();
+
+        MPI_Comm communicator;
+        int nRanks = 1;
+        summationMode mode = plainSummation;
+
+        //!make room for a slot of the given number of values, returning its offset
+        int newSlot(int size, bool exact);
+
+        //!(value, error) or reproducibleSum digits for every registered slot
+        vector<double> localValues;
+        vector<double> globalValues;
+        //!the offset of every slot in localValues
+        vector<int> slotOffsets;
+        //!whether every slot holds reproducibleSum digits
+        vector<bool> slotIsExact;
+        //!the number of registered slots, and of values in them
+        int slots = 0;
+        int values = 0;
+        //!whether the current batch contains reproducibleSum digits
+        bool batchIsExact = false;
+        //!true between start() and finish()
+        bool inFlight = false;
+        //!true once a reduction has finished; the next add() begins a new batch
+        bool batchDone = false;
+        MPI_Request request;
+
+        bool compensatedOperationCreated = false;
+        MPI_Datatype pairType;
+        MPI_Op compensatedOperation;
+    };
+#endif
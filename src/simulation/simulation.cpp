@@ -108,7 +108,13 @@ void Simulation::computeForces()
         {
         auto frc = forceComputers[f].lock();
         bool zeroForces = (f==0 && !Conf->selfForceCompute);
-        frc->computeForces(Conf->returnForces(),zeroForces);
+        if(!useGPU)
+            {
+            frc->computeForces(Conf->returnForces(),zeroForces,0);
+            frc->computeForces(Conf->returnForces(),false,1);
+            }
+        else
+            frc->computeForces(Conf->returnForces(),zeroForces);
         };
     Conf->forcesComputed = true;
     };
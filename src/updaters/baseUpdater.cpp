@@ -15,8 +15,11 @@ int updater::getNTotal()
         {//scope for array handles
         nTotal = Ndof;
         ArrayHandle<int> h_t(model->returnTypes(),access_location::host,access_mode::read);
+        GPUArray<int> &dofParticles = model->returnDegreeOfFreedomParticles();
+        bool mapped = dofParticles.getNumElements() > 0;
+        ArrayHandle<int> particles(dofParticles,access_location::host,access_mode::read);
         for (int i = 0; i < Ndof; ++i)
-            if(h_t.data[i] > 0)
+            if(h_t.data[mapped ? particles.data[i] : i] > 0)
                 nTotal -= 1;
 
         updaterData[0] = nTotal;
@@ -26,3 +29,38 @@ int updater::getNTotal()
     //printf("nTotal set to %i\n",nTotal);
     return nTotal;
     }
+
+/*!
+Each call starts the global sum of the local values in updaterData and returns (in updaterData) the global sums
+started by the previous call, so the reduction overlaps the work of a whole step instead of stalling it. Updaters that
+use this act on global quantities one step late.
+*/
+void updater::sumUpdaterDataLagged()
+    {
+    if(laggedSumInFlight)
+        {
+        sim->finishSumUpdaterData(laggedSums);
+        laggedSumInFlight = false;
+        laggedSumKnown = true;
+        };
+    sim->startSumUpdaterData(updaterData);
+    if(!laggedSumKnown)
+        {
+        //nothing to lag behind yet
+        sim->finishSumUpdaterData(updaterData);
+        laggedSums = updaterData;
+        laggedSumKnown = true;
+        return;
+        };
+    //keep the local values of this call until their sum arrives, and use the sums of the previous call
+    std::swap(updaterData,laggedSums);
+    laggedSumInFlight = true;
+    };
+
+void updater::resetLaggedSums()
+    {
+    if(laggedSumInFlight)
+        sim->finishSumUpdaterData(laggedSums);
+    laggedSumInFlight = false;
+    laggedSumKnown = false;
+    };
@@ -44,7 +44,7 @@ class updater
             };
 
         //!by default, set Ndof
-        virtual void initializeFromModel(){Ndof = model->getNumberOfParticles();};
+        virtual void initializeFromModel(){Ndof = model->getNumberOfDegreesOfFreedom();};
 
         //! set the period
         void setPeriod(int _p){Period = _p;};
@@ -88,6 +88,11 @@ class updater
         int getNTotal();
         vector<scalar> updaterData;
 
+        //!can the updater also advance the halo sites a model computes forces on, between halo exchanges (see multirankSimulation::setCommunicationAvoidingUpdates)?
+        virtual bool supportsCommunicationAvoidance(){return false;};
+        //!set by the simulation: move the halo sites that have forces too, and lag global sums by a step
+        bool communicationAvoiding = false;
+
         //!The number of iterations performed
         int iterations;
 
@@ -112,6 +117,15 @@ class updater
         scalar deltaT;
         //!The maximum number of iterations allowed
         int maxIterations;
+
+        //!sum updaterData over all ranks without waiting: replaced by the sums of the previous call (of this call, the first time after resetLaggedSums)
+        void sumUpdaterDataLagged();
+        //!wait for a lagged sum that is still in flight, and forget the sums of previous calls
+        void resetLaggedSums();
+        //!the local values of the sum in flight, or the global sums of the last call
+        vector<scalar> laggedSums;
+        bool laggedSumInFlight = false;
+        bool laggedSumKnown = false;
     };
 
 typedef shared_ptr<updater> UpdaterPtr;
@@ -7,7 +7,7 @@
 void energyMinimizerAdam::initializeFromModel()
     {
     iterations = 0;
-    Ndof = model->getNumberOfParticles();
+    Ndof = model->getNumberOfDegreesOfFreedom();
     displacement.resize(Ndof);
     biasedMomentumEstimate.resize(Ndof);
     biasedMomentumSquaredEstimate.resize(Ndof);
@@ -85,7 +85,7 @@ void energyMinimizerAdam::adamStepCPU()
 
 void energyMinimizerAdam::minimize()
     {
-    if (Ndof != model->getNumberOfParticles())
+    if (Ndof != model->getNumberOfDegreesOfFreedom())
         initializeFromModel();
     forceMax = 110.0;
     cout << "attempting minimization " <<iterations <<" out of " << maxIterations << " maximum attempts" << endl;
@@ -48,8 +48,12 @@ Initialize the minimizer with some default parameters.
 */
 void energyMinimizerFIRE::initializeFromModel()
     {
-    //model->freeGPUArrays(false,false,false);
-    Ndof = model->getNumberOfParticles();
+    if(!model->storeVelocities)
+        {
+        printf("FIRE needs the velocities of the model, which have been freed (freeGPUArrays)\n");
+        throw std::exception();
+        };
+    Ndof = model->getNumberOfDegreesOfFreedom();
     neverGPU = model->neverGPU;
     if(neverGPU)
         {
@@ -87,20 +91,26 @@ void energyMinimizerFIRE::fireStepGPU()
     //The forces are really ``co-forces'' as defined in the non-orthonormal basis of Qxx,Qxy,Qyy,Qxz,Qyz
     //As a result, we take the vector norm of all three quantities
     //
-    scalar forceNorm = gpu_gpuarray_QT_vector_dot_product(model->returnForces(),
-                                            sumReductionIntermediate,sumReductionIntermediate2,Ndof);
-    scalar velocityNorm = gpu_gpuarray_QT_vector_dot_product(model->returnVelocities(),
-                                                sumReductionIntermediate,sumReductionIntermediate2,Ndof);
-    Power = gpu_gpuarray_QT_vector_dot_product(model->returnForces(),model->returnVelocities(),
+    scalar forceNorm, velocityNorm;
+    if(sim->reproducibleSums)
+        exactPowerAndNorms(forceNorm,Power,velocityNorm);
+    else
+        {
+        forceNorm = gpu_gpuarray_QT_vector_dot_product(model->returnForces(),
                                                 sumReductionIntermediate,sumReductionIntermediate2,Ndof);
+        velocityNorm = gpu_gpuarray_QT_vector_dot_product(model->returnVelocities(),
+                                                    sumReductionIntermediate,sumReductionIntermediate2,Ndof);
+        Power = gpu_gpuarray_QT_vector_dot_product(model->returnForces(),model->returnVelocities(),
+                                                    sumReductionIntermediate,sumReductionIntermediate2,Ndof);
 
-    updaterData[0] = forceNorm;
-    updaterData[1] = Power;
-    updaterData[2] = velocityNorm;
-    sim->sumUpdaterData(updaterData);
-    forceNorm = updaterData[0];
-    Power = updaterData[1];
-    velocityNorm = updaterData[2];
+        updaterData[0] = forceNorm;
+        updaterData[1] = Power;
+        updaterData[2] = velocityNorm;
+        sim->sumUpdaterData(updaterData);
+        forceNorm = updaterData[0];
+        Power = updaterData[1];
+        velocityNorm = updaterData[2];
+        };
 
     forceMax = sqrt(forceNorm) / ((scalar)nTotal);
     scaling = 0.0;
@@ -135,6 +145,32 @@ void energyMinimizerFIRE::fireStepGPU()
         };
     };
 
+/*!
+The per-site terms are accumulated in reproducibleSums, and summed exactly over ranks, so the results are identical
+for any decomposition of the lattice (and for the CPU and GPU, up to differences in the per-site forces themselves)
+*/
+void energyMinimizerFIRE::exactPowerAndNorms(scalar &forceNorm, scalar &power, scalar &velocityNorm)
+    {
+    exactSums.resize(3);
+    for (int ii = 0; ii < 3; ++ii)
+        exactSums[ii].reset();
+    {//scope for array handles
+    ArrayHandle<dVec> h_f(model->returnForces(),access_location::host,access_mode::read);
+    ArrayHandle<dVec> h_v(model->returnVelocities(),access_location::host,access_mode::read);
+    bool orthonormal = model->orthonormalBasis;
+    for (int i = 0; i < Ndof; ++i)
+        {
+        exactSums[0].add(orthonormal ? dot(h_f.data[i],h_f.data[i]) : dotVec(h_f.data[i],h_f.data[i]));
+        exactSums[1].add(orthonormal ? dot(h_f.data[i],h_v.data[i]) : dotVec(h_f.data[i],h_v.data[i]));
+        exactSums[2].add(orthonormal ? dot(h_v.data[i],h_v.data[i]) : dotVec(h_v.data[i],h_v.data[i]));
+        };
+    }
+    sim->sumUpdaterData(exactSums);
+    forceNorm = exactSums[0].value();
+    power = exactSums[1].value();
+    velocityNorm = exactSums[2].value();
+    };
+
 /*!
  * Perform a FIRE minimization step on the CPU
  */
@@ -149,35 +185,47 @@ void energyMinimizerFIRE::fireStepCPU()
     ArrayHandle<dVec> h_v(model->returnVelocities());
     scalar forceNorm = 0.0;
     scalar velocityNorm = 0.0;
-    for (int i = 0; i < Ndof; ++i)
+    if(sim->reproducibleSums)
+        exactPowerAndNorms(forceNorm,Power,velocityNorm);
+    else
         {
-        //
-        //The forces are really ``co-forces'' as defined in the non-orthonormal basis of Qxx,Qxy,Qyy,Qxz,Qyz
-        //As a result, we take the vector norm of all three quantities
-        //
-        scalar fdot  = dotVec(h_f.data[i],h_f.data[i]);
-        scalar vdot  = dotVec(h_v.data[i],h_v.data[i]);
-        scalar pdot  = dotVec(h_f.data[i],h_v.data[i]);
-        forceNorm    += fdot ;
-        velocityNorm += vdot;
-        Power        += pdot;
-        };
+        bool orthonormal = model->orthonormalBasis;
+        //only the degrees of freedom of the model count towards the norms, not any halo sites it advances
+        for (int i = 0; i < Ndof; ++i)
+            {
+            //
+            //The forces are really ``co-forces'' as defined in the non-orthonormal basis of Qxx,Qxy,Qyy,Qxz,Qyz
+            //As a result, we take the vector norm of all three quantities (unless they are orthonormal components)
+            //
+            scalar fdot  = orthonormal ? dot(h_f.data[i],h_f.data[i]) : dotVec(h_f.data[i],h_f.data[i]);
+            scalar vdot  = orthonormal ? dot(h_v.data[i],h_v.data[i]) : dotVec(h_v.data[i],h_v.data[i]);
+            scalar pdot  = orthonormal ? dot(h_f.data[i],h_v.data[i]) : dotVec(h_f.data[i],h_v.data[i]);
+            forceNorm    += fdot ;
+            velocityNorm += vdot;
+            Power        += pdot;
+            };
 
-    updaterData[0] = forceNorm;
-    updaterData[1] = Power;
-    updaterData[2] = velocityNorm;
-    sim->sumUpdaterData(updaterData);
-    forceNorm = updaterData[0];
-    Power = updaterData[1];
-    velocityNorm = updaterData[2];
+        updaterData[0] = forceNorm;
+        updaterData[1] = Power;
+        updaterData[2] = velocityNorm;
+        //communication-avoiding updates steer with the sums of the previous step while those of this one are in flight
+        if(communicationAvoiding)
+            sumUpdaterDataLagged();
+        else
+            sim->sumUpdaterData(updaterData);
+        forceNorm = updaterData[0];
+        Power = updaterData[1];
+        velocityNorm = updaterData[2];
+        };
 
+    int nSites = model->getNumberOfForceSites();
     forceMax = sqrt(forceNorm) / ((scalar)nTotal);
     //printf("fnorm = %g\t velocity norm = %g\n",forceNorm,velocityNorm);
     scaling = 0.0;
     if(forceNorm > 0.)
         scaling = sqrt(velocityNorm/forceNorm);
     //adjust the velocity according to the FIRE algorithm
-    for (int i = 0; i < Ndof; ++i)
+    for (int i = 0; i < nSites; ++i)
         {
         for (int dd = 0; dd < DIMENSION; ++dd)
             h_v.data[i][dd] = (1.0-alpha)*h_v.data[i][dd] + alpha*scaling*h_f.data[i][dd];
@@ -201,7 +249,8 @@ void energyMinimizerFIRE::fireStepCPU()
         deltaT = max (deltaT,deltaTMin);
         alpha = alphaStart;
         ArrayHandle<dVec> h_v(model->returnVelocities());
-        for (int i = 0; i < Ndof; ++i)
+        int nSites = model->getNumberOfForceSites();
+        for (int i = 0; i < nSites; ++i)
             {
             h_v.data[i] = make_dVec(0.0);
             };
@@ -215,10 +264,11 @@ void energyMinimizerFIRE::fireStepCPU()
 void energyMinimizerFIRE::minimize()
     {
     //cout << "attempting a minimization" << endl;
-    if (Ndof != model->getNumberOfParticles())
+    if (Ndof != model->getNumberOfDegreesOfFreedom())
         initializeFromModel();
     //initialize the forces?
     sim->computeForces();
+    resetLaggedSums();
     int curIterations = iterations;
     //always iterate at least once
     while((iterations < maxIterations && forceMax > forceCutoff) || iterations == curIterations)
@@ -230,6 +280,7 @@ void energyMinimizerFIRE::minimize()
         if(iterations%1000 == 999)
             printf("step %i max force:%.3g \tpower: %.3g\t alpha %.3g\t dt %g \t scaling %.3g \n",iterations,forceMax,Power,alpha,deltaT,scaling);cout.flush();
         };
+    resetLaggedSums();
         printf("fire finished: step %i max force:%.3g \tpower: %.3g\t alpha %.3g\t dt %g \tscaling %.3g \n",iterations,forceMax,Power,alpha,deltaT,scaling);cout.flush();
     };
 
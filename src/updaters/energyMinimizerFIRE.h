@@ -56,6 +56,8 @@ class energyMinimizerFIRE : public velocityVerlet
         void fireStepCPU();
         //!Perform a velocity Verlet step on the GPU
         void fireStepGPU();
+        //!global force norm, power, and velocity norm, accumulated exactly (on the host) when the simulation asks for reproducible sums
+        void exactPowerAndNorms(scalar &forceNorm, scalar &power, scalar &velocityNorm);
 
         //!Minimize to either the force tolerance or the maximum number of iterations
         void minimize();
@@ -64,6 +66,8 @@ class energyMinimizerFIRE : public velocityVerlet
 
         //!Return the maximum force
         virtual scalar getMaxForce(){return forceMax;};
+        //!FIRE acts site by site, given lagged global sums (on the CPU)
+        virtual bool supportsCommunicationAvoidance(){return true;};
 
         virtual scalar getClassSize()
             {
@@ -107,6 +111,8 @@ class energyMinimizerFIRE : public velocityVerlet
         GPUArray<scalar> sumReductionIntermediate2;
         //!Utility array for simple reductions
         GPUArray<scalar> sumReductions;
+        //!exact partial sums of the force norm, power, and velocity norm
+        vector<reproducibleSum> exactSums;
 
         //!kernel tuner for performance
         shared_ptr<kernelTuner> dotProductTuner;
@@ -36,7 +36,7 @@ Initialize the minimizer with some default parameters.
 */
 void energyMinimizerGradientDescent::initializeFromModel()
     {
-    Ndof = model->getNumberOfParticles();
+    Ndof = model->getNumberOfDegreesOfFreedom();
     neverGPU = model->neverGPU;
     if(neverGPU)
         {
@@ -67,14 +67,37 @@ void energyMinimizerGradientDescent::gradientDescentGPU()
     {
     sim->moveParticles(model->returnForces(),deltaT);
     sim->computeForces();
-    scalar forceNorm = gpu_gpuarray_dVec_dot_products(model->returnForces(),model->returnForces(),
-                                                sumReductionIntermediate,sumReductionIntermediate2,Ndof);
-    updaterData[0] = forceNorm;
-    sim->sumUpdaterData(updaterData);
-    forceNorm = updaterData[0];
+    scalar forceNorm;
+    if(sim->reproducibleSums)
+        forceNorm = exactForceNorm();
+    else
+        {
+        forceNorm = gpu_gpuarray_dVec_dot_products(model->returnForces(),model->returnForces(),
+                                                    sumReductionIntermediate,sumReductionIntermediate2,Ndof);
+        updaterData[0] = forceNorm;
+        sim->sumUpdaterData(updaterData);
+        forceNorm = updaterData[0];
+        };
     forceMax = sqrt(forceNorm) / ((scalar)nTotal);
     };
 
+/*!
+The per-site terms are accumulated in a reproducibleSum, and summed exactly over ranks, so the result is identical
+for any decomposition of the lattice
+*/
+scalar energyMinimizerGradientDescent::exactForceNorm()
+    {
+    exactSums.resize(1);
+    exactSums[0].reset();
+    {//scope for array handles
+    ArrayHandle<dVec> h_f(model->returnForces(),access_location::host,access_mode::read);
+    for (int i = 0; i < Ndof; ++i)
+        exactSums[0].add(dot(h_f.data[i],h_f.data[i]));
+    }
+    sim->sumUpdaterData(exactSums);
+    return exactSums[0].value();
+    };
+
 /*!
  * Perform a GD minimization step on the CPU
  */
@@ -83,6 +106,11 @@ void energyMinimizerGradientDescent::gradientDescentCPU()
     sim->moveParticles(model->returnForces(),deltaT);
     sim->computeForces();
     scalar forceNorm = 0.0;
+    if(sim->reproducibleSums)
+        {
+        forceMax = sqrt(exactForceNorm()) / ((scalar)nTotal);
+        return;
+        };
     {//scope for array handles
     ArrayHandle<dVec> h_f(model->returnForces());
     //ArrayHandle<scalar> h_m(model->returnMasses());
@@ -94,7 +122,11 @@ void energyMinimizerGradientDescent::gradientDescentCPU()
     };//handle scope
     //move particles
     updaterData[0] = forceNorm;
-    sim->sumUpdaterData(updaterData);
+    //communication-avoiding updates test the force norm of the previous step while that of this one is in flight
+    if(communicationAvoiding)
+        sumUpdaterDataLagged();
+    else
+        sim->sumUpdaterData(updaterData);
     forceNorm = updaterData[0];
     forceMax = sqrt(forceNorm) / ((scalar)nTotal);
     };
@@ -106,10 +138,11 @@ void energyMinimizerGradientDescent::gradientDescentCPU()
 void energyMinimizerGradientDescent::minimize()
     {
     //cout << "attempting a minimization" << endl;
-    if (Ndof != model->getNumberOfParticles())
+    if (Ndof != model->getNumberOfDegreesOfFreedom())
         initializeFromModel();
     //initialize the forces?
     sim->computeForces();
+    resetLaggedSums();
     int curIterations = iterations;
     //always iterate at least once
     while((iterations < maxIterations && forceMax > forceCutoff) || iterations == curIterations)
@@ -120,6 +153,7 @@ void energyMinimizerGradientDescent::minimize()
         if(iterations%1000 == 999)
             printf("step %i max force:%.3g \n",iterations,forceMax);cout.flush();
         };
+    resetLaggedSums();
         printf("gradient descent finished: step %i max force:%.3g \n",iterations,forceMax);cout.flush();
     };
 
@@ -41,6 +41,8 @@ class energyMinimizerGradientDescent : public equationOfMotion
         void gradientDescentCPU();
         //!Perform a velocity Verlet step on the GPU
         void gradientDescentGPU();
+        //!the global force norm, accumulated exactly (on the host) when the simulation asks for reproducible sums
+        scalar exactForceNorm();
 
         //!Minimize to either the force tolerance or the maximum number of iterations
         void minimize();
@@ -49,6 +51,8 @@ class energyMinimizerGradientDescent : public equationOfMotion
 
         //!Return the maximum force
         virtual scalar getMaxForce(){return forceMax;};
+        //!gradient descent acts site by site, and only its stopping test needs a global sum (on the CPU)
+        virtual bool supportsCommunicationAvoidance(){return true;};
 
         virtual scalar getClassSize()
             {
@@ -68,6 +72,8 @@ class energyMinimizerGradientDescent : public equationOfMotion
         //!Utility array for simple reductions
         GPUArray<scalar> sumReductionIntermediate;
         GPUArray<scalar> sumReductionIntermediate2;
+        //!exact partial sum of the force norm
+        vector<reproducibleSum> exactSums;
 
     };
 #endif
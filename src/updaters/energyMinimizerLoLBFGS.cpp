@@ -1,6 +1,7 @@
 #include"energyMinimizerLoLBFGS.h"
 //#include"energyMinimizerNesterovAG.cuh"
 #include "utilities.cuh"
+#include "qTensorFunctions.h"
 
 /*! \file energyMinimizerLoLBFGS.cpp */
 
@@ -30,7 +31,9 @@ void energyMinimizerLoLBFGS::initializeParameters()
 void energyMinimizerLoLBFGS::initializeFromModel()
     {
     //model->freeGPUArrays(true,true,true);
-    Ndof = model->getNumberOfParticles();
+    Ndof = model->getNumberOfDegreesOfFreedom();
+    nTotal = Ndof;
+    gramMatrix.clear();
     unscaledStep.resize(Ndof);
     sumReductionIntermediate.resize(Ndof);
     sumReductionIntermediate2.resize(Ndof);
@@ -62,19 +65,25 @@ void energyMinimizerLoLBFGS::lineSearchCPU(GPUArray<dVec> &descentDirection)
     ArrayHandle<dVec> pt(descentDirection,access_location::host,access_mode::read);
     ArrayHandle<dVec> f(model->returnForces(),access_location::host,access_mode::read);
     ArrayHandle<dVec> pos(model->returnPositions(), access_location::host,access_mode::read);
+    GPUArray<int> &dofParticles = model->returnDegreeOfFreedomParticles();
+    bool mapped = dofParticles.getNumElements() > 0;
+    ArrayHandle<int> particles(dofParticles,access_location::host,access_mode::read);
     dotProduct = host_dVec_dot_products(f.data,pt.data,Ndof);
 
     scalar otherMin = -2.0/3.0;
     scalar otherMax = 5./6.;
     for (int ii = 0; ii <Ndof; ++ii)
         {
+        int particle = mapped ? particles.data[ii] : ii;
         scalar step;
+        //the bounds are on the Q-tensor components
+        dVec direction = model->orthonormalBasis ? orthonormalBasisTransform(pt.data[ii]) : pt.data[ii];
         for (int dd = 0; dd < DIMENSION; ++dd)
             {
             scalar maxB = (dd >2 ) ? .5 : otherMax;
             scalar minB = (dd >2 ) ? -.75 : otherMin;
-            scalar topBound = (maxB - pos.data[ii][dd]) / pt.data[ii][dd];
-            scalar bottomBound = (minB - pos.data[ii][dd]) / pt.data[ii][dd];
+            scalar topBound = (maxB - pos.data[particle][dd]) / direction[dd];
+            scalar bottomBound = (minB - pos.data[particle][dd]) / direction[dd];
             scalar stepRestriction = max(topBound,bottomBound);
             if(stepRestriction >0 && stepRestriction < iStep)
                 iStep = stepRestriction;
@@ -106,7 +115,7 @@ void energyMinimizerLoLBFGS::lineSearchGPU(GPUArray<dVec> &descentDirection)
 
 void energyMinimizerLoLBFGS::LoLBFGSStepGPU()
     {
-    int lastM = (currentIterationInMLoop - 1+m) %m;
+    int lastM = historySlot(0);
     //step 1
     {
     if(iterations == 0)
@@ -121,7 +130,7 @@ void energyMinimizerLoLBFGS::LoLBFGSStepGPU()
     ArrayHandle<scalar> a(alpha);
     for (int ii = 0; ii < m; ++ii)
         {
-        int tMinusI = (currentIterationInMLoop - ii - 1 + m) % m;
+        int tMinusI = historySlot(ii);
         {
         sy.data[ii]= gpu_gpuarray_dVec_dot_products(secantEquation[tMinusI],gradientDifference[tMinusI],
                                                     sumReductionIntermediate,sumReductionIntermediate2);
@@ -156,7 +165,7 @@ void energyMinimizerLoLBFGS::LoLBFGSStepGPU()
     ArrayHandle<scalar> a(alpha);
     for(int ii = m-1; ii >= 0; --ii)
         {
-        int tMinusI = (currentIterationInMLoop - ii - 1 + m) % m;
+        int tMinusI = historySlot(ii);
         scalar beta =0;
         if(sy.data[ii] != 0)
             {
@@ -196,100 +205,245 @@ void energyMinimizerLoLBFGS::LoLBFGSStepGPU()
     forceMax=sqrt(fdotf)/Ndof;
     }
 
+/*!
+Host pointers to the current gradient (unscaledStep) and to the arrays of the history ring buffers, in the order of the
+basis {s_0,...,s_{m-1},y_0,...,y_{m-1},g}. The handles only make sure that the data is current on the host; the host
+data of a GPUArray does not move while it is not resized.
+*/
+void energyMinimizerLoLBFGS::getBasisPointers()
+    {
+    basisPointers.resize(2*m+1);
+    for (int jj = 0; jj < m; ++jj)
+        {
+        ArrayHandle<dVec> s(secantEquation[jj],access_location::host,access_mode::readwrite);
+        ArrayHandle<dVec> y(gradientDifference[jj],access_location::host,access_mode::readwrite);
+        basisPointers[jj] = s.data;
+        basisPointers[m+jj] = y.data;
+        }
+    ArrayHandle<dVec> g(unscaledStep,access_location::host,access_mode::readwrite);
+    basisPointers[2*m] = g.data;
+    };
+
+void energyMinimizerLoLBFGS::mergeExactDots(vector<reproducibleSum> &threadDots)
+    {
+    #pragma omp critical
+    for (unsigned int kk = 0; kk < threadDots.size(); ++kk)
+        exactDots[kk].add(threadDots[kk]);
+    };
+
+/*!
+One sweep over the lattice computes the dot product of every pair of basis vectors on this rank, and a single call to
+sumUpdaterData turns them into global dot products. With reproducible sums each thread accumulates exact partial sums,
+which do not depend on how the sites are split among threads and ranks.
+*/
+void energyMinimizerLoLBFGS::computeGramMatrix()
+    {
+    int nBasis = 2*m+1;
+    int nPairs = nBasis*(nBasis+1)/2;
+    getBasisPointers();
+    updaterData.assign(nPairs,0.0);
+    scalar *dots = updaterData.data();
+    dVec **b = basisPointers.data();
+    bool exact = sim->reproducibleSums;
+    if(exact)
+        exactDots.assign(nPairs,reproducibleSum());
+    #pragma omp parallel num_threads(nThreads)
+        {
+        vector<reproducibleSum> threadDots(exact ? nPairs : 0);
+        #pragma omp for reduction(+:dots[:nPairs])
+        for (int ii = 0; ii < Ndof; ++ii)
+            {
+            int pair = 0;
+            for (int j1 = 0; j1 < nBasis; ++j1)
+                for (int j2 = j1; j2 < nBasis; ++j2)
+                    {
+                    scalar d = dot(b[j1][ii],b[j2][ii]);
+                    if(exact)
+                        threadDots[pair].add(d);
+                    else
+                        dots[pair] += d;
+                    pair += 1;
+                    }
+            }
+        if(exact)
+            mergeExactDots(threadDots);
+        }
+    if(exact)
+        {
+        sim->sumUpdaterData(exactDots);
+        for (int pair = 0; pair < nPairs; ++pair)
+            updaterData[pair] = exactDots[pair].value();
+        }
+    else
+        sim->sumUpdaterData(updaterData);
+    gramMatrix.resize(nBasis*nBasis);
+    int pair = 0;
+    for (int j1 = 0; j1 < nBasis; ++j1)
+        for (int j2 = j1; j2 < nBasis; ++j2)
+            {
+            gramMatrix[j1*nBasis+j2] = updaterData[pair];
+            gramMatrix[j2*nBasis+j1] = updaterData[pair];
+            pair += 1;
+            }
+    };
+
+/*!
+The two-loop recursion only ever needs dot products between the current gradient g and the stored s and y vectors, and
+the step is a linear combination of those same vectors. So the recursion is carried out on the coefficients of the step
+in the basis {s_j, y_j, g}, using the (globally reduced) Gram matrix of the basis, and the lattice is swept only twice per
+iteration: once to form the step (and to stash the current forces), and, after the forces have been recomputed, once to
+form the new y and g while computing all of the dot products involving the new s, y, and g. The latter are reduced across
+ranks with a single sumUpdaterData call, so the minimizer is correct for any number of ranks. Its trajectory depends on
+the decomposition of the lattice (among ranks and threads) only through the rounding of those sums, unless the
+simulation asks for reproducible sums, in which case they are exact and the trajectory does not depend on it at all.
+*/
 void energyMinimizerLoLBFGS::LoLBFGSStepCPU()
     {
-    int lastM = (currentIterationInMLoop - 1+m) %m;
+    int nBasis = 2*m+1;
+    int gIndex = 2*m;
     //step 1
-    {
-    if(iterations == 0)
+    if(iterations == 0 || (int)gramMatrix.size() != nBasis*nBasis)
         {
-        sim->computeForces();
-        unscaledStep = model->returnForces();
+        if(iterations == 0)
+            {
+            sim->computeForces();
+            unscaledStep.copyFrom(model->returnForces(),Ndof);
+            }
+        computeGramMatrix();
         }
-    }
+    vector<scalar> &G = gramMatrix;
+    stepCoefficients.assign(nBasis,0.0);
+    stepCoefficients[gIndex] = 1.0;
+    //(basis vector b).(current step)
+    auto dotWithStep = [&](int b)
+        {
+        scalar ans = 0.0;
+        for (int kk = 0; kk < nBasis; ++kk)
+            ans += stepCoefficients[kk]*G[b*nBasis+kk];
+        return ans;
+        };
 
-    //step 2
+    //steps 2-4, on the coefficients
     {
-    ArrayHandle<dVec> p(unscaledStep);
     ArrayHandle<scalar> sy(sDotY);
     ArrayHandle<scalar> a(alpha);
     for(int ii = 0; ii < m; ++ii)
         {
-        int tMinusI = (currentIterationInMLoop - ii - 1 + m) % m;
-        ArrayHandle<dVec> s(secantEquation[tMinusI],access_location::host,access_mode::read);
-        ArrayHandle<dVec> y(gradientDifference[tMinusI],access_location::host,access_mode::read);
-        sy.data[ii]=host_dVec_dot_products(s.data,y.data,Ndof);
+        int tMinusI = historySlot(ii);
+        sy.data[ii] = G[tMinusI*nBasis+m+tMinusI];
         a.data[ii] = 0;
         if(sy.data[ii] != 0)
-            a.data[ii] = host_dVec_dot_products(s.data,p.data,Ndof)/sy.data[ii];
-        host_dVec_plusEqual_dVec(p.data,y.data,-a.data[ii],Ndof);
+            a.data[ii] = dotWithStep(tMinusI)/sy.data[ii];
+        stepCoefficients[m+tMinusI] -= a.data[ii];
         }
-    }
 
-    //step 3
-    {
-    ArrayHandle<scalar> sy(sDotY);
-    ArrayHandle<dVec> y(gradientDifference[lastM],access_location::host,access_mode::read);
+    int lastM = historySlot(0);
     scalar val1 = sy.data[0];
-    scalar val2 = host_dVec_dot_products(y.data,y.data,Ndof);
+    scalar val2 = G[(m+lastM)*nBasis+m+lastM];
     if(val2!=0)
-        {
-        ArrayHandle<dVec> p(unscaledStep);
-        host_dVec_plusEqual_dVec(p.data,y.data,val1/val2,Ndof);
-        };
-    }
+        stepCoefficients[m+lastM] += val1/val2;
 
-    //step 4
-    {
-    ArrayHandle<dVec> p(unscaledStep);
-    ArrayHandle<scalar> sy(sDotY);
-    ArrayHandle<scalar> a(alpha);
     for(int ii = m-1; ii >= 0; --ii)
         {
-        int tMinusI = (currentIterationInMLoop - ii - 1 + m) % m;
-        ArrayHandle<dVec> s(secantEquation[tMinusI],access_location::host,access_mode::read);
-        ArrayHandle<dVec> y(gradientDifference[tMinusI],access_location::host,access_mode::read);
-        scalar beta =0;
+        int tMinusI = historySlot(ii);
         if(sy.data[ii] != 0)
             {
-            beta = host_dVec_dot_products(y.data,p.data,Ndof)/sy.data[ii];
-            host_dVec_plusEqual_dVec(p.data,s.data,a.data[ii]-beta,Ndof);
+            scalar beta = dotWithStep(m+tMinusI)/sy.data[ii];
+            stepCoefficients[tMinusI] += a.data[ii]-beta;
             }
         }
     }
 
-    //update step
+    //update step: overwrite the oldest (s,y) pair with the scaled step and the current forces
+    int current = currentIterationInMLoop;
+    getBasisPointers();
     {
-    ArrayHandle<dVec> p(unscaledStep,access_location::host,access_mode::read);
-    ArrayHandle<dVec> s(secantEquation[currentIterationInMLoop],access_location::host,access_mode::readwrite);
-    host_dVec_times_scalar(p.data,eta,s.data,Ndof);
+    dVec **b = basisPointers.data();
+    scalar *coefficients = stepCoefficients.data();
+    #pragma omp parallel for num_threads(nThreads)
+    for (int ii = 0; ii < Ndof; ++ii)
+        {
+        dVec step = coefficients[gIndex]*b[gIndex][ii];
+        for (int jj = 0; jj < 2*m; ++jj)
+            if(coefficients[jj] != 0)
+                step += coefficients[jj]*b[jj][ii];
+        b[m+current][ii] = b[gIndex][ii];
+        b[current][ii] = eta*step;
+        }
     }
-    //temporarily store the old forces here in the gradient difference term
-    gradientDifference[currentIterationInMLoop] = model->returnForces();
 
-    sim->moveParticles(secantEquation[currentIterationInMLoop]);
-    //lineSearchCPU(secantEquation[currentIterationInMLoop]);
+    sim->moveParticles(secantEquation[current]);
+    //lineSearchCPU(secantEquation[current]);
     sim->computeForces();
 
-    unscaledStep = model->returnForces();
+    //y = old forces - new forces, g = new forces, and every dot product involving the new s, y, and g
+    int sRow = current;
+    int yRow = m+current;
+    getBasisPointers();
     {
-    ArrayHandle<dVec> y(gradientDifference[currentIterationInMLoop],access_location::host,access_mode::readwrite);
-    ArrayHandle<dVec> p(unscaledStep,access_location::host,access_mode::read);
-    host_dVec_plusEqual_dVec(y.data,p.data,-1.0,Ndof);
+    updaterData.assign(3*nBasis,0.0);
+    scalar *dots = updaterData.data();
+    dVec **b = basisPointers.data();
+    ArrayHandle<dVec> f(model->returnForces(),access_location::host,access_mode::read);
+    int nDots = 3*nBasis;
+    bool exact = sim->reproducibleSums;
+    if(exact)
+        exactDots.assign(nDots,reproducibleSum());
+    #pragma omp parallel num_threads(nThreads)
+        {
+        vector<reproducibleSum> threadDots(exact ? nDots : 0);
+        #pragma omp for reduction(+:dots[:nDots])
+        for (int ii = 0; ii < Ndof; ++ii)
+            {
+            b[yRow][ii] = b[yRow][ii] - f.data[ii];
+            b[gIndex][ii] = f.data[ii];
+            for (int jj = 0; jj < nBasis; ++jj)
+                {
+                scalar sDot = dot(b[sRow][ii],b[jj][ii]);
+                scalar yDot = dot(b[yRow][ii],b[jj][ii]);
+                scalar gDot = dot(b[gIndex][ii],b[jj][ii]);
+                if(exact)
+                    {
+                    threadDots[jj].add(sDot);
+                    threadDots[nBasis+jj].add(yDot);
+                    threadDots[2*nBasis+jj].add(gDot);
+                    }
+                else
+                    {
+                    dots[jj] += sDot;
+                    dots[nBasis+jj] += yDot;
+                    dots[2*nBasis+jj] += gDot;
+                    }
+                }
+            }
+        if(exact)
+            mergeExactDots(threadDots);
+        }
     }
+    if(sim->reproducibleSums)
+        {
+        sim->sumUpdaterData(exactDots);
+        for (int kk = 0; kk < 3*nBasis; ++kk)
+            updaterData[kk] = exactDots[kk].value();
+        }
+    else
+        sim->sumUpdaterData(updaterData);
+    int rows[3] = {sRow,yRow,gIndex};
+    for (int rr = 0; rr < 3; ++rr)
+        for (int jj = 0; jj < nBasis; ++jj)
+            {
+            G[rows[rr]*nBasis+jj] = updaterData[rr*nBasis+jj];
+            G[jj*nBasis+rows[rr]] = updaterData[rr*nBasis+jj];
+            }
 
     //get force norm
-    {
-    ArrayHandle<dVec> p(unscaledStep,access_location::host,access_mode::read);
-    forceMax=sqrt(host_dVec_dot_products(p.data,p.data,Ndof))/Ndof;
-    }
-
+    forceMax=sqrt(G[gIndex*nBasis+gIndex])/nTotal;
     };
 
 void energyMinimizerLoLBFGS::minimize()
     {
 
-    if (Ndof != model->getNumberOfParticles())
+    if (Ndof != model->getNumberOfDegreesOfFreedom())
         initializeFromModel();
 
     int curIterations = iterations;
@@ -9,6 +9,11 @@
 the "online" formalism of LBFGS ("A Stochastic Quasi-Newton Method for Online Convex Optimization",
 Nicol N. Schraudolph, Jin Yu, Simon Gunter, 2007) so that there is no line search, but without the "online"
 part related to stochastic gradient estimates
+
+On the CPU the two-loop recursion is carried out on the coefficients of the step in the basis of stored secant pairs
+and the current gradient, so that each iteration needs only two sweeps over the lattice and one global reduction
+(see LoLBFGSStepCPU), which also makes it correct in multi-rank simulations. With the reproducible sums of the simulation
+those dot products are exact, so that the trajectory is the same, bit for bit, for any number of ranks and threads
 */
 class energyMinimizerLoLBFGS : public equationOfMotion
     {
@@ -66,6 +71,13 @@ class energyMinimizerLoLBFGS : public equationOfMotion
         void LoLBFGSStepCPU();
         void LoLBFGSStepGPU();
 
+        //!compute all pairwise (global) dot products of the basis {s_j, y_j, g}
+        void computeGramMatrix();
+        //!sum the per-thread exact dot products of threadDots into exactDots
+        void mergeExactDots(vector<reproducibleSum> &threadDots);
+        //!point basisPointers at the host data of the basis vectors
+        void getBasisPointers();
+
         void lineSearchCPU(GPUArray<dVec> &descentDirection);
         void lineSearchGPU(GPUArray<dVec> &descentDirection);
 
@@ -91,16 +103,32 @@ class energyMinimizerLoLBFGS : public equationOfMotion
 
         //!the unscaled version of the step size
         GPUArray<dVec> unscaledStep;
-        //!vector of GPUArray of gradient differences
+        //!the slot of the history ring buffers holding the pair from lag+1 iterations ago
+        int historySlot(int lag){return (currentIterationInMLoop - lag - 1 + m) % m;};
+        //!ring buffer of GPUArray of gradient differences
+        /*!
+        The m most recent gradient differences and steps are kept in ring buffers of Ndof-sized arrays that are
+        allocated once (in initializeFromModel); every iteration overwrites the oldest slot in place, so that an
+        iteration does not allocate any memory
+        */
         vector<GPUArray<dVec> > gradientDifference;
-        //!vector of GPUArray of steps in trajectory space
+        //!ring buffer of GPUArray of steps in trajectory space
         vector<GPUArray<dVec> > secantEquation;
 
+        //!the Gram matrix of the basis {s_0..s_{m-1}, y_0..y_{m-1}, g}, row-major
+        vector<scalar> gramMatrix;
+        //!the coefficients of the step in that basis
+        vector<scalar> stepCoefficients;
+        //!host pointers to the basis vectors
+        vector<dVec *> basisPointers;
+
         //!Utility array for simple reductions
         GPUArray<scalar> sumReductionIntermediate;
         GPUArray<scalar> sumReductionIntermediate2;
         //!Utility array for simple (sum or dot product) reductions
         GPUArray<scalar> reductions;
+        //!exact partial sums of the dot products of the basis vectors, used when the simulation asks for reproducible sums
+        vector<reproducibleSum> exactDots;
 
         //!kernel tuner for performance
         shared_ptr<kernelTuner> dotProductTuner;
@@ -1,6 +1,7 @@
 #include"energyMinimizerNesterovAG.h"
 #include"energyMinimizerNesterovAG.cuh"
 #include "utilities.cuh"
+#include "qTensorFunctions.h"
 
 /*! \file energyMinimizerNesterovAG.cpp */
 
@@ -30,10 +31,21 @@ void energyMinimizerNesterovAG::initializeParameters()
 
 void energyMinimizerNesterovAG::initializeFromModel()
     {
-    Ndof = model->getNumberOfParticles();
+    Ndof = model->getNumberOfDegreesOfFreedom();
     sumReductionIntermediate.resize(Ndof);
     sumReductionIntermediate2.resize(Ndof);
     alternateSequence = model->returnPositions();
+    //keep the sequence per degree of freedom (particles are sorted, so this can be gathered in place)
+    if(Ndof != model->getNumberOfParticles())
+        {
+        {
+        ArrayHandle<dVec> altPos(alternateSequence);
+        ArrayHandle<int> particles(model->returnDegreeOfFreedomParticles(),access_location::host,access_mode::read);
+        for (int nn = 0; nn < Ndof; ++nn)
+            altPos.data[nn] = altPos.data[particles.data[nn]];
+        }
+        alternateSequence.resize(Ndof);
+        };
     };
 
 void energyMinimizerNesterovAG::nesterovStepGPU()
@@ -76,20 +88,26 @@ void energyMinimizerNesterovAG::nesterovStepCPU()
     ArrayHandle<dVec> negativeGrad(model->returnForces());
     ArrayHandle<dVec> positions(model->returnPositions());
     ArrayHandle<dVec> altPos(alternateSequence);
+    GPUArray<int> &dofParticles = model->returnDegreeOfFreedomParticles();
+    bool mapped = dofParticles.getNumElements() > 0;
+    ArrayHandle<int> particles(dofParticles,access_location::host,access_mode::read);
     dVec oldAltPos;
     for (int nn = 0; nn < Ndof;++nn)
         {
+        int particle = mapped ? particles.data[nn] : nn;
         forceNorm += dot(negativeGrad.data[nn],negativeGrad.data[nn]);
         oldAltPos = altPos.data[nn];
-        altPos.data[nn] = positions.data[nn] + deltaT*negativeGrad.data[nn];
-        positions.data[nn] = altPos.data[nn] +mu*(altPos.data[nn] - oldAltPos);
+        //the forces of a model in its orthonormal basis are mapped to changes of the positions
+        dVec step = model->orthonormalBasis ? orthonormalBasisTransform(negativeGrad.data[nn]) : negativeGrad.data[nn];
+        altPos.data[nn] = positions.data[particle] + deltaT*step;
+        positions.data[particle] = altPos.data[nn] +mu*(altPos.data[nn] - oldAltPos);
         }
     forceMax = sqrt(forceNorm)/Ndof;
     };
 
 void energyMinimizerNesterovAG::minimize()
     {
-    if (Ndof != model->getNumberOfParticles())
+    if (Ndof != model->getNumberOfDegreesOfFreedom())
         initializeFromModel();
     forceMax = 110.0;
     while( (iterations < maxIterations) && (forceMax > forceCutoff) )
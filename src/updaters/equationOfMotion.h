@@ -11,7 +11,7 @@ class equationOfMotion : public updater
 
         virtual void integrateEquationOfMotion()
             {
-            if (model->getNumberOfParticles() != Ndof)
+            if (model->getNumberOfDegreesOfFreedom() != Ndof)
                 initializeFromModel();
             if (useGPU)
                 integrateEOMGPU();
@@ -24,7 +24,7 @@ class equationOfMotion : public updater
 
         virtual void initializeFromModel()
             {
-            Ndof = model->getNumberOfParticles();
+            Ndof = model->getNumberOfDegreesOfFreedom();
             neverGPU = model->neverGPU;
             if(neverGPU)
                 displacement.noGPU = true;
@@ -0,0 +1,86 @@
+#include "relaxationalDynamics.h"
+#include "utilities.cuh"
+/*! \file relaxationalDynamics.cpp */
+
+relaxationalDynamics::relaxationalDynamics(shared_ptr<simpleModel> system, scalar _mobility)
+    {
+    mobility = _mobility;
+    setGPU(false);
+    setModel(system);
+    lattice = dynamic_pointer_cast<cubicLattice>(system);
+    iterations = 0;
+    };
+
+/*!
+\param noise the source whose counter seed keys the noise; it must be the same on every rank
+\param _temperature the temperature of the noise (in the energy units of the force computers)
+*/
+void relaxationalDynamics::setNoise(noiseSource &noise, scalar _temperature)
+    {
+    temperature = _temperature;
+    noiseSeed = noise.counterSeed;
+    };
+
+/*!
+For A a 3x3 matrix of independent unit normals, S = (A + A^T)/sqrt(2) has <S_ij S_kl> = delta_ik delta_jl + delta_il delta_jk,
+and removing its trace gives the projection onto symmetric, traceless tensors
+*/
+void relaxationalDynamics::thermalNoise(counterBasedRNG &rng, scalar amplitude, dVec &xi)
+    {
+    scalar sxx = sqrt2*rng.normal();
+    scalar syy = sqrt2*rng.normal();
+    scalar szz = sqrt2*rng.normal();
+    scalar trace = (sxx+syy+szz)/3.0;
+    xi[0] = amplitude*(sxx-trace);
+    xi[1] = amplitude*rng.normal();
+    xi[2] = amplitude*rng.normal();
+    xi[3] = amplitude*(syy-trace);
+    xi[4] = amplitude*rng.normal();
+    };
+
+void relaxationalDynamics::integrateEOMCPU()
+    {
+    sim->computeForces();
+    {//scope for array handles
+    ArrayHandle<dVec> h_f(model->returnForces(),access_location::host,access_mode::read);
+    ArrayHandle<int> h_t(model->returnTypes(),access_location::host,access_mode::read);
+    ArrayHandle<dVec> h_d(displacement,access_location::host,access_mode::overwrite);
+    //in sparse lattice storage, degree of freedom i is the site activeSites[i]
+    bool sparse = lattice && lattice->sparseStorage;
+    GPUArray<int> noSites;
+    ArrayHandle<int> h_sites(sparse ? lattice->activeSites : noSites,access_location::host,access_mode::read);
+    scalar forceFactor = mobility*deltaT;
+    scalar noiseAmplitude = (temperature > 0) ? sqrt(2.0*mobility*temperature*deltaT) : 0.0;
+    unsigned int step = iterations;
+    #pragma omp parallel for num_threads(nThreads)
+    for (int i = 0; i < Ndof; ++i)
+        {
+        h_d.data[i] = forceFactor*h_f.data[i];
+        int particle = sparse ? h_sites.data[i] : i;
+        if(noiseAmplitude > 0 && h_t.data[particle] <= 0)
+            {
+            uint64_t site = lattice ? counterRNGSiteKey(lattice->globalLatticePosition(particle)) : (uint64_t)particle;
+            counterBasedRNG rng(noiseSeed,site,step,relaxationalNoiseStream);
+            dVec xi;
+            thermalNoise(rng,noiseAmplitude,xi);
+            h_d.data[i] += xi;
+            }
+        };
+    };//handle scope
+    sim->moveParticles(displacement);
+    iterations += 1;
+    };
+
+void relaxationalDynamics::integrateEOMGPU()
+    {
+    if(temperature > 0)
+        UNWRITTENCODE("thermal noise in relaxational dynamics is currently only implemented on the CPU");
+    sim->computeForces();
+    {//scope for array handles
+    ArrayHandle<dVec> d_f(model->returnForces(),access_location::device,access_mode::read);
+    ArrayHandle<dVec> d_d(displacement,access_location::device,access_mode::overwrite);
+    gpu_dVec_times_scalar(d_f.data,mobility*deltaT,d_d.data,Ndof);
+    };
+    sim->moveParticles(displacement);
+    iterations += 1;
+    };
@@ -0,0 +1,45 @@
+#ifndef relaxationalDynamics_H
+#define relaxationalDynamics_H
+
+#include "equationOfMotion.h"
+#include "noiseSource.h"
+#include "cubicLattice.h"
+/*! \file relaxationalDynamics.h */
+
+//!Overdamped (model A / Beris-Edwards without flow) dynamics of the Q-tensor, with optional thermal noise
+/*!
+Each time step integrates dQ/dt = Gamma H + xi with a forward Euler(-Maruyama) step, where H = -dF/dQ is the force
+computed by the simulation's force computers and Gamma is a mobility. When the temperature T is positive, xi is a
+Gaussian, symmetric-traceless tensor noise with <xi_ij xi_kl> = 2 Gamma T (delta_ik delta_jl + delta_il delta_jk
+- 2/3 delta_ij delta_kl) / dt, independently at every site that is not part of an object.
+
+The noise at each site is drawn from a counter-based generator keyed by the global lattice position of the site and
+by the number of steps taken so far (iterations), so the noisy dynamics are identical for any number of threads and any
+rank decomposition; setCurrentIterations can be used to continue the same noise history after a restart.
+*/
+class relaxationalDynamics : public equationOfMotion
+    {
+    public:
+        //!The basic constructor, with the mobility Gamma
+        relaxationalDynamics(shared_ptr<simpleModel> system, scalar _mobility = 1.0);
+
+        //!Set up the thermal noise, keyed by the counter seed of the noiseSource. A temperature <= 0 turns the noise off
+        void setNoise(noiseSource &noise, scalar _temperature);
+
+        virtual void integrateEOMGPU();
+        virtual void integrateEOMCPU();
+
+        //!the mobility Gamma
+        scalar mobility;
+        //!the temperature of the thermal noise
+        scalar temperature = 0.0;
+
+    protected:
+        //!the model as a lattice (if it is one), to look up global site positions
+        shared_ptr<cubicLattice> lattice;
+        //!the key of the counter-based noise generators
+        unsigned int noiseSeed = 0;
+        //!generate a traceless symmetric Gaussian tensor of the given amplitude
+        void thermalNoise(counterBasedRNG &rng, scalar amplitude, dVec &xi);
+    };
+#endif
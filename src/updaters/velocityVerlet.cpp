@@ -3,14 +3,22 @@
 /*! \file velocityVerlet.cpp */
 
 
+/*!
+Forces may have been computed on some halo sites as well (see multirankSimulation::setCommunicationAvoidingUpdates),
+which are then advanced along with the degrees of freedom of the model
+*/
 void velocityVerlet::integrateEOMCPU()
     {
+    int nSites = model->getNumberOfForceSites();
+    if(displacement.getNumElements() < nSites)
+        displacement.resize(nSites);
     {//scope for array handles
     ArrayHandle<dVec> h_f(model->returnForces());
     ArrayHandle<dVec> h_v(model->returnVelocities());
     //ArrayHandle<scalar> h_m(model->returnMasses());
     ArrayHandle<dVec> h_d(displacement);
-    for (int i = 0; i < Ndof; ++i)
+    #pragma omp parallel for num_threads(nThreads)
+    for (int i = 0; i < nSites; ++i)
         {
         //update displacement
         h_d.data[i] = deltaT*h_v.data[i] + (0.5*deltaT*deltaT)*h_f.data[i];
@@ -28,7 +36,10 @@ void velocityVerlet::integrateEOMCPU()
     ArrayHandle<dVec> h_f(model->returnForces());
     ArrayHandle<dVec> h_v(model->returnVelocities());
     //ArrayHandle<scalar> h_m(model->returnMasses());
-    for (int i = 0; i < Ndof; ++i)
+    //the new forces may cover fewer halo sites
+    nSites = model->getNumberOfForceSites();
+    #pragma omp parallel for num_threads(nThreads)
+    for (int i = 0; i < nSites; ++i)
         {
         //h_v.data[i] += (0.5/h_m.data[i])*deltaT*h_f.data[i];
         h_v.data[i] += (0.5)*deltaT*h_f.data[i];
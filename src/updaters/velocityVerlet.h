@@ -7,6 +7,16 @@
 class velocityVerlet : public equationOfMotion
     {
     public:
+        //!velocity Verlet needs the velocities of the model
+        virtual void initializeFromModel()
+            {
+            if(!model->storeVelocities)
+                {
+                printf("velocity Verlet needs the velocities of the model, which have been freed (freeGPUArrays)\n");
+                throw std::exception();
+                };
+            equationOfMotion::initializeFromModel();
+            };
         virtual void integrateEOMGPU();
         virtual void integrateEOMCPU();
     };
@@ -0,0 +1,181 @@
+/*! \file cpuOnlyKernelStubs.cpp */
+/*!
+CPU-only builds do not compile the .cu files. So that the host code (whose GPU branches are never taken when there
+is no device) still links, this file gives every kernel caller declared in a .cuh file a definition that reports
+an error if it is ever called.
+*/
+#ifdef CPU_ONLY
+#include "baseLatticeForce.cuh"
+#include "landauDeGennesLC.cuh"
+#include "cubicLattice.cuh"
+#include "multirankQTensorLatticeModel.cuh"
+#include "qTensorLatticeModel.cuh"
+#include "simpleModel.cuh"
+#include "energyMinimizerAdam.cuh"
+#include "energyMinimizerFIRE.cuh"
+#include "energyMinimizerNesterovAG.cuh"
+#include "velocityVerlet.cuh"
+#include "hyperrectangularCellList.cuh"
+#include "neighborList.cuh"
+#include "noiseSource.cuh"
+#include "utilities.cuh"
+
+static bool gpuUnavailable(const char *kernelCaller)
+    {
+    printf("\nERROR: %s was called, but this is a CPU-only build\n",kernelCaller);
+    throw std::exception();
+    return false;
+    };
+
+bool gpu_lattice_spin_force_nn(dVec *d_force, dVec *d_spins, Index3D latticeIndex, scalar J, int N, bool zeroForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_lattice_spin_force_nn");};
+
+bool gpuCorrectForceFromMetric(dVec *d_force, int N, int maxBlockSize)
+    {return gpuUnavailable("gpuCorrectForceFromMetric");};
+
+bool gpu_qTensor_oneConstantForce(dVec *d_force, dVec *d_spins, int *d_types, int *d_latticeNeighbors, Index2D neighborIndex, scalar A,scalar B,scalar C,scalar L, int N, bool zeroForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_oneConstantForce");};
+
+bool gpu_qTensor_multiConstantForce(dVec *d_force, dVec *d_spins, int *d_types, cubicLatticeDerivativeVector *d_derivatives, int *d_latticeNeighbors, Index2D neighborIndex, scalar A,scalar B,scalar C, scalar L1,scalar L2,scalar L3, scalar L4,scalar L6, int N, bool zeroForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_multiConstantForce");};
+
+bool gpu_computeAllEnergyTerms(scalar *energyPerSite, dVec *Qtensors, int *latticeTypes, boundaryObject *bounds, int *d_latticeNeighbors, Index2D neighborIndex, scalar a, scalar b, scalar c, scalar L1, scalar L2, scalar L3, scalar L4, scalar L6, bool computeEfieldContribution, bool computeHfieldContribution, scalar epsilon, scalar epsilon0, scalar deltaEpsilon, scalar3 Efield, scalar Chi, scalar mu0, scalar deltaChi, scalar3 Hfield, int N)
+    {return gpuUnavailable("gpu_computeAllEnergyTerms");};
+
+bool gpu_qTensor_computeUniformFieldForcesGPU(dVec * d_force, int *d_types, int N, scalar3 field, scalar anisotropicSusceptibility, scalar vacuumPermeability, bool zeroOutForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_computeUniformFieldForcesGPU");};
+
+bool gpu_qTensor_computeSpatiallyVaryingFieldForcesGPU(dVec * d_force, int *d_types, int N, scalar3 *field, scalar anisotropicSusceptibility, scalar vacuumPermeability, bool zeroOutForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_computeSpatiallyVaryingFieldForcesGPU");};
+
+bool gpu_qTensor_firstDerivatives(cubicLatticeDerivativeVector *d_derivatives, dVec *d_spins, int *d_types, int *latticeNeighbors, Index2D neighborIndex, int N, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_firstDerivatives");};
+
+bool gpu_qTensor_computeBoundaryForcesGPU(dVec *d_force, dVec *d_spins, int *d_types, boundaryObject *d_bounds, Index3D latticeIndex, int N, bool zeroForce, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_computeBoundaryForcesGPU");};
+
+bool gpu_qTensor_computeObjectForceFromStresses(int *sites, int *latticeTypes, int *latticeNeighbors, Matrix3x3 *stress, scalar3 *objectForces, Index2D neighborIndex, int nSites, int maxBlockSize)
+    {return gpuUnavailable("gpu_qTensor_computeObjectForceFromStresses");};
+
+bool gpu_update_spins(dVec *d_disp, dVec *d_pos, scalar scale, int N, bool normalize)
+    {return gpuUnavailable("gpu_update_spins");};
+
+bool gpu_set_random_spins(dVec *d_pos, curandState *rngs, int blockSize, int nBlocks, int N)
+    {return gpuUnavailable("gpu_set_random_spins");};
+
+bool gpu_copy_boundary_object(dVec *pos, int *sites, int *neighbors, pair<int,dVec> *assistStructure, int *types, Index2D neighborIndex, int motionDirection, bool resetLattice, int Nsites)
+    {return gpuUnavailable("gpu_copy_boundary_object");};
+
+bool gpu_move_boundary_object(dVec *pos, int *sites, pair<int,dVec> *assistStructure, int *types, int newTypeValue, int Nsites)
+    {return gpuUnavailable("gpu_move_boundary_object");};
+
+bool gpu_copyReceivingBuffer(int *type, dVec *position, int *iBuf, scalar *dBuf, int N, int maxIndex, int blockSize)
+    {return gpuUnavailable("gpu_copyReceivingBuffer");};
+
+bool gpu_prepareSendingBuffer(int *type, dVec *position, int *iBuf, scalar *dBuf, int3 latticeSites, Index3D latticeIndex, int maxIndex, int blockSize)
+    {return gpuUnavailable("gpu_prepareSendingBuffer");};
+
+bool gpu_update_qTensor(dVec *d_disp, dVec *Q, int N, int blockSize)
+    {return gpuUnavailable("gpu_update_qTensor");};
+
+bool gpu_update_qTensor(dVec *d_disp, dVec *Q, scalar scale, int N, int blockSize)
+    {return gpuUnavailable("gpu_update_qTensor");};
+
+bool gpu_get_qtensor_DefectMeasures(dVec *Q, scalar *defects, int *t, int defectType, int N)
+    {return gpuUnavailable("gpu_get_qtensor_DefectMeasures");};
+
+bool gpu_set_random_nematic_qTensors(dVec *d_pos, int *d_types, curandState *rngs, scalar amplitude, int blockSize, int nBlocks, bool globallyAligned, scalar theta, scalar phi, int N)
+    {return gpuUnavailable("gpu_set_random_nematic_qTensors");};
+
+bool gpu_move_particles(dVec *d_pos, dVec *d_disp, periodicBoundaryConditions &Box, scalar scale, int N)
+    {return gpuUnavailable("gpu_move_particles");};
+
+bool gpu_adam_step(dVec *force, dVec *biasedMomentum, dVec *biasedMomentum2, dVec *correctedMomentum, dVec *correctedMomentum2, dVec *displacement, scalar deltaT, scalar beta1, scalar beta2, scalar beta1t, scalar beta2t, int N, int blockSize)
+    {return gpuUnavailable("gpu_adam_step");};
+
+bool gpu_update_velocity_FIRE(dVec *d_velocity, dVec *d_force, scalar alpha, scalar scaling, int N)
+    {return gpuUnavailable("gpu_update_velocity_FIRE");};
+
+bool gpu_nesterovAG_step(dVec *force, dVec *position, dVec *alternatePosition, scalar deltaT, scalar mu, int N, int blockSize)
+    {return gpuUnavailable("gpu_nesterovAG_step");};
+
+bool gpu_update_velocity(dVec *d_velocity, dVec *d_force, scalar deltaT, int N)
+    {return gpuUnavailable("gpu_update_velocity");};
+
+bool gpu_displacement_velocity_verlet(dVec *d_displacement, dVec *d_velocity, dVec *d_force, scalar deltaT, int N)
+    {return gpuUnavailable("gpu_displacement_velocity_verlet");};
+
+bool gpu_compute_cell_list(dVec *d_pt, unsigned int *d_cell_sizes, int *d_idx, dVec *d_cellParticlePos, int Np, int &Nmax, iVec gridCellsPerSide, dVec gridCellSizes, BoxPtr Box, IndexDD &ci, Index2D &cli, int *d_assist)
+    {return gpuUnavailable("gpu_compute_cell_list");};
+
+bool gpu_compute_neighbor_list(int *d_idx, unsigned int *d_npp, dVec *d_vec, unsigned int *particlesPerCell, int *indices, dVec *cellParticlePos, dVec *d_pt, int *d_assist, int *d_adj, periodicBoundaryConditions &Box, Index2D neighborIndexer, Index2D cellListIndexer, IndexDD cellIndexer, Index2D adjacentCellIndexer, int adjacentCellsPerCell, iVec gridCellsPerSide, dVec gridCellSizes, int cellListNmax, scalar maxRange, int nmax, int Np, int maxBlockSize, bool threadPerCell)
+    {return gpuUnavailable("gpu_compute_neighbor_list");};
+
+bool gpu_initialize_RNG_array(curandState *states, int N, int Timestep, int GlobalSeed)
+    {return gpuUnavailable("gpu_initialize_RNG_array");};
+
+template<typename T> bool gpu_set_array(T *arr, T value, int N, int maxBlockSize)
+    {return gpuUnavailable("gpu_set_array");};
+
+bool gpu_dot_dVec_vectors(dVec *d_vec1, dVec *d_vec2, scalar *d_ans, int N)
+    {return gpuUnavailable("gpu_dot_dVec_vectors");};
+
+bool gpu_dVec_times_scalar(dVec *d_vec1, scalar factor, int N)
+    {return gpuUnavailable("gpu_dVec_times_scalar");};
+
+bool gpu_dVec_times_scalar(dVec *d_vec1, scalar factor, dVec *d_ans, int N)
+    {return gpuUnavailable("gpu_dVec_times_scalar");};
+
+bool gpu_scalar_times_dVec_squared(dVec *d_vec1, scalar *d_scalars, scalar factor, scalar *d_answer, int N)
+    {return gpuUnavailable("gpu_scalar_times_dVec_squared");};
+
+bool gpu_dVec_plusEqual_dVec(dVec *d_vec1, dVec *d_vec2, scalar factor, int N, int maxBlockSize)
+    {return gpuUnavailable("gpu_dVec_plusEqual_dVec");};
+
+bool gpu_serial_reduction(scalar *array, scalar *output, int helperIdx, int N)
+    {return gpuUnavailable("gpu_serial_reduction");};
+
+bool gpu_parallel_reduction(scalar *input, scalar *intermediate, scalar *output, int helperIdx, int N, int block_size)
+    {return gpuUnavailable("gpu_parallel_reduction");};
+
+bool gpu_dVec_dot_products(dVec *input1, dVec *input2, scalar *output, int helperIdx, int N)
+    {return gpuUnavailable("gpu_dVec_dot_products");};
+
+bool gpu_dVec_dot_products(dVec *input1, dVec *input2, scalar *intermediate, scalar *intermediate2, scalar *output, int helperIdx, int N, int block_size)
+    {return gpuUnavailable("gpu_dVec_dot_products");};
+
+scalar gpu_gpuarray_QT_vector_dot_product(GPUArray<dVec> &input1, GPUArray<dVec> &input2, GPUArray<scalar> &intermediate, GPUArray<scalar> &intermediate2, int N, int block_size)
+    {gpuUnavailable("gpu_gpuarray_QT_vector_dot_product"); return 0;};
+
+scalar gpu_gpuarray_QT_vector_dot_product(GPUArray<dVec> &input1, GPUArray<scalar> &intermediate, GPUArray<scalar> &intermediate2, int N, int block_size)
+    {gpuUnavailable("gpu_gpuarray_QT_vector_dot_product"); return 0;};
+
+scalar gpu_gpuarray_QT_covector_dot_product(GPUArray<dVec> &input1, GPUArray<scalar> &intermediate, GPUArray<scalar> &intermediate2, int N, int block_size)
+    {gpuUnavailable("gpu_gpuarray_QT_covector_dot_product"); return 0;};
+
+scalar gpu_gpuarray_dVec_dot_products(GPUArray<dVec> &input1, GPUArray<dVec> &input2, GPUArray<scalar> &intermediate, GPUArray<scalar> &intermediate2, int N, int maxBlockSize)
+    {gpuUnavailable("gpu_gpuarray_dVec_dot_products"); return 0;};
+
+template <class T> void reduce(int size, int threads, int blocks, T *d_idata, T *d_odata)
+    {gpuUnavailable("reduce");};
+
+template <class T> T gpuReduction(int n, int numThreads, int numBlocks, int maxThreads, int maxBlocks, T *d_idata, T *d_odata)
+    {gpuUnavailable("gpuReduction"); return 0;};
+
+template<typename T> bool gpu_copy_gpuarray(GPUArray<T> &copyInto,GPUArray<T> &copyFrom,int block_size)
+    {return gpuUnavailable("gpu_copy_gpuarray");};
+
+template bool gpu_set_array<int>(int *,int, int, int);
+template bool gpu_set_array<unsigned int>(unsigned int *,unsigned int, int, int);
+template bool gpu_set_array<int2>(int2 *,int2, int, int);
+template bool gpu_set_array<scalar>(scalar *,scalar, int, int);
+template bool gpu_set_array<dVec>(dVec *,dVec, int, int);
+template bool gpu_set_array<cubicLatticeDerivativeVector>(cubicLatticeDerivativeVector *,cubicLatticeDerivativeVector, int, int);
+template bool gpu_copy_gpuarray<dVec>(GPUArray<dVec> &copyInto,GPUArray<dVec> &copyFrom,int maxBlockSize);
+template bool gpu_copy_gpuarray<scalar>(GPUArray<scalar> &copyInto,GPUArray<scalar> &copyFrom,int maxBlockSize);
+template scalar gpuReduction<scalar>(int n,int numThreads,int numBlocks,int maxThreads,int maxBlocks,scalar *d_idata,scalar *d_odata);
+template int gpuReduction<int>(int n,int numThreads,int numBlocks,int maxThreads,int maxBlocks,int *d_idata,int *d_odata);
+template void reduce<int>(int size, int threads, int blocks, int *d_idata, int *d_odata);
+template void reduce<scalar>(int size, int threads, int blocks, scalar *d_idata, scalar *d_odata);
+
+#endif
@@ -1,18 +1,97 @@
 #include "kernelTuner.h"
+#include <cstdio>
 /*!\file kernelTuner.cpp */
 
+tuningCacheFile tuningCache;
+
+tuningCacheFile::tuningCacheFile()
+    {
+    char name[256];
+    if(gethostname(name,sizeof(name)) != 0)
+        name[0] = 0;
+    name[sizeof(name)-1] = 0;
+    hostName = name;
+    const char *environmentSetting = getenv("OPENQMIN_TUNING_CACHE");
+    if(environmentSetting != NULL)
+        open(environmentSetting);
+    };
+
+void tuningCacheFile::open(string _fileName)
+    {
+    fileName = _fileName;
+    entries.clear();
+    if(fileName.empty())
+        return;
+    ifstream in(fileName.c_str());
+    string line;
+    while(getline(in,line))
+        {
+        size_t firstTab = line.find('\t');
+        size_t lastTab = line.rfind('\t');
+        if(firstTab == string::npos || lastTab == firstTab)
+            continue;
+        entries[line.substr(0,lastTab)] = atoi(line.substr(lastTab+1).c_str());
+        };
+    };
+
+bool tuningCacheFile::lookup(const string &key, int &value)
+    {
+    std::map<string,int>::iterator entry = entries.find(hostName+"\t"+key);
+    if(entry == entries.end())
+        return false;
+    value = entry->second;
+    return true;
+    };
+
+void tuningCacheFile::record(const string &key, int value)
+    {
+    if(fileName.empty())
+        return;
+    //pick up what other processes have recorded since the file was read
+    string name = fileName;
+    std::map<string,int> ours = entries;
+    open(name);
+    for (std::map<string,int>::iterator entry = ours.begin(); entry != ours.end(); ++entry)
+        if(entries.find(entry->first) == entries.end())
+            entries[entry->first] = entry->second;
+    entries[hostName+"\t"+key] = value;
+
+    stringstream temporaryName;
+    temporaryName << fileName << ".tmp" << getpid();
+    ofstream out(temporaryName.str().c_str());
+    for (std::map<string,int>::iterator entry = entries.begin(); entry != entries.end(); ++entry)
+        out << entry->first << "\t" << entry->second << "\n";
+    out.close();
+    if(!out || rename(temporaryName.str().c_str(),fileName.c_str()) != 0)
+        {
+        printf("could not write the tuning cache %s\n",fileName.c_str());
+        remove(temporaryName.str().c_str());
+        };
+    };
+
 kernelTuner::kernelTuner(int start, int end, int step, int nSamples, int _period)
+    {
+    parameterValue = start;
+    //set vector of possible parameters
+    for(int ii = start; ii <=end; ii +=step)
+        possibleParameters.push_back(ii);
+    initialize(nSamples,_period);
+    };
+
+kernelTuner::kernelTuner(vector<int> values, int nSamples, int _period)
+    {
+    possibleParameters = values;
+    parameterValue = possibleParameters[0];
+    initialize(nSamples,_period);
+    };
+
+void kernelTuner::initialize(int nSamples, int _period)
     {
     internalState=STARTUP;
     currentSample = 0;
     currentParameterIndex = 0;
     callsSinceLastSample = 0;
     period = _period;
-
-    parameterValue = start;
-    //set vector of possible parameters
-    for(int ii = start; ii <=end; ii +=step)
-        possibleParameters.push_back(ii);
     //force samplesPerValue to be odd
     samplesPerValue=nSamples;
     if(samplesPerValue%2==1)
@@ -26,6 +105,27 @@ kernelTuner::kernelTuner(int start, int end, int step, int nSamples, int _period
 
     };
 
+/*!
+A tuner that finds its key in the cache starts idle at the stored value and never samples again (the stored value
+was chosen from a complete set of samples, which the periodic rescans of a running tuner only refresh one at a time).
+Otherwise the value chosen at the end of the initial sampling is recorded under the key.
+*/
+void kernelTuner::setCacheKey(string key)
+    {
+    cacheKey = key;
+    int value;
+    if(internalState != STARTUP || !tuningCache.lookup(cacheKey,value))
+        return;
+    for (int ii = 0; ii < possibleParameters.size(); ++ii)
+        if(possibleParameters[ii] == value)
+            {
+            parameterValue = value;
+            currentParameterIndex = ii;
+            internalState = IDLE;
+            period = -1;
+            };
+    };
+
 kernelTuner::~kernelTuner()
     {
     //cudaEventDestroy(startEvent);
@@ -66,6 +166,8 @@ void kernelTuner::end()
                 currentParameterIndex = 0;
                 internalState = IDLE;
                 parameterValue = computeOptimalParameter();
+                if(!cacheKey.empty())
+                    tuningCache.record(cacheKey,parameterValue);
                 }
             else
                 {
@@ -92,8 +194,8 @@ void kernelTuner::end()
     else if (internalState == IDLE)
         {
         callsSinceLastSample += 1;
-        //if it's been longer than (period), transition back to scanning state
-        if(callsSinceLastSample > period)
+        //if it's been longer than (period), transition back to scanning state (never, for a negative period)
+        if(period >= 0 && callsSinceLastSample > period)
             {
             callsSinceLastSample = 0;
             parameterValue = possibleParameters[currentParameterIndex];
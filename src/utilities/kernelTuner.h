@@ -3,14 +3,48 @@
 
 #include "std_include.h"
 #include <chrono>
+#include <map>
 /*!\file kernelTuner.h */
 
+//!The best parameters found by kernelTuners, kept in a file between runs
+/*!
+Each entry is keyed by the host name and a description of the kernel and problem (see kernelTuner::setCacheKey), so
+one file can serve several machines and lattice sizes. The file is plain text, one "host<TAB>key<TAB>value" line per
+entry. Setting the environment variable OPENQMIN_TUNING_CACHE to a file name opens it at start-up. Several
+processes may record into the same file: each rewrites it to a temporary file that is renamed over the old one, so
+the file always holds a complete set of entries, though an entry recorded at the same moment by another process may
+be lost.
+*/
+class tuningCacheFile
+    {
+    public:
+        tuningCacheFile();
+        //!read the entries of the named file (which need not exist yet); an empty name turns the cache off
+        void open(string fileName);
+        //!is there a cache file?
+        bool isOpen(){return !fileName.empty();};
+        //!the cached value of the key on this host, if there is one
+        bool lookup(const string &key, int &value);
+        //!set the value of the key on this host and rewrite the file
+        void record(const string &key, int value);
+
+    protected:
+        string fileName;
+        string hostName;
+        //!entries by host and key
+        std::map<string,int> entries;
+    };
+//!the tuning cache of this process
+extern tuningCacheFile tuningCache;
+
 //!A class that tries to dynamically optimize a kernel parameter
 class kernelTuner
     {
     public:
         //!Base constructor takes (start,end,step) values to scan, sample number, and period
         kernelTuner(int start, int end, int step, int nSamples, int _period);
+        //!scan an explicit list of values (e.g. indices into a list of configurations of a CPU kernel)
+        kernelTuner(vector<int> values, int nSamples, int _period);
         //!destroy the cuda events
         ~kernelTuner();
 
@@ -38,7 +72,14 @@ class kernelTuner
             return (internalState != STARTUP);
             };
 
+        //!store the result of the initial sampling in the tuning cache under this key, or start from a stored result
+        void setCacheKey(string key);
+
     protected:
+        //!set up the sample storage for the possible parameters
+        void initialize(int nSamples, int _period);
+        //!the key of this tuner in the tuning cache (empty if it is not cached)
+        string cacheKey;
 
         int computeOptimalParameter();
         //!names for the internal state
@@ -62,6 +62,7 @@ void noiseSource::initializeGPURNGs(int globalSeed,int tempSeed)
 void noiseSource::setReproducibleSeed(int _seed)
     {
     RNGSeed = _seed;
+    counterSeed = _seed;
     mt19937 Gener(RNGSeed);
     gen = Gener;
 #ifdef DEBUGFLAGUP
@@ -5,6 +5,7 @@
 #include "curand_kernel.h"
 #include "std_include.h"
 #include "gpuarray.h"
+#include "counterBasedRNG.h"
 #include "noiseSource.cuh"
 
 /*! \file noiseSource.h */
@@ -13,6 +14,8 @@
 Provides features to some psuedo-rng functions. On the CPU side, one can call for a random integer
 (in a specified range), a random real with a uniform distribution, or a random real from a normal
 distribution. On the GPU side, provides access to a GPUArray of curandState objects, and functionality to initialize them.
+Finally, counterRNG hands out counter-based generators keyed by a (global) lattice site and a time step, for random
+fields that must not depend on the order in which sites are visited (threads, ranks, CPU vs GPU).
 */
 class noiseSource
     {
@@ -29,6 +32,11 @@ class noiseSource
         #endif
             gen = Gener;
             genrd=GenerRd;
+        #ifndef DEBUGFLAGUP
+            counterSeed = Reproducible ? 13377 : rd();
+        #else
+            counterSeed = 13377;
+        #endif
             }
 
         //!Get a reproducible integer
@@ -48,12 +56,21 @@ class noiseSource
         void setReproducible(bool _rep){Reproducible = _rep;};
         //!set the seed on a reproducible RNG run
         void setReproducibleSeed(int _seed);
+        //!set the key of the counter-based generators; for rank-independent fields this must be the same on every rank
+        void setCounterSeed(unsigned int _seed){counterSeed = _seed;};
+        //!a counter-based generator for the given site key, time step, and stream
+        counterBasedRNG counterRNG(uint64_t site, unsigned int step = 0, unsigned int stream = directorStream)
+            {
+            return counterBasedRNG(counterSeed,site,step,stream);
+            };
         //!should the dynamics be reproducible?
         bool Reproducible;
         //!number of entries for the cuda RNG
         int N;
         //!The seed used by the random number generator, when non-reproducible dynamics have been set
         int RNGSeed;
+        //!The key shared by all counter-based generators
+        unsigned int counterSeed;
         //!an initializer for non-reproducible random number generation on the cpu
         random_device rd;
         //!A reproducible Mersenne Twister
@@ -0,0 +1,358 @@
+#include "regionTimers.h"
+#include <mpi.h>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+/*! \file regionTimers.cpp */
+
+regionTimerRegistry regionTimers;
+
+regionTimerRegistry::regionTimerRegistry()
+    {
+    reset();
+    const char *environmentSetting = getenv("OPENQMIN_TIMERS");
+    if(environmentSetting != NULL && strcmp(environmentSetting,"0") != 0)
+        enable(strcmp(environmentSetting,"counters") == 0);
+    };
+
+regionTimerRegistry::~regionTimerRegistry()
+    {
+    if(!reported && nodes.size() > 1)
+        reportLocal();
+    closeCounters();
+    };
+
+void regionTimerRegistry::reset()
+    {
+    nodes.clear();
+    regionNode root;
+    root.name = "total";
+    root.parent = -1;
+    nodes.push_back(root);
+    openRegions.clear();
+    openRegions.push_back(0);
+    trace.clear();
+    reported = false;
+    };
+
+void regionTimerRegistry::enable(bool hardwareCounters, string traceFile)
+    {
+    if(hardwareCounters && !useCounters)
+        {
+        useCounters = openCounters();
+        if(!useCounters)
+            printf("hardware counters are not available (perf_event_open failed); timing regions without them\n");
+        };
+    keepTrace = (traceFile != "");
+    traceFileName = traceFile;
+    traceOrigin = chrono::steady_clock::now();
+    enabled = true;
+    };
+
+bool regionTimerRegistry::openCounters()
+    {
+#ifdef __linux__
+    const unsigned long long configs[nCounters] = {PERF_COUNT_HW_CPU_CYCLES,PERF_COUNT_HW_INSTRUCTIONS,PERF_COUNT_HW_CACHE_MISSES};
+    for (int cc = 0; cc < nCounters; ++cc)
+        {
+        struct perf_event_attr attributes;
+        memset(&attributes,0,sizeof(attributes));
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.size = sizeof(attributes);
+        attributes.config = configs[cc];
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        //count the threads spawned later (e.g. the OpenMP pool) as well
+        attributes.inherit = 1;
+        counterFiles[cc] = syscall(__NR_perf_event_open,&attributes,0,-1,-1,0);
+        if(counterFiles[cc] < 0)
+            {
+            closeCounters();
+            return false;
+            };
+        };
+    return true;
+#else
+    return false;
+#endif
+    };
+
+void regionTimerRegistry::closeCounters()
+    {
+#ifdef __linux__
+    for (int cc = 0; cc < nCounters; ++cc)
+        {
+        if(counterFiles[cc] >= 0)
+            close(counterFiles[cc]);
+        counterFiles[cc] = -1;
+        };
+#endif
+    useCounters = false;
+    };
+
+void regionTimerRegistry::readCounters(long long *values)
+    {
+    for (int cc = 0; cc < nCounters; ++cc)
+        {
+        values[cc] = 0;
+#ifdef __linux__
+        if(useCounters && read(counterFiles[cc],&values[cc],sizeof(long long)) != sizeof(long long))
+            values[cc] = 0;
+#endif
+        };
+    };
+
+void regionTimerRegistry::begin(const char *name)
+    {
+    int parent = openRegions.back();
+    int node = -1;
+    vector<int> &siblings = nodes[parent].children;
+    for (unsigned int ii = 0; ii < siblings.size(); ++ii)
+        {
+        const char *siblingName = nodes[siblings[ii]].name;
+        if(siblingName == name || strcmp(siblingName,name) == 0)
+            {
+            node = siblings[ii];
+            break;
+            };
+        };
+    if(node < 0)
+        {
+        regionNode newNode;
+        newNode.name = name;
+        newNode.parent = parent;
+        node = nodes.size();
+        nodes.push_back(newNode);
+        nodes[parent].children.push_back(node);
+        };
+    openRegions.push_back(node);
+    readCounters(nodes[node].startCounters);
+    nodes[node].startTime = chrono::steady_clock::now();
+    };
+
+void regionTimerRegistry::end()
+    {
+    chrono::time_point<chrono::steady_clock> endTime = chrono::steady_clock::now();
+    if(openRegions.size() < 2)
+        {
+        printf("a timing region was closed without being opened\n");
+        throw std::exception();
+        };
+    int node = openRegions.back();
+    openRegions.pop_back();
+    regionNode &region = nodes[node];
+    long long endCounters[nCounters];
+    readCounters(endCounters);
+    chrono::duration<double> elapsed = endTime - region.startTime;
+    region.seconds += elapsed.count();
+    region.calls += 1;
+    for (int cc = 0; cc < nCounters; ++cc)
+        region.counters[cc] += endCounters[cc] - region.startCounters[cc];
+    if(keepTrace && trace.size() < maxTraceEvents)
+        {
+        chrono::duration<double> start = region.startTime - traceOrigin;
+        traceEvent event;
+        event.node = node;
+        event.start = start.count();
+        event.duration = elapsed.count();
+        trace.push_back(event);
+        };
+    };
+
+string regionTimerRegistry::path(int node)
+    {
+    string ans = nodes[node].name;
+    for (int parent = nodes[node].parent; parent > 0; parent = nodes[parent].parent)
+        ans = string(nodes[parent].name) + "/" + ans;
+    return ans;
+    };
+
+string regionTimerRegistry::serialize()
+    {
+    //depth-first, so that every region is listed after its parent
+    stringstream ss;
+    ss.precision(17);
+    vector<int> stack(1,0);
+    while(stack.size() > 0)
+        {
+        int node = stack.back();
+        stack.pop_back();
+        for (int ii = nodes[node].children.size()-1; ii >= 0; --ii)
+            stack.push_back(nodes[node].children[ii]);
+        if(node == 0)
+            continue;
+        ss << path(node) << "\t" << nodes[node].calls << "\t" << nodes[node].seconds;
+        for (int cc = 0; cc < nCounters; ++cc)
+            ss << "\t" << nodes[node].counters[cc];
+        ss << "\n";
+        };
+    return ss.str();
+    };
+
+//!the statistics of one region over ranks
+struct regionSummary
+    {
+    int ranks = 0;
+    long long calls = 0;
+    double minimum = 0.0;
+    double maximum = 0.0;
+    double sum = 0.0;
+    long long counters[regionTimerRegistry::nCounters] = {0,0,0};
+    };
+
+//!print one line per region, indented by depth
+static void printSummary(FILE *out, vector<string> &order, map<string,regionSummary> &summaries, int nRanks, bool counters)
+    {
+    fprintf(out,"%-48s %10s %12s %12s %12s %9s","region (seconds per rank)","calls/rank","min","mean","max","max/mean");
+    if(counters)
+        fprintf(out," %8s %14s","IPC","LLC misses/call");
+    fprintf(out,"\n");
+    for (unsigned int ii = 0; ii < order.size(); ++ii)
+        {
+        regionSummary &s = summaries[order[ii]];
+        int depth = count(order[ii].begin(),order[ii].end(),'/');
+        string name = order[ii].substr(order[ii].find_last_of('/')+1);
+        string label = string(2*depth,' ') + name;
+        //ranks that never entered the region count as zero time
+        double minimum = s.ranks < nRanks ? 0.0 : s.minimum;
+        double mean = s.sum/nRanks;
+        fprintf(out,"%-48s %10.4g %12.6g %12.6g %12.6g %9.3f",label.c_str(),(double)s.calls/nRanks,minimum,mean,s.maximum,mean > 0 ? s.maximum/mean : 1.0);
+        if(counters)
+            {
+            double ipc = s.counters[0] > 0 ? (double)s.counters[1]/s.counters[0] : 0.0;
+            fprintf(out," %8.3f %14.4g",ipc,s.calls > 0 ? (double)s.counters[2]/s.calls : 0.0);
+            };
+        fprintf(out,"\n");
+        };
+    };
+
+//!parse serialized regions, adding them to the summaries
+static void addSerializedRegions(const string &text, vector<string> &order, map<string,regionSummary> &summaries)
+    {
+    stringstream lines(text);
+    string line;
+    while(getline(lines,line))
+        {
+        stringstream fields(line);
+        string path;
+        getline(fields,path,'\t');
+        long long calls;
+        double seconds;
+        fields >> calls >> seconds;
+        if(summaries.find(path) == summaries.end())
+            order.push_back(path);
+        regionSummary &s = summaries[path];
+        s.minimum = s.ranks == 0 ? seconds : min(s.minimum,seconds);
+        s.maximum = s.ranks == 0 ? seconds : max(s.maximum,seconds);
+        s.sum += seconds;
+        s.calls += calls;
+        s.ranks += 1;
+        for (int cc = 0; cc < regionTimerRegistry::nCounters; ++cc)
+            {
+            long long value;
+            fields >> value;
+            s.counters[cc] += value;
+            };
+        };
+    };
+
+void regionTimerRegistry::report(string fname)
+    {
+    int initialized = 0, finalized = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if(!initialized || finalized)
+        {
+        reportLocal();
+        return;
+        };
+    int myRank, nRanks;
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    MPI_Comm_size(MPI_COMM_WORLD,&nRanks);
+
+    string local = serialize();
+    int localLength = local.size();
+    vector<int> lengths(nRanks);
+    MPI_Gather(&localLength,1,MPI_INT,lengths.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+    vector<int> offsets(nRanks,0);
+    int totalLength = 0;
+    for (int rr = 0; rr < nRanks; ++rr)
+        {
+        offsets[rr] = totalLength;
+        totalLength += lengths[rr];
+        };
+    vector<char> all(max(totalLength,1));
+    MPI_Gatherv(&local[0],localLength,MPI_CHAR,all.data(),lengths.data(),offsets.data(),MPI_CHAR,0,MPI_COMM_WORLD);
+    writeTrace();
+    reported = true;
+    if(myRank != 0)
+        return;
+
+    vector<string> order;
+    map<string,regionSummary> summaries;
+    for (int rr = 0; rr < nRanks; ++rr)
+        addSerializedRegions(string(all.data()+offsets[rr],lengths[rr]),order,summaries);
+    FILE *out = stdout;
+    if(fname != "")
+        {
+        out = fopen(fname.c_str(),"w");
+        if(out == NULL)
+            {
+            printf("could not open %s for the timing summary\n",fname.c_str());
+            throw std::exception();
+            };
+        };
+    printSummary(out,order,summaries,nRanks,useCounters);
+    if(out != stdout)
+        fclose(out);
+    else
+        fflush(stdout);
+    };
+
+void regionTimerRegistry::reportLocal()
+    {
+    vector<string> order;
+    map<string,regionSummary> summaries;
+    addSerializedRegions(serialize(),order,summaries);
+    int myRank = 0;
+    int initialized = 0, finalized = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if(initialized && !finalized)
+        MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    printf("timing regions of rank %i\n",myRank);
+    printSummary(stdout,order,summaries,1,useCounters);
+    writeTrace();
+    reported = true;
+    };
+
+void regionTimerRegistry::writeTrace()
+    {
+    if(!keepTrace)
+        return;
+    int myRank = 0;
+    int initialized = 0, finalized = 0;
+    MPI_Initialized(&initialized);
+    MPI_Finalized(&finalized);
+    if(initialized && !finalized)
+        MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    char fn[512];
+    sprintf(fn,"%s_rank%i.json",traceFileName.c_str(),myRank);
+    ofstream out(fn);
+    out << "{\"traceEvents\":[\n";
+    for (unsigned int ii = 0; ii < trace.size(); ++ii)
+        {
+        out << "{\"name\":\"" << nodes[trace[ii].node].name << "\",\"ph\":\"X\",\"pid\":" << myRank << ",\"tid\":0,"
+            << "\"ts\":" << 1e6*trace[ii].start << ",\"dur\":" << 1e6*trace[ii].duration << "}";
+        out << (ii+1 < trace.size() ? ",\n" : "\n");
+        };
+    out << "]}\n";
+    if(trace.size() == maxTraceEvents)
+        printf("the trace of rank %i was truncated after %i region calls\n",myRank,maxTraceEvents);
+    };
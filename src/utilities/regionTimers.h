@@ -0,0 +1,133 @@
+#ifndef regionTimers_H
+#define regionTimers_H
+
+#include "std_include.h"
+#include <chrono>
+
+/*! \file regionTimers.h */
+
+//!A registry of named, nested timing regions, aggregated over ranks
+/*!
+Code marks a region by putting a scopedRegionTimer on the stack, e.g.
+    scopedRegionTimer timer("halo exchange");
+Regions opened while another region is open become its children, so the same name can appear in several places of
+the tree (e.g. "halo wait" below both "forces" and "move"). Region names must be string literals (or otherwise outlive
+the registry). When the registry is disabled (the default) a scopedRegionTimer costs a single test of a bool.
+
+Once enabled, every region accumulates its number of calls and its wall-clock time, and, if hardware counters were
+requested and perf_event is available, the cycles, instructions, and last-level cache misses of the process (counted
+in every thread created after enable()). A trace of individual region calls, in the chrome://tracing JSON format, can
+also be kept (up to maxTraceEvents calls per rank).
+
+report() is collective: the region trees of all ranks are gathered on rank 0, which prints the minimum, mean, and
+maximum time of each region over the ranks (a large max/mean exposes load imbalance). Call it before MPI_Finalize;
+otherwise, if the registry is enabled, every rank prints its own summary when the program exits. Setting the
+environment variable OPENQMIN_TIMERS (to "counters" to also read hardware counters) enables the registry at start-up,
+so that any driver can be profiled without recompiling.
+
+Regions should only be opened by the thread that calls the simulation, never inside an OpenMP parallel region.
+*/
+class regionTimerRegistry
+    {
+    public:
+        regionTimerRegistry();
+        ~regionTimerRegistry();
+
+        //!start timing; optionally read hardware counters, and keep a trace written to traceFile_rank<r>.json
+        void enable(bool hardwareCounters = false, string traceFile = "");
+        //!stop timing (accumulated times are kept)
+        void disable(){enabled = false;};
+        //!forget all regions
+        void reset();
+
+        //!open a region nested in the currently open one
+        void begin(const char *name);
+        //!close the most recently opened region
+        void end();
+
+        //!gather every rank's regions and print a summary on rank 0 (to the named file, if given); writes the traces
+        void report(string fname = "");
+
+        //!is timing on? checked by every scopedRegionTimer
+        bool enabled = false;
+        //!were the hardware counters opened (by enable(true), where perf_event is permitted)?
+        bool countingHardware(){return useCounters;};
+        //!the current cycle, instruction, and cache-miss counts of this process (zeros without hardware counters)
+        void currentCounters(long long *values){readCounters(values);};
+
+        static const int nCounters = 3;
+        static const int maxTraceEvents = 1 << 20;
+
+    protected:
+        //!a region, identified by its name and its parent
+        struct regionNode
+            {
+            const char *name;
+            int parent;
+            vector<int> children;
+            int calls = 0;
+            double seconds = 0.0;
+            long long counters[nCounters] = {0,0,0};
+            //!values at the most recent begin()
+            chrono::time_point<chrono::steady_clock> startTime;
+            long long startCounters[nCounters] = {0,0,0};
+            };
+        //!a single call of a region, for the trace
+        struct traceEvent
+            {
+            int node;
+            double start;
+            double duration;
+            };
+
+        //!read the hardware counters (zeros if they are not in use)
+        void readCounters(long long *values);
+        //!open the perf_event counters; returns false if they are not available
+        bool openCounters();
+        void closeCounters();
+        //!"parent/child/..." name of a node
+        string path(int node);
+        //!one line per region: path, calls, seconds, counters
+        string serialize();
+        //!print the regions of this rank only (used at exit, when MPI can no longer be used)
+        void reportLocal();
+        void writeTrace();
+
+        //!node 0 is the root, which is never timed
+        vector<regionNode> nodes;
+        //!the currently open regions, innermost last
+        vector<int> openRegions;
+
+        bool useCounters = false;
+        int counterFiles[nCounters] = {-1,-1,-1};
+
+        bool keepTrace = false;
+        string traceFileName;
+        vector<traceEvent> trace;
+        chrono::time_point<chrono::steady_clock> traceOrigin;
+
+        bool reported = false;
+    };
+
+//!the registry used by all scopedRegionTimers
+extern regionTimerRegistry regionTimers;
+
+//!Times the enclosing scope as a region of the global registry
+class scopedRegionTimer
+    {
+    public:
+        scopedRegionTimer(const char *name)
+            {
+            active = regionTimers.enabled;
+            if(active)
+                regionTimers.begin(name);
+            };
+        ~scopedRegionTimer()
+            {
+            if(active)
+                regionTimers.end();
+            };
+    protected:
+        bool active;
+    };
+#endif
@@ -0,0 +1,455 @@
+#include "snapshotCompression.h"
+
+/*! \file snapshotCompression.cpp */
+
+//the block coder works with 4-byte minimum matches found via a hash table, and 16-bit match offsets
+static const int lzHashLog = 16;
+static const size_t lzMinMatch = 4;
+static const size_t lzMaxOffset = 65535;
+//the last bytes of every block are always stored as literals, which keeps the decoder simple
+static const size_t lzLastLiterals = 5;
+static const size_t lzMinBlockForMatch = 12;
+
+static const char snapshotMagic[8] = {'O','Q','M','S','N','A','P','\0'};
+static const int32_t snapshotVersion = 1;
+
+static inline uint32_t read32(const uint8_t *p)
+    {
+    uint32_t v;
+    memcpy(&v,p,sizeof(uint32_t));
+    return v;
+    };
+
+static inline uint32_t lzHash(uint32_t v)
+    {
+    return (v*2654435761u) >> (32-lzHashLog);
+    };
+
+//!lengths >= 15 spill into a sequence of extra bytes, each of which is 255 except the last
+static inline void lzWriteLength(vector<uint8_t> &dst, size_t length)
+    {
+    while(length >= 255)
+        {
+        dst.push_back(255);
+        length -= 255;
+        };
+    dst.push_back((uint8_t)length);
+    };
+
+static inline size_t lzReadLength(const uint8_t *src, size_t &ip, size_t compressedSize)
+    {
+    size_t length = 0;
+    uint8_t b;
+    do
+        {
+        if(ip >= compressedSize)
+            throw std::runtime_error("corrupt compressed block: truncated length");
+        b = src[ip++];
+        length += b;
+        } while (b == 255);
+    return length;
+    };
+
+/*!
+Emit one sequence: a token (high nibble literal length, low nibble matchLength-4), any extra length bytes,
+the literals themselves, and (if matchLength > 0) a little-endian 16-bit offset and the extra match-length bytes
+*/
+static void lzEmitSequence(vector<uint8_t> &dst, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+    {
+    size_t ml = (matchLength > 0) ? matchLength - lzMinMatch : 0;
+    uint8_t token = (uint8_t)((min(literalLength,(size_t)15) << 4) | min(ml,(size_t)15));
+    dst.push_back(token);
+    if(literalLength >= 15)
+        lzWriteLength(dst,literalLength-15);
+    dst.insert(dst.end(),literals,literals+literalLength);
+    if(matchLength == 0)
+        return;
+    dst.push_back((uint8_t)(offset & 0xFF));
+    dst.push_back((uint8_t)(offset >> 8));
+    if(ml >= 15)
+        lzWriteLength(dst,ml-15);
+    };
+
+void byteShuffle(const uint8_t *in, uint8_t *out, size_t elementCount, size_t elementSize)
+    {
+    for (size_t ii = 0; ii < elementCount; ++ii)
+        for (size_t bb = 0; bb < elementSize; ++bb)
+            out[bb*elementCount+ii] = in[ii*elementSize+bb];
+    };
+
+void byteUnshuffle(const uint8_t *in, uint8_t *out, size_t elementCount, size_t elementSize)
+    {
+    for (size_t bb = 0; bb < elementSize; ++bb)
+        for (size_t ii = 0; ii < elementCount; ++ii)
+            out[ii*elementSize+bb] = in[bb*elementCount+ii];
+    };
+
+/*!
+A greedy LZ77 coder in the spirit of the LZ4 block format. Candidate matches are found by hashing the next four
+bytes; the search step grows while no matches are found, so that incompressible data passes through quickly.
+*/
+size_t lzCompress(const uint8_t *src, size_t n, vector<uint8_t> &dst)
+    {
+    size_t startSize = dst.size();
+    size_t anchor = 0;
+    if(n >= lzMinBlockForMatch)
+        {
+        vector<int64_t> hashTable(1 << lzHashLog, -1);
+        size_t matchLimit = n - lzLastLiterals;
+        size_t searchLimit = n - lzMinBlockForMatch;
+        size_t ip = 0;
+        while(ip <= searchLimit)
+            {
+            uint32_t sequence = read32(src+ip);
+            uint32_t h = lzHash(sequence);
+            int64_t ref = hashTable[h];
+            hashTable[h] = (int64_t)ip;
+            if(ref >= 0 && ip - ref <= lzMaxOffset && read32(src+ref) == sequence)
+                {
+                size_t matchLength = lzMinMatch;
+                while(ip + matchLength < matchLimit && src[ref+matchLength] == src[ip+matchLength])
+                    matchLength += 1;
+                lzEmitSequence(dst,src+anchor,ip-anchor,ip-ref,matchLength);
+                ip += matchLength;
+                anchor = ip;
+                }
+            else
+                ip += 1 + ((ip-anchor) >> 6);
+            };
+        };
+    lzEmitSequence(dst,src+anchor,n-anchor,0,0);
+    return dst.size()-startSize;
+    };
+
+void lzDecompress(const uint8_t *src, size_t compressedSize, uint8_t *dst, size_t rawSize)
+    {
+    size_t ip = 0;
+    size_t op = 0;
+    while(ip < compressedSize)
+        {
+        uint8_t token = src[ip++];
+        size_t literalLength = token >> 4;
+        if(literalLength == 15)
+            literalLength += lzReadLength(src,ip,compressedSize);
+        if(ip + literalLength > compressedSize || op + literalLength > rawSize)
+            throw std::runtime_error("corrupt compressed block: literal run out of range");
+        memcpy(dst+op,src+ip,literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if(ip >= compressedSize)
+            break;
+
+        if(ip + 2 > compressedSize)
+            throw std::runtime_error("corrupt compressed block: truncated offset");
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip+1] << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if(matchLength == 15)
+            matchLength += lzReadLength(src,ip,compressedSize);
+        matchLength += lzMinMatch;
+        if(offset == 0 || offset > op || op + matchLength > rawSize)
+            throw std::runtime_error("corrupt compressed block: match out of range");
+        //matches may overlap the bytes they are producing, so copy forwards one byte at a time
+        uint8_t *match = dst + op - offset;
+        for (size_t ii = 0; ii < matchLength; ++ii)
+            dst[op+ii] = match[ii];
+        op += matchLength;
+        };
+    if(op != rawSize)
+        throw std::runtime_error("corrupt compressed block: wrong decompressed size");
+    };
+
+/*!
+The raw (pre-compression) layout of a tile with n sites is n shuffled int32 types followed by DIMENSION planes of
+n shuffled 8-byte words. The words are either the bit patterns of the Q-tensor components or, in the lossy mode,
+zig-zag encoded differences of successive quantized components. If compression does not help, the shuffled raw
+bytes are stored directly (signalled by encodedSize == rawSize).
+*/
+size_t qTensorSnapshot::encodeTile(const dVec *Q, const int *types, Index3D &latticeIdx, int3 tileMin, int3 tileMax,
+                                   scalar errorBound, vector<uint8_t> &encoded)
+    {
+    int3 extent = tileMax - tileMin;
+    size_t nSites = (size_t)extent.x*extent.y*extent.z;
+    size_t rawSize = nSites*(sizeof(int32_t) + DIMENSION*sizeof(uint64_t));
+    vector<int32_t> typePlane(nSites);
+    vector<uint64_t> componentPlanes(DIMENSION*nSites);
+
+    scalar inverseBinWidth = (errorBound > 0) ? 0.5/errorBound : 0.0;
+    int64_t previousCode[DIMENSION];
+    for (int dd = 0; dd < DIMENSION; ++dd)
+        previousCode[dd] = 0;
+    size_t site = 0;
+    for (int z = tileMin.z; z < tileMax.z; ++z)
+        for (int y = tileMin.y; y < tileMax.y; ++y)
+            for (int x = tileMin.x; x < tileMax.x; ++x)
+                {
+                int idx = latticeIdx(x,y,z);
+                typePlane[site] = types[idx];
+                for (int dd = 0; dd < DIMENSION; ++dd)
+                    {
+                    uint64_t word;
+                    if(errorBound > 0)
+                        {
+                        scalar scaled = Q[idx][dd]*inverseBinWidth;
+                        if(!(fabs(scaled) < 4.0e18))
+                            throw std::runtime_error("Q-tensor component cannot be quantized with the requested error bound");
+                        int64_t code = llround(scaled);
+                        int64_t delta = code - previousCode[dd];
+                        previousCode[dd] = code;
+                        word = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+                        }
+                    else
+                        memcpy(&word,&Q[idx][dd],sizeof(uint64_t));
+                    componentPlanes[dd*nSites+site] = word;
+                    };
+                site += 1;
+                };
+
+    vector<uint8_t> raw(rawSize);
+    byteShuffle((const uint8_t *)typePlane.data(),raw.data(),nSites,sizeof(int32_t));
+    size_t planeStart = nSites*sizeof(int32_t);
+    for (int dd = 0; dd < DIMENSION; ++dd)
+        byteShuffle((const uint8_t *)&componentPlanes[dd*nSites],raw.data()+planeStart+dd*nSites*sizeof(uint64_t),
+                    nSites,sizeof(uint64_t));
+
+    size_t startSize = encoded.size();
+    size_t compressedSize = lzCompress(raw.data(),rawSize,encoded);
+    if(compressedSize >= rawSize)
+        {
+        encoded.resize(startSize);
+        encoded.insert(encoded.end(),raw.begin(),raw.end());
+        };
+    return rawSize;
+    };
+
+void qTensorSnapshot::decodeTile(const uint8_t *encoded, size_t encodedSize, size_t rawSize, int nSites,
+                                 scalar errorBound, vector<dVec> &Q, vector<int> &types)
+    {
+    size_t n = nSites;
+    if(rawSize != n*(sizeof(int32_t) + DIMENSION*sizeof(uint64_t)))
+        throw std::runtime_error("snapshot tile has an unexpected size");
+    vector<uint8_t> raw(rawSize);
+    if(encodedSize == rawSize)
+        memcpy(raw.data(),encoded,rawSize);
+    else
+        lzDecompress(encoded,encodedSize,raw.data(),rawSize);
+
+    vector<int32_t> typePlane(n);
+    vector<uint64_t> componentPlanes(DIMENSION*n);
+    byteUnshuffle(raw.data(),(uint8_t *)typePlane.data(),n,sizeof(int32_t));
+    size_t planeStart = n*sizeof(int32_t);
+    for (int dd = 0; dd < DIMENSION; ++dd)
+        byteUnshuffle(raw.data()+planeStart+dd*n*sizeof(uint64_t),(uint8_t *)&componentPlanes[dd*n],n,sizeof(uint64_t));
+
+    Q.resize(n);
+    types.resize(n);
+    scalar binWidth = 2.0*errorBound;
+    for (int dd = 0; dd < DIMENSION; ++dd)
+        {
+        int64_t code = 0;
+        for (size_t ii = 0; ii < n; ++ii)
+            {
+            uint64_t word = componentPlanes[dd*n+ii];
+            if(errorBound > 0)
+                {
+                int64_t delta = (int64_t)(word >> 1) ^ -(int64_t)(word & 1);
+                code += delta;
+                Q[ii][dd] = code*binWidth;
+                }
+            else
+                memcpy(&Q[ii][dd],&word,sizeof(uint64_t));
+            };
+        };
+    for (size_t ii = 0; ii < n; ++ii)
+        types[ii] = typePlane[ii];
+    };
+
+/*!
+The file layout is: an 8-byte magic string, the format version, the lattice size, the lattice offset, the tile size,
+and the error bound, followed by a table with the (offset, encoded size, raw size) of every tile, and then the
+encoded tiles themselves.
+*/
+void qTensorSnapshot::save(string fname, const dVec *Q, const int *types, int3 _latticeSites, int3 _latticeOffset,
+                           int _tileSize, scalar _errorBound)
+    {
+    if(_tileSize < 1)
+        _tileSize = 1;
+    Index3D latticeIdx(_latticeSites);
+    int3 tileGrid;
+    tileGrid.x = (_latticeSites.x + _tileSize - 1) / _tileSize;
+    tileGrid.y = (_latticeSites.y + _tileSize - 1) / _tileSize;
+    tileGrid.z = (_latticeSites.z + _tileSize - 1) / _tileSize;
+    Index3D tileIdx(tileGrid);
+    int nTiles = tileIdx.getNumElements();
+
+    vector<uint8_t> encoded;
+    vector<uint64_t> encodedStarts(nTiles+1);
+    vector<uint64_t> rawSizes(nTiles);
+    for (int tt = 0; tt < nTiles; ++tt)
+        {
+        int3 tile = tileIdx.inverseIndex(tt);
+        int3 tileMin = make_int3(tile.x*_tileSize,tile.y*_tileSize,tile.z*_tileSize);
+        int3 tileMax = make_int3(min(tileMin.x+_tileSize,_latticeSites.x),
+                                 min(tileMin.y+_tileSize,_latticeSites.y),
+                                 min(tileMin.z+_tileSize,_latticeSites.z));
+        encodedStarts[tt] = encoded.size();
+        rawSizes[tt] = encodeTile(Q,types,latticeIdx,tileMin,tileMax,_errorBound,encoded);
+        };
+    encodedStarts[nTiles] = encoded.size();
+
+    int32_t header[11] = {snapshotVersion,
+                          _latticeSites.x,_latticeSites.y,_latticeSites.z,
+                          _latticeOffset.x,_latticeOffset.y,_latticeOffset.z,
+                          _tileSize, tileGrid.x,tileGrid.y,tileGrid.z};
+    double eb = _errorBound;
+    uint64_t dataStart = sizeof(snapshotMagic) + sizeof(header) + sizeof(double) + 3*nTiles*sizeof(uint64_t);
+    vector<uint64_t> table(3*nTiles);
+    for (int tt = 0; tt < nTiles; ++tt)
+        {
+        table[3*tt] = dataStart + encodedStarts[tt];
+        table[3*tt+1] = encodedStarts[tt+1]-encodedStarts[tt];
+        table[3*tt+2] = rawSizes[tt];
+        };
+
+    ofstream myfile(fname.c_str(),ios::binary);
+    if(myfile.fail())
+        {
+        printf("\nERROR trying to write compressed snapshot %s\n",fname.c_str());
+        throw std::exception();
+        }
+    myfile.write(snapshotMagic,sizeof(snapshotMagic));
+    myfile.write((const char *)header,sizeof(header));
+    myfile.write((const char *)&eb,sizeof(double));
+    myfile.write((const char *)table.data(),table.size()*sizeof(uint64_t));
+    myfile.write((const char *)encoded.data(),encoded.size());
+    myfile.close();
+    };
+
+void qTensorSnapshot::open(string fname)
+    {
+    fileName = fname;
+    ifstream myfile(fname.c_str(),ios::binary);
+    if(myfile.fail())
+        {
+        printf("\nERROR trying to load file named %s\n",fname.c_str());
+        printf("\nYou have tried to load a file that either does not exist or that you do not have permission to access! \n Error in file %s at line %d\n",__FILE__,__LINE__);
+        throw std::exception();
+        }
+    char magic[8];
+    int32_t header[11];
+    double eb;
+    myfile.read(magic,sizeof(magic));
+    myfile.read((char *)header,sizeof(header));
+    myfile.read((char *)&eb,sizeof(double));
+    if(!myfile || memcmp(magic,snapshotMagic,sizeof(magic)) != 0 || header[0] != snapshotVersion)
+        {
+        printf("\nERROR: %s is not a compressed snapshot this version of the code can read\n",fname.c_str());
+        throw std::exception();
+        }
+    latticeSites = make_int3(header[1],header[2],header[3]);
+    latticeOffset = make_int3(header[4],header[5],header[6]);
+    tileSize = header[7];
+    tileIndex.setSizes(make_int3(header[8],header[9],header[10]));
+    errorBound = eb;
+
+    int nTiles = tileIndex.getNumElements();
+    vector<uint64_t> table(3*nTiles);
+    myfile.read((char *)table.data(),table.size()*sizeof(uint64_t));
+    if(!myfile)
+        throw std::runtime_error("truncated snapshot tile table");
+    tileOffsets.resize(nTiles);
+    tileEncodedBytes.resize(nTiles);
+    tileRawBytes.resize(nTiles);
+    for (int tt = 0; tt < nTiles; ++tt)
+        {
+        tileOffsets[tt] = table[3*tt];
+        tileEncodedBytes[tt] = table[3*tt+1];
+        tileRawBytes[tt] = table[3*tt+2];
+        };
+    myfile.seekg(0,ios::end);
+    fileSize = myfile.tellg();
+    myfile.close();
+    };
+
+void qTensorSnapshot::getTileBounds(int tile, int3 &tileMin, int3 &tileMax)
+    {
+    int3 t = tileIndex.inverseIndex(tile);
+    tileMin = make_int3(t.x*tileSize,t.y*tileSize,t.z*tileSize);
+    tileMax = make_int3(min(tileMin.x+tileSize,latticeSites.x),
+                        min(tileMin.y+tileSize,latticeSites.y),
+                        min(tileMin.z+tileSize,latticeSites.z));
+    };
+
+void qTensorSnapshot::readTile(int tile, vector<dVec> &Q, vector<int> &types)
+    {
+    if(tile < 0 || tile >= getNumberOfTiles())
+        throw std::runtime_error("invalid snapshot tile requested");
+    int3 tileMin, tileMax;
+    getTileBounds(tile,tileMin,tileMax);
+    int3 extent = tileMax - tileMin;
+
+    ifstream myfile(fileName.c_str(),ios::binary);
+    vector<uint8_t> encoded(tileEncodedBytes[tile]);
+    myfile.seekg(tileOffsets[tile]);
+    myfile.read((char *)encoded.data(),encoded.size());
+    if(!myfile)
+        throw std::runtime_error("truncated snapshot tile");
+    decodeTile(encoded.data(),encoded.size(),tileRawBytes[tile],extent.x*extent.y*extent.z,errorBound,Q,types);
+    };
+
+void qTensorSnapshot::readRegion(int3 regionMin, int3 regionMax, vector<dVec> &Q, vector<int> &types)
+    {
+    regionMin = make_int3(max(regionMin.x,0),max(regionMin.y,0),max(regionMin.z,0));
+    regionMax = make_int3(min(regionMax.x,latticeSites.x),min(regionMax.y,latticeSites.y),min(regionMax.z,latticeSites.z));
+    int3 extent = make_int3(max(regionMax.x-regionMin.x,0),max(regionMax.y-regionMin.y,0),max(regionMax.z-regionMin.z,0));
+    Index3D regionIdx(extent);
+    Q.resize(regionIdx.getNumElements());
+    types.resize(regionIdx.getNumElements());
+    if(regionIdx.getNumElements() == 0)
+        return;
+
+    vector<dVec> tileQ;
+    vector<int> tileTypes;
+    for (int tz = regionMin.z/tileSize; tz <= (regionMax.z-1)/tileSize; ++tz)
+        for (int ty = regionMin.y/tileSize; ty <= (regionMax.y-1)/tileSize; ++ty)
+            for (int tx = regionMin.x/tileSize; tx <= (regionMax.x-1)/tileSize; ++tx)
+                {
+                int tile = tileIndex(tx,ty,tz);
+                readTile(tile,tileQ,tileTypes);
+                int3 tileMin, tileMax;
+                getTileBounds(tile,tileMin,tileMax);
+                Index3D localIdx(tileMax-tileMin);
+                for (int z = max(tileMin.z,regionMin.z); z < min(tileMax.z,regionMax.z); ++z)
+                    for (int y = max(tileMin.y,regionMin.y); y < min(tileMax.y,regionMax.y); ++y)
+                        for (int x = max(tileMin.x,regionMin.x); x < min(tileMax.x,regionMax.x); ++x)
+                            {
+                            int target = regionIdx(x-regionMin.x,y-regionMin.y,z-regionMin.z);
+                            int source = localIdx(x-tileMin.x,y-tileMin.y,z-tileMin.z);
+                            Q[target] = tileQ[source];
+                            types[target] = tileTypes[source];
+                            };
+                };
+    };
+
+void qTensorSnapshot::readLattice(dVec *Q, int *types)
+    {
+    Index3D latticeIdx(latticeSites);
+    vector<dVec> tileQ;
+    vector<int> tileTypes;
+    for (int tt = 0; tt < getNumberOfTiles(); ++tt)
+        {
+        readTile(tt,tileQ,tileTypes);
+        int3 tileMin, tileMax;
+        getTileBounds(tt,tileMin,tileMax);
+        int site = 0;
+        for (int z = tileMin.z; z < tileMax.z; ++z)
+            for (int y = tileMin.y; y < tileMax.y; ++y)
+                for (int x = tileMin.x; x < tileMax.x; ++x)
+                    {
+                    int idx = latticeIdx(x,y,z);
+                    Q[idx] = tileQ[site];
+                    types[idx] = tileTypes[site];
+                    site += 1;
+                    };
+        };
+    };
@@ -0,0 +1,101 @@
+#ifndef snapshotCompression_H
+#define snapshotCompression_H
+
+#include "std_include.h"
+#include "indexer.h"
+#include <cstdint>
+
+/*! \file snapshotCompression.h */
+
+/** @defgroup snapshotCompression compressed snapshots
+ * @{
+ \brief byte-shuffling, LZ-style block compression, and tiled binary snapshots of Q-tensor fields
+ */
+
+//!Gather bytes of equal significance together: out[b*elementCount+i] = in[i*elementSize+b]
+void byteShuffle(const uint8_t *in, uint8_t *out, size_t elementCount, size_t elementSize);
+//!The inverse of byteShuffle
+void byteUnshuffle(const uint8_t *in, uint8_t *out, size_t elementCount, size_t elementSize);
+
+//!Compress n bytes of src with a small LZ77-style block coder, appending the result to dst; returns the compressed size
+size_t lzCompress(const uint8_t *src, size_t n, vector<uint8_t> &dst);
+//!Decompress a block produced by lzCompress into exactly rawSize bytes of dst
+void lzDecompress(const uint8_t *src, size_t compressedSize, uint8_t *dst, size_t rawSize);
+
+//!Write and read tiled, compressed binary snapshots of the Q-tensor field and site types of a cubic lattice
+/*!
+The (rank-local) lattice is chopped into tiles of tileSize^3 sites, each of which is encoded independently.
+A table of tile offsets sits at the head of the file, so that a reader can decode any region of the lattice
+by reading only the tiles that overlap it.
+
+Within a tile the data is stored component-planar (all types, then all Qxx, then all Qxy, ...), each plane is
+byte-shuffled so that bytes of equal significance sit next to each other, and the result is passed through
+lzCompress. With errorBound = 0 the encoding is lossless. With errorBound > 0 every component is first
+quantized onto a uniform grid of spacing 2*errorBound (so that each decoded component is within errorBound of
+the original) and the integer codes are delta-encoded in lattice order before shuffling.
+
+The data pointers passed to save, and filled by readLattice, are expected to hold the sites in the default order
+of cubicLattice::latticeIndex (x fastest, then y, then z; see cubicLattice::setSiteBlockSize for the other).
+*/
+class qTensorSnapshot
+    {
+    public:
+        //!Encode the lattice and write it to fname
+        static void save(string fname, const dVec *Q, const int *types, int3 _latticeSites, int3 _latticeOffset,
+                         int _tileSize = 16, scalar _errorBound = 0.0);
+
+        //!An empty snapshot... call open to read the header and tile table of a file
+        qTensorSnapshot(){};
+        //!Open a file and read its header and tile table
+        qTensorSnapshot(string fname){open(fname);};
+        //!Read the header and tile table of a snapshot file
+        void open(string fname);
+
+        //!Decode the whole lattice into Q and types (each must have room for getNumberOfSites() elements)
+        void readLattice(dVec *Q, int *types);
+        //!Decode the half-open box [regionMin, regionMax) of local lattice coordinates; results are x-fastest within the box
+        void readRegion(int3 regionMin, int3 regionMax, vector<dVec> &Q, vector<int> &types);
+        //!Decode a single tile; results are x-fastest within the tile
+        void readTile(int tile, vector<dVec> &Q, vector<int> &types);
+
+        //!The half-open box [tileMin,tileMax) of local lattice coordinates covered by the given tile
+        void getTileBounds(int tile, int3 &tileMin, int3 &tileMax);
+
+        int getNumberOfSites(){return latticeSites.x*latticeSites.y*latticeSites.z;};
+        int getNumberOfTiles(){return tileIndex.getNumElements();};
+        //!the total size of the file, in bytes
+        size_t getFileSize(){return fileSize;};
+
+        //!Encode the sites of one tile of a lattice, appending the result to encoded; returns the number of raw bytes
+        static size_t encodeTile(const dVec *Q, const int *types, Index3D &latticeIdx, int3 tileMin, int3 tileMax,
+                                 scalar errorBound, vector<uint8_t> &encoded);
+        //!Decode a tile produced by encodeTile
+        static void decodeTile(const uint8_t *encoded, size_t encodedSize, size_t rawSize, int nSites,
+                               scalar errorBound, vector<dVec> &Q, vector<int> &types);
+
+        //!the number of lattice sites in each direction
+        int3 latticeSites;
+        //!the global position of the (0,0,0) site of the saved lattice
+        int3 latticeOffset;
+        //!the linear size of a tile
+        int tileSize;
+        //!the maximum error of each component of a decoded Q-tensor (0 means lossless)
+        scalar errorBound;
+
+    protected:
+        //!the file containing the snapshot
+        string fileName;
+        //!indexes the tiles
+        Index3D tileIndex;
+        //!for each tile, the file offset of its data
+        vector<uint64_t> tileOffsets;
+        //!for each tile, the number of encoded bytes
+        vector<uint64_t> tileEncodedBytes;
+        //!for each tile, the number of raw bytes
+        vector<uint64_t> tileRawBytes;
+        //!the total size of the file
+        size_t fileSize = 0;
+    };
+
+/** @} */ //end of group declaration
+#endif
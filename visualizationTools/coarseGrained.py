@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+
+import numpy as np
+import matplotlib.pyplot as plt
+import argparse as ap
+
+"""
+Read (and, for slices, plot) the binary .oqcg files written by openQmin's --coarseGrainedSaving and --slices options.
+"""
+
+def readCoarseGrained(fileName):
+	"""Return (S, director, lcFraction, blockSize, origin); the arrays are indexed as [x, y, z] block coordinates."""
+	with open(fileName, 'rb') as f:
+		magic = f.read(8)
+		if magic[:5] != b'OQMCG':
+			raise ValueError(fileName + ' is not a coarse-grained openQmin file')
+		header = np.fromfile(f, dtype=np.int32, count=10)
+		nBlocks = header[1:4]
+		blockSize = header[4:7]
+		origin = header[7:10]
+		data = np.fromfile(f, dtype=np.float32, count=5*np.prod(nBlocks))
+	# files are written x fastest, so reshape as [z, y, x, field] and transpose
+	data = data.reshape(nBlocks[2], nBlocks[1], nBlocks[0], 5).transpose(2, 1, 0, 3)
+	return data[..., 0], data[..., 1:4], data[..., 4], blockSize, origin
+
+if __name__ == '__main__':
+	parser = ap.ArgumentParser(description='Plot a coarse-grained openQmin slice (.oqcg file)')
+	parser.add_argument('infile', help='slice file to plot')
+	parser.add_argument('-sf', '--savefig', dest='savefig_name', type=str, default='',
+						help='filename to save figure; leave blank to show it interactively')
+	args = parser.parse_args()
+
+	S, n, lcFraction, blockSize, origin = readCoarseGrained(args.infile)
+	normal = int(np.argmin(S.shape))
+	inPlane = [ax for ax in range(3) if ax != normal]
+	S2 = np.squeeze(S, axis=normal)
+	n2 = np.squeeze(n, axis=normal)
+	coords = [origin[ax] + blockSize[ax]*(np.arange(S.shape[ax]) + 0.5) for ax in inPlane]
+	X, Y = np.meshgrid(coords[0], coords[1], indexing='ij')
+
+	fig, axes = plt.subplots()
+	image = axes.pcolormesh(X, Y, S2, shading='auto', cmap='viridis')
+	fig.colorbar(image, ax=axes, label='S')
+	# directors are headless: draw centered segments
+	axes.quiver(X, Y, n2[..., inPlane[0]], n2[..., inPlane[1]], pivot='middle', headwidth=0, headlength=0, headaxislength=0)
+	axes.set_aspect('equal')
+	axes.set_xlabel('xyz'[inPlane[0]])
+	axes.set_ylabel('xyz'[inPlane[1]])
+	if args.savefig_name != '':
+		plt.savefig(args.savefig_name)
+	else:
+		plt.show()